@@ -0,0 +1,365 @@
+#define _GNU_SOURCE // posix_fadvise flags
+
+#include <errno.h>
+#include <fcntl.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include <linux/limits.h>
+#include <sys/stat.h>
+#include <sys/statfs.h>
+#include <sys/statvfs.h>
+
+#include "../include/error_handler.h"
+#include "../include/file_operations.h"
+
+/**
+ * @file copy_bench.c
+ * @brief Benchmarks `copyFile` across file sizes, file shapes, directories and copy parameters.
+ *
+ * For every directory (e.g. a tmpfs and a disk), file size and shape (dense or sparse),
+ * a source file is generated once and copied with every engine, buffer size and thread
+ * count. Each configuration runs several times with the source evicted from the page
+ * cache, and one JSON object per configuration is printed on `stdout`, so results can be
+ * compared between builds. Progress goes to `stderr`.
+ *
+ * Usage: redit_bench [-d DIR]... [-m MAX_SIZE] [-r REPEAT] [-w] [-s]
+ */
+
+#define MAX_BENCH_DIRS 8 // Directories benchmarked in one run
+#define DEFAULT_MAX_SIZE (1024LL * 1024 * 1024) // Larger sizes are opt-in with -m
+#define DEFAULT_REPEAT 3 // Timed runs per configuration
+#define SPARSE_STRIDE (1024 * 1024) // Sparse files get one data block per stride
+#define FILL_BUFFER_SIZE (1024 * 1024) // Buffer used to generate dense files
+
+/**
+ * @brief File sizes benchmarked, up to the maximum size.
+ */
+static const long long BENCH_SIZES[] = {
+    1024LL, 64 * 1024LL, 1024 * 1024LL, 16 * 1024 * 1024LL, 256 * 1024 * 1024LL, 1024 * 1024 * 1024LL,
+    10 * 1024 * 1024 * 1024LL
+};
+
+/**
+ * @brief Buffer sizes benchmarked with each engine.
+ */
+static const size_t BENCH_BUFFERS[] = {64 * 1024, 256 * 1024, 1024 * 1024, 8 * 1024 * 1024};
+
+/**
+ * @brief Thread counts benchmarked, for files large enough to be split.
+ */
+static const size_t BENCH_THREADS[] = {1, 4};
+
+/**
+ * @brief Benchmark settings.
+ */
+typedef struct {
+    const char *dirs[MAX_BENCH_DIRS]; ///< Directories the files are created in.
+    size_t n_dirs; ///< Number of directories.
+    long long max_size; ///< Largest file size benchmarked.
+    int repeat; ///< Timed runs per configuration.
+    bool warm; ///< Keep the source in the page cache between runs.
+    bool sync; ///< Flush the destination (`fdatasync`) as part of each run.
+} bench_settings_t;
+
+/**
+ * @brief Reads the monotonic clock in seconds.
+ */
+static double nowSeconds() {
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return (double) now.tv_sec + (double) now.tv_nsec / 1e9;
+}
+
+/**
+ * @brief Parses a size with an optional K, M or G suffix.
+ *
+ * @return The size in bytes, or -1 if the value is invalid.
+ */
+static long long parseSize(const char *value) {
+    char *end = NULL;
+    const long long number = strtoll(value, &end, 10);
+    if (end == value || number <= 0) {
+        return -1;
+    }
+    switch (*end) {
+        case '\0': return number;
+        case 'K': case 'k': return end[1] == '\0' ? number * 1024 : -1;
+        case 'M': case 'm': return end[1] == '\0' ? number * 1024 * 1024 : -1;
+        case 'G': case 'g': return end[1] == '\0' ? number * 1024 * 1024 * 1024 : -1;
+        default: return -1;
+    }
+}
+
+/**
+ * @brief Generates a benchmark source file.
+ *
+ * @param path Path of the file to create.
+ * @param size Size of the file.
+ * @param sparse Whether the file is mostly holes (one 4 KB block per `SPARSE_STRIDE`).
+ * @return `SUCCESS` if the file was created, or an error code otherwise.
+ */
+static int createSourceFile(const char *path, const long long size, const bool sparse) {
+    const int fd = open(path, O_WRONLY | O_CREAT | O_TRUNC, S_IRUSR | S_IWUSR);
+    if (fd == -1) {
+        return ERROR_PERMISSION_DENIED;
+    }
+
+    // Incompressible data, so no layer can shortcut the copy
+    uint8_t *buffer = malloc(FILL_BUFFER_SIZE);
+    if (buffer == NULL) {
+        close(fd);
+        return ERROR_MEMORY_ALLOCATION;
+    }
+    uint64_t state = 0x9E3779B97F4A7C15ULL;
+    for (size_t i = 0; i + sizeof(uint64_t) <= FILL_BUFFER_SIZE; i += sizeof(uint64_t)) {
+        state ^= state << 13;
+        state ^= state >> 7;
+        state ^= state << 17;
+        memcpy(buffer + i, &state, sizeof(state));
+    }
+
+    int result = SUCCESS;
+    if (sparse) {
+        if (ftruncate(fd, size) == -1) {
+            result = ERROR_COPY_FAILED;
+        }
+        for (long long offset = 0; result == SUCCESS && offset < size; offset += SPARSE_STRIDE) {
+            const size_t length = size - offset < 4096 ? (size_t) (size - offset) : 4096;
+            if (pwrite(fd, buffer, length, offset) != (ssize_t) length) {
+                result = ERROR_COPY_FAILED;
+            }
+        }
+    } else {
+        for (long long offset = 0; result == SUCCESS && offset < size; offset += FILL_BUFFER_SIZE) {
+            const size_t length = size - offset < FILL_BUFFER_SIZE ? (size_t) (size - offset) : FILL_BUFFER_SIZE;
+            if (write(fd, buffer, length) != (ssize_t) length) {
+                result = ERROR_COPY_FAILED;
+            }
+        }
+    }
+    if (fsync(fd) == -1) {
+        result = ERROR_COPY_FAILED; // The source must not be dirty while timing
+    }
+
+    free(buffer);
+    close(fd);
+    return result;
+}
+
+/**
+ * @brief Evicts a file from the page cache, so the next copy reads it from storage.
+ */
+static void dropFromCache(const char *path) {
+    const int fd = open(path, O_RDONLY);
+    if (fd != -1) {
+        posix_fadvise(fd, 0, 0, POSIX_FADV_DONTNEED);
+        close(fd);
+    }
+}
+
+/**
+ * @brief Returns the median of a small array of durations (sorted in place).
+ */
+static double median(double *values, const int count) {
+    for (int i = 1; i < count; ++i) {
+        const double value = values[i];
+        int j = i - 1;
+        while (j >= 0 && values[j] > value) {
+            values[j + 1] = values[j];
+            j--;
+        }
+        values[j + 1] = value;
+    }
+    return count % 2 == 1 ? values[count / 2] : (values[count / 2 - 1] + values[count / 2]) / 2;
+}
+
+/**
+ * @brief Times one copy configuration and prints its result as a JSON object.
+ *
+ * @return `SUCCESS` if every run copied the whole file, or an error code otherwise.
+ */
+static int benchConfiguration(const bench_settings_t *settings, const char *dir, const unsigned long fs_type,
+                              const char *src_path, const char *dest_path, const long long size, const bool sparse,
+                              const copy_options_t *options) {
+    double durations[16] = {0};
+    const int runs = settings->repeat < 16 ? settings->repeat : 16;
+    int result = SUCCESS;
+
+    for (int run = 0; run < runs && result == SUCCESS; ++run) {
+        if (!settings->warm) {
+            dropFromCache(src_path);
+        }
+        unlink(dest_path); // Measure a fresh destination every time
+
+        const double start = nowSeconds();
+        result = copyFile(src_path, dest_path, options);
+        durations[run] = nowSeconds() - start;
+
+        struct stat dest_stat;
+        if (result == SUCCESS && (stat(dest_path, &dest_stat) == -1 || dest_stat.st_size != size)) {
+            result = ERROR_COPY_FAILED; // A benchmark of a broken copy is meaningless
+        }
+    }
+    unlink(dest_path);
+
+    if (result != SUCCESS) {
+        printf("{\"dir\":\"%s\",\"fs_type\":\"%lx\",\"size\":%lld,\"shape\":\"%s\",\"engine\":\"%s\","
+               "\"buffer\":%zu,\"threads\":%zu,\"error\":%d}\n", dir, fs_type, size, sparse ? "sparse" : "dense",
+               getCopyEngineName(options->engine), options->buffer_size, options->threads, result);
+        return result;
+    }
+
+    double fastest = durations[0];
+    for (int run = 1; run < runs; ++run) {
+        fastest = durations[run] < fastest ? durations[run] : fastest;
+    }
+    const double median_seconds = median(durations, runs);
+    printf("{\"dir\":\"%s\",\"fs_type\":\"%lx\",\"size\":%lld,\"shape\":\"%s\",\"engine\":\"%s\",\"buffer\":%zu,"
+           "\"threads\":%zu,\"runs\":%d,\"warm\":%s,\"sync\":%s,\"median_ms\":%.3f,\"min_ms\":%.3f,"
+           "\"median_mb_s\":%.1f}\n", dir, fs_type, size, sparse ? "sparse" : "dense",
+           getCopyEngineName(options->engine), options->buffer_size, options->threads, runs,
+           settings->warm ? "true" : "false", settings->sync ? "true" : "false", median_seconds * 1e3,
+           fastest * 1e3, (double) size / (1024.0 * 1024.0) / (median_seconds > 0 ? median_seconds : 1e-9));
+    fflush(stdout);
+    return SUCCESS;
+}
+
+/**
+ * @brief Benchmarks every size, shape and configuration in one directory.
+ */
+static void benchDirectory(const bench_settings_t *settings, const char *dir) {
+    struct statfs fs_stat;
+    const unsigned long fs_type = statfs(dir, &fs_stat) == 0 ? (unsigned long) fs_stat.f_type : 0;
+
+    char src_path[PATH_MAX], dest_path[PATH_MAX];
+    if (snprintf(src_path, PATH_MAX, "%s/redit_bench_src.%d", dir, (int) getpid()) >= PATH_MAX ||
+        snprintf(dest_path, PATH_MAX, "%s/redit_bench_dest.%d", dir, (int) getpid()) >= PATH_MAX) {
+        fprintf(stderr, "Error: Path too long: '%s'.\n", dir);
+        return;
+    }
+
+    for (size_t s = 0; s < sizeof(BENCH_SIZES) / sizeof(BENCH_SIZES[0]); ++s) {
+        const long long size = BENCH_SIZES[s];
+        if (size > settings->max_size) {
+            break;
+        }
+
+        for (int shape = 0; shape < 2; ++shape) {
+            const bool sparse = shape == 1;
+
+            // The source and a dense copy of it must fit
+            struct statvfs vfs_stat;
+            if (statvfs(dir, &vfs_stat) == 0 &&
+                (long long) vfs_stat.f_bavail * (long long) vfs_stat.f_frsize < 2 * size + 64 * 1024 * 1024) {
+                fprintf(stderr, "Skipping %lld bytes in '%s': not enough free space.\n", size, dir);
+                continue;
+            }
+
+            fprintf(stderr, "Benchmarking %lld bytes (%s) in '%s'...\n", size, sparse ? "sparse" : "dense", dir);
+            if (createSourceFile(src_path, size, sparse) != SUCCESS) {
+                fprintf(stderr, "Error: Could not create the source file in '%s'.\n", dir);
+                unlink(src_path);
+                return;
+            }
+
+            for (int engine = COPY_ENGINE_READ_WRITE; engine <= COPY_ENGINE_KERNEL; ++engine) {
+                for (size_t b = 0; b < sizeof(BENCH_BUFFERS) / sizeof(BENCH_BUFFERS[0]); ++b) {
+                    for (size_t t = 0; t < sizeof(BENCH_THREADS) / sizeof(BENCH_THREADS[0]); ++t) {
+                        // Threads only apply to files that copyFile actually splits
+                        if (BENCH_THREADS[t] > 1 && size < 16 * 1024 * 1024) {
+                            continue;
+                        }
+                        const copy_options_t options = {
+                            .sync_mode = settings->sync ? SYNC_DATA : SYNC_NONE,
+                            .engine = engine,
+                            .buffer_size = BENCH_BUFFERS[b],
+                            .threads = BENCH_THREADS[t]
+                        };
+                        benchConfiguration(settings, dir, fs_type, src_path, dest_path, size, sparse, &options);
+                    }
+                }
+            }
+            unlink(src_path);
+        }
+    }
+}
+
+/**
+ * @brief Displays the usage of the benchmark.
+ */
+static void displayUsage(const char *program) {
+    fprintf(stderr, "Usage: %s [-d DIR]... [-m MAX_SIZE] [-r REPEAT] [-w] [-s]\n", program);
+    fprintf(stderr, "\n");
+    fprintf(stderr, "Benchmarks copyFile with every engine, buffer size and thread count.\n");
+    fprintf(stderr, "\n");
+    fprintf(stderr, "Options:\n");
+    fprintf(stderr, "  -d DIR        Directory to benchmark in (repeatable). Defaults to /dev/shm (tmpfs)\n");
+    fprintf(stderr, "                and the current directory.\n");
+    fprintf(stderr, "  -m MAX_SIZE   Largest file size, with an optional K, M or G suffix (default 1G,\n");
+    fprintf(stderr, "                sizes go from 1K up to 10G).\n");
+    fprintf(stderr, "  -r REPEAT     Timed runs per configuration (default 3, at most 16).\n");
+    fprintf(stderr, "  -w            Keep the source in the page cache (warm runs).\n");
+    fprintf(stderr, "  -s            Include fdatasync of the destination in each run.\n");
+    fprintf(stderr, "\n");
+    fprintf(stderr, "Results are printed on stdout, one JSON object per configuration.\n");
+}
+
+/**
+ * @brief Entry point of the copy benchmark.
+ */
+int main(const int argc, char *argv[]) {
+    bench_settings_t settings = {.max_size = DEFAULT_MAX_SIZE, .repeat = DEFAULT_REPEAT};
+
+    int option;
+    while ((option = getopt(argc, argv, "d:m:r:wsh")) != -1) {
+        switch (option) {
+            case 'd':
+                if (settings.n_dirs < MAX_BENCH_DIRS) {
+                    settings.dirs[settings.n_dirs++] = optarg;
+                }
+                break;
+            case 'm':
+                settings.max_size = parseSize(optarg);
+                if (settings.max_size <= 0) {
+                    fprintf(stderr, "Error: Invalid size '%s'.\n", optarg);
+                    return ERROR_INVALID_ARGUMENT;
+                }
+                break;
+            case 'r':
+                settings.repeat = atoi(optarg);
+                if (settings.repeat <= 0) {
+                    fprintf(stderr, "Error: Invalid repeat count '%s'.\n", optarg);
+                    return ERROR_INVALID_ARGUMENT;
+                }
+                break;
+            case 'w':
+                settings.warm = true;
+                break;
+            case 's':
+                settings.sync = true;
+                break;
+            default:
+                displayUsage(argv[0]);
+                return option == 'h' ? SUCCESS : ERROR_INVALID_ARGUMENT;
+        }
+    }
+
+    if (settings.n_dirs == 0) {
+        settings.dirs[settings.n_dirs++] = "/dev/shm";
+        settings.dirs[settings.n_dirs++] = ".";
+    }
+
+    for (size_t i = 0; i < settings.n_dirs; ++i) {
+        struct stat dir_stat;
+        if (stat(settings.dirs[i], &dir_stat) == -1 || !S_ISDIR(dir_stat.st_mode)) {
+            fprintf(stderr, "Skipping '%s': not a directory.\n", settings.dirs[i]);
+            continue;
+        }
+        benchDirectory(&settings, settings.dirs[i]);
+    }
+    return SUCCESS;
+}
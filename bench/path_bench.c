@@ -0,0 +1,424 @@
+#define _GNU_SOURCE // posix_spawn file actions
+
+#include <fcntl.h>
+#include <libgen.h>
+#include <pwd.h>
+#include <spawn.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include <linux/limits.h>
+#include <sys/wait.h>
+
+#include "../include/error_handler.h"
+#include "../include/flags_handler.h"
+#include "../include/paths_handler.h"
+
+/**
+ * @file path_bench.c
+ * @brief Microbenchmarks the per-invocation CPU path: flag parsing and path resolution.
+ *
+ * Each benchmark runs one function over a generated corpus of inputs (path shapes such
+ * as `~user`, `$VAR`, `..` chains and long paths, or flag combinations) for a minimum
+ * amount of time, and reports nanoseconds and heap allocations per operation. The
+ * allocator is interposed to count every allocation, including those made inside the C
+ * library. A cold-start benchmark spawns the `redit` binary repeatedly and measures the
+ * whole process lifetime, from exec to exit.
+ *
+ * Usage: redit_microbench [-t SECONDS] [-n COLD_RUNS] [-b REDIT_BINARY] [-j]
+ */
+
+#define CORPUS_SIZE 4096 // Inputs per corpus
+#define DEFAULT_MIN_TIME 0.5 // Seconds each benchmark runs at least
+#define DEFAULT_COLD_RUNS 200 // Process spawns measured by the cold-start benchmark
+
+// glibc's allocator entry points, used by the counting replacements below
+extern void *__libc_malloc(size_t size);
+extern void *__libc_calloc(size_t count, size_t size);
+extern void *__libc_realloc(void *pointer, size_t size);
+extern void __libc_free(void *pointer);
+
+static uint64_t allocation_count = 0; // Allocations made since the start
+static uint64_t allocation_bytes = 0; // Bytes requested since the start
+
+void *malloc(const size_t size) {
+    allocation_count++;
+    allocation_bytes += size;
+    return __libc_malloc(size);
+}
+
+void *calloc(const size_t count, const size_t size) {
+    allocation_count++;
+    allocation_bytes += count * size;
+    return __libc_calloc(count, size);
+}
+
+void *realloc(void *pointer, const size_t size) {
+    allocation_count++;
+    allocation_bytes += size;
+    return __libc_realloc(pointer, size);
+}
+
+void free(void *pointer) {
+    __libc_free(pointer);
+}
+
+/**
+ * @brief Result of one benchmark.
+ */
+typedef struct {
+    uint64_t operations; ///< Operations run.
+    double ns_per_op; ///< Nanoseconds per operation.
+    double allocs_per_op; ///< Heap allocations per operation.
+    double bytes_per_op; ///< Heap bytes requested per operation.
+} bench_result_t;
+
+/**
+ * @brief An input corpus: strings, or argument vectors for the flag benchmark.
+ */
+typedef struct {
+    char *items[CORPUS_SIZE]; ///< Paths (string corpora).
+    char **argvs[CORPUS_SIZE]; ///< Argument vectors (flag corpus).
+    int argcs[CORPUS_SIZE]; ///< Argument counts (flag corpus).
+} corpus_t;
+
+typedef void (*bench_function_t)(const corpus_t *corpus, size_t index);
+
+/**
+ * @brief Reads the monotonic clock in nanoseconds.
+ */
+static uint64_t nowNs() {
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return (uint64_t) now.tv_sec * 1000000000ULL + (uint64_t) now.tv_nsec;
+}
+
+/**
+ * @brief Runs a function over a corpus, in rounds, until the minimum time is reached.
+ */
+static bench_result_t runBenchmark(const bench_function_t function, const corpus_t *corpus, const double min_time) {
+    // Warm-up round, so first-touch costs (page faults, NSS lookups) are not measured
+    for (size_t i = 0; i < CORPUS_SIZE; ++i) {
+        function(corpus, i);
+    }
+
+    const uint64_t allocations_before = allocation_count;
+    const uint64_t bytes_before = allocation_bytes;
+    const uint64_t start = nowNs();
+    uint64_t operations = 0;
+    uint64_t elapsed;
+    do {
+        for (size_t i = 0; i < CORPUS_SIZE; ++i) {
+            function(corpus, i);
+        }
+        operations += CORPUS_SIZE;
+        elapsed = nowNs() - start;
+    } while ((double) elapsed < min_time * 1e9);
+
+    return (bench_result_t){
+        .operations = operations,
+        .ns_per_op = (double) elapsed / (double) operations,
+        .allocs_per_op = (double) (allocation_count - allocations_before) / (double) operations,
+        .bytes_per_op = (double) (allocation_bytes - bytes_before) / (double) operations
+    };
+}
+
+/**
+ * @brief Prints one benchmark result as a table row or a JSON object.
+ */
+static void printResult(const char *name, const bench_result_t *result, const bool json) {
+    if (json) {
+        printf("{\"benchmark\":\"%s\",\"operations\":%llu,\"ns_per_op\":%.1f,\"allocs_per_op\":%.3f,"
+               "\"bytes_per_op\":%.1f}\n", name, (unsigned long long) result->operations, result->ns_per_op,
+               result->allocs_per_op, result->bytes_per_op);
+    } else {
+        printf("%-28s %12llu %12.1f %12.3f %12.1f\n", name, (unsigned long long) result->operations,
+               result->ns_per_op, result->allocs_per_op, result->bytes_per_op);
+    }
+    fflush(stdout);
+}
+
+/**
+ * @brief Builds a path of `depth` components of `length` characters each.
+ */
+static void appendComponents(char *path, const size_t size, const int depth, const int length, const char *separator) {
+    for (int d = 0; d < depth; ++d) {
+        size_t used = strlen(path);
+        if (used + length + strlen(separator) + 1 >= size) {
+            return;
+        }
+        strcat(path, separator);
+        used = strlen(path);
+        for (int c = 0; c < length; ++c) {
+            path[used + c] = (char) ('a' + (d + c) % 26);
+        }
+        path[used + length] = '\0';
+    }
+}
+
+/**
+ * @brief Generates the path corpus: every shape `getAbsolutePathFuture` handles, at several lengths.
+ *
+ * @return `SUCCESS` if the corpus was built, or an error code otherwise.
+ */
+static int buildPathCorpus(corpus_t *corpus) {
+    const struct passwd *pw = getpwuid(getuid());
+    const char *user_name = pw != NULL ? pw->pw_name : "root";
+
+    for (size_t i = 0; i < CORPUS_SIZE; ++i) {
+        char path[PATH_MAX] = {0};
+        const int depth = 1 + (int) (i % 12); // Number of components
+        const int length = 1 + (int) ((i / 12) % 24); // Characters per component
+        const bool long_path = i % 64 == 63; // Close to PATH_MAX
+
+        switch (i % 8) {
+            case 0: // Home directory
+                strcpy(path, "~");
+                break;
+            case 1: // Another user's home directory
+                snprintf(path, sizeof(path), "~%s", user_name);
+                break;
+            case 2: // Environment variable
+                strcpy(path, "$HOME");
+                break;
+            case 3: // Parent directory chain
+                for (int up = 0; up < 1 + (int) (i % 6); ++up) {
+                    strcat(path, up == 0 ? ".." : "/..");
+                }
+                break;
+            case 4: // Current directory
+                strcpy(path, ".");
+                break;
+            case 5: // Relative
+                strcpy(path, "rel");
+                break;
+            case 6: // Absolute
+                strcpy(path, "/abs");
+                break;
+            case 7: // Absolute with repeated and trailing slashes
+                strcpy(path, "//abs//");
+                break;
+        }
+        appendComponents(path, long_path ? PATH_MAX - 512 : sizeof(path), long_path ? 200 : depth,
+                         long_path ? 15 : length, i % 8 == 7 ? "///" : "/");
+        if (i % 8 == 7) {
+            strcat(path, "//");
+        }
+
+        corpus->items[i] = strdup(path);
+        if (corpus->items[i] == NULL) {
+            return ERROR_MEMORY_ALLOCATION;
+        }
+    }
+    return SUCCESS;
+}
+
+/**
+ * @brief Generates the flag corpus: valid and incompatible combinations of every flag.
+ *
+ * @return `SUCCESS` if the corpus was built, or an error code otherwise.
+ */
+static int buildFlagCorpus(corpus_t *corpus) {
+    static const char *FLAG_SETS[][8] = {
+        {"-C", NULL},
+        {"-O", NULL},
+        {"-Cd", "copy.txt", NULL},
+        {"-CD", "dir", NULL},
+        {"-C", "-e", "vim", NULL},
+        {"-Ok", "--sync=group", NULL},
+        {"-C", "--lock-timeout=2.5", "--direct", NULL},
+        {"-O", "--stats=json", "--recalibrate", NULL},
+        {"-CO", NULL}, // Incompatible
+        {"-Ode", NULL}, // Incompatible
+        {"-CdD", "x", NULL}, // Incompatible
+        {"-Ck", "--sync=full", NULL}, // Incompatible
+    };
+    const size_t n_sets = sizeof(FLAG_SETS) / sizeof(FLAG_SETS[0]);
+
+    for (size_t i = 0; i < CORPUS_SIZE; ++i) {
+        const char **set = FLAG_SETS[i % n_sets];
+        int argc = 1;
+        while (set[argc - 1] != NULL) {
+            argc++;
+        }
+        argc++; // Privileged file
+
+        char **argv = calloc((size_t) argc + 1, sizeof(char *));
+        if (argv == NULL) {
+            return ERROR_MEMORY_ALLOCATION;
+        }
+        argv[0] = "redit";
+        for (int a = 1; a < argc - 1; ++a) {
+            argv[a] = (char *) set[a - 1];
+        }
+        argv[argc - 1] = "/etc/hosts";
+        corpus->argvs[i] = argv;
+        corpus->argcs[i] = argc;
+    }
+    return SUCCESS;
+}
+
+static void benchNormalizeSlashes(const corpus_t *corpus, const size_t index) {
+    char normalized[PATH_MAX];
+    normalizeSlashes(corpus->items[index], normalized);
+}
+
+static void benchGetAbsolutePathFuture(const corpus_t *corpus, const size_t index) {
+    char resolved[PATH_MAX];
+    getAbsolutePathFuture(corpus->items[index], resolved);
+}
+
+static void benchGetAbsFilePathFromDir(const corpus_t *corpus, const size_t index) {
+    char path[PATH_MAX];
+    strlcpy(path, corpus->items[index], PATH_MAX);
+    getAbsFilePathFromDir(path, "privileged_file.conf");
+}
+
+static void benchHandleFlags(const corpus_t *corpus, const size_t index) {
+    flag_state_t flags = {0};
+    handleFlags(corpus->argcs[index], corpus->argvs[index], &flags);
+}
+
+/**
+ * @brief Measures the lifetime of `redit` processes, from exec to exit.
+ *
+ * @param binary Path to the `redit` binary.
+ * @param arguments Arguments of each run, ending with `NULL`.
+ * @param runs Number of processes to spawn.
+ * @param json Whether to print JSON.
+ */
+static void benchColdStart(const char *name, const char *binary, char *const arguments[], const int runs,
+                           const bool json) {
+    posix_spawn_file_actions_t actions;
+    posix_spawn_file_actions_init(&actions);
+    posix_spawn_file_actions_addopen(&actions, STDOUT_FILENO, "/dev/null", O_WRONLY, 0);
+    posix_spawn_file_actions_addopen(&actions, STDERR_FILENO, "/dev/null", O_WRONLY, 0);
+
+    uint64_t total = 0;
+    int completed = 0;
+    for (int run = 0; run < runs; ++run) {
+        const uint64_t start = nowNs();
+        pid_t pid;
+        if (posix_spawn(&pid, binary, &actions, NULL, arguments, environ) != 0) {
+            break;
+        }
+        int status;
+        waitpid(pid, &status, 0);
+        total += nowNs() - start;
+        completed++;
+    }
+    posix_spawn_file_actions_destroy(&actions);
+
+    if (completed == 0) {
+        fprintf(stderr, "Skipping %s: could not run '%s'.\n", name, binary);
+        return;
+    }
+    const bench_result_t result = {.operations = (uint64_t) completed, .ns_per_op = (double) total / completed};
+    printResult(name, &result, json);
+}
+
+/**
+ * @brief Displays the usage of the microbenchmarks.
+ */
+static void displayUsage(const char *program) {
+    fprintf(stderr, "Usage: %s [-t SECONDS] [-n COLD_RUNS] [-b REDIT_BINARY] [-j]\n", program);
+    fprintf(stderr, "\n");
+    fprintf(stderr, "Microbenchmarks flag parsing, path resolution and process start-up.\n");
+    fprintf(stderr, "\n");
+    fprintf(stderr, "Options:\n");
+    fprintf(stderr, "  -t SECONDS    Minimum time per benchmark (default 0.5).\n");
+    fprintf(stderr, "  -n COLD_RUNS  Processes spawned by the cold-start benchmarks (default 200).\n");
+    fprintf(stderr, "  -b BINARY     redit binary for the cold-start benchmarks (default: 'redit' next\n");
+    fprintf(stderr, "                to this program).\n");
+    fprintf(stderr, "  -j            Print one JSON object per benchmark instead of a table.\n");
+}
+
+/**
+ * @brief Entry point of the microbenchmarks.
+ */
+int main(const int argc, char *argv[]) {
+    double min_time = DEFAULT_MIN_TIME;
+    int cold_runs = DEFAULT_COLD_RUNS;
+    const char *binary = NULL;
+    bool json = false;
+
+    int option;
+    while ((option = getopt(argc, argv, "t:n:b:jh")) != -1) {
+        switch (option) {
+            case 't':
+                min_time = atof(optarg);
+                break;
+            case 'n':
+                cold_runs = atoi(optarg);
+                break;
+            case 'b':
+                binary = optarg;
+                break;
+            case 'j':
+                json = true;
+                break;
+            default:
+                displayUsage(argv[0]);
+                return option == 'h' ? SUCCESS : ERROR_INVALID_ARGUMENT;
+        }
+    }
+    if (min_time <= 0 || cold_runs < 0) {
+        displayUsage(argv[0]);
+        return ERROR_INVALID_ARGUMENT;
+    }
+
+    // The redit binary is built next to this one
+    char default_binary[PATH_MAX];
+    if (binary == NULL) {
+        char self[PATH_MAX];
+        const ssize_t length = readlink("/proc/self/exe", self, sizeof(self) - 1);
+        if (length > 0) {
+            self[length] = '\0';
+            snprintf(default_binary, sizeof(default_binary), "%s/redit", dirname(self));
+            binary = default_binary;
+        }
+    }
+
+    static corpus_t paths, flag_sets;
+    if (buildPathCorpus(&paths) != SUCCESS || buildFlagCorpus(&flag_sets) != SUCCESS) {
+        fprintf(stderr, "Error: Memory allocation failed.\n");
+        return ERROR_MEMORY_ALLOCATION;
+    }
+
+    // Incompatible flag combinations print an error, which is part of their cost but not of the output
+    fflush(stderr);
+    const int saved_stderr = dup(STDERR_FILENO);
+    const int null_fd = open("/dev/null", O_WRONLY);
+
+    if (!json) {
+        printf("%-28s %12s %12s %12s %12s\n", "benchmark", "operations", "ns/op", "allocs/op", "bytes/op");
+    }
+
+    bench_result_t result = runBenchmark(benchNormalizeSlashes, &paths, min_time);
+    printResult("normalizeSlashes", &result, json);
+    result = runBenchmark(benchGetAbsolutePathFuture, &paths, min_time);
+    printResult("getAbsolutePathFuture", &result, json);
+    result = runBenchmark(benchGetAbsFilePathFromDir, &paths, min_time);
+    printResult("getAbsFilePathFromDir", &result, json);
+
+    if (null_fd != -1) {
+        dup2(null_fd, STDERR_FILENO);
+    }
+    result = runBenchmark(benchHandleFlags, &flag_sets, min_time);
+    fflush(stderr);
+    if (saved_stderr != -1) {
+        dup2(saved_stderr, STDERR_FILENO);
+    }
+    printResult("handleFlags", &result, json);
+
+    if (binary != NULL && cold_runs > 0) {
+        char *help_arguments[] = {"redit", "--help", NULL};
+        benchColdStart("cold start (--help)", binary, help_arguments, cold_runs, json);
+        char *error_arguments[] = {"redit", "-C", "/nonexistent/redit_bench", NULL};
+        benchColdStart("cold start (-C, missing file)", binary, error_arguments, cold_runs, json);
+    }
+    return SUCCESS;
+}
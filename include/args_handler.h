@@ -0,0 +1,25 @@
+/**
+ * @file args_handler.h
+ * @brief This header file contains declarations for functions in args_handler.c.
+ *
+ * This functions allow for resolving and validating the copy and privileged file paths given
+ * on the command line, and for creating the directory of a copy path if the user agrees to it.
+ *
+ * Functions:
+ * - int resolveAndValidatePaths(int argc, char *argv[], const flag_state_t *flags,
+ *                              char copy_file_path[PATH_MAX], char privileged_file_path[PATH_MAX]);
+ * - int validateOrCreatePath(const char path[], bool check_read, bool check_write);
+ */
+#ifndef ARGS_HANDLER_H
+#define ARGS_HANDLER_H
+
+#include <linux/limits.h>
+#include "flags_handler.h"
+#include <stdbool.h>
+
+int resolveAndValidatePaths(int argc, char *argv[], const flag_state_t *flags,
+                            char copy_file_path[PATH_MAX], char privileged_file_path[PATH_MAX]);
+
+int validateOrCreatePath(const char path[PATH_MAX], bool check_read, bool check_write);
+
+#endif
@@ -0,0 +1,51 @@
+/**
+ * @file backup_handler.h
+ * @brief This header file contains declarations for the functions in backup_handler.c.
+ *
+ * The functions provided in this file keep every version of a privileged file replaced by
+ * `redit` in a content-addressed store, split into content-defined chunks that are shared
+ * between versions, and bring those versions back with `--restore`.
+ *
+ * Functions:
+ * - int backupFile(const char *file_path, bool durable, off_t *stored_bytes);
+ * - int listBackups(const char *file_path, backup_version_t **versions, size_t *count);
+ * - int restoreBackup(const char *file_path, const char *version_id, int dest_fd, off_t *restored_bytes);
+ */
+
+#ifndef BACKUP_HANDLER_H
+#define BACKUP_HANDLER_H
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <time.h>
+#include <sys/types.h>
+#include "baseline_handler.h"
+
+#define BACKUP_DIR REDIT_STATE_DIR "/backups" // Backup store, with chunks shared by every version of every file
+#define BACKUP_CHUNK_MIN_SIZE (16 * 1024) // No chunk boundary before this many bytes
+#define BACKUP_CHUNK_MASK ((1ULL << 16) - 1) // Boundary where these hash bits are clear: 64 KB chunks on average
+#define BACKUP_CHUNK_MAX_SIZE (256 * 1024) // Boundary forced after this many bytes
+#define BACKUP_MAX_VERSIONS 32 // Versions kept per file; older ones are pruned with their unshared chunks
+#define BACKUP_PRUNE_SLACK 8 // Extra versions tolerated before pruning, so chunk sweeps stay rare
+
+/**
+ * @struct backup_version_t
+ * @brief One stored version of a file.
+ */
+typedef struct {
+    char id[32]; ///< Version identifier: its creation time, as `seconds.nanoseconds`.
+    struct timespec created; ///< When the version was stored.
+    off_t size; ///< Size of the file.
+    mode_t mode; ///< Permissions of the file.
+    uid_t owner; ///< Owner of the file.
+    gid_t group; ///< Group of the file.
+    size_t chunks; ///< Number of chunks the content is made of.
+} backup_version_t;
+
+int backupFile(const char *file_path, bool durable, off_t *stored_bytes);
+
+int listBackups(const char *file_path, backup_version_t **versions, size_t *count);
+
+int restoreBackup(const char *file_path, const char *version_id, int dest_fd, off_t *restored_bytes);
+
+#endif
@@ -0,0 +1,37 @@
+/**
+ * @file baseline_handler.h
+ * @brief This header file contains declarations for the functions in baseline_handler.c.
+ *
+ * The functions provided in this file keep a snapshot of the privileged file as it was
+ * when the copy was taken, so the overwrite mode can detect and merge changes made to
+ * the privileged file in the meantime.
+ *
+ * Functions:
+ * - int getBaselinePath(const char *copy_file_path, const char *privileged_file_path, char baseline_path[PATH_MAX]);
+ * - int saveBaseline(const char *source_path, const char *copy_file_path, const char *privileged_file_path,
+ *                    const struct stat *prv_stat);
+ * - int checkBaseline(const char *copy_file_path, const char *privileged_file_path, bool *prv_changed);
+ * - int removeBaseline(const char *copy_file_path, const char *privileged_file_path);
+ */
+
+#ifndef BASELINE_HANDLER_H
+#define BASELINE_HANDLER_H
+
+#include <stdbool.h>
+#include <linux/limits.h>
+#include <sys/stat.h>
+
+#define REDIT_STATE_DIR "/var/lib/redit" // Root-only state shared by every redit run
+#define BASELINE_DIR REDIT_STATE_DIR "/baselines" // Baseline snapshots, one per copy/privileged pair
+#define BASELINE_MAX_SIZE (64 * 1024 * 1024) // Larger files are not snapshotted (nor merged)
+
+int getBaselinePath(const char *copy_file_path, const char *privileged_file_path, char baseline_path[PATH_MAX]);
+
+int saveBaseline(const char *source_path, const char *copy_file_path, const char *privileged_file_path,
+                 const struct stat *prv_stat);
+
+int checkBaseline(const char *copy_file_path, const char *privileged_file_path, bool *prv_changed);
+
+int removeBaseline(const char *copy_file_path, const char *privileged_file_path);
+
+#endif
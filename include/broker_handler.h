@@ -0,0 +1,31 @@
+/**
+ * @file broker_handler.h
+ * @brief This header file contains declarations for the functions in broker_handler.c.
+ *
+ * The functions provided in this file run the `--broker` daemon, a long-lived root
+ * process that opens privileged files on behalf of unprivileged `redit` runs, as
+ * allowed by a policy file, and hands them the descriptors over a Unix socket. They
+ * also implement the client side of that exchange.
+ *
+ * Functions:
+ * - int runBroker(const char *socket_path, const char *policy_path);
+ * - int requestBrokerFile(const char *socket_path, const char *file_path, bool write, int *fd);
+ */
+
+#ifndef BROKER_HANDLER_H
+#define BROKER_HANDLER_H
+
+#include <stdbool.h>
+
+#define BROKER_SOCKET_DIR "/run/redit" // Directory of the broker socket
+#define BROKER_SOCKET_PATH BROKER_SOCKET_DIR "/broker.sock" // Socket the broker listens on
+#define BROKER_POLICY_PATH "/etc/redit/broker.policy" // Who may open which files through the broker
+#define BROKER_PROTOCOL_VERSION 1 // Bumped whenever the request or reply layout changes
+#define BROKER_CLIENT_TIMEOUT 1 // Seconds a client may take to send its request or read the reply
+#define BROKER_MAX_CLIENTS 64 // Clients served at once, each on its own thread
+
+int runBroker(const char *socket_path, const char *policy_path);
+
+int requestBrokerFile(const char *socket_path, const char *file_path, bool write, int *fd);
+
+#endif
@@ -0,0 +1,20 @@
+/**
+ * @file checksum_handler.h
+ * @brief This header file contains declarations for the functions in checksum_handler.c.
+ *
+ * The functions provided in this file compute CRC32C (Castagnoli) checksums, with the CPU's
+ * CRC instructions where available, to check that written data reads back as it was written.
+ *
+ * Functions:
+ * - uint32_t updateCrc32c(uint32_t crc, const void *data, size_t length);
+ */
+
+#ifndef CHECKSUM_HANDLER_H
+#define CHECKSUM_HANDLER_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+uint32_t updateCrc32c(uint32_t crc, const void *data, size_t length);
+
+#endif
@@ -0,0 +1,72 @@
+/**
+ * @file compression_handler.h
+ * @brief This header file contains declarations for the functions in compression_handler.c.
+ *
+ * The functions provided in this file let compressed privileged files (`.gz`, and `.zst`
+ * where libzstd is available) be edited as plain text: the copy holds the decompressed
+ * content, and the overwrite compresses it back with the codec and level of the original,
+ * on every available CPU.
+ *
+ * Functions:
+ * - int detectCompression(int fd, compression_t *compression);
+ * - const char *getCompressionName(compression_format_t format);
+ * - int decompressFile(int src_fd, int dest_fd, compression_format_t format, uint32_t *crc, off_t *written);
+ * - int compressFile(int src_fd, int dest_fd, const compression_t *compression, size_t threads, uint32_t *crc,
+ *                    off_t *read);
+ * - int saveCompression(const char *copy_file_path, const char *privileged_file_path,
+ *                       const compression_t *compression, const struct stat *prv_stat);
+ * - int loadCompression(const char *copy_file_path, const char *privileged_file_path, compression_t *compression,
+ *                       bool *prv_changed);
+ * - int removeCompression(const char *copy_file_path, const char *privileged_file_path);
+ */
+
+#ifndef COMPRESSION_HANDLER_H
+#define COMPRESSION_HANDLER_H
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <sys/stat.h>
+#include <sys/types.h>
+
+#define COMPRESSION_BLOCK_SIZE (2 * 1024 * 1024) // Bytes compressed independently by one thread
+#define COMPRESSION_MAX_THREADS 64 // Upper bound for parallel compression
+#define COMPRESSION_STREAM_SIZE (256 * 1024) // Bytes read and written at once while decompressing
+
+/**
+ * @enum compression_format_t
+ * @brief Compressed formats edited transparently.
+ */
+typedef enum {
+    COMPRESSION_NONE = 0, ///< Not compressed, or in a format that is copied as is.
+    COMPRESSION_GZIP, ///< gzip (RFC 1952), through zlib.
+    COMPRESSION_ZSTD ///< Zstandard (RFC 8878), through libzstd.
+} compression_format_t;
+
+/**
+ * @struct compression_t
+ * @brief Codec and level of a compressed file.
+ */
+typedef struct {
+    compression_format_t format; ///< Codec.
+    int level; ///< Compression level, as far as the file tells it.
+} compression_t;
+
+int detectCompression(int fd, compression_t *compression);
+
+const char *getCompressionName(compression_format_t format);
+
+int decompressFile(int src_fd, int dest_fd, compression_format_t format, uint32_t *crc, off_t *written);
+
+int compressFile(int src_fd, int dest_fd, const compression_t *compression, size_t threads, uint32_t *crc,
+                 off_t *read);
+
+int saveCompression(const char *copy_file_path, const char *privileged_file_path, const compression_t *compression,
+                    const struct stat *prv_stat);
+
+int loadCompression(const char *copy_file_path, const char *privileged_file_path, compression_t *compression,
+                    bool *prv_changed);
+
+int removeCompression(const char *copy_file_path, const char *privileged_file_path);
+
+#endif
@@ -0,0 +1,32 @@
+/**
+ * @file device_handler.h
+ * @brief This header file contains declarations for the functions in device_handler.c.
+ *
+ * The functions provided in this file tell how much concurrent I/O a device takes, from
+ * `/etc/redit/devices` or its rotational flag in sysfs, and where a file lies on it, so
+ * multi-file work can be scheduled per device.
+ *
+ * Functions:
+ * - size_t getDeviceConcurrency(dev_t device, bool *rotational);
+ * - uint64_t getPhysicalOffset(int fd, const struct stat *file_stat);
+ */
+
+#ifndef DEVICE_HANDLER_H
+#define DEVICE_HANDLER_H
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <sys/stat.h>
+#include <sys/types.h>
+
+#define DEVICE_CONFIG_PATH "/etc/redit/devices" // Concurrency limits set by the administrator, per mount point
+#define DEVICE_ROTATIONAL_LIMIT 1 // Concurrent streams on a spinning disk, which seeks between them
+#define DEVICE_SOLID_STATE_LIMIT 16 // Concurrent streams on an SSD or NVMe drive, which needs deep queues
+#define DEVICE_OTHER_LIMIT 4 // Concurrent streams on NFS and other file systems without a block device
+
+size_t getDeviceConcurrency(dev_t device, bool *rotational);
+
+uint64_t getPhysicalOffset(int fd, const struct stat *file_stat);
+
+#endif
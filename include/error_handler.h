@@ -7,9 +7,13 @@
  *
  * This file includes:
  * - `error_codes` enum: A list of predefined error codes used throughout the program.
- * - `printError` function: Maps error codes to descriptive messages and outputs them.
+ * - `getErrorMessage` function: Maps error codes to descriptive messages.
+ * - `printError` function: Outputs the message of an error code.
+ * - `REDIT_API` macro: Marks the functions exported by `libredit.so`.
  */
 
+#define REDIT_API __attribute__((visibility("default"))) // Exported by libredit.so, built with hidden visibility
+
 /**
  * @enum error_codes
  * @brief Defines standard error codes for the program.
@@ -33,11 +37,29 @@ enum error_codes {
     ERROR_PATH_INVALID, ///< Invalid path provided.
     ERROR_PATH_TOO_LONG, ///< Path length exceeds the maximum limit.
     ERROR_INVALID_SOURCE, ///< Invalid copy file.
+    ERROR_MERGE_CONFLICT, ///< Concurrent changes could not be merged automatically.
+    ERROR_LOCK_TIMEOUT, ///< Timed out waiting for a file lock.
+    ERROR_SYNC_FAILED, ///< Flushing written data to stable storage failed.
+    ERROR_BROKER_UNAVAILABLE, ///< The `--broker` daemon could not be reached.
+    ERROR_BACKUP_CORRUPTED, ///< A stored backup is missing chunks or does not match their hashes.
+    ERROR_WINDOW_CHANGED, ///< The privileged file changed since a range of its lines was copied.
+    ERROR_PATCH_REJECTED, ///< Some hunk of a patch was not found in the privileged file.
+    ERROR_VERIFY_FAILED, ///< A written file did not read back as it was written.
+    ERROR_COMPRESSION_FAILED, ///< A compressed privileged file could not be compressed back.
     HELP_DISPLAYED = 100, ///< Help message displayed.
     ERROR_COMMAND_NOT_FOUND = 256, ///< Command not found.
     UNKNOWN_ERROR = 666 ///< An unknown error occurred.
 };
 
+/**
+ * @brief Returns the descriptive message of an error code, without printing it.
+ *
+ * @param error_code The error code to interpret.
+ * @return A static string describing the error, or `NULL` if the error code is not
+ *         one of `error_codes`.
+ */
+REDIT_API const char *getErrorMessage(int error_code);
+
 /**
  * @brief Prints a descriptive error message based on the provided error code.
  *
@@ -6,19 +6,60 @@
  * modifying file permissions, and executing editor commands on files.
  *
  * Functions:
- * - int copyFile(const char *src, const char *dest);
+ * - int copyFile(const char *src, const char *dest, const copy_options_t *options);
+ * - int copyDescriptors(int src_fd, int dest_fd, const char *dest, const copy_options_t *options, off_t *copied);
+ * - const char *getCopyEngineName(copy_engine_t engine);
  * - int changeFileOwner(const char *file_path, uid_t user_uid);
  * - int addFilePermissions(const char *file_path, mode_t add_mode);
  * - int overwriteFilePermissions(const char *file_path, mode_t new_mode);
- * - int executeEditorCommand(const char *editor, const char copy_file_path[], const char *PROGRAM_DEFAULT_EDITOR);
+ * - int executeEditorCommand(const char *editor, const char copy_file_path[PATH_MAX], const char *PROGRAM_DEFAULT_EDITOR);
  */
 
 #ifndef FILE_ACTIONS_H
 #define FILE_ACTIONS_H
 
+#include <stdbool.h>
+#include <linux/limits.h>
 #include <sys/types.h>
+#include "sync_handler.h"
 
-int copyFile(const char *src, const char *dest);
+#define MAX_COPY_THREADS 16 // Upper bound for parallel copy ranges
+
+/**
+ * @enum copy_engine_t
+ * @brief Mechanisms `copyFile` can use to move data.
+ */
+typedef enum {
+    COPY_ENGINE_READ_WRITE = 0, ///< `pread`/`pwrite` through a user-space buffer (default).
+    COPY_ENGINE_KERNEL ///< `copy_file_range`, falling back to read/write where unsupported.
+} copy_engine_t;
+
+/**
+ * @struct copy_options_t
+ * @brief Tunes how `copyFile` writes the destination file.
+ *
+ * A `NULL` options pointer is equivalent to a zero-initialized structure.
+ */
+typedef struct {
+    sync_mode_t sync_mode; ///< Durability mode for the destination file.
+    sync_group_t *sync_group; ///< Group collecting deferred flushes in `SYNC_GROUP` mode.
+    bool direct_io; ///< Bypass the page cache with `O_DIRECT` where supported.
+    copy_engine_t engine; ///< Engine moving the data.
+    size_t buffer_size; ///< Bytes per request, 0 for the built-in heuristic.
+    size_t threads; ///< Ranges copied concurrently for large files, 0 or 1 for a sequential copy.
+    off_t max_length; ///< Copy at most this many bytes from the start, 0 for the whole file.
+    bool verify_write; ///< Read the destination back from storage and check it against the copied bytes.
+    double bandwidth_limit; ///< Most bytes per second moved by all threads together, 0 for no limit.
+    bool resumable; ///< Journal copies of `JOURNAL_MIN_SIZE` bytes or more, resuming them if interrupted (`copyFile`).
+    off_t *resumed; ///< Set to the bytes an interrupted copy left intact and were not copied again, or `NULL`.
+    bool progress; ///< Report the progress of the copy (see `progress_handler.c`).
+} copy_options_t;
+
+int copyFile(const char *src, const char *dest, const copy_options_t *options);
+
+int copyDescriptors(int src_fd, int dest_fd, const char *dest, const copy_options_t *options, off_t *copied);
+
+const char *getCopyEngineName(copy_engine_t engine);
 
 int changeFileOwner(const char *file_path, uid_t user_uid);
 
@@ -26,6 +67,6 @@ int addFilePermissions(const char *file_path, mode_t add_mode);
 
 int overwriteFilePermissions(const char *file_path, mode_t new_mode);
 
-int executeEditorCommand(const char *editor, const char copy_file_path[], const char *PROGRAM_DEFAULT_EDITOR);
+int executeEditorCommand(const char *editor, const char copy_file_path[PATH_MAX], const char *PROGRAM_DEFAULT_EDITOR);
 
 #endif
@@ -2,15 +2,11 @@
  * @file file_utils.h
  * @brief This header file contains declarations for functions in file_utils.c.
  *
- * The functions provided in this file allow for retrieving program options,
- * checking program flags, and getting information about files and directories.
+ * The functions provided in this file allow for getting information about the user,
+ * files and directories.
  *
  * Functions:
- * - const cag_option *getProgramOptions();
- * - size_t getProgramOptionsSize();
  * - char *tryHelpMessage();
- * - bool checkProgramFlags(bool copy_mode, bool overwrite_mode, bool copied_file_path, bool copied_dir_path,
- *                         bool e_included, bool keep_copy);
  * - int getCurrentWorkingDirectory(char cwd[]);
  * - int getEffectiveUserId(uid_t *u_id);
  * - int getFilePermissions(const char *file_path, mode_t *permissions);
@@ -22,17 +18,9 @@
 
 #include <linux/limits.h>
 #include <sys/types.h>
-#include <cargs.h>
-
-const cag_option *getProgramOptions();
-
-size_t getProgramOptionsSize();
 
 char *tryHelpMessage();
 
-bool checkProgramFlags(bool copy_mode, bool overwrite_mode, bool copied_file_path, bool copied_dir_path,
-                       bool e_included, bool keep_copy);
-
 int getCurrentWorkingDirectory(char cwd[PATH_MAX]);
 
 int getEffectiveUserId(uid_t *u_id);
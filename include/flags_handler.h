@@ -1,6 +1,10 @@
 #ifndef FLAGS_HANDLER_H
 #define FLAGS_HANDLER_H
 
+#include "stats_handler.h"
+#include "sync_handler.h"
+#include "throttle_handler.h"
+
 /**
  * @file flags_handler.h
  * @brief Header file for handling command-line flags in the `redit` program.
@@ -24,6 +28,29 @@ typedef struct {
     bool use_editor; ///< Indicates if an editor should be used (-e).
     bool keep_copy; ///< Indicates if the copy file should be kept after overwriting (-k).
     const char *editor; ///< Stores the editor specified with the -e flag.
+    double lock_timeout; ///< Seconds to wait for the file lock (--lock-timeout), negative to wait indefinitely.
+    sync_mode_t sync_mode; ///< Durability mode for written files (--sync).
+    bool direct_io; ///< Indicates if copies should bypass the page cache (--direct).
+    bool verify_write; ///< Indicates if written files should be read back and checked (--verify-write).
+    bool raw; ///< Indicates if compressed privileged files should be copied as they are (--raw).
+    io_priority_t io_priority; ///< I/O priority of the run (--ionice).
+    double bandwidth_limit; ///< Most MB/s a copy may move (--bwlimit), 0 for no limit.
+    size_t cpus; ///< Most CPUs the run may use (--cpus), 0 for all of them.
+    bool recalibrate; ///< Indicates if the copy parameters should be calibrated again (--recalibrate).
+    stats_format_t stats_format; ///< Format of the per-phase report (--stats), `STATS_OFF` for none.
+    bool report; ///< Indicates if the latency report of past runs should be printed (--report).
+    bool sessions; ///< Indicates if the copies taken by the user should be listed (--sessions).
+    bool sessions_clean; ///< Indicates if unedited copies and gone ones should be cleaned up (--sessions=clean).
+    const char *trace_path; ///< File receiving the Chrome trace of the run (--trace), or `NULL`.
+    bool broker; ///< Indicates if the program should run as the privileged broker daemon (--broker).
+    bool restore; ///< Indicates if backups of a privileged file should be listed or restored (--restore).
+    const char *restore_version; ///< Version to restore (--restore=<version>), or `NULL` to list them.
+    const char *restore_path; ///< Privileged file taken as the --restore value, or `NULL` if it follows it.
+    const char *substitute_expression; ///< Substitution to rewrite the privileged file with (-S), or `NULL`.
+    const char *patch_path; ///< Unified diff to apply to the privileged file (-P), or `NULL`.
+    bool verify; ///< Indicates if the copies of the privileged files should be checked for changes (--verify).
+    size_t first_line; ///< First line of the window to copy (--lines), or 0 to copy the whole file.
+    size_t last_line; ///< Last line of the window to copy (--lines), or 0 for the end of the file.
     int param_index; ///< Index of the first non-flag parameter in `argv`.
 } flag_state_t;
 
@@ -0,0 +1,27 @@
+/**
+ * @file history_handler.h
+ * @brief This header file contains declarations for the functions in history_handler.c.
+ *
+ * The functions provided in this file keep a fixed-size history of past runs (mode,
+ * bytes, file system, phase durations and result) and summarize it as latency
+ * percentiles with `--report`.
+ *
+ * Functions:
+ * - int recordRun(bool copy_mode, const char *privileged_file_path, int result);
+ * - int printHistoryReport();
+ */
+
+#ifndef HISTORY_HANDLER_H
+#define HISTORY_HANDLER_H
+
+#include <stdbool.h>
+
+#define HISTORY_DIR ".local/state/redit" // History directory, relative to the user's home
+#define HISTORY_FILE "history" // Run history ring file name
+#define HISTORY_CAPACITY 8192 // Runs kept in the ring, the oldest being overwritten
+
+int recordRun(bool copy_mode, const char *privileged_file_path, int result);
+
+int printHistoryReport();
+
+#endif
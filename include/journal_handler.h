@@ -0,0 +1,66 @@
+/**
+ * @file journal_handler.h
+ * @brief This header file contains declarations for the functions in journal_handler.c.
+ *
+ * The functions provided in this file keep a small journal for the destination of a large
+ * copy, recording how far each of its ranges got and the checksum of what it wrote, so an
+ * interrupted copy resumes from there instead of starting over.
+ *
+ * Functions:
+ * - int openJournal(const char *dest, const struct stat *src_stat, copy_journal_t *journal);
+ * - int startJournal(copy_journal_t *journal, const struct stat *dest_stat, const journal_range_t *ranges,
+ *                    size_t n_ranges);
+ * - void checkpointJournal(const copy_journal_t *journal, size_t index, off_t checkpoint, uint32_t crc);
+ * - void closeJournal(copy_journal_t *journal, bool done);
+ */
+
+#ifndef JOURNAL_HANDLER_H
+#define JOURNAL_HANDLER_H
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <linux/limits.h>
+#include <sys/stat.h>
+#include <sys/types.h>
+#include "baseline_handler.h"
+
+#define JOURNAL_MIN_SIZE (256LL * 1024 * 1024) // Copies from this size on are journaled
+#define JOURNAL_CHECKPOINT_INTERVAL (64 * 1024 * 1024) // Bytes a range copies between checkpoints
+#define JOURNAL_MAX_RANGES 16 // Most ranges a journal records
+#define JOURNAL_DIR REDIT_STATE_DIR "/journals" // Journals of unfinished copies, one per destination
+
+/**
+ * @struct journal_range_t
+ * @brief Progress of one range of a journaled copy.
+ */
+typedef struct {
+    off_t start; ///< First byte of the range.
+    off_t end; ///< One past the last byte of the range, or `INT64_MAX` for the end of the source.
+    off_t checkpoint; ///< The range is known to be copied up to here.
+    uint32_t crc; ///< CRC32C of the destination from `start` to `checkpoint`.
+} journal_range_t;
+
+/**
+ * @struct copy_journal_t
+ * @brief Journal of a copy, open for checkpoints.
+ */
+typedef struct {
+    int fd; ///< Descriptor of the journal file.
+    char path[PATH_MAX]; ///< Path to the journal file.
+    struct stat src_stat; ///< Source being copied; a journal of another source, or of one since modified, is discarded.
+    bool resumed; ///< Whether the journal was left by an interrupted copy of the same source.
+    size_t n_ranges; ///< Number of `ranges`.
+    journal_range_t ranges[JOURNAL_MAX_RANGES]; ///< Ranges of the copy, as left by the interrupted copy if `resumed`.
+} copy_journal_t;
+
+int openJournal(const char *dest, const struct stat *src_stat, copy_journal_t *journal);
+
+int startJournal(copy_journal_t *journal, const struct stat *dest_stat, const journal_range_t *ranges,
+                 size_t n_ranges);
+
+void checkpointJournal(const copy_journal_t *journal, size_t index, off_t checkpoint, uint32_t crc);
+
+void closeJournal(copy_journal_t *journal, bool done);
+
+#endif
@@ -0,0 +1,26 @@
+/**
+ * @file lock_handler.h
+ * @brief This header file contains declarations for the functions in lock_handler.c.
+ *
+ * The functions provided in this file take and release open file description (OFD)
+ * advisory locks on privileged files, so concurrent `redit` sessions working on the
+ * same file are serialized while sessions on different files never wait on each other.
+ *
+ * Functions:
+ * - int acquireFileLock(const char *file_path, bool exclusive, double timeout, int *lock_fd, double *waited);
+ * - int lockDescriptor(int fd, bool exclusive, double timeout, double *waited);
+ * - void releaseFileLock(int lock_fd);
+ */
+
+#ifndef LOCK_HANDLER_H
+#define LOCK_HANDLER_H
+
+#include <stdbool.h>
+
+int acquireFileLock(const char *file_path, bool exclusive, double timeout, int *lock_fd, double *waited);
+
+int lockDescriptor(int fd, bool exclusive, double timeout, double *waited);
+
+void releaseFileLock(int lock_fd);
+
+#endif
@@ -0,0 +1,32 @@
+#ifndef MERGE_HANDLER_H
+#define MERGE_HANDLER_H
+
+#include <stddef.h>
+
+/**
+ * @file merge_handler.h
+ * @brief Provides a line-based three-way merge for the `redit` program.
+ *
+ * This file declares the `mergeFiles` function, which reconciles the edited copy
+ * with changes made to the privileged file after the copy was taken, using the
+ * baseline snapshot as the common ancestor.
+ */
+
+/**
+ * @brief Performs a three-way merge of a baseline, an edited copy and the current file.
+ *
+ * Lines are hashed and diffed with Myers' O(ND) algorithm against the baseline.
+ * Hunks changed on only one side are applied automatically; conflict markers are
+ * written only where both sides changed the same region differently.
+ *
+ * @param base_path Path to the common ancestor (baseline snapshot).
+ * @param copy_path Path to the edited copy file.
+ * @param current_path Path to the current privileged file.
+ * @param output_path Path where the merged result is written. May be `copy_path`.
+ * @param conflicts Pointer to a variable where the number of conflicting hunks will be stored.
+ * @return int `SUCCESS` if the merge result was written, or an error code otherwise.
+ */
+int mergeFiles(const char *base_path, const char *copy_path, const char *current_path, const char *output_path,
+               size_t *conflicts);
+
+#endif // MERGE_HANDLER_H
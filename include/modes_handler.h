@@ -2,34 +2,80 @@
 #define FILE_MODES_H
 
 #include <stdbool.h>
+#include "flags_handler.h"
 
 /**
  * @file modes_handler.h
  * @brief Provides functionality to handle execution of `copy` and `overwrite` modes.
  *
  * This file declares the `executeFileMode` function, which determines the mode to execute
- * based on user input and invokes the corresponding internal implementation.
+ * based on user input and runs it through the C API declared in redit.h, and the
+ * `executeSubstituteMode`, `executePatchMode`, `executeVerifyMode`, `executeRestoreMode` and
+ * `executeSessionsMode` functions behind `-S`, `-P`, `--verify`, `--restore` and `--sessions`.
  */
 
 /**
  * @brief Executes the appropriate mode (`copy` or `overwrite`) based on user input.
  *
  * This function determines whether to perform a `copy` or `overwrite` operation
- * and delegates the implementation to the respective function. It handles file
- * permissions, ownership, and optionally opens the file in an editor.
+ * and delegates it to `reditCopy` or `reditOverwrite`, reporting their outcome.
+ * After a copy, it optionally opens the file in an editor.
  *
- * @param is_copy Indicates whether the operation is in `copy` mode.
+ * @param flags Pointer to the parsed flag states (mode, editor, keep copy, lock timeout).
  * @param copy_file_path The path to the copy file.
  * @param privileged_file_path The path to the privileged file.
- * @param keep_copy Indicates whether to keep the copy file after overwriting.
- * @param editor The editor to use if specified by the user.
- * @param use_editor Indicates whether an editor should be invoked.
  * @param program_default_editor The default editor to use if none is specified.
  * @return int A status code indicating the success or failure of the operation:
  *             - `SUCCESS` on success.
  *             - An appropriate error code on failure.
  */
-int executeFileMode(const bool is_copy, const char *copy_file_path, const char *privileged_file_path,
-                    bool keep_copy, const char *editor, bool use_editor, const char *program_default_editor);
+int executeFileMode(const flag_state_t *flags, const char *copy_file_path, const char *privileged_file_path,
+                    const char *program_default_editor);
+
+/**
+ * @brief Rewrites a privileged file through a sed-style substitution (`-S`).
+ *
+ * @param flags Pointer to the parsed flag states (substitution, sync mode, lock timeout).
+ * @param privileged_file_path The path to the privileged file.
+ * @return int `SUCCESS` on success (also when nothing matched), or an appropriate error code on failure.
+ */
+int executeSubstituteMode(const flag_state_t *flags, const char *privileged_file_path);
+
+/**
+ * @brief Prints the privileged files whose copies differ from them (`--verify`).
+ *
+ * @param copy_dir_path The directory holding the copies, named after their privileged files.
+ * @param privileged_files The privileged files, as given on the command line.
+ * @param count The number of `privileged_files`.
+ * @return int `SUCCESS` if every copy was checked, or the error of the first that could not be.
+ */
+int executeVerifyMode(const char *copy_dir_path, const char **privileged_files, size_t count);
+
+/**
+ * @brief Applies a unified diff to a privileged file (`-P`).
+ *
+ * @param flags Pointer to the parsed flag states (sync mode, lock timeout).
+ * @param patch_file_path The path to the patch file.
+ * @param privileged_file_path The path to the privileged file.
+ * @return int `SUCCESS` if every hunk was applied, or an appropriate error code on failure.
+ */
+int executePatchMode(const flag_state_t *flags, const char *patch_file_path, const char *privileged_file_path);
+
+/**
+ * @brief Lists the backups of a privileged file, or restores one of them (`--restore`).
+ *
+ * @param flags Pointer to the parsed flag states (restore version, sync mode, lock timeout).
+ * @param privileged_file_path The path to the privileged file.
+ * @return int `SUCCESS` on success, or an appropriate error code on failure.
+ */
+int executeRestoreMode(const flag_state_t *flags, const char *privileged_file_path);
+
+/**
+ * @brief Lists the copies taken by the user, or cleans them up (`--sessions`).
+ *
+ * @param clean Whether to remove the copies that do not differ from their privileged files, and forget gone ones.
+ * @return int `SUCCESS` if every copy was listed or cleaned up, or the error of the first that could not be.
+ */
+int executeSessionsMode(bool clean);
 
 #endif // FILE_MODES_H
@@ -0,0 +1,79 @@
+/**
+ * @file patch_handler.h
+ * @brief This header file contains declarations for the functions in patch_handler.c.
+ *
+ * The functions provided in this file read a unified diff and apply it to a file in a single
+ * forward pass, for the non-interactive `-P` mode.
+ *
+ * Functions:
+ * - int loadPatch(const char *patch_file_path, patch_t *patch);
+ * - void freePatch(patch_t *patch);
+ * - int applyPatch(int src_fd, int dest_fd, const patch_t *patch, patch_report_t *report);
+ */
+
+#ifndef PATCH_HANDLER_H
+#define PATCH_HANDLER_H
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <sys/types.h>
+
+#define PATCH_MAX_SIZE (64 * 1024 * 1024) // Largest patch file accepted
+#define PATCH_MAX_FUZZ 2 // Context lines that may be ignored at each end of a hunk, as with `patch`
+#define PATCH_SEARCH_LINES 1000 // Lines around its expected position searched for a hunk
+#define PATCH_SCAN_SIZE (256 * 1024) // Bytes read at once while counting lines between hunks
+
+/**
+ * @struct patch_line_t
+ * @brief One line of a hunk.
+ */
+typedef struct {
+    char type; ///< ' ' for context, '-' for a removed line, '+' for an added line.
+    const char *text; ///< Text of the line, without its newline, pointing into the patch.
+    size_t length; ///< Length of `text`.
+    bool newline; ///< The line ends with a newline (no "\ No newline at end of file" after it).
+} patch_line_t;
+
+/**
+ * @struct patch_hunk_t
+ * @brief One hunk of a unified diff.
+ */
+typedef struct {
+    size_t old_start; ///< First line of the hunk in the original file, from 1 (0 for an empty range).
+    size_t old_count; ///< Context and removed lines.
+    size_t new_count; ///< Context and added lines.
+    patch_line_t *lines; ///< Lines of the hunk, in order.
+    size_t line_count; ///< Number of `lines`.
+    size_t leading_context; ///< Context lines before the first change.
+    size_t trailing_context; ///< Context lines after the last change.
+} patch_hunk_t;
+
+/**
+ * @struct patch_t
+ * @brief A unified diff of one file.
+ */
+typedef struct {
+    char *content; ///< Content of the patch file, which the hunk lines point into.
+    patch_hunk_t *hunks; ///< Hunks, in file order.
+    size_t hunk_count; ///< Number of `hunks`.
+} patch_t;
+
+/**
+ * @struct patch_report_t
+ * @brief How each hunk of a patch was applied.
+ */
+typedef struct {
+    size_t applied; ///< Hunks applied.
+    size_t moved; ///< Applied hunks found away from the line given in their header.
+    size_t fuzzed; ///< Applied hunks that needed context lines to be ignored.
+    size_t rejected; ///< Hunks whose lines were not found.
+    size_t first_rejected; ///< Number of the first rejected hunk, from 1, or 0 if none.
+} patch_report_t;
+
+int loadPatch(const char *patch_file_path, patch_t *patch);
+
+void freePatch(patch_t *patch);
+
+int applyPatch(int src_fd, int dest_fd, const patch_t *patch, patch_report_t *report);
+
+#endif
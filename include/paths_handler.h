@@ -2,28 +2,32 @@
  * @file paths_handler.h
  * @brief This header file contains declarations for functions in paths_handler.c.
  *
- * This functions allow for resolving and validating paths based on command-line arguments,
- * converting relative paths to absolute paths, validating file paths for read/write permissions,
- * and creating paths if they do not exist.
+ * This functions allow for converting relative paths to absolute paths, validating file paths
+ * for read/write permissions, and creating the per-user data directories. The command-line
+ * arguments are resolved to paths by args_handler.h.
  *
  * Functions:
- * - int resolveAndValidatePaths(int argc, char *argv[], const flag_state_t *flags,
- *                              char copy_file_path[PATH_MAX], char privileged_file_path[PATH_MAX]);
+ * - void normalizeSlashes(const char *input_path, char normalized_path[PATH_MAX]);
  * - int getAbsolutePath(const char *original_path, char resolved_path[]);
  * - int getAbsolutePathFuture(const char *original_path, char resolved_path[]);
  * - int getAbsFilePathFromDir(char path[PATH_MAX], const char *file_name);
  * - int validatePath(const char path[PATH_MAX], bool check_read, bool check_write);
- * - int validateOrCreatePath(const char path[], bool check_read, bool check_write);
+ * - int createDirRecursively(const char *path);
+ * - int openUserDataDir(const char *relative_dir, int *dir_fd, uid_t *ef_uid);
+
+int getStoreEntryPath(const char *store_dir, const char *key_path, const char *second_key_path,
+                      char entry_path[PATH_MAX]);
+ * - int getStoreEntryPath(const char *store_dir, const char *key_path, const char *second_key_path,
+ *                         char entry_path[PATH_MAX]);
  */
 #ifndef PATHS_HANDLE_H
 #define PATHS_HANDLE_H
 
 #include <linux/limits.h>
-#include "flags_handler.h"
 #include <stdbool.h>
+#include <sys/types.h>
 
-int resolveAndValidatePaths(int argc, char *argv[], const flag_state_t *flags,
-                            char copy_file_path[PATH_MAX], char privileged_file_path[PATH_MAX]);
+void normalizeSlashes(const char *input_path, char normalized_path[PATH_MAX]);
 
 int getAbsolutePath(const char *original_path, char resolved_path[PATH_MAX]);
 
@@ -33,6 +37,11 @@ int getAbsFilePathFromDir(char path[PATH_MAX], const char *file_name);
 
 int validatePath(const char path[PATH_MAX], bool check_read, bool check_write);
 
-int validateOrCreatePath(const char path[PATH_MAX], bool check_read, bool check_write);
+int createDirRecursively(const char *path);
+
+int openUserDataDir(const char *relative_dir, int *dir_fd, uid_t *ef_uid);
+
+int getStoreEntryPath(const char *store_dir, const char *key_path, const char *second_key_path,
+                      char entry_path[PATH_MAX]);
 
 #endif
@@ -0,0 +1,29 @@
+/**
+ * @file pristine_handler.h
+ * @brief This header file contains declarations for the functions in pristine_handler.c.
+ *
+ * The functions provided in this file keep reflinked clones of freshly made copies, keyed
+ * by the identity and change state of their privileged file, so copying an unchanged file
+ * again clones the cached copy instead of reading the privileged file.
+ *
+ * Functions:
+ * - int clonePristineCopy(const struct stat *prv_stat, const char *dest, const copy_options_t *options);
+ * - int storePristineCopy(const char *copy_file_path, const struct stat *prv_stat);
+ */
+
+#ifndef PRISTINE_HANDLER_H
+#define PRISTINE_HANDLER_H
+
+#include <sys/stat.h>
+#include "baseline_handler.h"
+#include "file_operations.h"
+
+#define PRISTINE_DIR REDIT_STATE_DIR "/pristine" // Pristine copies, one per unchanged privileged file
+#define PRISTINE_MAX_BYTES (8LL * 1024 * 1024 * 1024) // Apparent size of the cache before evicting the LRU entries
+#define PRISTINE_MAX_ENTRIES 512 // Cached copies before evicting the least recently used
+
+int clonePristineCopy(const struct stat *prv_stat, const char *dest, const copy_options_t *options);
+
+int storePristineCopy(const char *copy_file_path, const struct stat *prv_stat);
+
+#endif
@@ -0,0 +1,33 @@
+/**
+ * @file progress_handler.h
+ * @brief This header file contains declarations for the functions in progress_handler.c.
+ *
+ * The functions provided in this file report how far a long copy got, its throughput and
+ * when it should end: continuously on a terminal, and once per `SIGUSR1` otherwise.
+ *
+ * Functions:
+ * - void progressStart(bool live);
+ * - void progressBegin(const char *label, off_t total, const char *engine);
+ * - void progressAdd(off_t bytes);
+ * - void progressEnd();
+ */
+
+#ifndef PROGRESS_HANDLER_H
+#define PROGRESS_HANDLER_H
+
+#include <stdbool.h>
+#include <sys/types.h>
+
+#define PROGRESS_TICK_NS 100000000ULL // How often the reporting thread looks for a SIGUSR1
+#define PROGRESS_REDRAW_NS 500000000ULL // How often the live line is redrawn
+#define PROGRESS_DELAY_NS 1000000000ULL // Copies shorter than this never show a live line
+
+void progressStart(bool live);
+
+void progressBegin(const char *label, off_t total, const char *engine);
+
+void progressAdd(off_t bytes);
+
+void progressEnd();
+
+#endif
@@ -0,0 +1,169 @@
+/**
+ * @file redit.h
+ * @brief C API of the `redit` library, declaring the functions in redit.c.
+ *
+ * The functions provided in this file copy a privileged file to a user-editable copy,
+ * overwrite it back (merging concurrent changes), snapshot file metadata and resolve
+ * paths, rewrite a privileged file through a sed-style substitution or a unified diff, check
+ * which copies differ from their privileged files, and restore the versions backed up before
+ * each overwrite. A copy can hold only a range of lines of the privileged file,
+ * which the overwrite then splices back. They take option structs, fill structured results and
+ * never print, so they can be embedded in long-running programs. The `redit` executable is a
+ * client of them.
+ *
+ * The functions share process-wide state (the `--stats` accounting, the trace file and the
+ * progress display), so they are not thread-safe: a program calling them from several threads
+ * must serialize the calls, e.g. behind one mutex. Only these functions and `getErrorMessage`
+ * are exported by `libredit.so`.
+ *
+ * Functions:
+ * - redit_options_t reditDefaultOptions();
+ * - int reditCopy(const char *privileged_file_path, const char *copy_file_path, const redit_options_t *options,
+ *                 redit_result_t *result);
+ * - int reditOverwrite(const char *copy_file_path, const char *privileged_file_path, const redit_options_t *options,
+ *                      redit_result_t *result);
+ * - int reditSubstitute(const char *privileged_file_path, const char *expression, const redit_options_t *options,
+ *                      redit_result_t *result);
+ * - int reditPatch(const char *privileged_file_path, const char *patch_file_path, const redit_options_t *options,
+ *                  redit_result_t *result);
+ * - int reditVerify(redit_verify_t *pairs, size_t count);
+ * - int reditListBackups(const char *privileged_file_path, redit_backup_t **backups, size_t *count);
+ * - int reditRestore(const char *privileged_file_path, size_t version, const redit_options_t *options,
+ *                    redit_result_t *result);
+ * - int reditSnapshotMetadata(const char *file_path, redit_metadata_t *metadata);
+ * - int reditResolvePath(const char *path, bool must_exist, char resolved_path[PATH_MAX]);
+ */
+
+#ifndef REDIT_H
+#define REDIT_H
+
+#include <stdbool.h>
+#include <time.h>
+#include <linux/limits.h>
+#include <sys/types.h>
+#include "error_handler.h"
+#include "sync_handler.h"
+
+#define REDIT_EFFECTIVE_USER ((uid_t) -1) // Copy owner resolved from `SUDO_USER`, or the real user
+
+/**
+ * @struct redit_options_t
+ * @brief Options of a copy or overwrite. Start from `reditDefaultOptions()`.
+ */
+typedef struct {
+    sync_mode_t sync_mode; ///< Durability mode for written files.
+    bool direct_io; ///< Bypass the page cache for the copy.
+    bool recalibrate; ///< Measure the copy parameters again for these file systems.
+    double lock_timeout; ///< Seconds to wait for the file lock, negative to wait indefinitely.
+    uid_t copy_owner; ///< Owner given to the copy file, or `REDIT_EFFECTIVE_USER`.
+    bool keep_copy; ///< Keep the copy file after overwriting (overwrite only).
+    bool use_broker; ///< Open the privileged file through the `--broker` daemon instead of directly.
+    bool backup; ///< Back up the privileged file before overwriting it (not done through the broker).
+    bool pristine_cache; ///< Clone unchanged privileged files from the pristine-copy cache (copy only).
+    size_t first_line; ///< First line of the window to copy, from 1, or 0 to copy the whole file (copy only).
+    size_t last_line; ///< Last line of the window to copy, or 0 for the end of the file (copy only).
+    bool verify_write; ///< Read whole-file copies back from storage and check them (not through the broker).
+    double bandwidth_limit; ///< Most bytes per second a copy may move, 0 for no limit.
+    size_t max_threads; ///< Most threads a copy may use, 0 for as many as calibrated.
+    bool resumable; ///< Journal large copies, resuming them after an interruption (copy only).
+    bool decompress; ///< Edit gzip and Zstandard files decompressed, compressing them back (not through the broker).
+} redit_options_t;
+
+/**
+ * @struct redit_result_t
+ * @brief Outcome of a copy or overwrite, filled on success and on failure.
+ */
+typedef struct {
+    const char *failed_step; ///< Step that failed (e.g. "locking privileged file"), `NULL` on success.
+    double lock_waited; ///< Seconds spent waiting for another session to release the file lock.
+    double calibrated_throughput; ///< MB/s measured if the copy was calibrated during the call, 0 otherwise.
+    const char *engine; ///< Copy engine used.
+    size_t buffer_size; ///< Copy buffer size, in bytes.
+    size_t threads; ///< Concurrent copy streams.
+    off_t bytes; ///< Bytes copied.
+    bool cloned; ///< The copy was cloned from the pristine-copy cache instead of read from the privileged file.
+    off_t resumed_bytes; ///< Bytes left intact by an interrupted copy, which the copy resumed after.
+    const char *compression; ///< Codec the privileged file is compressed with ("gzip", "zstd"), or `NULL`.
+    bool merged; ///< Changes made to the privileged file since the copy were merged into the copy.
+    bool baseline_skipped; ///< The copy is too large for a merge baseline, so later changes will not be merged.
+    size_t conflicts; ///< Conflicting hunks written to the copy when the result is `ERROR_MERGE_CONFLICT`.
+    bool copy_removed; ///< The copy file and its baseline were removed after overwriting.
+    bool backed_up; ///< The privileged file was backed up before being replaced.
+    off_t backup_bytes; ///< Bytes the backup added to the store, after deduplication.
+    bool rolled_back; ///< The written file did not read back as copied and was restored from its backup.
+    bool windowed; ///< Only a range of lines was copied, or spliced back.
+    off_t window_offset; ///< Offset of the range in the privileged file.
+    off_t window_length; ///< Length of the range in the privileged file, before overwriting.
+    size_t substitutions; ///< Matches replaced by a substitution; the file is not written if there are none.
+    size_t hunks_applied; ///< Hunks of a patch applied.
+    size_t hunks_moved; ///< Applied hunks found away from the line given in their header.
+    size_t hunks_fuzzed; ///< Applied hunks that needed context lines to be ignored.
+    size_t hunks_rejected; ///< Hunks of a patch not found; the file is not written if there are any.
+    size_t first_rejected_hunk; ///< Number of the first rejected hunk, from 1, or 0 if none.
+} redit_result_t;
+
+/**
+ * @struct redit_verify_t
+ * @brief A copy and its privileged file, checked by `reditVerify`.
+ */
+typedef struct {
+    const char *copy_file_path; ///< Absolute path to the copy.
+    const char *privileged_file_path; ///< Absolute path to the privileged file.
+    bool changed; ///< The copy differs from what it was copied from, and the overwrite would change the file.
+    bool compared; ///< The content had to be read, the size and modification time not being enough.
+    int error; ///< `SUCCESS`, or what kept the pair from being checked (e.g. a missing copy, or the file itself).
+} redit_verify_t;
+
+/**
+ * @struct redit_backup_t
+ * @brief One backed up version of a privileged file.
+ */
+typedef struct {
+    struct timespec created; ///< When the version was backed up.
+    off_t size; ///< Size of the file.
+    mode_t mode; ///< Permissions of the file.
+    uid_t owner; ///< Owner of the file.
+    gid_t group; ///< Group of the file.
+} redit_backup_t;
+
+/**
+ * @struct redit_metadata_t
+ * @brief Identity, ownership and modification state of a file at one point in time.
+ */
+typedef struct {
+    dev_t device; ///< Device holding the file.
+    ino_t inode; ///< Inode number.
+    uid_t owner; ///< Owner user ID.
+    gid_t group; ///< Owner group ID.
+    mode_t mode; ///< Type and permission bits.
+    off_t size; ///< Size in bytes.
+    struct timespec modified; ///< Last content modification.
+    struct timespec changed; ///< Last status change.
+} redit_metadata_t;
+
+REDIT_API redit_options_t reditDefaultOptions();
+
+REDIT_API int reditCopy(const char *privileged_file_path, const char *copy_file_path, const redit_options_t *options,
+                        redit_result_t *result);
+
+REDIT_API int reditOverwrite(const char *copy_file_path, const char *privileged_file_path,
+                             const redit_options_t *options, redit_result_t *result);
+
+REDIT_API int reditSubstitute(const char *privileged_file_path, const char *expression,
+                              const redit_options_t *options, redit_result_t *result);
+
+REDIT_API int reditPatch(const char *privileged_file_path, const char *patch_file_path, const redit_options_t *options,
+                         redit_result_t *result);
+
+REDIT_API int reditVerify(redit_verify_t *pairs, size_t count);
+
+REDIT_API int reditListBackups(const char *privileged_file_path, redit_backup_t **backups, size_t *count);
+
+REDIT_API int reditRestore(const char *privileged_file_path, size_t version, const redit_options_t *options,
+                           redit_result_t *result);
+
+REDIT_API int reditSnapshotMetadata(const char *file_path, redit_metadata_t *metadata);
+
+REDIT_API int reditResolvePath(const char *path, bool must_exist, char resolved_path[PATH_MAX]);
+
+#endif
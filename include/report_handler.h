@@ -0,0 +1,17 @@
+/**
+ * @file report_handler.h
+ * @brief This header file contains declarations for the functions in report_handler.c.
+ *
+ * The functions provided in this file print the `--stats` report of a run, from the
+ * per-phase counters kept by stats_handler.h.
+ *
+ * Functions:
+ * - void printStatsReport();
+ */
+
+#ifndef REPORT_HANDLER_H
+#define REPORT_HANDLER_H
+
+void printStatsReport();
+
+#endif
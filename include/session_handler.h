@@ -0,0 +1,56 @@
+/**
+ * @file session_handler.h
+ * @brief This header file contains declarations for the functions in session_handler.c.
+ *
+ * The functions provided in this file remember which privileged file each copy was taken
+ * from, in a per-user index keyed by the inode of the copy, so the overwrite mode can be
+ * given the copy alone and `--sessions` can list and clean up the copies of a user.
+ *
+ * Functions:
+ * - int recordSession(const char *copy_file_path, const char *privileged_file_path);
+ * - int findSession(const char *copy_file_path, char privileged_file_path[PATH_MAX]);
+ * - int removeSession(const char *copy_file_path);
+ * - int listSessions(session_t **sessions, size_t *count);
+ * - int discardSession(const session_t *session, bool remove_copy);
+ */
+
+#ifndef SESSION_HANDLER_H
+#define SESSION_HANDLER_H
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <time.h>
+#include <linux/limits.h>
+#include <sys/types.h>
+#include "baseline_handler.h"
+
+#define SESSION_DIR REDIT_STATE_DIR "/sessions" // Session indexes, one per user
+#define SESSION_CAPACITY 1024 // Slots of a session index, a power of two
+#define SESSION_MAX_LOAD (SESSION_CAPACITY * 3 / 4) // Sessions kept before stale ones are pruned
+#define SESSION_PATH_SIZE 1024 // Longest path a session records, terminator included
+
+/**
+ * @struct session_t
+ * @brief A copy taken by the user, as listed by `listSessions`.
+ */
+typedef struct {
+    char copy_file_path[SESSION_PATH_SIZE]; ///< Absolute path to the copy file.
+    char privileged_file_path[SESSION_PATH_SIZE]; ///< Absolute path to the privileged file it was taken from.
+    time_t created; ///< When the copy was taken.
+    dev_t device; ///< Device of the copy file when its session was recorded.
+    ino_t inode; ///< Inode of the copy file when its session was recorded.
+    bool copy_exists; ///< The copy file is still there (possibly saved under a new inode by an editor).
+    bool prv_changed; ///< The privileged file changed, or is gone, since the copy was taken.
+} session_t;
+
+int recordSession(const char *copy_file_path, const char *privileged_file_path);
+
+int findSession(const char *copy_file_path, char privileged_file_path[PATH_MAX]);
+
+int removeSession(const char *copy_file_path);
+
+int listSessions(session_t **sessions, size_t *count);
+
+int discardSession(const session_t *session, bool remove_copy);
+
+#endif
@@ -0,0 +1,113 @@
+/**
+ * @file stats_handler.h
+ * @brief This header file contains declarations for the functions in stats_handler.c.
+ *
+ * The functions provided in this file split a run into phases and account, for each
+ * phase, the elapsed time, the system calls made and the bytes read and written, so
+ * `--stats` can show where the time of a run goes. Phases and I/O calls are also
+ * recorded as `--trace` spans. The report itself is printed by report_handler.h.
+ *
+ * Functions:
+ * - int parseStatsFormat(const char *value, stats_format_t *format);
+ * - void statsStart();
+ * - void statsEnable(stats_format_t format);
+ * - stats_phase_t statsEnterPhase(stats_phase_t phase);
+ * - uint64_t statsNow();
+ * - uint64_t statsNow();
+
+void statsCountSyscall();
+ * - ssize_t statsPread(int fd, void *buffer, size_t count, off_t offset);
+ * - ssize_t statsPwrite(int fd, const void *buffer, size_t count, off_t offset);
+ * - ssize_t statsCopyFileRange(int fd_in, off_t *off_in, int fd_out, off_t *off_out, size_t length, unsigned int flags);
+ * - uint64_t statsSnapshot(stats_counters_t counters[STATS_PHASE_COUNT]);
+ * - stats_format_t getStatsFormat();
+ * - const char *getStatsPhaseName(stats_phase_t phase);
+ * - void statsFinish();
+ */
+
+#ifndef STATS_HANDLER_H
+#define STATS_HANDLER_H
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <sys/types.h>
+
+/**
+ * @enum stats_format_t
+ * @brief Output formats of the `--stats` report.
+ */
+typedef enum {
+    STATS_OFF = 0, ///< No report (default).
+    STATS_TABLE, ///< Human-readable table.
+    STATS_JSON ///< One JSON object, for automation.
+} stats_format_t;
+
+/**
+ * @enum stats_phase_t
+ * @brief Phases of a run, in the order they usually happen.
+ */
+typedef enum {
+    STATS_PHASE_FLAGS = 0, ///< Command-line parsing.
+    STATS_PHASE_PATHS, ///< Path resolution and validation.
+    STATS_PHASE_TUNING, ///< Copy calibration lookup (or measurement).
+    STATS_PHASE_IDENTITY, ///< Effective user, owner and permission lookups.
+    STATS_PHASE_LOCK, ///< Waiting for the privileged file lock.
+    STATS_PHASE_MERGE, ///< Merging concurrent changes into the copy.
+    STATS_PHASE_COPY, ///< Copying file content.
+    STATS_PHASE_BASELINE, ///< Storing or removing the merge baseline.
+    STATS_PHASE_OWNERSHIP, ///< Restoring owner and permissions.
+    STATS_PHASE_SYNC, ///< Flushing written files to disk.
+    STATS_PHASE_EDITOR, ///< Running the editor.
+    STATS_PHASE_BACKUP, ///< Backing up the privileged file before it is replaced (appended, to keep history indices).
+    STATS_PHASE_INDEX, ///< Locating a range of lines in the privileged file.
+    STATS_PHASE_SUBSTITUTE, ///< Streaming the privileged file through a substitution.
+    STATS_PHASE_PATCH, ///< Applying a unified diff to the privileged file.
+    STATS_PHASE_VERIFY, ///< Checking which copies differ from their privileged files.
+    STATS_PHASE_COUNT ///< Number of phases.
+} stats_phase_t;
+
+/**
+ * @struct stats_counters_t
+ * @brief What a run has spent in one phase so far.
+ */
+typedef struct {
+    uint64_t elapsed_ns; ///< Time spent in the phase.
+    bool entered; ///< Whether the run went through the phase.
+    uint64_t syscalls; ///< System calls made, counted only once `statsEnable` was called.
+    uint64_t bytes_read; ///< Bytes read from files, counted only once `statsEnable` was called.
+    uint64_t bytes_written; ///< Bytes written to files, counted only once `statsEnable` was called.
+} stats_counters_t;
+
+/**
+ * @brief Counts the system call made by `call` in the current phase and evaluates to its result.
+ */
+#define STATS_SYSCALL(call) (statsCountSyscall(), (call))
+
+int parseStatsFormat(const char *value, stats_format_t *format);
+
+void statsStart();
+
+void statsEnable(stats_format_t format);
+
+stats_phase_t statsEnterPhase(stats_phase_t phase);
+
+uint64_t statsNow();
+
+void statsCountSyscall();
+
+ssize_t statsPread(int fd, void *buffer, size_t count, off_t offset);
+
+ssize_t statsPwrite(int fd, const void *buffer, size_t count, off_t offset);
+
+ssize_t statsCopyFileRange(int fd_in, off_t *off_in, int fd_out, off_t *off_out, size_t length, unsigned int flags);
+
+uint64_t statsSnapshot(stats_counters_t counters[STATS_PHASE_COUNT]);
+
+stats_format_t getStatsFormat();
+
+const char *getStatsPhaseName(stats_phase_t phase);
+
+void statsFinish();
+
+#endif
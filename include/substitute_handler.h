@@ -0,0 +1,45 @@
+/**
+ * @file substitute_handler.h
+ * @brief This header file contains declarations for the functions in substitute_handler.c.
+ *
+ * The functions provided in this file parse a sed-style substitution (`s/regex/replacement/flags`)
+ * and stream a file through it line by line, for the non-interactive `-S` mode.
+ *
+ * Functions:
+ * - int parseSubstitution(const char *expression, substitution_t *substitution);
+ * - void freeSubstitution(substitution_t *substitution);
+ * - int substituteStream(int src_fd, int dest_fd, const substitution_t *substitution, size_t *substitutions,
+ *                        off_t *bytes_written);
+ */
+
+#ifndef SUBSTITUTE_HANDLER_H
+#define SUBSTITUTE_HANDLER_H
+
+#include <regex.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include <sys/types.h>
+
+#define SUBSTITUTE_BUFFER_SIZE (1024 * 1024) // Bytes read and written at once while substituting
+#define SUBSTITUTE_MAX_LITERAL 64 // Longest literal kept to prefilter lines
+
+/**
+ * @struct substitution_t
+ * @brief A compiled substitution.
+ */
+typedef struct {
+    regex_t regex; ///< Compiled POSIX extended regular expression.
+    char *replacement; ///< Replacement, with escaped delimiters resolved; `&` and `\1`... are expanded per match.
+    bool global; ///< Replace every match of a line (`g`), not only the first.
+    char literal[SUBSTITUTE_MAX_LITERAL]; ///< Text every match contains, to skip lines without it.
+    size_t literal_length; ///< Length of `literal`, 0 if no line can be skipped.
+} substitution_t;
+
+int parseSubstitution(const char *expression, substitution_t *substitution);
+
+void freeSubstitution(substitution_t *substitution);
+
+int substituteStream(int src_fd, int dest_fd, const substitution_t *substitution, size_t *substitutions,
+                     off_t *bytes_written);
+
+#endif
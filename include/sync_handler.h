@@ -0,0 +1,48 @@
+/**
+ * @file sync_handler.h
+ * @brief This header file contains declarations for the functions in sync_handler.c.
+ *
+ * The functions provided in this file flush written files to stable storage according
+ * to the durability mode selected with `--sync`.
+ *
+ * Functions:
+ * - int parseSyncMode(const char *value, sync_mode_t *mode);
+ * - int syncFile(int fd, const char *file_path, sync_mode_t mode, sync_group_t *group);
+ * - int flushSyncGroup(sync_group_t *group);
+ */
+
+#ifndef SYNC_HANDLER_H
+#define SYNC_HANDLER_H
+
+#include <stddef.h>
+#include <sys/types.h>
+
+/**
+ * @enum sync_mode_t
+ * @brief Durability modes for written files.
+ */
+typedef enum {
+    SYNC_NONE = 0, ///< Leave flushing to the kernel (default).
+    SYNC_DATA, ///< `fdatasync` each file after it is written.
+    SYNC_FULL, ///< `fsync` each file and its parent directory.
+    SYNC_GROUP ///< Defer flushing to one `syncfs` per file system at the end of the run.
+} sync_mode_t;
+
+/**
+ * @struct sync_group_t
+ * @brief File systems written during a run in `SYNC_GROUP` mode.
+ */
+typedef struct {
+    dev_t *devices; ///< Device of each file system written to.
+    int *fds; ///< A descriptor on each file system, used for `syncfs`.
+    size_t count; ///< Number of file systems recorded.
+    size_t capacity; ///< Allocated entries.
+} sync_group_t;
+
+int parseSyncMode(const char *value, sync_mode_t *mode);
+
+int syncFile(int fd, const char *file_path, sync_mode_t mode, sync_group_t *group);
+
+int flushSyncGroup(sync_group_t *group);
+
+#endif
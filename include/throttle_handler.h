@@ -0,0 +1,72 @@
+/**
+ * @file throttle_handler.h
+ * @brief This header file contains declarations for the functions in throttle_handler.c.
+ *
+ * The functions provided in this file keep a run from competing with the services of a busy
+ * host: they lower its I/O priority (`--ionice`), confine it to a number of CPUs (`--cpus`)
+ * and pace its copies to a bandwidth (`--bwlimit`).
+ *
+ * Functions:
+ * - int parseIoPriority(const char *value, io_priority_t *priority);
+ * - int setIoPriority(const io_priority_t *priority);
+ * - int limitCpus(size_t cpus);
+ * - size_t countCpus();
+ * - void initThrottle(throttle_t *throttle, double bytes_per_second);
+ * - void throttleBytes(throttle_t *throttle, size_t bytes);
+ * - void destroyThrottle(throttle_t *throttle);
+ */
+
+#ifndef THROTTLE_HANDLER_H
+#define THROTTLE_HANDLER_H
+
+#include <pthread.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#define IO_PRIORITY_LEVELS 8 // Best-effort levels, from 0 (highest) to 7 (lowest)
+#define THROTTLE_BURST_NS 100000000ULL // Unused bandwidth carried over, in nanoseconds of the rate
+
+/**
+ * @enum io_class_t
+ * @brief I/O scheduling classes a run can be put in.
+ */
+typedef enum {
+    IO_CLASS_DEFAULT = 0, ///< Leave the priority inherited from the parent process.
+    IO_CLASS_BEST_EFFORT, ///< Best effort, at a given level.
+    IO_CLASS_IDLE ///< Served only when no other process needs the disk.
+} io_class_t;
+
+/**
+ * @struct io_priority_t
+ * @brief I/O priority selected with `--ionice`.
+ */
+typedef struct {
+    io_class_t io_class; ///< Scheduling class.
+    int level; ///< Level within `IO_CLASS_BEST_EFFORT`, from 0 to `IO_PRIORITY_LEVELS - 1`.
+} io_priority_t;
+
+/**
+ * @struct throttle_t
+ * @brief Token bucket pacing the threads of a copy to a shared bandwidth.
+ */
+typedef struct {
+    pthread_mutex_t mutex; ///< Guards `next_ns`.
+    double bytes_per_second; ///< Bandwidth the bytes are paced to.
+    uint64_t next_ns; ///< Time at which the bytes accounted so far have been paid for.
+} throttle_t;
+
+int parseIoPriority(const char *value, io_priority_t *priority);
+
+int setIoPriority(const io_priority_t *priority);
+
+int limitCpus(size_t cpus);
+
+size_t countCpus();
+
+void initThrottle(throttle_t *throttle, double bytes_per_second);
+
+void throttleBytes(throttle_t *throttle, size_t bytes);
+
+void destroyThrottle(throttle_t *throttle);
+
+#endif
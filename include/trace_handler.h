@@ -0,0 +1,30 @@
+/**
+ * @file trace_handler.h
+ * @brief This header file contains declarations for the functions in trace_handler.c.
+ *
+ * The functions provided in this file record the spans of a run (phases, path
+ * resolutions, copies and their I/O calls, editor waits) as Chrome trace events,
+ * which can be loaded into `chrome://tracing` or Perfetto.
+ *
+ * Functions:
+ * - int traceOpen(const char *trace_path, uid_t owner);
+ * - void traceClose();
+ * - uint64_t traceNow();
+ * - void traceSpan(const char *category, const char *name, uint64_t start_ns, const char *path, long long bytes);
+ */
+
+#ifndef TRACE_HANDLER_H
+#define TRACE_HANDLER_H
+
+#include <stdint.h>
+#include <sys/types.h>
+
+int traceOpen(const char *trace_path, uid_t owner);
+
+void traceClose();
+
+uint64_t traceNow();
+
+void traceSpan(const char *category, const char *name, uint64_t start_ns, const char *path, long long bytes);
+
+#endif
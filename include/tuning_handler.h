@@ -0,0 +1,31 @@
+/**
+ * @file tuning_handler.h
+ * @brief This header file contains declarations for the functions in tuning_handler.c.
+ *
+ * The functions provided in this file pick the copy engine, buffer size and number of
+ * threads for a pair of file systems by measuring them once, and remember the result
+ * in a per-user calibration cache.
+ *
+ * Functions:
+ * - int tuneCopyOptions(const char *src, const char *dest, bool recalibrate, copy_options_t *options,
+ *                       double *calibrated_throughput);
+ * - int clearCalibrationCache();
+ */
+
+#ifndef TUNING_HANDLER_H
+#define TUNING_HANDLER_H
+
+#include <stdbool.h>
+#include "file_operations.h"
+
+#define CALIBRATION_DIR ".cache/redit" // Calibration cache directory, relative to the user's home
+#define CALIBRATION_FILE "calibration" // Calibration cache file name
+#define CALIBRATION_MIN_SIZE (8 * 1024 * 1024) // Smaller copies do not trigger a calibration
+#define CALIBRATION_SAMPLE_SIZE (8 * 1024 * 1024) // Bytes copied by each calibration run
+
+int tuneCopyOptions(const char *src, const char *dest, bool recalibrate, copy_options_t *options,
+                    double *calibrated_throughput);
+
+int clearCalibrationCache();
+
+#endif
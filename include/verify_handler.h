@@ -0,0 +1,38 @@
+/**
+ * @file verify_handler.h
+ * @brief This header file contains declarations for the functions in verify_handler.c.
+ *
+ * The functions provided in this file find which copies differ from their privileged files,
+ * deciding on metadata when it is enough and comparing content across threads otherwise,
+ * for `--verify`.
+ *
+ * Functions:
+ * - int verifyPairs(verify_pair_t *pairs, size_t count, size_t threads);
+ */
+
+#ifndef VERIFY_HANDLER_H
+#define VERIFY_HANDLER_H
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <sys/types.h>
+
+#define VERIFY_MAX_THREADS 16 // Most threads comparing content at once
+#define VERIFY_CHUNK_SIZE (8 * 1024 * 1024) // Bytes of one pair a thread compares before taking more work
+#define VERIFY_BUFFER_SIZE (256 * 1024) // Bytes read from each file at once
+
+/**
+ * @struct verify_pair_t
+ * @brief A copy and its privileged file, and whether they differ.
+ */
+typedef struct {
+    const char *copy_file_path; ///< Absolute path to the copy.
+    const char *privileged_file_path; ///< Absolute path to the privileged file.
+    bool changed; ///< Set if the copy differs from the privileged file (or the range of it the copy holds).
+    bool compared; ///< Set if the content had to be read, because the metadata was not enough to decide.
+    int error; ///< Set to `SUCCESS`, or to the error that kept the pair from being checked.
+} verify_pair_t;
+
+int verifyPairs(verify_pair_t *pairs, size_t count, size_t threads);
+
+#endif
@@ -0,0 +1,69 @@
+/**
+ * @file window_handler.h
+ * @brief This header file contains declarations for the functions in window_handler.c.
+ *
+ * The functions provided in this file copy a range of lines of a large privileged file
+ * (`--lines`) instead of all of it, and splice the edited range back on overwrite. Line
+ * offsets are found through a per-file line index that is kept between runs.
+ *
+ * Functions:
+ * - int parseLineRange(const char *value, size_t *first_line, size_t *last_line);
+ * - int locateLines(int fd, const char *file_path, const struct stat *file_stat, size_t first_line,
+ *                   size_t last_line, off_t *offset, off_t *length);
+ * - int truncateLineIndex(const char *file_path, const struct stat *old_stat, const struct stat *new_stat,
+ *                         off_t valid_offset);
+ * - int copyByteRange(int src_fd, off_t src_offset, int dest_fd, off_t dest_offset, off_t length);
+ * - int spliceRange(int fd, off_t offset, off_t old_length, int src_fd, off_t new_length, off_t *written);
+ * - int saveWindow(const char *copy_file_path, const char *privileged_file_path, const window_t *window);
+ * - int loadWindow(const char *copy_file_path, const char *privileged_file_path, window_t *window);
+ * - int removeWindow(const char *copy_file_path, const char *privileged_file_path);
+ */
+
+#ifndef WINDOW_HANDLER_H
+#define WINDOW_HANDLER_H
+
+#include <stddef.h>
+#include <time.h>
+#include <sys/stat.h>
+#include <sys/types.h>
+#include "baseline_handler.h"
+
+#define LINE_INDEX_DIR REDIT_STATE_DIR "/lines" // Line indexes, one per privileged file
+#define LINE_INDEX_STRIDE 1024 // Lines between two offsets recorded in an index
+#define LINE_SCAN_SIZE (1024 * 1024) // Bytes read at once while scanning for newlines
+
+/**
+ * @struct window_t
+ * @brief A range of lines copied out of a privileged file, and the state of the file at that time.
+ */
+typedef struct {
+    off_t offset; ///< Offset of the first byte of the range in the privileged file.
+    off_t length; ///< Length of the range in the privileged file.
+    size_t first_line; ///< First line of the range, from 1.
+    size_t last_line; ///< Last line of the range, or 0 for the end of the file.
+    dev_t device; ///< Device of the privileged file.
+    ino_t inode; ///< Inode of the privileged file.
+    off_t size; ///< Size of the privileged file.
+    struct timespec modified; ///< Modification time of the privileged file.
+    struct timespec changed; ///< Status change time of the privileged file.
+} window_t;
+
+int parseLineRange(const char *value, size_t *first_line, size_t *last_line);
+
+int locateLines(int fd, const char *file_path, const struct stat *file_stat, size_t first_line, size_t last_line,
+                off_t *offset, off_t *length);
+
+int truncateLineIndex(const char *file_path, const struct stat *old_stat, const struct stat *new_stat,
+                      off_t valid_offset);
+
+int copyByteRange(int src_fd, off_t src_offset, int dest_fd, off_t dest_offset, off_t length);
+
+int spliceRange(int fd, off_t offset, off_t old_length, int src_fd, off_t new_length, off_t *written);
+
+int saveWindow(const char *copy_file_path, const char *privileged_file_path, const window_t *window);
+
+int loadWindow(const char *copy_file_path, const char *privileged_file_path, window_t *window);
+
+int removeWindow(const char *copy_file_path, const char *privileged_file_path);
+
+#endif
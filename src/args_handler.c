@@ -0,0 +1,218 @@
+#include <stdio.h>
+#include <linux/limits.h>
+#include <unistd.h>
+#include <sys/stat.h>
+#include <string.h>
+#include <libgen.h>
+#include <errno.h>
+
+#include "../include/error_handler.h"
+#include "../include/args_handler.h"
+#include "../include/paths_handler.h"
+#include "../include/flags_handler.h"
+#include "../include/file_utils.h"
+#include "../include/session_handler.h"
+#include "../include/stats_handler.h"
+
+/**
+ * @file args_handler.c
+ * @brief Provides functions to turn the command-line parameters of `redit` into file paths.
+ *
+ * This file contains the command-line side of path handling: it reports usage errors and
+ * prompts the user before creating a missing copy directory, so it is part of the executable
+ * and not of the library. The path utilities themselves live in paths_handler.c.
+ */
+
+// Function prototypes
+static bool resolveSessionPaths(const char *copy_arg, const char *cwd, char copy_file_path[PATH_MAX],
+                                char privileged_file_path[PATH_MAX]);
+
+/**
+ * @brief Resolves and validates paths for copy and overwrite operations.
+ *
+ * @param argc The number of command-line arguments.
+ * @param argv The array of command-line arguments.
+ * @param flags Pointer to the structure storing the parsed flag states.
+ * @param copy_file_path Buffer to store the resolved copy file path.
+ * @param privileged_file_path Buffer to store the resolved privileged file path.
+ * @return `SUCCESS` if paths are resolved and validated successfully, or an error code otherwise.
+ *
+ * @details
+ * - Handles both file and directory copy paths.
+ * - In overwrite mode, a lone parameter may be a copy: its session names the privileged file.
+ * - Resolves absolute paths for both source and destination files.
+ * - Validates that paths exist and meet access requirements.
+ */
+int resolveAndValidatePaths(const int argc, char *argv[], const flag_state_t *flags,
+                            char copy_file_path[PATH_MAX], char privileged_file_path[PATH_MAX]) {
+    // Checks if the 'd' or 'D' flag is set
+    // This means that the user has specified a directory or file path for the copy file
+    if (flags->copied_file_path || flags->copied_dir_path) {
+        // Check if there is the right number of arguments
+        if (flags->param_index + 1 >= argc) {
+            fprintf(stderr, "Usage: %s -C /path/to/copy/file /path/to/original/file\n%s\n", argv[0], tryHelpMessage());
+            return ERROR_INVALID_ARGUMENT;
+        }
+
+        // Get the absolute path of the privileged file
+        const int prv_path_result = getAbsolutePath(argv[flags->param_index + 1], privileged_file_path);
+        if (prv_path_result != SUCCESS) {
+            return printError(prv_path_result, "resolving privileged file path");
+        }
+
+        // Validate the privileged file path
+        const int prv_valid_result = validatePath(privileged_file_path, true, false);
+        if (prv_valid_result != SUCCESS) {
+            return printError(prv_valid_result, "validating privileged file path");
+        }
+
+        // Get the absolute path of the copy file
+        const int cpy_path_result = getAbsolutePathFuture(argv[flags->param_index], copy_file_path);
+        if (cpy_path_result != SUCCESS) {
+            return printError(cpy_path_result, "resolving copy file path");
+        }
+
+        // Check whether the user has specified a directory path for the copy file
+        if (flags->copied_dir_path) {
+            // Since the path is a directory, we need to get the base name of the privileged file
+            // and append it to the copy file path
+            const char *file_base_name = basename(privileged_file_path); // Get the base name of the privileged file
+            const int abs_file_path_result = getAbsFilePathFromDir(copy_file_path, file_base_name);
+            // Append the base name to the copy file path
+            if (abs_file_path_result != SUCCESS) {
+                return printError(abs_file_path_result, "getting absolute file path from directory");
+            }
+        }
+
+        // Validate the copy file path and create it if it doesn't exist
+        const int validation_result = validateOrCreatePath(copy_file_path, true, false);
+        if (validation_result != SUCCESS) {
+            return printError(validation_result, "validating copy file path");
+        }
+    } else {
+        // Check if there is the right number of arguments
+        if (flags->param_index >= argc) {
+            fprintf(stderr, "Usage: %s -C /path/to/original/file\n%s\n", argv[0], tryHelpMessage());
+            return ERROR_INVALID_ARGUMENT;
+        }
+
+        // Resolve current working directory
+        char cwd[PATH_MAX];
+        const int cwd_result = getCurrentWorkingDirectory(cwd);
+        if (cwd_result != SUCCESS) {
+            return printError(cwd_result, "resolving current working directory");
+        }
+
+        // A copy taken earlier knows its privileged file
+        if (flags->overwrite_mode &&
+            resolveSessionPaths(argv[flags->param_index], cwd, copy_file_path, privileged_file_path)) {
+            const int prv_valid_result = validatePath(privileged_file_path, true, false);
+            if (prv_valid_result != SUCCESS) {
+                return printError(prv_valid_result, "validating privileged file path");
+            }
+            return SUCCESS;
+        }
+
+        // Get the absolute path of the privileged file
+        const int prv_path_result = getAbsolutePath(argv[flags->param_index], privileged_file_path);
+        if (prv_path_result != SUCCESS) {
+            return printError(prv_path_result, "resolving privileged file path");
+        }
+
+        // Validate the privileged file path
+        const int prv_validation_result = validatePath(privileged_file_path, true, false);
+        if (prv_validation_result != SUCCESS) {
+            return printError(prv_validation_result, "validating privileged file path");
+        }
+
+        // Since the user has not specified a copy file path, we need to create one
+        // by appending the base name of the privileged file to the current working directory
+        const char *base_name = basename(privileged_file_path); // Get the base name of the privileged file
+        snprintf(copy_file_path, strlen(cwd) + strlen(base_name) + 2, "%s/%s", cwd, base_name);
+        // Append the base name to the current working directory
+
+        // Validate the copy file path and create it if it doesn't exist
+        const int validation_result = validatePath(copy_file_path, false, true);
+        if (validation_result != SUCCESS) {
+            return printError(validation_result, "validating copy file path");
+        }
+    }
+
+    return SUCCESS;
+}
+
+/**
+ * @brief Resolves the paths of an overwrite from the session of the copy given as its parameter.
+ *
+ * @param copy_arg Parameter of the overwrite.
+ * @param cwd Current working directory.
+ * @param copy_file_path Buffer to store the resolved copy file path.
+ * @param privileged_file_path Buffer to store the privileged file path recorded by the session.
+ * @return `true` if the parameter is a copy with a session, `false` to take it as the privileged file.
+ *
+ * @details
+ * - A privileged file whose copy sits in the current directory is still taken as such, as before sessions.
+ */
+static bool resolveSessionPaths(const char *copy_arg, const char *cwd, char copy_file_path[PATH_MAX],
+                                char privileged_file_path[PATH_MAX]) {
+    if (getAbsolutePath(copy_arg, copy_file_path) != SUCCESS ||
+        findSession(copy_file_path, privileged_file_path) != SUCCESS) {
+        return false;
+    }
+
+    char name[PATH_MAX], cwd_copy_path[PATH_MAX];
+    snprintf(name, sizeof(name), "%s", copy_file_path);
+    snprintf(cwd_copy_path, sizeof(cwd_copy_path), "%s", cwd);
+    return getAbsFilePathFromDir(cwd_copy_path, basename(name)) != SUCCESS ||
+           strcmp(cwd_copy_path, copy_file_path) == 0 || STATS_SYSCALL(access(cwd_copy_path, F_OK)) == -1;
+}
+
+/**
+ * @brief Validates a path or creates it if it doesn't exist.
+ *
+ * @param path The path to validate or create.
+ * @param check_read Check for read permissions.
+ * @param check_write Check for write permissions.
+ * @return `SUCCESS` if valid or created successfully, or an error code otherwise.
+ */
+int validateOrCreatePath(const char path[PATH_MAX], const bool check_read, const bool check_write) {
+    struct stat path_stat;
+    char path_copy[PATH_MAX];
+    strcpy(path_copy, path); // Make a copy of the path to avoid modifying the original
+    const char *path_dir = dirname(path_copy); // Get the directory of the path
+
+    // Check if the path exists
+    if (STATS_SYSCALL(stat(path_dir, &path_stat)) == -1) {
+        if (errno == ENOENT) {
+            // Prompt the user to create the directory if it doesn't exist
+            printf("The path '%s' does not exist. Do you want to create it? (y/n): ", path_copy);
+            char response;
+            while (scanf(" %c", &response) != 1 || (
+                       response != 'y' && response != 'Y' && response != 'n' && response != 'N')) {
+                printf("Invalid input. Please enter 'y' or 'n': ");
+            }
+            if (response == 'n' || response == 'N') {
+                return USER_EXIT;
+            }
+
+            // Create the directory recursively
+            const int create_result = createDirRecursively(path_dir);
+            switch (create_result) {
+                case ERROR_PATH_TOO_LONG:
+                    return ERROR_PATH_TOO_LONG;
+                case ERROR_PATH_INVALID:
+                    return ERROR_PATH_INVALID;
+            }
+            return SUCCESS;
+        }
+        return ERROR_PATH_INVALID; // If the errno is not ENOENT, the path is invalid
+    }
+
+    // Validate the path if it exists
+    const int val_result = validatePath(path, check_read, check_write);
+    if (val_result == ERROR_PERMISSION_DENIED) {
+        return ERROR_PERMISSION_DENIED;
+    }
+
+    return SUCCESS;
+}
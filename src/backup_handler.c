@@ -0,0 +1,969 @@
+#define _GNU_SOURCE // syncfs
+
+#include <dirent.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <linux/limits.h>
+#include <sys/file.h>
+#include <sys/stat.h>
+
+#include "../include/error_handler.h"
+#include "../include/backup_handler.h"
+#include "../include/paths_handler.h"
+#include "../include/stats_handler.h"
+
+/**
+ * @file backup_handler.c
+ * @brief Keeps previous versions of privileged files in a deduplicated, content-addressed store.
+ *
+ * Before a privileged file is replaced, its content is split into chunks whose boundaries
+ * are picked by a rolling gear hash, so an edit only moves the boundaries next to it and
+ * every other chunk is the same as in the previous version. Chunks are stored once, named
+ * by their SHA-256, and each version is a small text manifest listing them, so keeping
+ * many versions of a large file costs little more than the bytes that changed.
+ *
+ * Writers hold a shared lock on the store; pruning old versions and sweeping the chunks
+ * no manifest references any more takes it exclusively.
+ */
+
+#define BACKUP_MAGIC "redit-backup 1" // First line of every manifest
+#define BACKUP_READ_SIZE (4 * BACKUP_CHUNK_MAX_SIZE) // Bytes read at once while chunking
+#define BACKUP_GEAR_SEED 0x5245444954474541ULL // Seed of the gear table; changing it re-chunks every file
+
+#define SHA256_DIGEST_SIZE 32
+#define SHA256_HEX_SIZE (2 * SHA256_DIGEST_SIZE + 1)
+
+/**
+ * @brief Incremental SHA-256 state.
+ */
+typedef struct {
+    uint32_t state[8]; ///< Intermediate hash value.
+    uint64_t length; ///< Bytes hashed so far.
+    uint8_t block[64]; ///< Pending bytes of the current block.
+    size_t used; ///< Bytes in `block`.
+} sha256_ctx_t;
+
+/**
+ * @brief One entry of a manifest.
+ */
+typedef struct {
+    char hash[SHA256_HEX_SIZE]; ///< Hex SHA-256 of the chunk, which is also its name in the store.
+    size_t length; ///< Chunk size in bytes.
+} backup_chunk_t;
+
+/**
+ * @brief A parsed manifest.
+ */
+typedef struct {
+    backup_version_t version; ///< Version described by the manifest.
+    char path[PATH_MAX]; ///< Privileged file the version belongs to.
+    backup_chunk_t *chunks; ///< Chunks, in file order.
+    size_t capacity; ///< Allocated entries in `chunks`.
+} backup_manifest_t;
+
+static const uint32_t SHA256_K[64] = {
+    0x428a2f98, 0x71374491, 0xb5c0fbcf, 0xe9b5dba5, 0x3956c25b, 0x59f111f1, 0x923f82a4, 0xab1c5ed5,
+    0xd807aa98, 0x12835b01, 0x243185be, 0x550c7dc3, 0x72be5d74, 0x80deb1fe, 0x9bdc06a7, 0xc19bf174,
+    0xe49b69c1, 0xefbe4786, 0x0fc19dc6, 0x240ca1cc, 0x2de92c6f, 0x4a7484aa, 0x5cb0a9dc, 0x76f988da,
+    0x983e5152, 0xa831c66d, 0xb00327c8, 0xbf597fc7, 0xc6e00bf3, 0xd5a79147, 0x06ca6351, 0x14292967,
+    0x27b70a85, 0x2e1b2138, 0x4d2c6dfc, 0x53380d13, 0x650a7354, 0x766a0abb, 0x81c2c92e, 0x92722c85,
+    0xa2bfe8a1, 0xa81a664b, 0xc24b8b70, 0xc76c51a3, 0xd192e819, 0xd6990624, 0xf40e3585, 0x106aa070,
+    0x19a4c116, 0x1e376c08, 0x2748774c, 0x34b0bcb5, 0x391c0cb3, 0x4ed8aa4a, 0x5b9cca4f, 0x682e6ff3,
+    0x748f82ee, 0x78a5636f, 0x84c87814, 0x8cc70208, 0x90befffa, 0xa4506ceb, 0xbef9a3f7, 0xc67178f2
+};
+
+// Function prototypes
+static void sha256Init(sha256_ctx_t *ctx);
+
+static void sha256Block(sha256_ctx_t *ctx, const uint8_t *block);
+
+static void sha256Update(sha256_ctx_t *ctx, const void *data, size_t length);
+
+static void sha256Hex(const void *data, size_t length, char hex[SHA256_HEX_SIZE]);
+
+static void fillGearTable(uint64_t gear[256]);
+
+static size_t findChunkEnd(const uint64_t gear[256], const uint8_t *data, size_t length);
+
+static int getVersionsPath(const char *file_path, char versions_path[PATH_MAX]);
+
+static int openStore(bool create, int lock_operation, int *lock_fd);
+
+static int storeChunk(const uint8_t *data, size_t length, char hash[SHA256_HEX_SIZE], off_t *stored_bytes);
+
+static int addManifestChunk(backup_manifest_t *manifest, const char *hash, size_t length);
+
+static int readManifest(const char *manifest_path, bool with_chunks, backup_manifest_t *manifest);
+
+static int writeManifest(const char *versions_path, const backup_manifest_t *manifest, bool durable);
+
+static int compareVersionsNewestFirst(const void *a, const void *b);
+
+static int compareHashes(const void *a, const void *b);
+
+static int compareIds(const void *a, const void *b);
+
+static int readChunk(const backup_chunk_t *chunk, uint8_t *buffer);
+
+static void pruneBackups(const char *versions_path);
+
+static void sweepChunks();
+
+/**
+ * @brief Stores the current content of a file as a new backup version.
+ *
+ * @param file_path Absolute path to the file to back up.
+ * @param durable Whether the version must be on stable storage before returning.
+ * @param stored_bytes Set to the bytes of new chunks written; the rest was already in the store.
+ * @return `SUCCESS` if the version was stored, or an error code otherwise.
+ *
+ * @details
+ * - Creates the store on first use, readable by root only.
+ * - The manifest is renamed into place last, so a crash never leaves a version with missing chunks.
+ * - Once a file has more than `BACKUP_MAX_VERSIONS + BACKUP_PRUNE_SLACK` versions, the oldest
+ *   ones are pruned and the chunks no version uses any more are deleted.
+ */
+int backupFile(const char *file_path, const bool durable, off_t *stored_bytes) {
+    *stored_bytes = 0;
+    if (strchr(file_path, '\n') != NULL) {
+        return ERROR_PATH_INVALID; // Manifests are line-based
+    }
+
+    const int file_fd = STATS_SYSCALL(open(file_path, O_RDONLY | O_CLOEXEC));
+    if (file_fd == -1) {
+        return errno == EACCES ? ERROR_PERMISSION_DENIED : ERROR_FILE_NOT_FOUND;
+    }
+    struct stat file_stat;
+    if (STATS_SYSCALL(fstat(file_fd, &file_stat)) == -1 || !S_ISREG(file_stat.st_mode)) {
+        close(file_fd);
+        return ERROR_INVALID_SOURCE;
+    }
+
+    char versions_path[PATH_MAX];
+    int result = getVersionsPath(file_path, versions_path);
+    int lock_fd = -1;
+    if (result == SUCCESS) {
+        result = openStore(true, LOCK_SH, &lock_fd);
+    }
+    if (result == SUCCESS && mkdir(versions_path, 0700) == -1 && errno != EEXIST) {
+        result = ERROR_PERMISSION_DENIED;
+    }
+
+    backup_manifest_t manifest = {
+        .version = {
+            .size = file_stat.st_size,
+            .mode = file_stat.st_mode & 07777,
+            .owner = file_stat.st_uid,
+            .group = file_stat.st_gid
+        }
+    };
+    snprintf(manifest.path, sizeof(manifest.path), "%s", file_path);
+
+    uint8_t *buffer = result == SUCCESS ? malloc(BACKUP_READ_SIZE) : NULL;
+    if (result == SUCCESS && buffer == NULL) {
+        result = ERROR_MEMORY_ALLOCATION;
+    }
+
+    // Chunk the file as it is read, keeping the unchunked tail at the front of the buffer
+    uint64_t gear[256];
+    fillGearTable(gear);
+    size_t available = 0;
+    off_t offset = 0;
+    bool eof = false;
+    while (result == SUCCESS && (!eof || available > 0)) {
+        while (!eof && available < BACKUP_READ_SIZE) {
+            const ssize_t bytes_read = statsPread(file_fd, buffer + available, BACKUP_READ_SIZE - available, offset);
+            if (bytes_read == -1) {
+                result = ERROR_COPY_FAILED;
+                break;
+            }
+            eof = bytes_read == 0;
+            available += bytes_read;
+            offset += bytes_read;
+        }
+
+        // Only cut at the end of the buffer when no more data could move the boundary
+        size_t position = 0;
+        while (result == SUCCESS && available - position > 0 &&
+               (eof || available - position >= BACKUP_CHUNK_MAX_SIZE)) {
+            const size_t chunk_length = findChunkEnd(gear, buffer + position, available - position);
+            char hash[SHA256_HEX_SIZE];
+            result = storeChunk(buffer + position, chunk_length, hash, stored_bytes);
+            if (result == SUCCESS) {
+                result = addManifestChunk(&manifest, hash, chunk_length);
+            }
+            position += chunk_length;
+        }
+        memmove(buffer, buffer + position, available - position);
+        available -= position;
+    }
+    free(buffer);
+    close(file_fd);
+
+    if (result == SUCCESS) {
+        result = writeManifest(versions_path, &manifest, durable);
+    }
+    free(manifest.chunks);
+    if (lock_fd != -1) {
+        close(lock_fd); // Releases the store lock
+    }
+
+    if (result == SUCCESS) {
+        pruneBackups(versions_path);
+    }
+    return result;
+}
+
+/**
+ * @brief Lists the backup versions of a file.
+ *
+ * @param file_path Absolute path to the file.
+ * @param versions Set to an array of versions, newest first, to be freed by the caller.
+ * @param count Set to the number of versions.
+ * @return `SUCCESS` if the versions were listed (possibly none), or an error code otherwise.
+ */
+int listBackups(const char *file_path, backup_version_t **versions, size_t *count) {
+    *versions = NULL;
+    *count = 0;
+
+    char versions_path[PATH_MAX];
+    const int path_result = getVersionsPath(file_path, versions_path);
+    if (path_result != SUCCESS) {
+        return path_result;
+    }
+    int lock_fd;
+    const int store_result = openStore(false, LOCK_SH, &lock_fd);
+    if (store_result == ERROR_FILE_NOT_FOUND) {
+        return SUCCESS; // Nothing was ever backed up
+    }
+    if (store_result != SUCCESS) {
+        return store_result;
+    }
+
+    DIR *dir = opendir(versions_path);
+    if (dir == NULL) {
+        close(lock_fd);
+        return errno == ENOENT ? SUCCESS : ERROR_PERMISSION_DENIED;
+    }
+
+    int result = SUCCESS;
+    size_t capacity = 0;
+    const struct dirent *entry;
+    while (result == SUCCESS && (entry = readdir(dir)) != NULL) {
+        if (entry->d_name[0] == '.') {
+            continue; // Also skips manifests still being written
+        }
+        char manifest_path[PATH_MAX];
+        const int written = snprintf(manifest_path, PATH_MAX, "%s/%s", versions_path, entry->d_name);
+        if (written < 0 || written >= PATH_MAX) {
+            continue;
+        }
+        backup_manifest_t manifest = {0};
+        if (readManifest(manifest_path, false, &manifest) != SUCCESS || strcmp(manifest.path, file_path) != 0) {
+            continue; // Damaged, or another file sharing the path hash
+        }
+
+        if (*count == capacity) {
+            capacity = capacity == 0 ? 16 : capacity * 2;
+            backup_version_t *grown = realloc(*versions, capacity * sizeof(backup_version_t));
+            if (grown == NULL) {
+                result = ERROR_MEMORY_ALLOCATION;
+                break;
+            }
+            *versions = grown;
+        }
+        (*versions)[(*count)++] = manifest.version;
+    }
+    closedir(dir);
+    close(lock_fd);
+
+    if (result != SUCCESS) {
+        free(*versions);
+        *versions = NULL;
+        *count = 0;
+        return result;
+    }
+    qsort(*versions, *count, sizeof(backup_version_t), compareVersionsNewestFirst);
+    return SUCCESS;
+}
+
+/**
+ * @brief Writes a backup version of a file to a descriptor.
+ *
+ * @param file_path Absolute path to the file the version belongs to.
+ * @param version_id Identifier of the version, as listed by `listBackups`.
+ * @param dest_fd Descriptor open for writing, truncated and filled with the version.
+ * @param restored_bytes Set to the number of bytes written.
+ * @return `SUCCESS` if the version was written, `ERROR_BACKUP_CORRUPTED` if a chunk is missing or
+ *         damaged, or another error code.
+ *
+ * @details
+ * - Every chunk is checked against its hash before `dest_fd` is touched, so a damaged backup
+ *   never replaces a good file.
+ * - Restores the owner, group and permissions recorded with the version.
+ */
+int restoreBackup(const char *file_path, const char *version_id, const int dest_fd, off_t *restored_bytes) {
+    *restored_bytes = 0;
+    if (version_id[0] == '\0' || strspn(version_id, "0123456789.") != strlen(version_id)) {
+        return ERROR_INVALID_ARGUMENT;
+    }
+
+    char versions_path[PATH_MAX];
+    char manifest_path[PATH_MAX];
+    int result = getVersionsPath(file_path, versions_path);
+    if (result != SUCCESS) {
+        return result;
+    }
+    const int written = snprintf(manifest_path, PATH_MAX, "%s/%s", versions_path, version_id);
+    if (written < 0 || written >= PATH_MAX) {
+        return ERROR_PATH_TOO_LONG;
+    }
+
+    int lock_fd;
+    result = openStore(false, LOCK_SH, &lock_fd);
+    if (result != SUCCESS) {
+        return result;
+    }
+    backup_manifest_t manifest = {0};
+    result = readManifest(manifest_path, true, &manifest);
+    if (result == SUCCESS && strcmp(manifest.path, file_path) != 0) {
+        result = ERROR_FILE_NOT_FOUND;
+    }
+
+    uint8_t *buffer = result == SUCCESS ? malloc(BACKUP_CHUNK_MAX_SIZE) : NULL;
+    if (result == SUCCESS && buffer == NULL) {
+        result = ERROR_MEMORY_ALLOCATION;
+    }
+
+    // Check every chunk first, then write them out
+    off_t total = 0;
+    for (size_t i = 0; result == SUCCESS && i < manifest.version.chunks; ++i) {
+        result = readChunk(&manifest.chunks[i], buffer);
+        total += (off_t) manifest.chunks[i].length;
+    }
+    if (result == SUCCESS && total != manifest.version.size) {
+        result = ERROR_BACKUP_CORRUPTED;
+    }
+    if (result == SUCCESS && STATS_SYSCALL(ftruncate(dest_fd, 0)) == -1) {
+        result = ERROR_COPY_FAILED;
+    }
+    for (size_t i = 0; result == SUCCESS && i < manifest.version.chunks; ++i) {
+        result = readChunk(&manifest.chunks[i], buffer);
+        size_t done = 0;
+        while (result == SUCCESS && done < manifest.chunks[i].length) {
+            const ssize_t bytes_written = statsPwrite(dest_fd, buffer + done, manifest.chunks[i].length - done,
+                                                      *restored_bytes);
+            if (bytes_written <= 0) {
+                result = ERROR_COPY_FAILED;
+                break;
+            }
+            done += bytes_written;
+            *restored_bytes += bytes_written;
+        }
+    }
+    free(buffer);
+    free(manifest.chunks);
+    close(lock_fd);
+
+    if (result == SUCCESS) {
+        if (STATS_SYSCALL(fchown(dest_fd, manifest.version.owner, manifest.version.group)) == -1) {
+            return ERROR_PERMISSION_DENIED;
+        }
+        if (STATS_SYSCALL(fchmod(dest_fd, manifest.version.mode)) == -1) {
+            return ERROR_PERMISSION_DENIED;
+        }
+    }
+    return result;
+}
+
+/**
+ * @brief Resets a SHA-256 state.
+ */
+static void sha256Init(sha256_ctx_t *ctx) {
+    static const uint32_t initial[8] = {
+        0x6a09e667, 0xbb67ae85, 0x3c6ef372, 0xa54ff53a, 0x510e527f, 0x9b05688c, 0x1f83d9ab, 0x5be0cd19
+    };
+    memcpy(ctx->state, initial, sizeof(initial));
+    ctx->length = 0;
+    ctx->used = 0;
+}
+
+#define ROTR32(x, n) (((x) >> (n)) | ((x) << (32 - (n))))
+
+/**
+ * @brief Mixes one 64-byte block into a SHA-256 state.
+ */
+static void sha256Block(sha256_ctx_t *ctx, const uint8_t *block) {
+    uint32_t w[64];
+    for (int i = 0; i < 16; ++i) {
+        w[i] = (uint32_t) block[4 * i] << 24 | (uint32_t) block[4 * i + 1] << 16 |
+               (uint32_t) block[4 * i + 2] << 8 | (uint32_t) block[4 * i + 3];
+    }
+    for (int i = 16; i < 64; ++i) {
+        const uint32_t s0 = ROTR32(w[i - 15], 7) ^ ROTR32(w[i - 15], 18) ^ (w[i - 15] >> 3);
+        const uint32_t s1 = ROTR32(w[i - 2], 17) ^ ROTR32(w[i - 2], 19) ^ (w[i - 2] >> 10);
+        w[i] = w[i - 16] + s0 + w[i - 7] + s1;
+    }
+
+    uint32_t a = ctx->state[0], b = ctx->state[1], c = ctx->state[2], d = ctx->state[3];
+    uint32_t e = ctx->state[4], f = ctx->state[5], g = ctx->state[6], h = ctx->state[7];
+    for (int i = 0; i < 64; ++i) {
+        const uint32_t t1 = h + (ROTR32(e, 6) ^ ROTR32(e, 11) ^ ROTR32(e, 25)) + ((e & f) ^ (~e & g)) +
+                            SHA256_K[i] + w[i];
+        const uint32_t t2 = (ROTR32(a, 2) ^ ROTR32(a, 13) ^ ROTR32(a, 22)) + ((a & b) ^ (a & c) ^ (b & c));
+        h = g;
+        g = f;
+        f = e;
+        e = d + t1;
+        d = c;
+        c = b;
+        b = a;
+        a = t1 + t2;
+    }
+    ctx->state[0] += a;
+    ctx->state[1] += b;
+    ctx->state[2] += c;
+    ctx->state[3] += d;
+    ctx->state[4] += e;
+    ctx->state[5] += f;
+    ctx->state[6] += g;
+    ctx->state[7] += h;
+}
+
+/**
+ * @brief Adds data to a SHA-256 state.
+ */
+static void sha256Update(sha256_ctx_t *ctx, const void *data, size_t length) {
+    const uint8_t *bytes = data;
+    ctx->length += length;
+    if (ctx->used > 0) {
+        const size_t take = length < 64 - ctx->used ? length : 64 - ctx->used;
+        memcpy(ctx->block + ctx->used, bytes, take);
+        ctx->used += take;
+        bytes += take;
+        length -= take;
+        if (ctx->used < 64) {
+            return;
+        }
+        sha256Block(ctx, ctx->block);
+        ctx->used = 0;
+    }
+    for (; length >= 64; bytes += 64, length -= 64) {
+        sha256Block(ctx, bytes);
+    }
+    memcpy(ctx->block, bytes, length);
+    ctx->used = length;
+}
+
+/**
+ * @brief Computes the SHA-256 of a buffer as a lowercase hex string.
+ */
+static void sha256Hex(const void *data, const size_t length, char hex[SHA256_HEX_SIZE]) {
+    sha256_ctx_t ctx;
+    sha256Init(&ctx);
+    sha256Update(&ctx, data, length);
+
+    // Pad with 0x80, zeros and the bit length
+    const uint64_t bit_length = ctx.length * 8;
+    const uint8_t pad = 0x80;
+    sha256Update(&ctx, &pad, 1);
+    const uint8_t zero = 0;
+    while (ctx.used != 56) {
+        sha256Update(&ctx, &zero, 1);
+    }
+    uint8_t length_bytes[8];
+    for (int i = 0; i < 8; ++i) {
+        length_bytes[i] = (uint8_t) (bit_length >> (56 - 8 * i));
+    }
+    sha256Update(&ctx, length_bytes, 8);
+
+    for (int i = 0; i < 8; ++i) {
+        snprintf(hex + 8 * i, 9, "%08x", ctx.state[i]);
+    }
+}
+
+/**
+ * @brief Fills the gear table of the rolling hash.
+ *
+ * @details
+ * - The values come from a fixed-seed splitmix64 sequence, so every run (and every release)
+ *   cuts the same content at the same places and keeps deduplicating against older versions.
+ */
+static void fillGearTable(uint64_t gear[256]) {
+    uint64_t seed = BACKUP_GEAR_SEED;
+    for (int i = 0; i < 256; ++i) {
+        uint64_t z = (seed += 0x9E3779B97F4A7C15ULL);
+        z = (z ^ (z >> 30)) * 0xBF58476D1CE4E5B9ULL;
+        z = (z ^ (z >> 27)) * 0x94D049BB133111EBULL;
+        gear[i] = z ^ (z >> 31);
+    }
+}
+
+/**
+ * @brief Finds the end of the chunk starting at `data`.
+ *
+ * @param gear Gear table of the rolling hash.
+ * @param data Unchunked data.
+ * @param length Bytes available at `data`.
+ * @return Length of the chunk, between `BACKUP_CHUNK_MIN_SIZE` and `BACKUP_CHUNK_MAX_SIZE` unless
+ *         `length` is shorter.
+ *
+ * @details
+ * - The gear hash shifts one bit per byte, so it only depends on the last 64 bytes and boundaries
+ *   realign right after an insertion or deletion. Bytes before the minimum size are not hashed.
+ */
+static size_t findChunkEnd(const uint64_t gear[256], const uint8_t *data, size_t length) {
+    if (length <= BACKUP_CHUNK_MIN_SIZE) {
+        return length;
+    }
+    if (length > BACKUP_CHUNK_MAX_SIZE) {
+        length = BACKUP_CHUNK_MAX_SIZE;
+    }
+    uint64_t hash = 0;
+    for (size_t i = BACKUP_CHUNK_MIN_SIZE; i < length; ++i) {
+        hash = (hash << 1) + gear[data[i]];
+        if ((hash & BACKUP_CHUNK_MASK) == 0) {
+            return i + 1;
+        }
+    }
+    return length;
+}
+
+/**
+ * @brief Builds the path of the directory holding the versions of a file.
+ *
+ * @details
+ * - The directory name is the hash of the path (see `getStoreEntryPath`); each manifest records
+ *   the full path, so a hash collision is told apart.
+ */
+static int getVersionsPath(const char *file_path, char versions_path[PATH_MAX]) {
+    return getStoreEntryPath(BACKUP_DIR "/versions", file_path, NULL, versions_path);
+}
+
+/**
+ * @brief Locks the store, creating it if asked to.
+ *
+ * @param create Whether to create the store directories.
+ * @param lock_operation `LOCK_SH` to add or read versions, `LOCK_EX` to delete them.
+ * @param lock_fd Set to the descriptor holding the lock; closing it releases the lock.
+ * @return `SUCCESS` if the store is locked, `ERROR_FILE_NOT_FOUND` if it does not exist, or another error code.
+ */
+static int openStore(const bool create, const int lock_operation, int *lock_fd) {
+    if (create) {
+        const char *dirs[] = {REDIT_STATE_DIR, BACKUP_DIR, BACKUP_DIR "/chunks", BACKUP_DIR "/versions"};
+        for (size_t i = 0; i < sizeof(dirs) / sizeof(dirs[0]); ++i) {
+            if (mkdir(dirs[i], i == 0 ? 0755 : 0700) == -1 && errno != EEXIST) {
+                return errno == EACCES ? ERROR_PERMISSION_DENIED : ERROR_PATH_INVALID;
+            }
+        }
+    }
+
+    *lock_fd = STATS_SYSCALL(open(BACKUP_DIR "/lock", O_RDWR | O_CLOEXEC | (create ? O_CREAT : 0), S_IRUSR | S_IWUSR));
+    if (*lock_fd == -1) {
+        return errno == ENOENT ? ERROR_FILE_NOT_FOUND : ERROR_PERMISSION_DENIED;
+    }
+    if (STATS_SYSCALL(flock(*lock_fd, lock_operation)) == -1) {
+        close(*lock_fd);
+        return ERROR_PERMISSION_DENIED;
+    }
+    return SUCCESS;
+}
+
+/**
+ * @brief Stores a chunk unless the store already has it.
+ *
+ * @param data Chunk content.
+ * @param length Chunk size.
+ * @param hash Set to the hex SHA-256 of the chunk.
+ * @param stored_bytes Increased by `length` if the chunk was new.
+ * @return `SUCCESS` if the chunk is in the store, or an error code otherwise.
+ */
+static int storeChunk(const uint8_t *data, const size_t length, char hash[SHA256_HEX_SIZE], off_t *stored_bytes) {
+    sha256Hex(data, length, hash);
+
+    char chunk_dir[PATH_MAX];
+    char chunk_path[PATH_MAX];
+    char temp_path[PATH_MAX];
+    snprintf(chunk_dir, PATH_MAX, "%s/chunks/%.2s", BACKUP_DIR, hash);
+    snprintf(chunk_path, PATH_MAX, "%s/chunks/%.2s/%s", BACKUP_DIR, hash, hash + 2);
+    snprintf(temp_path, PATH_MAX, "%s/chunks/%.2s/.%s.%ld", BACKUP_DIR, hash, hash + 2, (long) getpid());
+
+    struct stat chunk_stat;
+    if (STATS_SYSCALL(stat(chunk_path, &chunk_stat)) == 0 && chunk_stat.st_size == (off_t) length) {
+        return SUCCESS; // Deduplicated
+    }
+    if (mkdir(chunk_dir, 0700) == -1 && errno != EEXIST) {
+        return ERROR_PERMISSION_DENIED;
+    }
+
+    // Write under a temporary name, so a chunk in the store is always complete
+    const int chunk_fd = STATS_SYSCALL(open(temp_path, O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, S_IRUSR | S_IWUSR));
+    if (chunk_fd == -1) {
+        return ERROR_PERMISSION_DENIED;
+    }
+    size_t done = 0;
+    while (done < length) {
+        const ssize_t bytes_written = statsPwrite(chunk_fd, data + done, length - done, (off_t) done);
+        if (bytes_written <= 0) {
+            break;
+        }
+        done += bytes_written;
+    }
+    if (STATS_SYSCALL(close(chunk_fd)) == -1 || done < length ||
+        STATS_SYSCALL(rename(temp_path, chunk_path)) == -1) {
+        unlink(temp_path);
+        return ERROR_COPY_FAILED;
+    }
+    *stored_bytes += (off_t) length;
+    return SUCCESS;
+}
+
+/**
+ * @brief Appends a chunk to a manifest.
+ */
+static int addManifestChunk(backup_manifest_t *manifest, const char *hash, const size_t length) {
+    if (manifest->version.chunks == manifest->capacity) {
+        const size_t capacity = manifest->capacity == 0 ? 64 : manifest->capacity * 2;
+        backup_chunk_t *grown = realloc(manifest->chunks, capacity * sizeof(backup_chunk_t));
+        if (grown == NULL) {
+            return ERROR_MEMORY_ALLOCATION;
+        }
+        manifest->chunks = grown;
+        manifest->capacity = capacity;
+    }
+    backup_chunk_t *chunk = &manifest->chunks[manifest->version.chunks++];
+    snprintf(chunk->hash, SHA256_HEX_SIZE, "%s", hash);
+    chunk->length = length;
+    return SUCCESS;
+}
+
+/**
+ * @brief Parses a manifest.
+ *
+ * @param manifest_path Path to the manifest.
+ * @param with_chunks Whether to load the chunk list, or only count its entries.
+ * @param manifest Filled with the manifest; `manifest->chunks` is to be freed by the caller.
+ * @return `SUCCESS` if the manifest was parsed, or an error code otherwise.
+ */
+static int readManifest(const char *manifest_path, const bool with_chunks, backup_manifest_t *manifest) {
+    FILE *file = fopen(manifest_path, "re");
+    if (file == NULL) {
+        return errno == ENOENT ? ERROR_FILE_NOT_FOUND : ERROR_PERMISSION_DENIED;
+    }
+
+    const char *id = strrchr(manifest_path, '/') + 1;
+    snprintf(manifest->version.id, sizeof(manifest->version.id), "%s", id);
+    long long seconds = 0;
+    long nanoseconds = 0;
+    sscanf(id, "%lld.%ld", &seconds, &nanoseconds);
+    manifest->version.created = (struct timespec){.tv_sec = seconds, .tv_nsec = nanoseconds};
+
+    int result = SUCCESS;
+    int fields = 0;
+    char line[PATH_MAX + 16];
+    if (fgets(line, sizeof(line), file) == NULL || strcmp(line, BACKUP_MAGIC "\n") != 0) {
+        result = ERROR_BACKUP_CORRUPTED;
+    }
+    while (result == SUCCESS && fgets(line, sizeof(line), file) != NULL) {
+        line[strcspn(line, "\n")] = '\0';
+        long long size;
+        unsigned int number;
+        char hash[SHA256_HEX_SIZE];
+        size_t length;
+        if (strncmp(line, "path ", 5) == 0 && strlen(line + 5) < PATH_MAX) {
+            strcpy(manifest->path, line + 5);
+            ++fields;
+        } else if (sscanf(line, "size %lld", &size) == 1) {
+            manifest->version.size = (off_t) size;
+            ++fields;
+        } else if (sscanf(line, "mode %o", &number) == 1) {
+            manifest->version.mode = (mode_t) number;
+            ++fields;
+        } else if (sscanf(line, "owner %u", &number) == 1) {
+            manifest->version.owner = (uid_t) number;
+            ++fields;
+        } else if (sscanf(line, "group %u", &number) == 1) {
+            manifest->version.group = (gid_t) number;
+            ++fields;
+        } else if (sscanf(line, "chunk %64s %zu", hash, &length) == 2 && strlen(hash) == SHA256_HEX_SIZE - 1) {
+            if (with_chunks) {
+                result = addManifestChunk(manifest, hash, length);
+            } else {
+                ++manifest->version.chunks;
+            }
+        } else {
+            result = ERROR_BACKUP_CORRUPTED;
+        }
+    }
+    fclose(file);
+
+    if (result == SUCCESS && fields != 5) {
+        result = ERROR_BACKUP_CORRUPTED;
+    }
+    if (result != SUCCESS) {
+        free(manifest->chunks);
+        manifest->chunks = NULL;
+    }
+    return result;
+}
+
+/**
+ * @brief Writes a manifest as a new version, named after the current time.
+ *
+ * @param versions_path Directory holding the versions of the file.
+ * @param manifest Manifest to write.
+ * @param durable Whether to flush the chunks and the manifest before returning.
+ * @return `SUCCESS` if the version was written, or an error code otherwise.
+ *
+ * @details
+ * - With `durable`, one `syncfs` flushes every chunk written for the version before the manifest
+ *   is renamed into place, and the directory is flushed after.
+ */
+static int writeManifest(const char *versions_path, const backup_manifest_t *manifest, const bool durable) {
+    struct timespec now;
+    clock_gettime(CLOCK_REALTIME, &now);
+    char manifest_path[PATH_MAX];
+    char temp_path[PATH_MAX];
+    const int written = snprintf(manifest_path, PATH_MAX, "%s/%010lld.%09ld", versions_path,
+                                 (long long) now.tv_sec, now.tv_nsec);
+    if (written < 0 || written >= PATH_MAX) {
+        return ERROR_PATH_TOO_LONG;
+    }
+    const int temp_written = snprintf(temp_path, PATH_MAX, "%s/.manifest.%ld", versions_path, (long) getpid());
+    if (temp_written < 0 || temp_written >= PATH_MAX) {
+        return ERROR_PATH_TOO_LONG;
+    }
+
+    const int manifest_fd = STATS_SYSCALL(open(temp_path, O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC,
+                                               S_IRUSR | S_IWUSR));
+    if (manifest_fd == -1) {
+        return ERROR_PERMISSION_DENIED;
+    }
+    FILE *file = fdopen(manifest_fd, "w");
+    if (file == NULL) {
+        close(manifest_fd);
+        unlink(temp_path);
+        return ERROR_MEMORY_ALLOCATION;
+    }
+    fprintf(file, "%s\npath %s\nsize %lld\nmode %o\nowner %u\ngroup %u\n", BACKUP_MAGIC, manifest->path,
+            (long long) manifest->version.size, (unsigned int) manifest->version.mode,
+            (unsigned int) manifest->version.owner, (unsigned int) manifest->version.group);
+    for (size_t i = 0; i < manifest->version.chunks; ++i) {
+        fprintf(file, "chunk %s %zu\n", manifest->chunks[i].hash, manifest->chunks[i].length);
+    }
+
+    bool failed = fflush(file) != 0;
+    if (!failed && durable) {
+        failed = STATS_SYSCALL(syncfs(manifest_fd)) == -1;
+    }
+    failed = fclose(file) != 0 || failed;
+    if (failed || STATS_SYSCALL(rename(temp_path, manifest_path)) == -1) {
+        unlink(temp_path);
+        return ERROR_COPY_FAILED;
+    }
+
+    if (durable) {
+        const int dir_fd = STATS_SYSCALL(open(versions_path, O_RDONLY | O_DIRECTORY | O_CLOEXEC));
+        if (dir_fd == -1 || STATS_SYSCALL(fsync(dir_fd)) == -1) {
+            if (dir_fd != -1) {
+                close(dir_fd);
+            }
+            return ERROR_SYNC_FAILED;
+        }
+        close(dir_fd);
+    }
+    return SUCCESS;
+}
+
+/**
+ * @brief Orders versions from the newest to the oldest.
+ *
+ * @details
+ * - Identifiers are fixed-width timestamps, so they compare like the times themselves.
+ */
+static int compareVersionsNewestFirst(const void *a, const void *b) {
+    return strcmp(((const backup_version_t *) b)->id, ((const backup_version_t *) a)->id);
+}
+
+/**
+ * @brief Orders chunk hashes, for sorting and searching.
+ */
+static int compareHashes(const void *a, const void *b) {
+    return strcmp(((const backup_chunk_t *) a)->hash, ((const backup_chunk_t *) b)->hash);
+}
+
+/**
+ * @brief Orders version identifiers from the oldest to the newest.
+ */
+static int compareIds(const void *a, const void *b) {
+    return strcmp(a, b);
+}
+
+/**
+ * @brief Reads a chunk from the store and checks it against its hash.
+ *
+ * @param chunk Chunk to read.
+ * @param buffer Buffer of at least `BACKUP_CHUNK_MAX_SIZE` bytes receiving the chunk.
+ * @return `SUCCESS` if the chunk is intact, or `ERROR_BACKUP_CORRUPTED` otherwise.
+ */
+static int readChunk(const backup_chunk_t *chunk, uint8_t *buffer) {
+    if (chunk->length > BACKUP_CHUNK_MAX_SIZE) {
+        return ERROR_BACKUP_CORRUPTED;
+    }
+    char chunk_path[PATH_MAX];
+    snprintf(chunk_path, PATH_MAX, "%s/chunks/%.2s/%s", BACKUP_DIR, chunk->hash, chunk->hash + 2);
+    const int chunk_fd = STATS_SYSCALL(open(chunk_path, O_RDONLY | O_CLOEXEC));
+    if (chunk_fd == -1) {
+        return ERROR_BACKUP_CORRUPTED;
+    }
+
+    size_t done = 0;
+    while (done < chunk->length) {
+        const ssize_t bytes_read = statsPread(chunk_fd, buffer + done, chunk->length - done, (off_t) done);
+        if (bytes_read <= 0) {
+            break;
+        }
+        done += bytes_read;
+    }
+    close(chunk_fd);
+
+    char hash[SHA256_HEX_SIZE];
+    sha256Hex(buffer, done, hash);
+    return done == chunk->length && strcmp(hash, chunk->hash) == 0 ? SUCCESS : ERROR_BACKUP_CORRUPTED;
+}
+
+/**
+ * @brief Deletes the oldest versions of a file beyond `BACKUP_MAX_VERSIONS`, then unused chunks.
+ *
+ * @param versions_path Directory holding the versions of the file.
+ *
+ * @details
+ * - Does nothing until the file has `BACKUP_PRUNE_SLACK` versions too many, so the chunk sweep,
+ *   which reads every manifest in the store, runs once every few overwrites at most.
+ * - Pruning is best effort: a failure only leaves extra versions behind.
+ */
+static void pruneBackups(const char *versions_path) {
+    DIR *dir = opendir(versions_path);
+    if (dir == NULL) {
+        return;
+    }
+    char (*ids)[32] = NULL;
+    size_t count = 0, capacity = 0;
+    const struct dirent *entry;
+    while ((entry = readdir(dir)) != NULL) {
+        if (entry->d_name[0] == '.' || strlen(entry->d_name) >= sizeof(ids[0])) {
+            continue;
+        }
+        if (count == capacity) {
+            capacity = capacity == 0 ? 64 : capacity * 2;
+            char (*grown)[32] = realloc(ids, capacity * sizeof(ids[0]));
+            if (grown == NULL) {
+                break;
+            }
+            ids = grown;
+        }
+        strcpy(ids[count++], entry->d_name);
+    }
+
+    if (count > BACKUP_MAX_VERSIONS + BACKUP_PRUNE_SLACK) {
+        int lock_fd;
+        if (openStore(false, LOCK_EX, &lock_fd) == SUCCESS) {
+            qsort(ids, count, sizeof(ids[0]), compareIds);
+            for (size_t i = 0; i < count - BACKUP_MAX_VERSIONS; ++i) {
+                STATS_SYSCALL(unlinkat(dirfd(dir), ids[i], 0));
+            }
+            sweepChunks();
+            close(lock_fd);
+        }
+    }
+    closedir(dir);
+    free(ids);
+}
+
+/**
+ * @brief Deletes the chunks no manifest references. The store must be locked exclusively.
+ *
+ * @details
+ * - Marks every chunk listed by a readable manifest, then sweeps the rest. If any manifest
+ *   cannot be read, nothing is deleted, since its chunks would be lost.
+ */
+static void sweepChunks() {
+    backup_manifest_t referenced = {0};
+    bool complete = true;
+
+    DIR *versions_dir = opendir(BACKUP_DIR "/versions");
+    if (versions_dir == NULL) {
+        return;
+    }
+    const struct dirent *file_entry;
+    while (complete && (file_entry = readdir(versions_dir)) != NULL) {
+        if (file_entry->d_name[0] == '.') {
+            continue;
+        }
+        char file_path[PATH_MAX];
+        snprintf(file_path, PATH_MAX, "%s/versions/%s", BACKUP_DIR, file_entry->d_name);
+        DIR *file_dir = opendir(file_path);
+        if (file_dir == NULL) {
+            complete = false;
+            break;
+        }
+        const struct dirent *entry;
+        while (complete && (entry = readdir(file_dir)) != NULL) {
+            if (entry->d_name[0] == '.') {
+                continue;
+            }
+            char manifest_path[PATH_MAX];
+            const int written = snprintf(manifest_path, PATH_MAX, "%s/%s", file_path, entry->d_name);
+            backup_manifest_t manifest = {0};
+            if (written < 0 || written >= PATH_MAX || readManifest(manifest_path, true, &manifest) != SUCCESS) {
+                complete = false;
+                break;
+            }
+            for (size_t i = 0; complete && i < manifest.version.chunks; ++i) {
+                complete = addManifestChunk(&referenced, manifest.chunks[i].hash, 0) == SUCCESS;
+            }
+            free(manifest.chunks);
+        }
+        closedir(file_dir);
+    }
+    closedir(versions_dir);
+
+    if (complete) {
+        qsort(referenced.chunks, referenced.version.chunks, sizeof(backup_chunk_t), compareHashes);
+        DIR *chunks_dir = opendir(BACKUP_DIR "/chunks");
+        const struct dirent *prefix_entry;
+        while (chunks_dir != NULL && (prefix_entry = readdir(chunks_dir)) != NULL) {
+            if (prefix_entry->d_name[0] == '.' || strlen(prefix_entry->d_name) != 2) {
+                continue;
+            }
+            char prefix_path[PATH_MAX];
+            snprintf(prefix_path, PATH_MAX, "%s/chunks/%s", BACKUP_DIR, prefix_entry->d_name);
+            DIR *prefix_dir = opendir(prefix_path);
+            const struct dirent *entry;
+            while (prefix_dir != NULL && (entry = readdir(prefix_dir)) != NULL) {
+                if (strlen(entry->d_name) != SHA256_HEX_SIZE - 3) {
+                    continue; // Not a chunk (temporary files carry a suffix)
+                }
+                backup_chunk_t key;
+                memcpy(key.hash, prefix_entry->d_name, 2);
+                memcpy(key.hash + 2, entry->d_name, SHA256_HEX_SIZE - 2);
+                if (bsearch(&key, referenced.chunks, referenced.version.chunks, sizeof(backup_chunk_t),
+                            compareHashes) == NULL) {
+                    STATS_SYSCALL(unlinkat(dirfd(prefix_dir), entry->d_name, 0));
+                }
+            }
+            if (prefix_dir != NULL) {
+                closedir(prefix_dir);
+            }
+        }
+        if (chunks_dir != NULL) {
+            closedir(chunks_dir);
+        }
+    }
+    free(referenced.chunks);
+}
@@ -0,0 +1,141 @@
+#include <errno.h>
+#include <fcntl.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <unistd.h>
+#include <linux/limits.h>
+#include <sys/stat.h>
+
+#include "../include/error_handler.h"
+#include "../include/baseline_handler.h"
+#include "../include/file_operations.h"
+#include "../include/paths_handler.h"
+#include "../include/stats_handler.h"
+
+/**
+ * @file baseline_handler.c
+ * @brief Manages the baseline snapshots used to merge concurrent changes on overwrite.
+ *
+ * When a copy is taken, the content handed to the user is also stored in a root-only
+ * directory, stamped with the size and modification time the privileged file had at
+ * that moment. On overwrite, a mismatch between those and the current privileged file
+ * means someone else changed it, and the snapshot becomes the common ancestor of a
+ * three-way merge.
+ */
+
+/**
+ * @brief Builds the path of the baseline snapshot for a copy/privileged pair.
+ *
+ * @param copy_file_path Absolute path to the copy file.
+ * @param privileged_file_path Absolute path to the privileged file.
+ * @param baseline_path Buffer to store the snapshot path.
+ * @return `SUCCESS` if the path was built, or an error code otherwise.
+ *
+ * @details
+ * - The snapshot name is the hash of both paths (see `getStoreEntryPath`), so each pair gets its own snapshot.
+ */
+int getBaselinePath(const char *copy_file_path, const char *privileged_file_path, char baseline_path[PATH_MAX]) {
+    return getStoreEntryPath(BASELINE_DIR, copy_file_path, privileged_file_path, baseline_path);
+}
+
+/**
+ * @brief Stores a baseline snapshot for a copy/privileged pair.
+ *
+ * @param source_path Path to the file holding the baseline content.
+ * @param copy_file_path Absolute path to the copy file.
+ * @param privileged_file_path Absolute path to the privileged file.
+ * @param prv_stat Metadata of the privileged file at the time `source_path` matched it.
+ * @return `SUCCESS` if the snapshot was stored, or an error code otherwise.
+ *
+ * @details
+ * - Creates the state directories on first use, readable by root only.
+ * - Files larger than `BASELINE_MAX_SIZE` are skipped, so bulk copies are not written twice.
+ * - Stamps the snapshot with the privileged file's modification time for the change check.
+ */
+int saveBaseline(const char *source_path, const char *copy_file_path, const char *privileged_file_path,
+                 const struct stat *prv_stat) {
+    // Too large to merge in memory: drop any stale snapshot instead
+    if (prv_stat->st_size > BASELINE_MAX_SIZE) {
+        return removeBaseline(copy_file_path, privileged_file_path);
+    }
+
+    // Create the state directories if they don't exist
+    if (mkdir(REDIT_STATE_DIR, 0755) == -1 && errno != EEXIST) {
+        return errno == EACCES ? ERROR_PERMISSION_DENIED : ERROR_PATH_INVALID;
+    }
+    if (mkdir(BASELINE_DIR, 0700) == -1 && errno != EEXIST) {
+        return errno == EACCES ? ERROR_PERMISSION_DENIED : ERROR_PATH_INVALID;
+    }
+
+    char baseline_path[PATH_MAX];
+    const int path_result = getBaselinePath(copy_file_path, privileged_file_path, baseline_path);
+    if (path_result != SUCCESS) {
+        return path_result;
+    }
+
+    const int copy_result = copyFile(source_path, baseline_path, NULL);
+    if (copy_result != SUCCESS) {
+        return copy_result;
+    }
+    if (chmod(baseline_path, S_IRUSR | S_IWUSR) == -1) {
+        return ERROR_PERMISSION_DENIED;
+    }
+
+    // Record the privileged file's modification time on the snapshot itself
+    const struct timespec times[2] = {prv_stat->st_atim, prv_stat->st_mtim};
+    if (utimensat(AT_FDCWD, baseline_path, times, 0) == -1) {
+        return ERROR_PERMISSION_DENIED;
+    }
+    return SUCCESS;
+}
+
+/**
+ * @brief Checks whether the privileged file changed since its baseline snapshot was taken.
+ *
+ * @param copy_file_path Absolute path to the copy file.
+ * @param privileged_file_path Absolute path to the privileged file.
+ * @param prv_changed Pointer to a variable set to `true` if the privileged file changed.
+ * @return `SUCCESS` if a snapshot exists, `ERROR_FILE_NOT_FOUND` if there is none, or another error code.
+ *
+ * @details
+ * - Compares size and nanosecond modification time, like `make` and `rsync` do.
+ */
+int checkBaseline(const char *copy_file_path, const char *privileged_file_path, bool *prv_changed) {
+    char baseline_path[PATH_MAX];
+    const int path_result = getBaselinePath(copy_file_path, privileged_file_path, baseline_path);
+    if (path_result != SUCCESS) {
+        return path_result;
+    }
+
+    struct stat base_stat, prv_stat;
+    if (STATS_SYSCALL(stat(baseline_path, &base_stat)) == -1) {
+        return ERROR_FILE_NOT_FOUND;
+    }
+    if (STATS_SYSCALL(stat(privileged_file_path, &prv_stat)) == -1) {
+        return errno == EACCES ? ERROR_PERMISSION_DENIED : ERROR_FILE_NOT_FOUND;
+    }
+
+    *prv_changed = base_stat.st_size != prv_stat.st_size ||
+                   base_stat.st_mtim.tv_sec != prv_stat.st_mtim.tv_sec ||
+                   base_stat.st_mtim.tv_nsec != prv_stat.st_mtim.tv_nsec;
+    return SUCCESS;
+}
+
+/**
+ * @brief Removes the baseline snapshot of a copy/privileged pair, if any.
+ *
+ * @param copy_file_path Absolute path to the copy file.
+ * @param privileged_file_path Absolute path to the privileged file.
+ * @return `SUCCESS` if the snapshot was removed or did not exist, or an error code otherwise.
+ */
+int removeBaseline(const char *copy_file_path, const char *privileged_file_path) {
+    char baseline_path[PATH_MAX];
+    const int path_result = getBaselinePath(copy_file_path, privileged_file_path, baseline_path);
+    if (path_result != SUCCESS) {
+        return path_result;
+    }
+    if (STATS_SYSCALL(unlink(baseline_path)) == -1 && errno != ENOENT) {
+        return ERROR_PERMISSION_DENIED;
+    }
+    return SUCCESS;
+}
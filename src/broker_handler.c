@@ -0,0 +1,495 @@
+#define _GNU_SOURCE // struct ucred, accept4, MSG_CMSG_CLOEXEC, O_PATH and syscall
+
+#include <errno.h>
+#include <fcntl.h>
+#include <fnmatch.h>
+#include <grp.h>
+#include <pthread.h>
+#include <pwd.h>
+#include <semaphore.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include <linux/limits.h>
+#include <linux/openat2.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/syscall.h>
+#include <sys/un.h>
+
+#include "../include/broker_handler.h"
+#include "../include/error_handler.h"
+#include "../include/stats_handler.h"
+#include "../include/trace_handler.h"
+
+#define MAX_PEER_GROUPS 256 // Supplementary groups considered for `%group` policy rules
+
+/**
+ * @file broker_handler.c
+ * @brief Implements the `--broker` daemon and its client.
+ *
+ * Every `redit` run normally starts as root through `sudo`, which can take hundreds of
+ * milliseconds with PAM and audit plugins. The broker is started once as root and listens
+ * on a Unix socket; an unprivileged run sends it the path of the privileged file and gets
+ * back a descriptor opened for reading (copy) or writing (overwrite) with `SCM_RIGHTS`.
+ * The caller is identified with `SO_PEERCRED`, and each request is checked against the
+ * policy file, so only what the administrator listed can be opened.
+ *
+ * The policy file has one rule per line, `<who> <access> <pattern>`:
+ * - `who` is a user name, `%group` or `*`.
+ * - `access` is `read`, `write` or `rw`.
+ * - `pattern` is a `fnmatch` pattern matched against the resolved path (`*` also matches `/`).
+ * Empty lines and lines starting with `#` are ignored. A policy file that is not owned by root
+ * or is writable by others denies everything.
+ */
+
+/**
+ * @enum broker_operation_t
+ * @brief What a client asks the broker for.
+ */
+typedef enum {
+    BROKER_OPEN_READ = 1, ///< A descriptor open for reading, to copy the file.
+    BROKER_OPEN_WRITE ///< A descriptor open for writing, to overwrite the file.
+} broker_operation_t;
+
+/**
+ * @struct broker_request_t
+ * @brief Request sent by a client, as one socket message.
+ */
+typedef struct {
+    uint32_t version; ///< `BROKER_PROTOCOL_VERSION`.
+    uint32_t operation; ///< A `broker_operation_t`.
+    char path[PATH_MAX]; ///< Absolute path to the privileged file, NUL-terminated.
+} broker_request_t;
+
+/**
+ * @struct broker_reply_t
+ * @brief Reply sent by the broker, carrying the descriptor on success.
+ */
+typedef struct {
+    int32_t result; ///< `SUCCESS` or an error code.
+} broker_reply_t;
+
+/**
+ * @struct broker_client_t
+ * @brief A connected client, handed to the thread serving it.
+ */
+typedef struct {
+    int fd; ///< Socket of the client.
+    const char *policy_path; ///< Path to the policy file.
+    sem_t *slots; ///< Free client slots, released once the client is served.
+} broker_client_t;
+
+static pthread_mutex_t policy_mutex = PTHREAD_MUTEX_INITIALIZER; // The user and group lookups are not reentrant
+
+// Function prototypes
+static bool isPeerInGroup(const char *group_name, gid_t primary_group, const gid_t *groups, int n_groups);
+
+static bool isAllowedByPolicy(const char *policy_path, uid_t uid, const char *path, bool write);
+
+static int openForClient(const struct ucred *peer, const broker_request_t *request, const char *policy_path,
+                         int *fd);
+
+static void handleClient(int client_fd, const char *policy_path);
+
+static void *serveClient(void *arg);
+
+/**
+ * @brief Checks whether a peer belongs to a group.
+ *
+ * @param group_name Name of the group.
+ * @param primary_group Primary group of the peer.
+ * @param groups Supplementary groups of the peer.
+ * @param n_groups Number of supplementary groups.
+ * @return `true` if the peer belongs to the group.
+ */
+static bool isPeerInGroup(const char *group_name, const gid_t primary_group, const gid_t *groups,
+                          const int n_groups) {
+    const struct group *gr = getgrnam(group_name);
+    if (gr == NULL) {
+        return false;
+    }
+    if (gr->gr_gid == primary_group) {
+        return true;
+    }
+    for (int i = 0; i < n_groups; ++i) {
+        if (groups[i] == gr->gr_gid) {
+            return true;
+        }
+    }
+    return false;
+}
+
+/**
+ * @brief Checks whether the policy file allows a user to open a file.
+ *
+ * @param policy_path Path to the policy file.
+ * @param uid User ID of the peer.
+ * @param path Resolved absolute path to the file.
+ * @param write Whether the file is opened for writing.
+ * @return `true` if a rule allows it, `false` otherwise.
+ *
+ * @details
+ * - The policy file is read on every request, so changes apply without restarting the broker.
+ * - Called with `policy_mutex` held, as clients are served concurrently.
+ * - Root may always open files, as it does not need the broker anyway.
+ */
+static bool isAllowedByPolicy(const char *policy_path, const uid_t uid, const char *path, const bool write) {
+    if (uid == 0) {
+        return true;
+    }
+    const struct passwd *pw = getpwuid(uid);
+    if (pw == NULL) {
+        return false;
+    }
+    char user_name[256];
+    strlcpy(user_name, pw->pw_name, sizeof(user_name));
+    const gid_t primary_group = pw->pw_gid;
+    gid_t groups[MAX_PEER_GROUPS];
+    int n_groups = MAX_PEER_GROUPS;
+    if (getgrouplist(user_name, primary_group, groups, &n_groups) == -1) {
+        n_groups = MAX_PEER_GROUPS; // Only the first groups are considered
+    }
+
+    FILE *policy = fopen(policy_path, "re");
+    if (policy == NULL) {
+        return false;
+    }
+    struct stat policy_stat;
+    if (fstat(fileno(policy), &policy_stat) == -1 || policy_stat.st_uid != 0 ||
+        (policy_stat.st_mode & (S_IWGRP | S_IWOTH)) != 0) {
+        fclose(policy);
+        return false; // Anyone able to edit the policy could grant themselves anything
+    }
+
+    bool allowed = false;
+    char line[PATH_MAX + 512];
+    while (!allowed && fgets(line, sizeof(line), policy) != NULL) {
+        char who[256], access_mode[8], pattern[PATH_MAX];
+        if (line[0] == '#' || sscanf(line, "%255s %7s %4095s", who, access_mode, pattern) != 3) {
+            continue;
+        }
+
+        const bool grants = strcmp(access_mode, "rw") == 0 ||
+                            strcmp(access_mode, write ? "write" : "read") == 0;
+        const bool matches_who = strcmp(who, "*") == 0 ||
+                                 (who[0] == '%' && isPeerInGroup(who + 1, primary_group, groups, n_groups)) ||
+                                 strcmp(who, user_name) == 0;
+        allowed = grants && matches_who && fnmatch(pattern, path, 0) == 0;
+    }
+    fclose(policy);
+    return allowed;
+}
+
+/**
+ * @brief Opens the file requested by a client, if the policy allows it.
+ *
+ * @param peer Credentials of the client.
+ * @param request Request of the client.
+ * @param policy_path Path to the policy file.
+ * @param fd Pointer to a variable where the opened descriptor will be stored.
+ * @return `SUCCESS` if the file was opened, or an error code otherwise.
+ *
+ * @details
+ * - The path is first opened with `O_PATH`, which gives a handle on the file without opening it:
+ *   opening some devices has side effects (arming a watchdog, rewinding a tape), so nothing is
+ *   opened for reading or writing before the checks pass.
+ * - The policy is matched against the path the kernel reports for the handle
+ *   (`/proc/self/fd/N`), whose device and inode must be those of the handle. Resolving the path
+ *   and opening it separately would let a client swap a symbolic link in between, to get a file
+ *   the policy does not name.
+ * - The path is resolved with `openat2` and `RESOLVE_NO_SYMLINKS | RESOLVE_NO_MAGICLINKS`, so no
+ *   link is followed at all; clients send canonical paths. Kernels without `openat2` fall back to
+ *   `O_NOFOLLOW`, the policy check on the handle still applying.
+ * - Only regular files are handed out. The file is then opened with the requested access through
+ *   `/proc/self/fd/N`, which reopens the very file that was checked.
+ * - Files opened for writing are not truncated: the client does so once it holds the lock.
+ */
+static int openForClient(const struct ucred *peer, const broker_request_t *request, const char *policy_path,
+                         int *fd) {
+    if (request->version != BROKER_PROTOCOL_VERSION ||
+        (request->operation != BROKER_OPEN_READ && request->operation != BROKER_OPEN_WRITE) ||
+        memchr(request->path, '\0', PATH_MAX) == NULL || request->path[0] != '/') {
+        return ERROR_INVALID_ARGUMENT;
+    }
+    const bool write = request->operation == BROKER_OPEN_WRITE;
+
+    // Get a handle on the file, without opening it
+    const int path_flags = O_PATH | O_NOFOLLOW | O_CLOEXEC;
+    struct open_how how = {.flags = (uint64_t) path_flags, .resolve = RESOLVE_NO_SYMLINKS | RESOLVE_NO_MAGICLINKS};
+    int path_fd = (int) syscall(SYS_openat2, AT_FDCWD, request->path, &how, sizeof(how));
+    if (path_fd == -1 && errno == ENOSYS) {
+        path_fd = open(request->path, path_flags); // Before Linux 5.6
+    }
+    if (path_fd == -1) {
+        return errno == ENOENT ? ERROR_FILE_NOT_FOUND : ERROR_PERMISSION_DENIED;
+    }
+    struct stat file_stat;
+    if (fstat(path_fd, &file_stat) == -1) {
+        close(path_fd);
+        return ERROR_PERMISSION_DENIED;
+    }
+    if (!S_ISREG(file_stat.st_mode)) {
+        close(path_fd);
+        return ERROR_INVALID_SOURCE;
+    }
+
+    // Match the policy against the file actually resolved
+    char fd_path[64];
+    char opened_path[PATH_MAX];
+    snprintf(fd_path, sizeof(fd_path), "/proc/self/fd/%d", path_fd);
+    const ssize_t length = readlink(fd_path, opened_path, PATH_MAX - 1);
+    struct stat path_stat;
+    bool allowed = length > 0;
+    if (allowed) {
+        opened_path[length] = '\0';
+        allowed = opened_path[0] == '/' && lstat(opened_path, &path_stat) == 0 &&
+                  path_stat.st_dev == file_stat.st_dev && path_stat.st_ino == file_stat.st_ino;
+    }
+    if (allowed) {
+        pthread_mutex_lock(&policy_mutex);
+        allowed = isAllowedByPolicy(policy_path, peer->uid, opened_path, write);
+        pthread_mutex_unlock(&policy_mutex);
+    }
+    if (!allowed) {
+        close(path_fd);
+        return ERROR_PERMISSION_DENIED;
+    }
+
+    // Only now open the checked file, with the requested access
+    const int file_fd = open(fd_path, (write ? O_WRONLY : O_RDONLY) | O_NOCTTY | O_CLOEXEC);
+    close(path_fd);
+    if (file_fd == -1) {
+        return errno == ENOENT ? ERROR_FILE_NOT_FOUND : ERROR_PERMISSION_DENIED;
+    }
+
+    *fd = file_fd;
+    return SUCCESS;
+}
+
+/**
+ * @brief Serves the single request of a connected client.
+ *
+ * @param client_fd Socket of the client.
+ * @param policy_path Path to the policy file.
+ */
+static void handleClient(const int client_fd, const char *policy_path) {
+    // A stalled client must not hold up the others
+    const struct timeval timeout = {.tv_sec = BROKER_CLIENT_TIMEOUT};
+    setsockopt(client_fd, SOL_SOCKET, SO_RCVTIMEO, &timeout, sizeof(timeout));
+    setsockopt(client_fd, SOL_SOCKET, SO_SNDTIMEO, &timeout, sizeof(timeout));
+
+    struct ucred peer;
+    socklen_t peer_size = sizeof(peer);
+    if (getsockopt(client_fd, SOL_SOCKET, SO_PEERCRED, &peer, &peer_size) == -1) {
+        return;
+    }
+
+    broker_request_t request;
+    if (recv(client_fd, &request, sizeof(request), 0) != (ssize_t) sizeof(request)) {
+        return;
+    }
+
+    int file_fd = -1;
+    const broker_reply_t reply = {.result = openForClient(&peer, &request, policy_path, &file_fd)};
+
+    // Attach the descriptor to the reply
+    struct iovec iov = {.iov_base = (void *) &reply, .iov_len = sizeof(reply)};
+    union {
+        char buffer[CMSG_SPACE(sizeof(int))];
+        struct cmsghdr align;
+    } control = {0};
+    struct msghdr message = {.msg_iov = &iov, .msg_iovlen = 1};
+    if (file_fd != -1) {
+        message.msg_control = control.buffer;
+        message.msg_controllen = sizeof(control.buffer);
+        struct cmsghdr *header = CMSG_FIRSTHDR(&message);
+        header->cmsg_level = SOL_SOCKET;
+        header->cmsg_type = SCM_RIGHTS;
+        header->cmsg_len = CMSG_LEN(sizeof(int));
+        memcpy(CMSG_DATA(header), &file_fd, sizeof(int));
+    }
+    sendmsg(client_fd, &message, MSG_NOSIGNAL);
+    if (file_fd != -1) {
+        close(file_fd);
+    }
+}
+
+/**
+ * @brief Serves a client on its own thread, then releases its slot.
+ *
+ * @param arg The `broker_client_t` of the client, freed here.
+ */
+static void *serveClient(void *arg) {
+    broker_client_t *client = arg;
+    handleClient(client->fd, client->policy_path);
+    close(client->fd);
+    sem_post(client->slots);
+    free(client);
+    return NULL;
+}
+
+/**
+ * @brief Runs the broker daemon until it is killed.
+ *
+ * @param socket_path Path of the socket to listen on.
+ * @param policy_path Path to the policy file.
+ * @return An error code if the broker could not start; it does not return otherwise.
+ *
+ * @details
+ * - Must run as root. The socket is created world-connectable, since the policy file
+ *   decides what each user may do, and a stale socket from a previous run is replaced.
+ * - Each client is served on a detached thread, so a slow one does not hold up the others. At
+ *   most `BROKER_MAX_CLIENTS` are served at once; further connections wait in the backlog, and
+ *   a client gets `BROKER_CLIENT_TIMEOUT` seconds at most.
+ */
+int runBroker(const char *socket_path, const char *policy_path) {
+    if (geteuid() != 0) {
+        return ERROR_PERMISSION_DENIED;
+    }
+
+    struct sockaddr_un address = {.sun_family = AF_UNIX};
+    if (strlen(socket_path) >= sizeof(address.sun_path)) {
+        return ERROR_PATH_TOO_LONG;
+    }
+    strlcpy(address.sun_path, socket_path, sizeof(address.sun_path));
+
+    char socket_dir[PATH_MAX];
+    strlcpy(socket_dir, socket_path, PATH_MAX);
+    char *last_slash = strrchr(socket_dir, '/');
+    if (last_slash != NULL && last_slash != socket_dir) {
+        *last_slash = '\0';
+        if (mkdir(socket_dir, S_IRWXU | S_IRGRP | S_IXGRP | S_IROTH | S_IXOTH) == -1 && errno != EEXIST) {
+            return ERROR_PATH_INVALID;
+        }
+    }
+
+    const int listen_fd = socket(AF_UNIX, SOCK_SEQPACKET | SOCK_CLOEXEC, 0);
+    if (listen_fd == -1) {
+        return ERROR_PERMISSION_DENIED;
+    }
+    unlink(socket_path);
+    if (bind(listen_fd, (const struct sockaddr *) &address, sizeof(address)) == -1 ||
+        chmod(socket_path, S_IRUSR | S_IWUSR | S_IRGRP | S_IWGRP | S_IROTH | S_IWOTH) == -1 ||
+        listen(listen_fd, SOMAXCONN) == -1) {
+        close(listen_fd);
+        return ERROR_PERMISSION_DENIED;
+    }
+
+    sem_t slots;
+    sem_init(&slots, 0, BROKER_MAX_CLIENTS);
+    pthread_attr_t attributes;
+    pthread_attr_init(&attributes);
+    pthread_attr_setdetachstate(&attributes, PTHREAD_CREATE_DETACHED);
+
+    for (;;) {
+        while (sem_wait(&slots) == -1) {
+            // Interrupted by a signal
+        }
+        const int client_fd = accept4(listen_fd, NULL, NULL, SOCK_CLOEXEC);
+        if (client_fd == -1) {
+            if (errno == EMFILE || errno == ENFILE) {
+                const struct timespec pause = {.tv_nsec = 10000000};
+                nanosleep(&pause, NULL); // Wait for descriptors to be released
+            }
+            sem_post(&slots);
+            continue;
+        }
+
+        broker_client_t *client = malloc(sizeof(broker_client_t));
+        pthread_t thread;
+        if (client != NULL) {
+            *client = (broker_client_t){.fd = client_fd, .policy_path = policy_path, .slots = &slots};
+        }
+        if (client == NULL || pthread_create(&thread, &attributes, serveClient, client) != 0) {
+            // Out of memory or threads: serve it here
+            free(client);
+            handleClient(client_fd, policy_path);
+            close(client_fd);
+            sem_post(&slots);
+        }
+    }
+}
+
+/**
+ * @brief Asks the broker for a descriptor on a privileged file.
+ *
+ * @param socket_path Path of the broker socket.
+ * @param file_path Absolute path to the privileged file.
+ * @param write `true` for a descriptor open for writing (overwrite), `false` for reading (copy).
+ * @param fd Pointer to a variable where the received descriptor will be stored.
+ * @return `SUCCESS` if a descriptor was received, or an error code otherwise.
+ *
+ * @details
+ * - Returns `ERROR_BROKER_UNAVAILABLE` if no broker listens on the socket.
+ * - A descriptor open for writing is not truncated; the caller locks it first.
+ */
+int requestBrokerFile(const char *socket_path, const char *file_path, const bool write, int *fd) {
+    *fd = -1;
+    const uint64_t start_ns = traceNow();
+
+    struct sockaddr_un address = {.sun_family = AF_UNIX};
+    if (strlen(socket_path) >= sizeof(address.sun_path)) {
+        return ERROR_PATH_TOO_LONG;
+    }
+    strlcpy(address.sun_path, socket_path, sizeof(address.sun_path));
+
+    broker_request_t request = {
+        .version = BROKER_PROTOCOL_VERSION,
+        .operation = write ? BROKER_OPEN_WRITE : BROKER_OPEN_READ
+    };
+    if (strlcpy(request.path, file_path, PATH_MAX) >= PATH_MAX) {
+        return ERROR_PATH_TOO_LONG;
+    }
+
+    const int socket_fd = STATS_SYSCALL(socket(AF_UNIX, SOCK_SEQPACKET | SOCK_CLOEXEC, 0));
+    if (socket_fd == -1) {
+        return ERROR_BROKER_UNAVAILABLE;
+    }
+    if (STATS_SYSCALL(connect(socket_fd, (const struct sockaddr *) &address, sizeof(address))) == -1 ||
+        STATS_SYSCALL(send(socket_fd, &request, sizeof(request), MSG_NOSIGNAL)) != (ssize_t) sizeof(request)) {
+        close(socket_fd);
+        return ERROR_BROKER_UNAVAILABLE;
+    }
+
+    // Receive the reply and the descriptor attached to it
+    broker_reply_t reply;
+    struct iovec iov = {.iov_base = &reply, .iov_len = sizeof(reply)};
+    union {
+        char buffer[CMSG_SPACE(sizeof(int))];
+        struct cmsghdr align;
+    } control;
+    struct msghdr message = {
+        .msg_iov = &iov,
+        .msg_iovlen = 1,
+        .msg_control = control.buffer,
+        .msg_controllen = sizeof(control.buffer)
+    };
+    const ssize_t received = STATS_SYSCALL(recvmsg(socket_fd, &message, MSG_CMSG_CLOEXEC));
+    STATS_SYSCALL(close(socket_fd));
+    if (received != (ssize_t) sizeof(reply)) {
+        return ERROR_BROKER_UNAVAILABLE;
+    }
+
+    int received_fd = -1;
+    const struct cmsghdr *header = CMSG_FIRSTHDR(&message);
+    if (header != NULL && header->cmsg_level == SOL_SOCKET && header->cmsg_type == SCM_RIGHTS) {
+        memcpy(&received_fd, CMSG_DATA(header), sizeof(int));
+    }
+    traceSpan("broker", write ? "openWrite" : "openRead", start_ns, file_path, -1);
+
+    if (reply.result != SUCCESS) {
+        if (received_fd != -1) {
+            close(received_fd);
+        }
+        return reply.result;
+    }
+    if (received_fd == -1) {
+        return ERROR_BROKER_UNAVAILABLE;
+    }
+    *fd = received_fd;
+    return SUCCESS;
+}
@@ -0,0 +1,140 @@
+#include <pthread.h>
+#include <string.h>
+
+#if defined(__x86_64__)
+#include <immintrin.h>
+#elif defined(__aarch64__) && defined(__ARM_FEATURE_CRC32)
+#include <arm_acle.h>
+#endif
+
+#include "../include/checksum_handler.h"
+
+#define CRC32C_POLYNOMIAL 0x82F63B78 // Castagnoli polynomial, bit-reversed
+
+/**
+ * @file checksum_handler.c
+ * @brief Computes CRC32C checksums.
+ *
+ * On x86-64 CPUs with SSE4.2, which is checked once at run time so the binary still runs on
+ * older CPUs, and on ARMv8 builds with the CRC extension, the checksum is computed 8 bytes per
+ * instruction. Elsewhere a slicing-by-8 table does the same 8 bytes per step in software.
+ */
+
+typedef uint32_t (*crc32c_function_t)(uint32_t crc, const uint8_t *data, size_t length);
+
+static pthread_once_t crc32c_once = PTHREAD_ONCE_INIT; // Picks the implementation on first use
+static crc32c_function_t crc32c_function; // Implementation in use
+static uint32_t crc32c_table[8][256]; // Slicing-by-8 tables of the software implementation
+
+// Function prototypes
+static void selectCrc32c();
+
+static void fillCrc32cTables();
+
+static uint32_t crc32cSoftware(uint32_t crc, const uint8_t *data, size_t length);
+
+/**
+ * @brief Adds bytes to a CRC32C checksum.
+ *
+ * @param crc Checksum of the bytes before `data`, or 0 to start a new one.
+ * @param data Bytes to add.
+ * @param length Number of bytes to add.
+ * @return The checksum of the previous bytes followed by `data`.
+ *
+ * @details
+ * - Safe to call from several threads at once.
+ */
+uint32_t updateCrc32c(const uint32_t crc, const void *data, const size_t length) {
+    pthread_once(&crc32c_once, selectCrc32c);
+    return ~crc32c_function(~crc, data, length);
+}
+
+#if defined(__x86_64__)
+/**
+ * @brief Computes CRC32C with the SSE4.2 `crc32` instruction.
+ */
+__attribute__((target("sse4.2"))) static uint32_t crc32cHardware(const uint32_t crc, const uint8_t *data,
+                                                                 size_t length) {
+    uint64_t crc64 = crc;
+    for (; length >= 8; data += 8, length -= 8) {
+        uint64_t word;
+        memcpy(&word, data, sizeof(word));
+        crc64 = _mm_crc32_u64(crc64, word);
+    }
+    uint32_t crc32 = (uint32_t) crc64;
+    for (; length > 0; ++data, --length) {
+        crc32 = _mm_crc32_u8(crc32, *data);
+    }
+    return crc32;
+}
+#elif defined(__aarch64__) && defined(__ARM_FEATURE_CRC32)
+/**
+ * @brief Computes CRC32C with the ARMv8 `crc32c` instructions.
+ */
+static uint32_t crc32cHardware(uint32_t crc, const uint8_t *data, size_t length) {
+    for (; length >= 8; data += 8, length -= 8) {
+        uint64_t word;
+        memcpy(&word, data, sizeof(word));
+        crc = __crc32cd(crc, word);
+    }
+    for (; length > 0; ++data, --length) {
+        crc = __crc32cb(crc, *data);
+    }
+    return crc;
+}
+#endif
+
+/**
+ * @brief Picks the fastest implementation the CPU supports, building the software tables if needed.
+ */
+static void selectCrc32c() {
+#if defined(__x86_64__)
+    __builtin_cpu_init();
+    if (__builtin_cpu_supports("sse4.2")) {
+        crc32c_function = crc32cHardware;
+        return;
+    }
+#elif defined(__aarch64__) && defined(__ARM_FEATURE_CRC32)
+    crc32c_function = crc32cHardware;
+    return;
+#endif
+    fillCrc32cTables();
+    crc32c_function = crc32cSoftware;
+}
+
+/**
+ * @brief Builds the slicing-by-8 tables of the software implementation.
+ */
+static void fillCrc32cTables() {
+    for (uint32_t i = 0; i < 256; ++i) {
+        uint32_t crc = i;
+        for (int bit = 0; bit < 8; ++bit) {
+            crc = crc & 1 ? (crc >> 1) ^ CRC32C_POLYNOMIAL : crc >> 1;
+        }
+        crc32c_table[0][i] = crc;
+    }
+    for (int slice = 1; slice < 8; ++slice) {
+        for (int i = 0; i < 256; ++i) {
+            const uint32_t previous = crc32c_table[slice - 1][i];
+            crc32c_table[slice][i] = (previous >> 8) ^ crc32c_table[0][previous & 0xFF];
+        }
+    }
+}
+
+/**
+ * @brief Computes CRC32C with slicing-by-8 tables.
+ */
+static uint32_t crc32cSoftware(uint32_t crc, const uint8_t *data, size_t length) {
+    for (; length >= 8; data += 8, length -= 8) {
+        const uint32_t low = crc ^ ((uint32_t) data[0] | (uint32_t) data[1] << 8 | (uint32_t) data[2] << 16 |
+                                    (uint32_t) data[3] << 24);
+        crc = crc32c_table[7][low & 0xFF] ^ crc32c_table[6][(low >> 8) & 0xFF] ^
+              crc32c_table[5][(low >> 16) & 0xFF] ^ crc32c_table[4][low >> 24] ^
+              crc32c_table[3][data[4]] ^ crc32c_table[2][data[5]] ^ crc32c_table[1][data[6]] ^
+              crc32c_table[0][data[7]];
+    }
+    for (; length > 0; ++data, --length) {
+        crc = (crc >> 8) ^ crc32c_table[0][(crc ^ *data) & 0xFF];
+    }
+    return crc;
+}
@@ -0,0 +1,721 @@
+#include <errno.h>
+#include <fcntl.h>
+#include <pthread.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <linux/limits.h>
+#include <sys/stat.h>
+#include <zlib.h>
+
+#ifdef REDIT_HAVE_ZSTD
+#include <zstd.h>
+#endif
+
+#include "../include/baseline_handler.h"
+#include "../include/checksum_handler.h"
+#include "../include/compression_handler.h"
+#include "../include/error_handler.h"
+#include "../include/progress_handler.h"
+#include "../include/stats_handler.h"
+
+/**
+ * @file compression_handler.c
+ * @brief Decompresses privileged files into their copies and compresses the copies back.
+ *
+ * Decompression is a single stream, as gzip and Zstandard streams are. Compression is split
+ * the way `pigz` and `zstdmt` split it: the input is cut into `COMPRESSION_BLOCK_SIZE`
+ * blocks, each compressed by a pool of threads into a complete gzip member or Zstandard
+ * frame, and written in order. Both formats define a file of concatenated members (frames)
+ * as the concatenation of their content, so `zcat`, `gzip -d` and `zstd -d` read the result
+ * as usual. Blocks lose the history they would share with the previous one: about 0.1% of
+ * the compressed size with gzip, whose window is 32 KB anyway, and 1 to 2% with Zstandard on
+ * typical text. Files made of long repeats lose more.
+ *
+ * The main thread reads blocks ahead while the pool compresses, and writes each one as soon
+ * as it and those before it are done, so reading, compressing and writing overlap and the
+ * speed scales with the cores until the disk is the limit.
+ *
+ * A gzip header tells whether the file was compressed at the fastest or the best level
+ * (`XFL`), and the level is taken from it; otherwise the default of the codec is used.
+ */
+
+#define COMPRESSION_RECORD_MAGIC 0x43444552U // "REDC"
+#define GZIP_DEFAULT_LEVEL 6 // Level of `gzip` without options
+#define GZIP_HEADER_SIZE 10 // Fixed part of a gzip member header
+
+/**
+ * @brief A compression record, as stored next to the baseline of its copy/privileged pair.
+ */
+typedef struct {
+    uint32_t magic; ///< `COMPRESSION_RECORD_MAGIC`.
+    compression_t compression; ///< Codec and level of the privileged file.
+    int64_t size; ///< Size of the privileged file when its content was last decompressed.
+    int64_t modified_sec, modified_nsec; ///< Modification time of the privileged file at that time.
+} compression_record_t;
+
+/**
+ * @brief One block of a parallel compression.
+ */
+typedef struct {
+    uint8_t *input; ///< Uncompressed bytes.
+    size_t input_length; ///< Bytes in `input`.
+    uint8_t *output; ///< Compressed member (frame).
+    size_t output_length; ///< Bytes in `output`.
+    bool compressed; ///< Whether `output` is ready, or `result` failed.
+    int result; ///< `SUCCESS` or an error code.
+} compression_block_t;
+
+/**
+ * @brief State shared by the threads of a parallel compression.
+ *
+ * Blocks are numbered in input order; block `n` lives in slot `n % n_blocks`.
+ */
+typedef struct {
+    const compression_t *compression; ///< Codec and level.
+    pthread_mutex_t mutex; ///< Guards the counters and the `compressed` flags.
+    pthread_cond_t filled; ///< Signaled when a block is read, or the input ends.
+    pthread_cond_t compressed; ///< Signaled when a block is compressed.
+    compression_block_t *blocks; ///< Ring of slots.
+    size_t n_blocks; ///< Number of slots.
+    size_t output_capacity; ///< Size of each `output`.
+    uint64_t next_read; ///< Number of the next block to read.
+    uint64_t next_compress; ///< Number of the next block to compress.
+    bool finished; ///< Whether the input is fully read (or reading failed).
+} compression_pipeline_t;
+
+/**
+ * @brief Per-thread compression context.
+ */
+typedef struct {
+    z_stream gzip; ///< Deflate state, reset for each member.
+#ifdef REDIT_HAVE_ZSTD
+    ZSTD_CCtx *zstd; ///< Zstandard context, reused for each frame.
+#endif
+} compressor_t;
+
+// Function prototypes
+static void *compressBlocks(void *arg);
+
+static int initCompressor(compressor_t *compressor, const compression_t *compression);
+
+static int compressBlock(compressor_t *compressor, const compression_t *compression, compression_block_t *block,
+                         size_t capacity);
+
+static void destroyCompressor(compressor_t *compressor, const compression_t *compression);
+
+static int decompressGzip(int src_fd, int dest_fd, uint32_t *crc, off_t *written);
+
+#ifdef REDIT_HAVE_ZSTD
+static int decompressZstd(int src_fd, int dest_fd, uint32_t *crc, off_t *written);
+#endif
+
+static int emitOutput(int dest_fd, const uint8_t *data, size_t length, uint32_t *crc, off_t *written);
+
+static ssize_t readBlock(int fd, uint8_t *buffer, size_t length, off_t offset);
+
+static int getRecordPath(const char *copy_file_path, const char *privileged_file_path, char record_path[PATH_MAX]);
+
+/**
+ * @brief Tells whether a file is compressed in a format that can be edited transparently.
+ *
+ * @param fd Descriptor of the file, open for reading.
+ * @param compression Filled with the codec and level; `COMPRESSION_NONE` for any other file.
+ * @return `SUCCESS`, or `ERROR_COPY_FAILED` if the file cannot be read.
+ *
+ * @details
+ * - Zstandard files are reported as not compressed when `redit` is built without libzstd,
+ *   so they are copied as they are.
+ */
+int detectCompression(const int fd, compression_t *compression) {
+    *compression = (compression_t){.format = COMPRESSION_NONE, .level = 0};
+    uint8_t header[GZIP_HEADER_SIZE];
+    const ssize_t n_read = readBlock(fd, header, sizeof(header), 0);
+    if (n_read == -1) {
+        return ERROR_COPY_FAILED;
+    }
+
+    // Magic number and deflate method (RFC 1952, 2.3.1); XFL tells the fastest and best levels apart
+    if (n_read == GZIP_HEADER_SIZE && header[0] == 0x1F && header[1] == 0x8B && header[2] == 8) {
+        compression->format = COMPRESSION_GZIP;
+        compression->level = header[8] == 2 ? Z_BEST_COMPRESSION
+                           : header[8] == 4 ? Z_BEST_SPEED
+                                            : GZIP_DEFAULT_LEVEL;
+    }
+#ifdef REDIT_HAVE_ZSTD
+    // Frame magic number (RFC 8878, 3.1.1); the level is not recorded in the frame
+    if (n_read >= 4 && header[0] == 0x28 && header[1] == 0xB5 && header[2] == 0x2F && header[3] == 0xFD) {
+        compression->format = COMPRESSION_ZSTD;
+        compression->level = ZSTD_CLEVEL_DEFAULT;
+    }
+#endif
+    return SUCCESS;
+}
+
+/**
+ * @brief Returns the name of a compressed format, as shown to the user.
+ */
+const char *getCompressionName(const compression_format_t format) {
+    switch (format) {
+        case COMPRESSION_GZIP:
+            return "gzip";
+        case COMPRESSION_ZSTD:
+            return "zstd";
+        default:
+            return "none";
+    }
+}
+
+/**
+ * @brief Decompresses a file.
+ *
+ * @param src_fd Descriptor of the compressed file, read from its start.
+ * @param dest_fd Descriptor the content is written to from its start, or -1 to only take its checksum.
+ * @param format Format of the compressed file.
+ * @param crc Set to the CRC32C of the content, or `NULL`.
+ * @param written Set to the size of the content, or `NULL`.
+ * @return `SUCCESS` if the whole file was decompressed, `ERROR_INVALID_SOURCE` if it is
+ *         corrupted or truncated, or another error code otherwise.
+ *
+ * @details
+ * - Concatenated members (frames) are decompressed one after the other, as `gzip -d` does.
+ * - The compressed bytes consumed are reported to the progress counter.
+ */
+int decompressFile(const int src_fd, const int dest_fd, const compression_format_t format, uint32_t *crc,
+                   off_t *written) {
+    uint32_t content_crc = 0;
+    off_t content_size = 0;
+    int decompress_result = ERROR_INVALID_ARGUMENT;
+    if (format == COMPRESSION_GZIP) {
+        decompress_result = decompressGzip(src_fd, dest_fd, &content_crc, &content_size);
+    }
+#ifdef REDIT_HAVE_ZSTD
+    if (format == COMPRESSION_ZSTD) {
+        decompress_result = decompressZstd(src_fd, dest_fd, &content_crc, &content_size);
+    }
+#endif
+    if (decompress_result == SUCCESS && dest_fd != -1 && STATS_SYSCALL(ftruncate(dest_fd, content_size)) == -1) {
+        decompress_result = ERROR_COPY_FAILED;
+    }
+    if (crc != NULL) {
+        *crc = content_crc;
+    }
+    if (written != NULL) {
+        *written = content_size;
+    }
+    return decompress_result;
+}
+
+/**
+ * @brief Compresses a file with several threads.
+ *
+ * @param src_fd Descriptor of the file to compress, read from its start.
+ * @param dest_fd Descriptor the compressed file is written to from its start.
+ * @param compression Codec and level.
+ * @param threads Threads compressing blocks, besides the one reading and writing them.
+ * @param crc Set to the CRC32C of the uncompressed content, or `NULL`.
+ * @param read Set to the size of the uncompressed content, or `NULL`.
+ * @return `SUCCESS` if the file was compressed, or an error code otherwise.
+ *
+ * @details
+ * - The uncompressed bytes read are reported to the progress counter.
+ */
+int compressFile(const int src_fd, const int dest_fd, const compression_t *compression, size_t threads,
+                 uint32_t *crc, off_t *read) {
+    if (compression->format == COMPRESSION_NONE) {
+        return ERROR_INVALID_ARGUMENT;
+    }
+    threads = threads < 1 ? 1 : threads > COMPRESSION_MAX_THREADS ? COMPRESSION_MAX_THREADS : threads;
+
+    // Two slots per thread keep every thread busy while the main thread reads and writes
+    compression_pipeline_t pipeline = {.compression = compression, .n_blocks = 2 * threads};
+    pipeline.output_capacity = compressBound(COMPRESSION_BLOCK_SIZE) + 32; // Plus the gzip header and trailer
+#ifdef REDIT_HAVE_ZSTD
+    if (compression->format == COMPRESSION_ZSTD) {
+        pipeline.output_capacity = ZSTD_compressBound(COMPRESSION_BLOCK_SIZE);
+    }
+#endif
+    pipeline.blocks = calloc(pipeline.n_blocks, sizeof(compression_block_t));
+    if (pipeline.blocks == NULL) {
+        return ERROR_MEMORY_ALLOCATION;
+    }
+    int compress_result = SUCCESS;
+    for (size_t i = 0; i < pipeline.n_blocks && compress_result == SUCCESS; ++i) {
+        pipeline.blocks[i].input = malloc(COMPRESSION_BLOCK_SIZE);
+        pipeline.blocks[i].output = malloc(pipeline.output_capacity);
+        if (pipeline.blocks[i].input == NULL || pipeline.blocks[i].output == NULL) {
+            compress_result = ERROR_MEMORY_ALLOCATION;
+        }
+    }
+    pthread_mutex_init(&pipeline.mutex, NULL);
+    pthread_cond_init(&pipeline.filled, NULL);
+    pthread_cond_init(&pipeline.compressed, NULL);
+
+    pthread_t workers[COMPRESSION_MAX_THREADS];
+    size_t n_started = 0;
+    if (compress_result == SUCCESS) {
+        for (; n_started < threads; ++n_started) {
+            if (pthread_create(&workers[n_started], NULL, compressBlocks, &pipeline) != 0) {
+                break;
+            }
+        }
+        compress_result = n_started > 0 ? SUCCESS : ERROR_MEMORY_ALLOCATION;
+    }
+
+    // Read blocks ahead and write the compressed ones in order, until both run out
+    uint32_t content_crc = 0;
+    off_t read_offset = 0, write_offset = 0;
+    uint64_t next_write = 0;
+    bool input_done = compress_result != SUCCESS;
+    pthread_mutex_lock(&pipeline.mutex);
+    while (compress_result == SUCCESS && (!input_done || next_write < pipeline.next_read)) {
+        compression_block_t *ready = &pipeline.blocks[next_write % pipeline.n_blocks];
+        if (next_write < pipeline.next_read && ready->compressed) {
+            pthread_mutex_unlock(&pipeline.mutex);
+            compress_result = ready->result;
+            if (compress_result == SUCCESS &&
+                emitOutput(dest_fd, ready->output, ready->output_length, NULL, &write_offset) != SUCCESS) {
+                compress_result = ERROR_COPY_FAILED;
+            }
+            pthread_mutex_lock(&pipeline.mutex);
+            ready->compressed = false;
+            next_write++;
+        } else if (!input_done && pipeline.next_read - next_write < pipeline.n_blocks) {
+            compression_block_t *free_block = &pipeline.blocks[pipeline.next_read % pipeline.n_blocks];
+            pthread_mutex_unlock(&pipeline.mutex);
+            const ssize_t n_read = readBlock(src_fd, free_block->input, COMPRESSION_BLOCK_SIZE, read_offset);
+            if (n_read > 0) {
+                content_crc = updateCrc32c(content_crc, free_block->input, (size_t) n_read);
+                read_offset += n_read;
+                progressAdd(n_read);
+            }
+            pthread_mutex_lock(&pipeline.mutex);
+            if (n_read == -1) {
+                compress_result = ERROR_COPY_FAILED;
+            } else if (n_read > 0 || pipeline.next_read == 0) {
+                // An empty file still compresses to one (empty) member, which is a valid file
+                free_block->input_length = (size_t) n_read;
+                pipeline.next_read++;
+                pthread_cond_signal(&pipeline.filled);
+            }
+            input_done = n_read < COMPRESSION_BLOCK_SIZE;
+        } else {
+            pthread_cond_wait(&pipeline.compressed, &pipeline.mutex);
+        }
+    }
+    pipeline.finished = true;
+    pthread_cond_broadcast(&pipeline.filled);
+    pthread_mutex_unlock(&pipeline.mutex);
+
+    for (size_t i = 0; i < n_started; ++i) {
+        pthread_join(workers[i], NULL);
+    }
+    pthread_cond_destroy(&pipeline.compressed);
+    pthread_cond_destroy(&pipeline.filled);
+    pthread_mutex_destroy(&pipeline.mutex);
+    for (size_t i = 0; i < pipeline.n_blocks; ++i) {
+        free(pipeline.blocks[i].input);
+        free(pipeline.blocks[i].output);
+    }
+    free(pipeline.blocks);
+
+    if (compress_result == SUCCESS && STATS_SYSCALL(ftruncate(dest_fd, write_offset)) == -1) {
+        compress_result = ERROR_COPY_FAILED;
+    }
+    if (crc != NULL) {
+        *crc = content_crc;
+    }
+    if (read != NULL) {
+        *read = read_offset;
+    }
+    return compress_result;
+}
+
+/**
+ * @brief Records the codec and level of a privileged file whose copy holds its decompressed content.
+ *
+ * @param copy_file_path Absolute path to the copy file.
+ * @param privileged_file_path Absolute path to the privileged file.
+ * @param compression Codec and level of the privileged file.
+ * @param prv_stat Metadata of the privileged file at the time its content was decompressed.
+ * @return `SUCCESS` if the record was written, or an error code otherwise.
+ *
+ * @details
+ * - The record lives next to the baseline snapshot of the pair, in the root-only state directory.
+ * - It also stands in for the baseline stamp in the change check: the baseline holds the
+ *   decompressed content, whose size tells nothing about the compressed file.
+ */
+int saveCompression(const char *copy_file_path, const char *privileged_file_path, const compression_t *compression,
+                    const struct stat *prv_stat) {
+    if (mkdir(REDIT_STATE_DIR, 0755) == -1 && errno != EEXIST) {
+        return errno == EACCES ? ERROR_PERMISSION_DENIED : ERROR_PATH_INVALID;
+    }
+    if (mkdir(BASELINE_DIR, 0700) == -1 && errno != EEXIST) {
+        return errno == EACCES ? ERROR_PERMISSION_DENIED : ERROR_PATH_INVALID;
+    }
+    char record_path[PATH_MAX];
+    const int path_result = getRecordPath(copy_file_path, privileged_file_path, record_path);
+    if (path_result != SUCCESS) {
+        return path_result;
+    }
+
+    const compression_record_t record = {
+        .magic = COMPRESSION_RECORD_MAGIC,
+        .compression = *compression,
+        .size = prv_stat->st_size,
+        .modified_sec = prv_stat->st_mtim.tv_sec,
+        .modified_nsec = prv_stat->st_mtim.tv_nsec
+    };
+    const int fd = STATS_SYSCALL(open(record_path, O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, S_IRUSR | S_IWUSR));
+    if (fd == -1) {
+        return ERROR_PERMISSION_DENIED;
+    }
+    const bool written = statsPwrite(fd, &record, sizeof(record), 0) == (ssize_t) sizeof(record);
+    if (STATS_SYSCALL(close(fd)) == -1 || !written) {
+        unlink(record_path);
+        return ERROR_COPY_FAILED;
+    }
+    return SUCCESS;
+}
+
+/**
+ * @brief Reads the codec and level recorded for a copy file.
+ *
+ * @param copy_file_path Absolute path to the copy file.
+ * @param privileged_file_path Absolute path to the privileged file.
+ * @param compression Filled with the codec and level.
+ * @param prv_changed Set if the privileged file changed since its content was decompressed, or `NULL`.
+ * @return `SUCCESS` if the copy holds decompressed content, `ERROR_FILE_NOT_FOUND` if it holds
+ *         the privileged file as is, or another error code.
+ *
+ * @details
+ * - Compares size and nanosecond modification time, as `checkBaseline` does.
+ */
+int loadCompression(const char *copy_file_path, const char *privileged_file_path, compression_t *compression,
+                    bool *prv_changed) {
+    char record_path[PATH_MAX];
+    const int path_result = getRecordPath(copy_file_path, privileged_file_path, record_path);
+    if (path_result != SUCCESS) {
+        return path_result;
+    }
+    const int fd = STATS_SYSCALL(open(record_path, O_RDONLY | O_CLOEXEC));
+    if (fd == -1) {
+        return errno == ENOENT ? ERROR_FILE_NOT_FOUND : ERROR_PERMISSION_DENIED;
+    }
+    compression_record_t record;
+    const bool complete = statsPread(fd, &record, sizeof(record), 0) == (ssize_t) sizeof(record);
+    close(fd);
+    if (!complete || record.magic != COMPRESSION_RECORD_MAGIC) {
+        return ERROR_FILE_NOT_FOUND;
+    }
+    *compression = record.compression;
+
+    struct stat prv_stat;
+    if (prv_changed != NULL) {
+        *prv_changed = STATS_SYSCALL(stat(privileged_file_path, &prv_stat)) == -1 || prv_stat.st_size != record.size ||
+                       prv_stat.st_mtim.tv_sec != record.modified_sec ||
+                       prv_stat.st_mtim.tv_nsec != record.modified_nsec;
+    }
+    return SUCCESS;
+}
+
+/**
+ * @brief Forgets the codec and level recorded for a copy file, if any.
+ *
+ * @param copy_file_path Absolute path to the copy file.
+ * @param privileged_file_path Absolute path to the privileged file.
+ * @return `SUCCESS` if the record was removed or did not exist, or an error code otherwise.
+ */
+int removeCompression(const char *copy_file_path, const char *privileged_file_path) {
+    char record_path[PATH_MAX];
+    const int path_result = getRecordPath(copy_file_path, privileged_file_path, record_path);
+    if (path_result != SUCCESS) {
+        return path_result;
+    }
+    if (STATS_SYSCALL(unlink(record_path)) == -1 && errno != ENOENT) {
+        return ERROR_PERMISSION_DENIED;
+    }
+    return SUCCESS;
+}
+
+/**
+ * @brief Compresses blocks as they are read; the body of each compression thread.
+ *
+ * @param arg Pointer to the `compression_pipeline_t`.
+ * @return Always `NULL`; the outcome of each block is in its `result`.
+ */
+static void *compressBlocks(void *arg) {
+    compression_pipeline_t *pipeline = arg;
+    compressor_t compressor;
+    const int init_result = initCompressor(&compressor, pipeline->compression);
+
+    pthread_mutex_lock(&pipeline->mutex);
+    while (true) {
+        while (pipeline->next_compress == pipeline->next_read && !pipeline->finished) {
+            pthread_cond_wait(&pipeline->filled, &pipeline->mutex);
+        }
+        if (pipeline->next_compress == pipeline->next_read) {
+            break; // Input finished and every block taken
+        }
+        compression_block_t *block = &pipeline->blocks[pipeline->next_compress++ % pipeline->n_blocks];
+        pthread_mutex_unlock(&pipeline->mutex);
+        block->result = init_result == SUCCESS
+                            ? compressBlock(&compressor, pipeline->compression, block, pipeline->output_capacity)
+                            : init_result;
+        pthread_mutex_lock(&pipeline->mutex);
+        block->compressed = true;
+        pthread_cond_signal(&pipeline->compressed);
+    }
+    pthread_mutex_unlock(&pipeline->mutex);
+
+    if (init_result == SUCCESS) {
+        destroyCompressor(&compressor, pipeline->compression);
+    }
+    return NULL;
+}
+
+/**
+ * @brief Sets up the compression context of a thread.
+ *
+ * @return `SUCCESS`, or `ERROR_MEMORY_ALLOCATION` if the codec could not be initialized.
+ */
+static int initCompressor(compressor_t *compressor, const compression_t *compression) {
+    memset(compressor, 0, sizeof(*compressor));
+    if (compression->format == COMPRESSION_GZIP) {
+        // windowBits 15 + 16: the largest window, wrapped in a gzip header and trailer
+        return deflateInit2(&compressor->gzip, compression->level, Z_DEFLATED, 15 + 16, 8, Z_DEFAULT_STRATEGY) == Z_OK
+                   ? SUCCESS
+                   : ERROR_MEMORY_ALLOCATION;
+    }
+#ifdef REDIT_HAVE_ZSTD
+    if (compression->format == COMPRESSION_ZSTD) {
+        compressor->zstd = ZSTD_createCCtx();
+        return compressor->zstd != NULL ? SUCCESS : ERROR_MEMORY_ALLOCATION;
+    }
+#endif
+    return ERROR_INVALID_ARGUMENT;
+}
+
+/**
+ * @brief Compresses one block into a complete member (frame).
+ *
+ * @return `SUCCESS`, or `ERROR_COMPRESSION_FAILED` if the codec failed.
+ */
+static int compressBlock(compressor_t *compressor, const compression_t *compression, compression_block_t *block,
+                         const size_t capacity) {
+    if (compression->format == COMPRESSION_GZIP) {
+        z_stream *stream = &compressor->gzip;
+        if (deflateReset(stream) != Z_OK) {
+            return ERROR_COMPRESSION_FAILED;
+        }
+        stream->next_in = block->input;
+        stream->avail_in = (uInt) block->input_length;
+        stream->next_out = block->output;
+        stream->avail_out = (uInt) capacity;
+        if (deflate(stream, Z_FINISH) != Z_STREAM_END) {
+            return ERROR_COMPRESSION_FAILED;
+        }
+        block->output_length = capacity - stream->avail_out;
+        return SUCCESS;
+    }
+#ifdef REDIT_HAVE_ZSTD
+    if (compression->format == COMPRESSION_ZSTD) {
+        const size_t length = ZSTD_compressCCtx(compressor->zstd, block->output, capacity, block->input,
+                                                block->input_length, compression->level);
+        if (ZSTD_isError(length)) {
+            return ERROR_COMPRESSION_FAILED;
+        }
+        block->output_length = length;
+        return SUCCESS;
+    }
+#endif
+    return ERROR_INVALID_ARGUMENT;
+}
+
+/**
+ * @brief Frees the compression context of a thread.
+ */
+static void destroyCompressor(compressor_t *compressor, const compression_t *compression) {
+    if (compression->format == COMPRESSION_GZIP) {
+        deflateEnd(&compressor->gzip);
+    }
+#ifdef REDIT_HAVE_ZSTD
+    if (compression->format == COMPRESSION_ZSTD) {
+        ZSTD_freeCCtx(compressor->zstd);
+    }
+#endif
+}
+
+/**
+ * @brief Decompresses a gzip file, member after member; see `decompressFile`.
+ */
+static int decompressGzip(const int src_fd, const int dest_fd, uint32_t *crc, off_t *written) {
+    uint8_t *input = malloc(COMPRESSION_STREAM_SIZE);
+    uint8_t *output = malloc(COMPRESSION_STREAM_SIZE);
+    z_stream stream = {0};
+    // windowBits 15 + 16: the largest window, gzip header and trailer expected
+    if (input == NULL || output == NULL || inflateInit2(&stream, 15 + 16) != Z_OK) {
+        free(input);
+        free(output);
+        return ERROR_MEMORY_ALLOCATION;
+    }
+
+    int decompress_result = SUCCESS;
+    off_t read_offset = 0;
+    bool member_ended = false; // The input may only end between members
+    bool drained = true; // zlib holds no output that did not fit in the last buffer
+    while (decompress_result == SUCCESS) {
+        if (stream.avail_in == 0 && drained) {
+            const ssize_t n_read = readBlock(src_fd, input, COMPRESSION_STREAM_SIZE, read_offset);
+            if (n_read == -1) {
+                decompress_result = ERROR_COPY_FAILED;
+                break;
+            }
+            if (n_read == 0) {
+                decompress_result = member_ended ? SUCCESS : ERROR_INVALID_SOURCE;
+                break;
+            }
+            read_offset += n_read;
+            progressAdd(n_read);
+            stream.next_in = input;
+            stream.avail_in = (uInt) n_read;
+        }
+        if (member_ended) {
+            inflateReset(&stream); // Another member follows
+            member_ended = false;
+        }
+
+        stream.next_out = output;
+        stream.avail_out = COMPRESSION_STREAM_SIZE;
+        const int inflate_result = inflate(&stream, Z_NO_FLUSH);
+        if (inflate_result != Z_OK && inflate_result != Z_STREAM_END && inflate_result != Z_BUF_ERROR) {
+            decompress_result = ERROR_INVALID_SOURCE;
+            break;
+        }
+        member_ended = inflate_result == Z_STREAM_END;
+        drained = member_ended || stream.avail_out != 0;
+        decompress_result = emitOutput(dest_fd, output, COMPRESSION_STREAM_SIZE - stream.avail_out, crc, written);
+    }
+    inflateEnd(&stream);
+    free(input);
+    free(output);
+    return decompress_result;
+}
+
+#ifdef REDIT_HAVE_ZSTD
+/**
+ * @brief Decompresses a Zstandard file, frame after frame; see `decompressFile`.
+ */
+static int decompressZstd(const int src_fd, const int dest_fd, uint32_t *crc, off_t *written) {
+    const size_t input_size = ZSTD_DStreamInSize();
+    const size_t output_size = ZSTD_DStreamOutSize();
+    uint8_t *input = malloc(input_size);
+    uint8_t *output = malloc(output_size);
+    ZSTD_DCtx *context = ZSTD_createDCtx();
+    if (input == NULL || output == NULL || context == NULL) {
+        free(input);
+        free(output);
+        ZSTD_freeDCtx(context);
+        return ERROR_MEMORY_ALLOCATION;
+    }
+
+    int decompress_result = SUCCESS;
+    off_t read_offset = 0;
+    size_t frame_left = 0; // Non-zero while a frame is incomplete
+    bool drained = true; // libzstd holds no output that did not fit in the last buffer
+    ZSTD_inBuffer in = {.src = input, .size = 0, .pos = 0};
+    while (decompress_result == SUCCESS) {
+        if (in.pos == in.size && drained) {
+            const ssize_t n_read = readBlock(src_fd, input, input_size, read_offset);
+            if (n_read == -1) {
+                decompress_result = ERROR_COPY_FAILED;
+                break;
+            }
+            if (n_read == 0) {
+                decompress_result = frame_left == 0 && read_offset > 0 ? SUCCESS : ERROR_INVALID_SOURCE;
+                break;
+            }
+            read_offset += n_read;
+            progressAdd(n_read);
+            in = (ZSTD_inBuffer){.src = input, .size = (size_t) n_read, .pos = 0};
+        }
+        ZSTD_outBuffer out = {.dst = output, .size = output_size, .pos = 0};
+        frame_left = ZSTD_decompressStream(context, &out, &in);
+        if (ZSTD_isError(frame_left)) {
+            decompress_result = ERROR_INVALID_SOURCE;
+            break;
+        }
+        // A frame that ends exactly as the output fills is fully flushed; calling again would start the next one
+        drained = frame_left == 0 || out.pos < out.size;
+        decompress_result = emitOutput(dest_fd, output, out.pos, crc, written);
+    }
+    ZSTD_freeDCtx(context);
+    free(input);
+    free(output);
+    return decompress_result;
+}
+#endif
+
+/**
+ * @brief Writes decompressed (or compressed) bytes at the current end of the output.
+ *
+ * @param dest_fd Descriptor of the output, or -1 to only account the bytes.
+ * @param crc CRC32C updated with the bytes, or `NULL`.
+ * @param written Size of the output so far, advanced by `length`.
+ * @return `SUCCESS`, or `ERROR_COPY_FAILED` if the write failed.
+ */
+static int emitOutput(const int dest_fd, const uint8_t *data, const size_t length, uint32_t *crc, off_t *written) {
+    if (crc != NULL) {
+        *crc = updateCrc32c(*crc, data, length);
+    }
+    for (size_t done = 0; dest_fd != -1 && done < length;) {
+        const ssize_t n_written = statsPwrite(dest_fd, data + done, length - done, *written + (off_t) done);
+        if (n_written <= 0) {
+            return ERROR_COPY_FAILED;
+        }
+        done += (size_t) n_written;
+    }
+    *written += (off_t) length;
+    return SUCCESS;
+}
+
+/**
+ * @brief Reads up to `length` bytes at an offset, across short reads.
+ *
+ * @return Bytes read, less than `length` only at the end of the file, or -1 on error.
+ */
+static ssize_t readBlock(const int fd, uint8_t *buffer, const size_t length, const off_t offset) {
+    size_t done = 0;
+    while (done < length) {
+        const ssize_t n_read = statsPread(fd, buffer + done, length - done, offset + (off_t) done);
+        if (n_read == -1 && errno == EINTR) {
+            continue;
+        }
+        if (n_read == -1) {
+            return -1;
+        }
+        if (n_read == 0) {
+            break;
+        }
+        done += (size_t) n_read;
+    }
+    return (ssize_t) done;
+}
+
+/**
+ * @brief Builds the path of the compression record of a copy/privileged pair.
+ */
+static int getRecordPath(const char *copy_file_path, const char *privileged_file_path, char record_path[PATH_MAX]) {
+    char baseline_path[PATH_MAX];
+    const int path_result = getBaselinePath(copy_file_path, privileged_file_path, baseline_path);
+    if (path_result != SUCCESS) {
+        return path_result;
+    }
+    const int written = snprintf(record_path, PATH_MAX, "%s.compression", baseline_path);
+    if (written < 0 || written >= PATH_MAX) {
+        return ERROR_PATH_TOO_LONG;
+    }
+    return SUCCESS;
+}
@@ -0,0 +1,133 @@
+#include <stdio.h>
+#include <string.h>
+#include <linux/fiemap.h>
+#include <linux/fs.h>
+#include <linux/limits.h>
+#include <sys/ioctl.h>
+#include <sys/sysmacros.h>
+
+#include "../include/device_handler.h"
+#include "../include/stats_handler.h"
+
+/**
+ * @file device_handler.c
+ * @brief Tells how devices should be loaded with concurrent I/O.
+ *
+ * A flat pool of threads thrashes a spinning disk, whose head seeks between the streams it
+ * is asked to read at once, while it underuses an NVMe drive, which needs many requests in
+ * flight to reach its throughput. Each device therefore gets its own limit: the one set for
+ * it in `DEVICE_CONFIG_PATH`, or one derived from the `queue/rotational` flag the kernel
+ * exposes in sysfs. File systems without a block device (NFS, tmpfs, FUSE) get a middle one.
+ *
+ * On a spinning disk, files are best read in the order they lie on the platter, which
+ * `FS_IOC_FIEMAP` tells from the physical offset of their first extent.
+ */
+
+// Function prototypes
+static bool readConfiguredLimit(dev_t device, size_t *limit);
+
+static int readRotationalFlag(dev_t device);
+
+/**
+ * @brief Returns how many streams of I/O a device should serve at once.
+ *
+ * @param device Device of a file system, as in `st_dev`.
+ * @param rotational Set if the device is a spinning disk.
+ * @return The configured limit of the device, or the default for its kind.
+ */
+size_t getDeviceConcurrency(const dev_t device, bool *rotational) {
+    const int flag = readRotationalFlag(device);
+    *rotational = flag == 1;
+
+    size_t limit;
+    if (readConfiguredLimit(device, &limit)) {
+        return limit;
+    }
+    if (flag == -1) {
+        return DEVICE_OTHER_LIMIT;
+    }
+    return *rotational ? DEVICE_ROTATIONAL_LIMIT : DEVICE_SOLID_STATE_LIMIT;
+}
+
+/**
+ * @brief Returns a key ordering files by where they lie on their device.
+ *
+ * @param fd Descriptor of the file.
+ * @param file_stat Status of the file.
+ * @return The physical offset of the first extent of the file, or, where the file system
+ *         cannot map extents, its inode number, which most file systems allocate near its data.
+ */
+uint64_t getPhysicalOffset(const int fd, const struct stat *file_stat) {
+    // Room for the first extent only, aligned for the 64-bit fields of both structures
+    uint64_t request[(sizeof(struct fiemap) + sizeof(struct fiemap_extent)) / sizeof(uint64_t)] = {0};
+    struct fiemap *map = (struct fiemap *) request;
+    map->fm_start = 0;
+    map->fm_length = FIEMAP_MAX_OFFSET;
+    map->fm_extent_count = 1;
+    if (STATS_SYSCALL(ioctl(fd, FS_IOC_FIEMAP, map)) == 0 && map->fm_mapped_extents == 1 &&
+        (map->fm_extents[0].fe_flags & FIEMAP_EXTENT_UNKNOWN) == 0) {
+        return map->fm_extents[0].fe_physical;
+    }
+    return (uint64_t) file_stat->st_ino;
+}
+
+/**
+ * @brief Looks a device up in `DEVICE_CONFIG_PATH`.
+ *
+ * @details
+ * - Each line holds a path on a file system and the number of streams its device takes,
+ *   e.g. `/srv/archive 2`. Lines starting with `#` are comments.
+ */
+static bool readConfiguredLimit(const dev_t device, size_t *limit) {
+    FILE *config = fopen(DEVICE_CONFIG_PATH, "re");
+    if (config == NULL) {
+        return false;
+    }
+    bool found = false;
+    char line[PATH_MAX + 64];
+    while (!found && fgets(line, sizeof(line), config) != NULL) {
+        char path[PATH_MAX];
+        size_t configured;
+        struct stat path_stat;
+        if (line[0] == '#' || sscanf(line, "%4095s %zu", path, &configured) != 2 || configured == 0) {
+            continue;
+        }
+        if (STATS_SYSCALL(stat(path, &path_stat)) == 0 && path_stat.st_dev == device) {
+            *limit = configured;
+            found = true;
+        }
+    }
+    fclose(config);
+    return found;
+}
+
+/**
+ * @brief Reads the rotational flag of the block device behind a file system.
+ *
+ * @return 1 for a spinning disk, 0 for a solid-state one, or -1 if there is no block device.
+ *
+ * @details
+ * - A partition has no queue of its own; the flag is read from the disk holding it.
+ */
+static int readRotationalFlag(const dev_t device) {
+    if (major(device) == 0) {
+        return -1; // Anonymous device: NFS, tmpfs, FUSE, Btrfs subvolume...
+    }
+    static const char *QUEUE_PATHS[] = {"/sys/dev/block/%u:%u/queue/rotational",
+                                        "/sys/dev/block/%u:%u/../queue/rotational"};
+    for (size_t i = 0; i < sizeof(QUEUE_PATHS) / sizeof(QUEUE_PATHS[0]); ++i) {
+        char path[PATH_MAX];
+        snprintf(path, sizeof(path), QUEUE_PATHS[i], major(device), minor(device));
+        FILE *flag_file = fopen(path, "re");
+        if (flag_file == NULL) {
+            continue;
+        }
+        int flag = -1;
+        const int n_read = fscanf(flag_file, "%d", &flag);
+        fclose(flag_file);
+        if (n_read == 1) {
+            return flag != 0 ? 1 : 0;
+        }
+    }
+    return -1;
+}
@@ -5,80 +5,104 @@
  * @file error_handler.c
  * @brief Implementation of the centralized error handling mechanism.
  *
- * This file contains the `printError` function, which interprets error codes
- * and prints corresponding messages to `stderr`.
+ * This file contains the `getErrorMessage` function, which interprets error codes,
+ * and the `printError` function, which prints the corresponding messages to `stderr`.
  */
 
 /**
- * @brief Prints a descriptive error message based on the provided error code.
- *
- * The function uses a switch-case construct to match the given error code with
- * its corresponding message. If the `context` is provided, it is appended to
- * the message for additional clarity. If the error code is not recognized, a
- * generic "unknown error" message is displayed.
+ * @brief Returns the descriptive message of an error code.
  *
  * @param error_code The error code to interpret.
- * @param context A string describing the context of the error. Can be `NULL`.
- * @return int The input `error_code` for propagation.
+ * @return A static string describing the error, or `NULL` if the error code is not recognized.
  */
-int printError(const int error_code, const char *context) {
-    // Determine whether to include a blank space before the context
-    char *blank_space = " ";
-    if (context == NULL) {
-        blank_space = "";
-    }
-
-    // Match error code to a specific message
+const char *getErrorMessage(const int error_code) {
     switch (error_code) {
+        case SUCCESS:
+            return "Success.";
         case USER_EXIT:
-            return USER_EXIT;
+            return "Cancelled by the user.";
         case ERROR_FILE_NOT_FOUND:
-            fprintf(stderr, "Error%s%s: File not found.\n", blank_space, context);
-            return ERROR_FILE_NOT_FOUND;
+            return "File not found.";
         case ERROR_PERMISSION_DENIED:
-            fprintf(stderr, "Error%s%s: Permission denied.\n", blank_space, context);
-            return ERROR_PERMISSION_DENIED;
+            return "Permission denied.";
         case ERROR_MEMORY_ALLOCATION:
-            fprintf(stderr, "Error%s%s: Memory allocation failed.\n", blank_space, context);
-            return ERROR_MEMORY_ALLOCATION;
+            return "Memory allocation failed.";
         case ERROR_COPY_FAILED:
-            fprintf(stderr, "Error%s%s: Copy failed.\n", blank_space, context);
-            return ERROR_COPY_FAILED;
+            return "Copy failed.";
         case ERROR_INVALID_ARGUMENT:
-            fprintf(stderr, "Error%s%s: Invalid argument.\n", blank_space, context);
-            return ERROR_INVALID_ARGUMENT;
+            return "Invalid argument.";
         case ERROR_SAME_SOURCE:
-            fprintf(stderr, "Error%s%s: Copy and privileged paths are the same.\n", blank_space, context);
-            return ERROR_SAME_SOURCE;
+            return "Copy and privileged paths are the same.";
         case ERROR_CWD:
-            fprintf(stderr, "Error%s%s: Current working directory error.\n", blank_space, context);
-            return ERROR_CWD;
+            return "Current working directory error.";
         case ERROR_RESOLVING_PATH:
-            fprintf(stderr, "Error%s%s: Resolving path failed.\n", blank_space, context);
-            return ERROR_RESOLVING_PATH;
+            return "Resolving path failed.";
         case ERROR_BUFFER_TOO_SMALL:
-            fprintf(stderr, "Error%s%s: Buffer too small.\n", blank_space, context);
-            return ERROR_BUFFER_TOO_SMALL;
+            return "Buffer too small.";
         case ERROR_USER_NOT_FOUND:
-            fprintf(stderr, "Error%s%s: User not found.\n", blank_space, context);
-            return ERROR_USER_NOT_FOUND;
+            return "User not found.";
         case ERROR_EXECUTING_COMMAND:
-            fprintf(stderr, "Error%s%s: Executing command failed.\n", blank_space, context);
-            return ERROR_EXECUTING_COMMAND;
+            return "Executing command failed.";
         case ERROR_PATH_INVALID:
-            fprintf(stderr, "Error%s%s: Invalid path.\n", blank_space, context);
-            return ERROR_PATH_INVALID;
+            return "Invalid path.";
         case ERROR_PATH_TOO_LONG:
-            fprintf(stderr, "Error%s%s: Path too long.\n", blank_space, context);
-            return ERROR_PATH_TOO_LONG;
+            return "Path too long.";
         case ERROR_INVALID_SOURCE:
-            fprintf(stderr, "Error%s%s: Invalid copy file.\n", blank_space, context);
-            return ERROR_INVALID_SOURCE;
+            return "Invalid copy file.";
+        case ERROR_MERGE_CONFLICT:
+            return "Merge conflict.";
+        case ERROR_LOCK_TIMEOUT:
+            return "Timed out waiting for the file lock.";
+        case ERROR_SYNC_FAILED:
+            return "Syncing to disk failed.";
+        case ERROR_BROKER_UNAVAILABLE:
+            return "The redit broker is not running.";
+        case ERROR_BACKUP_CORRUPTED:
+            return "The backup is damaged.";
+        case ERROR_WINDOW_CHANGED:
+            return "The privileged file changed since the window was copied.";
+        case ERROR_PATCH_REJECTED:
+            return "The patch does not apply to the privileged file.";
+        case ERROR_VERIFY_FAILED:
+            return "The written file does not match what was copied.";
+        case ERROR_COMPRESSION_FAILED:
+            return "Compressing the file failed.";
         case ERROR_COMMAND_NOT_FOUND:
-            fprintf(stderr, "Error%s%s: Command not found.\n", blank_space, context);
-            return ERROR_COMMAND_NOT_FOUND;
+            return "Command not found.";
         default:
-            fprintf(stderr, "Error%s%s: Unknown error code %d.\n", blank_space, context, error_code);
-            return UNKNOWN_ERROR;
+            return NULL;
+    }
+}
+
+/**
+ * @brief Prints a descriptive error message based on the provided error code.
+ *
+ * The message comes from `getErrorMessage`. If the `context` is provided, it is
+ * appended to the message for additional clarity. If the error code is not
+ * recognized, a generic "unknown error" message is displayed. Nothing is printed
+ * for `USER_EXIT`.
+ *
+ * @param error_code The error code to interpret.
+ * @param context A string describing the context of the error. Can be `NULL`.
+ * @return int The input `error_code` for propagation.
+ */
+int printError(const int error_code, const char *context) {
+    if (error_code == USER_EXIT) {
+        return USER_EXIT;
+    }
+
+    // Determine whether to include a blank space before the context
+    char *blank_space = " ";
+    if (context == NULL) {
+        blank_space = "";
+        context = "";
+    }
+
+    const char *message = getErrorMessage(error_code);
+    if (message == NULL) {
+        fprintf(stderr, "Error%s%s: Unknown error code %d.\n", blank_space, context, error_code);
+        return UNKNOWN_ERROR;
     }
+    fprintf(stderr, "Error%s%s: %s\n", blank_space, context, message);
+    return error_code;
 }
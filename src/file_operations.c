@@ -1,5 +1,9 @@
+#define _GNU_SOURCE // O_DIRECT, fallocate, sync_file_range and copy_file_range
+
 #include <ctype.h>
 #include <errno.h>
+#include <pthread.h>
+#include <stdint.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <fcntl.h>
@@ -10,8 +14,22 @@
 #include <sys/stat.h>
 #include <sys/statvfs.h>
 
+#include "../include/checksum_handler.h"
 #include "../include/error_handler.h"
+#include "../include/file_operations.h"
 #include "../include/file_utils.h"
+#include "../include/journal_handler.h"
+#include "../include/progress_handler.h"
+#include "../include/stats_handler.h"
+#include "../include/throttle_handler.h"
+#include "../include/trace_handler.h"
+
+#define DIRECT_IO_ALIGNMENT 4096 // Buffer, offset and length alignment accepted by O_DIRECT
+#define DIRECT_IO_BUFFER_SIZE (1024 * 1024) // Buffer size used for direct I/O
+#define CACHE_DROP_THRESHOLD (32 * 1024 * 1024) // Files from this size on are evicted from the page cache as copied
+#define CACHE_DROP_WINDOW (8 * 1024 * 1024) // Bytes copied between page cache evictions
+#define PARALLEL_MIN_RANGE (2 * 1024 * 1024) // Smallest range worth a thread of its own
+#define COPY_TO_EOF INT64_MAX // Range end meaning "until the end of the source"
 
 /**
  * @file file_operations.c
@@ -23,36 +41,433 @@
  * during operations.
  */
 
+/**
+ * @brief One contiguous range of a copy, handled by a single thread.
+ */
+typedef struct {
+    int src_fd; ///< Descriptor of the source file.
+    int dest_fd; ///< Descriptor of the destination file.
+    off_t start; ///< First byte of the range.
+    off_t end; ///< One past the last byte of the range, or `COPY_TO_EOF`.
+    size_t buf_size; ///< Size of each read/write request.
+    copy_engine_t engine; ///< Engine used to move the data.
+    bool direct_io; ///< Whether the descriptors may be in `O_DIRECT` mode.
+    bool drop_cache; ///< Whether copied pages are evicted from the page cache.
+    bool checksum; ///< Whether the copied bytes are added to `crc`.
+    uint32_t crc; ///< Output: CRC32C of the bytes copied, if `checksum` is set.
+    throttle_t *throttle; ///< Token bucket pacing the copy, shared by every range, or `NULL`.
+    copy_journal_t *journal; ///< Journal the range checkpoints into, or `NULL`.
+    size_t index; ///< Index of the range in the journal.
+    bool progress; ///< Whether the copied bytes are reported to the progress counter.
+    off_t resumed; ///< Output: bytes of the range left intact by an interrupted copy.
+    off_t reached; ///< Output: offset reached (end of range, or EOF).
+    int result; ///< Output: `SUCCESS` or an error code.
+} copy_range_t;
+
+/**
+ * @brief One copied range read back from the destination, handled by a single thread.
+ */
+typedef struct {
+    int fd; ///< Descriptor the destination is read back through.
+    const copy_range_t *range; ///< Range to read back, with the checksum of the bytes copied to it.
+    int result; ///< Output: `SUCCESS`, `ERROR_VERIFY_FAILED` or another error code.
+} check_range_t;
+
+// Function prototypes
+static int copyContent(int src_fd, int dest_fd, const char *dest, const copy_options_t *options,
+                       copy_journal_t *journal, off_t *copied);
+
+static off_t resumeRange(copy_range_t *range, uint8_t *buffer);
+
+static int checkWritten(int dest_fd, const char *dest, const copy_range_t *ranges, size_t n_ranges);
+
+static void *checkRange(void *arg);
+
+/**
+ * @brief Clears `O_DIRECT` on a descriptor, so unaligned I/O can proceed through the page cache.
+ */
+static void disableDirectIo(const int fd) {
+    const int fd_flags = STATS_SYSCALL(fcntl(fd, F_GETFL));
+    if (fd_flags != -1) {
+        STATS_SYSCALL(fcntl(fd, F_SETFL, fd_flags & ~O_DIRECT));
+    }
+}
+
+/**
+ * @brief Evicts an already copied range of both files from the page cache.
+ *
+ * @param src_fd Descriptor of the source file.
+ * @param dest_fd Descriptor of the destination file.
+ * @param offset Start of the range.
+ * @param length Length of the range.
+ *
+ * @details
+ * - Dirty destination pages cannot be dropped, so the range is written back first. The caller
+ *   starts that writeback one window earlier, which usually makes this wait free.
+ */
+static void dropCopiedPages(const int src_fd, const int dest_fd, const off_t offset, const off_t length) {
+    STATS_SYSCALL(sync_file_range(dest_fd, offset, length,
+                                  SYNC_FILE_RANGE_WAIT_BEFORE | SYNC_FILE_RANGE_WRITE | SYNC_FILE_RANGE_WAIT_AFTER));
+    STATS_SYSCALL(posix_fadvise(dest_fd, offset, length, POSIX_FADV_DONTNEED));
+    STATS_SYSCALL(posix_fadvise(src_fd, offset, length, POSIX_FADV_DONTNEED));
+}
+
+/**
+ * @brief Adds bytes the kernel copied to the checksum of a range, reading them back from the destination.
+ *
+ * @return `true` if the bytes were read back, `false` otherwise.
+ *
+ * @details
+ * - The bytes were just written, so they are usually read from the page cache. A cloned or
+ *   offloaded range is read from storage, which is still cheaper than moving it through user space.
+ */
+static bool checksumCopied(copy_range_t *range, uint8_t *buffer, off_t offset, const size_t length) {
+    for (const off_t end = offset + (off_t) length; offset < end;) {
+        const off_t remaining = end - offset;
+        const size_t chunk = remaining < (off_t) range->buf_size ? (size_t) remaining : range->buf_size;
+        const ssize_t n_read = statsPread(range->dest_fd, buffer, chunk, offset);
+        if (n_read <= 0) {
+            return false;
+        }
+        range->crc = updateCrc32c(range->crc, buffer, n_read);
+        offset += n_read;
+    }
+    return true;
+}
+
+/**
+ * @brief Moves up to `length` bytes at `offset` with `pread`/`pwrite`.
+ *
+ * @return The number of bytes copied, 0 at the end of the source, or -1 on error.
+ */
+static ssize_t copyChunkReadWrite(const copy_range_t *range, u_int8_t *buffer, const off_t offset,
+                                  const size_t length) {
+    ssize_t n_read = statsPread(range->src_fd, buffer, length, offset);
+    // An unaligned offset (after a short read) is rejected under O_DIRECT
+    if (n_read == -1 && errno == EINVAL && range->direct_io) {
+        disableDirectIo(range->src_fd);
+        n_read = statsPread(range->src_fd, buffer, length, offset);
+    }
+    if (n_read <= 0) {
+        return n_read;
+    }
+    // A partial block (the file tail) cannot be written under O_DIRECT
+    if (range->direct_io && n_read % DIRECT_IO_ALIGNMENT != 0) {
+        disableDirectIo(range->dest_fd);
+    }
+
+    ssize_t n_written = 0;
+    while (n_written < n_read) {
+        const ssize_t result = statsPwrite(range->dest_fd, buffer + n_written, n_read - n_written, offset + n_written);
+        if (result == -1) {
+            return -1;
+        }
+        n_written += result;
+    }
+    return n_read;
+}
+
+/**
+ * @brief Copies one range of the file, evicting copied windows from the page cache if requested.
+ *
+ * @param arg Pointer to the `copy_range_t` to copy. Its `reached` and `result` fields are filled in.
+ * @return `NULL`, so it can run as a thread.
+ *
+ * @details
+ * - The kernel engine (`copy_file_range`) moves data without a round trip through user space and
+ *   lets the file system clone or offload it (e.g. NFS server-side copy). Where it is not supported,
+ *   the rest of the range falls back to `pread`/`pwrite`.
+ */
+static void *copyRange(void *arg) {
+    copy_range_t *range = arg;
+    const uint64_t start_ns = traceNow();
+    range->reached = range->start;
+    range->result = SUCCESS;
+
+    // Allocate buffer for file copying, aligned as O_DIRECT requires
+    uint8_t *buffer = NULL;
+    if (posix_memalign((void **) &buffer, DIRECT_IO_ALIGNMENT, range->buf_size) != 0) {
+        range->result = ERROR_MEMORY_ALLOCATION;
+        return NULL;
+    }
+
+    bool use_kernel = range->engine == COPY_ENGINE_KERNEL;
+    off_t offset = range->journal != NULL ? resumeRange(range, buffer) : range->start;
+    off_t flushed = offset; // Writeback has been started up to here
+    off_t dropped = offset; // Evicted from the page cache up to here
+    off_t checkpointed = offset; // Recorded in the journal up to here
+    if (range->progress) {
+        progressAdd(offset - range->start); // Left intact by an interrupted copy
+    }
+
+    while (offset < range->end) {
+        const off_t remaining = range->end - offset;
+        const size_t length = remaining < (off_t) range->buf_size ? (size_t) remaining : range->buf_size;
+
+        ssize_t n_copied;
+        if (use_kernel) {
+            off_t in_offset = offset, out_offset = offset;
+            n_copied = statsCopyFileRange(range->src_fd, &in_offset, range->dest_fd, &out_offset, length, 0);
+            if (n_copied == -1 && (errno == EXDEV || errno == ENOSYS || errno == EOPNOTSUPP || errno == EINVAL)) {
+                use_kernel = false; // Not possible between these files: continue in user space
+                continue;
+            }
+            if (n_copied > 0 && range->checksum && !checksumCopied(range, buffer, offset, n_copied)) {
+                n_copied = -1;
+            }
+        } else {
+            n_copied = copyChunkReadWrite(range, buffer, offset, length);
+            if (n_copied > 0 && range->checksum) {
+                range->crc = updateCrc32c(range->crc, buffer, n_copied);
+            }
+        }
+        if (n_copied == -1) {
+            range->result = ERROR_COPY_FAILED;
+            break;
+        }
+        if (n_copied == 0) {
+            break; // End of the source
+        }
+        offset += n_copied;
+        if (range->progress) {
+            progressAdd(n_copied);
+        }
+        if (range->throttle != NULL) {
+            throttleBytes(range->throttle, n_copied);
+        }
+        if (range->journal != NULL && offset - checkpointed >= JOURNAL_CHECKPOINT_INTERVAL) {
+            checkpointJournal(range->journal, range->index, offset, range->crc);
+            checkpointed = offset;
+        }
+
+        // Start writeback of the latest window and evict the one before it
+        if (range->drop_cache && offset - flushed >= CACHE_DROP_WINDOW) {
+            STATS_SYSCALL(sync_file_range(range->dest_fd, flushed, offset - flushed, SYNC_FILE_RANGE_WRITE));
+            if (flushed > dropped) {
+                dropCopiedPages(range->src_fd, range->dest_fd, dropped, flushed - dropped);
+                dropped = flushed;
+            }
+            flushed = offset;
+        }
+    }
+
+    // The source tail of the range is no longer needed either
+    if (range->drop_cache) {
+        STATS_SYSCALL(posix_fadvise(range->src_fd, dropped, offset - dropped, POSIX_FADV_DONTNEED));
+    }
+
+    free(buffer);
+    range->reached = offset;
+    traceSpan("copy", "range", start_ns, NULL, offset - range->start);
+    return NULL;
+}
+
+/**
+ * @brief Finds where an interrupted copy of a range stopped, checking what it wrote.
+ *
+ * @param range Range to resume, with its journal. Its `crc` and `resumed` fields are set.
+ * @param buffer Buffer of `range->buf_size` bytes, aligned for direct I/O.
+ * @return The offset to resume the range from: its last checkpoint if the destination still
+ *         holds what the journal recorded up to it, or its start otherwise.
+ */
+static off_t resumeRange(copy_range_t *range, uint8_t *buffer) {
+    const journal_range_t *recorded = &range->journal->ranges[range->index];
+    range->crc = 0;
+    range->resumed = 0;
+    if (!range->journal->resumed || recorded->checkpoint <= range->start) {
+        return range->start;
+    }
+
+    // Read back what the interrupted copy wrote, as storage holds it
+    uint32_t crc = 0;
+    for (off_t offset = range->start; offset < recorded->checkpoint;) {
+        const off_t remaining = recorded->checkpoint - offset;
+        const size_t length = remaining < (off_t) range->buf_size ? (size_t) remaining : range->buf_size;
+        ssize_t n_read = statsPread(range->dest_fd, buffer, length, offset);
+        if (n_read == -1 && errno == EINVAL && range->direct_io) {
+            disableDirectIo(range->dest_fd);
+            n_read = statsPread(range->dest_fd, buffer, length, offset);
+        }
+        if (n_read <= 0) {
+            return range->start; // Shorter than recorded
+        }
+        crc = updateCrc32c(crc, buffer, n_read);
+        offset += n_read;
+    }
+    if (crc != recorded->crc) {
+        return range->start;
+    }
+    range->crc = crc;
+    range->resumed = recorded->checkpoint - range->start;
+    return recorded->checkpoint;
+}
+
+/**
+ * @brief Returns the printable name of a copy engine.
+ *
+ * @param engine The copy engine.
+ * @return A static string naming the engine.
+ */
+const char *getCopyEngineName(const copy_engine_t engine) {
+    switch (engine) {
+        case COPY_ENGINE_READ_WRITE:
+            return "read-write";
+        case COPY_ENGINE_KERNEL:
+            return "copy_file_range";
+    }
+    return "unknown";
+}
+
 /**
  * @brief Copies a file from source to destination.
  *
  * @param src Path to the source file.
  * @param dest Path to the destination file.
+ * @param options Copy options (durability, direct I/O, engine, buffer size, threads). `NULL` uses the defaults.
  * @return `SUCCESS` if the file is copied successfully, or an error code otherwise.
  *
  * @details
  * - Validates that the source and destination are not the same.
- * - Adjusts buffer size dynamically based on file system and file size.
  * - Ensures the source file exists and is a regular file.
- * - Handles errors during file opening, reading, writing, or memory allocation.
+ * - With direct I/O, both files are opened with `O_DIRECT` where the file system allows it.
+ * - With `resumable`, a copy of `JOURNAL_MIN_SIZE` bytes or more records its progress in a
+ *   journal (see `journal_handler.c`). If the previous copy of the same, unmodified source to
+ *   the same destination was interrupted, the destination is not truncated, and each range
+ *   resumes from its last checkpoint once what it wrote up to it is checked.
+ * - The content is copied by `copyDescriptors`.
  */
-int copyFile(const char *src, const char *dest) {
+int copyFile(const char *src, const char *dest, const copy_options_t *options) {
+    const copy_options_t default_options = {0};
+    if (options == NULL) {
+        options = &default_options;
+    }
+
     if (strcmp(src, dest) == 0) {
         return ERROR_SAME_SOURCE; // Prevent copying a file onto itself
     }
+    const uint64_t start_ns = traceNow();
 
     struct stat src_stat;
-    if (stat(src, &src_stat) == -1) {
+    if (STATS_SYSCALL(stat(src, &src_stat)) == -1) {
         return errno == EACCES ? ERROR_PERMISSION_DENIED : ERROR_FILE_NOT_FOUND;
     }
     if (!S_ISREG(src_stat.st_mode)) {
         return ERROR_INVALID_SOURCE; // Source must be a regular file
     }
 
+    // Open source file (O_DIRECT is refused by some file systems, e.g. tmpfs)
+    int src_fd = options->direct_io ? STATS_SYSCALL(open(src, O_RDONLY | O_DIRECT)) : -1;
+    if (src_fd == -1) {
+        src_fd = STATS_SYSCALL(open(src, O_RDONLY));
+    }
+    if (src_fd == -1) {
+        return errno == EACCES ? ERROR_PERMISSION_DENIED : ERROR_FILE_NOT_FOUND;
+    }
+
+    // Journal large copies, picking up where an interrupted one stopped
+    copy_journal_t journal = {.fd = -1};
+    const bool journaled = options->resumable && src_stat.st_size >= JOURNAL_MIN_SIZE &&
+                           openJournal(dest, &src_stat, &journal) == SUCCESS;
+
+    // Open destination file, readable to check what a resumed copy wrote
+    const int dest_flags = (journaled ? O_RDWR : O_WRONLY) | O_CREAT | (journal.resumed ? 0 : O_TRUNC);
+    const mode_t dest_mode = S_IRUSR | S_IWUSR | S_IRGRP | S_IROTH;
+    int dest_fd = options->direct_io ? STATS_SYSCALL(open(dest, dest_flags | O_DIRECT, dest_mode)) : -1;
+    if (dest_fd == -1) {
+        dest_fd = STATS_SYSCALL(open(dest, dest_flags, dest_mode));
+    }
+    if (dest_fd == -1) {
+        const int open_error = errno;
+        close(src_fd);
+        closeJournal(&journal, false);
+        return open_error == EACCES ? ERROR_PERMISSION_DENIED : ERROR_COPY_FAILED;
+    }
+
+    off_t copied = 0;
+    int copy_result = copyContent(src_fd, dest_fd, dest, options, journaled ? &journal : NULL, &copied);
+
+    // Clean up
+    STATS_SYSCALL(close(src_fd));
+    if (STATS_SYSCALL(close(dest_fd)) == -1 && copy_result == SUCCESS) {
+        copy_result = ERROR_COPY_FAILED; // Delayed write errors are reported on close
+    }
+    closeJournal(&journal, copy_result == SUCCESS); // Kept for the next run if the copy did not complete
+    traceSpan("copy", "copyFile", start_ns, dest, copied);
+
+    return copy_result;
+}
+
+/**
+ * @brief Copies the content of an open file into another open file.
+ *
+ * @param src_fd Descriptor of the source file, open for reading.
+ * @param dest_fd Descriptor of the destination file, open for writing and empty.
+ * @param dest Path to the destination file, used to flush its directory in `SYNC_FULL` mode.
+ * @param options Copy options (durability, direct I/O, engine, buffer size, threads). `NULL` uses the defaults.
+ * @param copied Set to the number of bytes copied.
+ * @return `SUCCESS` if the content is copied successfully, or an error code otherwise.
+ *
+ * @details
+ * - Adjusts buffer size dynamically based on file system and file size, unless the options set one.
+ * - Hints sequential access on the source and preallocates the destination to its final size.
+ * - Files of `CACHE_DROP_THRESHOLD` bytes or more are evicted from the page cache behind the
+ *   copy cursor, so a bulk copy does not push out the working set of other processes.
+ * - With direct I/O, both files bypass the page cache through aligned buffers, falling back
+ *   to buffered I/O where the file system or the file tail does not allow it.
+ * - With several threads, files of at least `PARALLEL_MIN_RANGE` bytes per thread are split into
+ *   contiguous ranges copied concurrently.
+ * - With a bandwidth limit, every range pays for what it moves in a shared token bucket, so the
+ *   copy (and its read back) does not exceed the limit however many threads it uses.
+ * - With `verify_write`, the data goes through user space, where its checksum is taken, and the
+ *   destination is read back from storage and checked against it (see `checkWritten`). A
+ *   mismatch returns `ERROR_VERIFY_FAILED`.
+ * - Handles errors during reading, writing, or memory allocation.
+ * - Flushes the destination according to the selected durability mode. The descriptors are not closed.
+ * - Works on descriptors received from another process, such as the `--broker` daemon.
+ */
+int copyDescriptors(const int src_fd, const int dest_fd, const char *dest, const copy_options_t *options,
+                    off_t *copied) {
+    return copyContent(src_fd, dest_fd, dest, options, NULL, copied);
+}
+
+/**
+ * @brief Copies the content of an open file into another, recording its progress in a journal.
+ *
+ * @param journal Open journal of the copy, or `NULL` for an unjournaled one. If it was left by
+ *                an interrupted copy, its ranges are resumed; otherwise it is started.
+ * @return `SUCCESS` if the content is copied successfully, or an error code otherwise.
+ *
+ * @details
+ * - See `copyDescriptors` for the other parameters and the copy itself.
+ * - Journaled data keeps the calibrated engine. Its checksum is taken in user space with the
+ *   read/write engine, or by reading back what the kernel engine wrote (see `checksumCopied`).
+ */
+static int copyContent(const int src_fd, const int dest_fd, const char *dest, const copy_options_t *options,
+                       copy_journal_t *journal, off_t *copied) {
+    const copy_options_t default_options = {0};
+    if (options == NULL) {
+        options = &default_options;
+    }
+    *copied = 0;
+
+    struct stat src_stat;
+    if (STATS_SYSCALL(fstat(src_fd, &src_stat)) == -1) {
+        return ERROR_COPY_FAILED;
+    }
+    if (!S_ISREG(src_stat.st_mode)) {
+        return ERROR_INVALID_SOURCE; // Source must be a regular file
+    }
+
+    // Bytes expected to be copied
+    off_t copy_size = src_stat.st_size;
+    if (options->max_length > 0 && options->max_length < copy_size) {
+        copy_size = options->max_length;
+    }
+
     // Dynamically adjust buffer size
     size_t buf_size = 4096; // Default buffer size
     struct statvfs fs_stat;
-    if (statvfs(src, &fs_stat) == 0) {
+    if (STATS_SYSCALL(fstatvfs(src_fd, &fs_stat)) == 0) {
         buf_size = fs_stat.f_bsize;
     }
     // Adjust buffer size based on file size
@@ -63,58 +478,248 @@ int copyFile(const char *src, const char *dest) {
     if (buf_size > 128 * 1024) {
         buf_size = 128 * 1024;
     }
+    // A calibrated buffer size takes precedence over the heuristic
+    if (options->buffer_size > 0) {
+        buf_size = options->buffer_size;
+    }
+    // Uncached requests are expensive, so direct I/O uses fewer, larger ones
+    if (options->direct_io) {
+        buf_size = DIRECT_IO_BUFFER_SIZE;
+    }
 
-    // Open source file
-    const int src_fd = open(src, O_RDONLY);
-    if (src_fd == -1) {
-        return errno == EACCES ? ERROR_PERMISSION_DENIED : ERROR_FILE_NOT_FOUND;
+    // Read the source once, front to back, and lay the destination out contiguously
+    STATS_SYSCALL(posix_fadvise(src_fd, 0, 0, POSIX_FADV_SEQUENTIAL));
+    if (copy_size > 0) {
+        // Best effort, not supported everywhere
+        STATS_SYSCALL(fallocate(dest_fd, FALLOC_FL_KEEP_SIZE, 0, copy_size));
     }
 
-    // Open destination file
-    const int dest_fd = open(dest, O_WRONLY | O_CREAT | O_TRUNC, S_IRUSR | S_IWUSR | S_IRGRP | S_IROTH);
-    if (dest_fd == -1) {
-        close(src_fd);
-        return errno == EACCES ? ERROR_PERMISSION_DENIED : ERROR_COPY_FAILED;
+    // Split the file into one range per thread, aligned for direct I/O
+    size_t n_threads = options->threads > 1 ? options->threads : 1;
+    if (n_threads > MAX_COPY_THREADS) {
+        n_threads = MAX_COPY_THREADS;
     }
+    while (n_threads > 1 && copy_size / (off_t) n_threads < PARALLEL_MIN_RANGE) {
+        n_threads--;
+    }
+    const off_t range_size = (copy_size / (off_t) n_threads) & ~((off_t) DIRECT_IO_BUFFER_SIZE - 1);
 
-    // Allocate buffer for file copying
-    u_int8_t *buffer = malloc(buf_size);
-    if (!buffer) {
-        close(src_fd);
-        close(dest_fd);
-        return ERROR_MEMORY_ALLOCATION;
+    // Pace every range to the bandwidth limit through one token bucket
+    throttle_t throttle;
+    if (options->bandwidth_limit > 0) {
+        initThrottle(&throttle, options->bandwidth_limit);
     }
 
-    // Copy content from source to destination
-    ssize_t n_read;
-    while ((n_read = read(src_fd, buffer, buf_size)) > 0) {
-        ssize_t n_written = 0;
-        while (n_written < n_read) {
-            const ssize_t result = write(dest_fd, buffer + n_written, n_read - n_written);
-            if (result == -1) {
-                free(buffer);
-                close(src_fd);
-                close(dest_fd);
-                return ERROR_COPY_FAILED;
+    copy_range_t ranges[MAX_COPY_THREADS];
+    for (size_t i = 0; i < n_threads; ++i) {
+        const bool is_last = i == n_threads - 1;
+        ranges[i] = (copy_range_t){
+            .src_fd = src_fd,
+            .dest_fd = dest_fd,
+            .start = (off_t) i * range_size,
+            // The last range runs to EOF, so a file growing during the copy is copied whole as before
+            .end = is_last ? (options->max_length > 0 ? copy_size : COPY_TO_EOF) : (off_t) (i + 1) * range_size,
+            .buf_size = buf_size,
+            .engine = options->direct_io || options->verify_write ? COPY_ENGINE_READ_WRITE : options->engine,
+            .direct_io = options->direct_io,
+            .drop_cache = copy_size >= CACHE_DROP_THRESHOLD,
+            .checksum = options->verify_write || journal != NULL,
+            .throttle = options->bandwidth_limit > 0 ? &throttle : NULL,
+            .journal = journal,
+            .index = i,
+            .progress = options->progress
+        };
+    }
+
+    // Resume the ranges of the interrupted copy, or record the new ones
+    if (journal != NULL && journal->resumed) {
+        n_threads = journal->n_ranges;
+        for (size_t i = 0; i < n_threads; ++i) {
+            ranges[i] = ranges[0];
+            ranges[i].start = journal->ranges[i].start;
+            ranges[i].end = journal->ranges[i].end;
+            ranges[i].index = i;
+        }
+    } else if (journal != NULL) {
+        journal_range_t journal_ranges[MAX_COPY_THREADS];
+        for (size_t i = 0; i < n_threads; ++i) {
+            journal_ranges[i] = (journal_range_t){.start = ranges[i].start, .end = ranges[i].end,
+                                                  .checkpoint = ranges[i].start, .crc = 0};
+        }
+        struct stat dest_stat;
+        if (STATS_SYSCALL(fstat(dest_fd, &dest_stat)) == -1 ||
+            startJournal(journal, &dest_stat, journal_ranges, n_threads) != SUCCESS) {
+            for (size_t i = 0; i < n_threads; ++i) {
+                ranges[i].journal = NULL; // Copy unjournaled
             }
-            n_written += result;
         }
     }
 
+    // Copy content from source to destination
+    if (options->progress) {
+        progressBegin(dest, copy_size, getCopyEngineName(ranges[0].engine));
+    }
+    pthread_t threads[MAX_COPY_THREADS];
+    size_t n_started = 1;
+    for (; n_started < n_threads; ++n_started) {
+        if (pthread_create(&threads[n_started], NULL, copyRange, &ranges[n_started]) != 0) {
+            break;
+        }
+    }
+    copyRange(&ranges[0]);
+    for (size_t i = 1; i < n_started; ++i) {
+        pthread_join(threads[i], NULL);
+    }
+    // Ranges whose thread could not be started are copied here
+    for (size_t i = n_started; i < n_threads; ++i) {
+        copyRange(&ranges[i]);
+    }
+    if (options->progress) {
+        progressEnd();
+    }
+
     // Check for read errors or incomplete copy
-    if (n_read == -1) {
-        free(buffer);
-        close(src_fd);
-        close(dest_fd);
-        return ERROR_COPY_FAILED;
+    int copy_result = SUCCESS;
+    off_t resumed = 0;
+    for (size_t i = 0; i < n_threads && copy_result == SUCCESS; ++i) {
+        copy_result = ranges[i].result;
+        *copied = ranges[i].reached;
+        resumed += ranges[i].resumed;
+    }
+    if (options->resumed != NULL) {
+        *options->resumed = resumed;
     }
 
-    // Clean up
-    free(buffer);
-    close(src_fd);
-    close(dest_fd);
+    // Release the preallocated blocks past the end if the source shrank while copying, or
+    // whatever a resumed destination held past it
+    if (copy_result == SUCCESS && (*copied < copy_size || (journal != NULL && journal->resumed))) {
+        STATS_SYSCALL(ftruncate(dest_fd, *copied));
+    }
+
+    // Check that what reached storage is what was copied
+    if (copy_result == SUCCESS && options->verify_write) {
+        copy_result = checkWritten(dest_fd, dest, ranges, n_threads);
+    }
+    if (options->bandwidth_limit > 0) {
+        destroyThrottle(&throttle);
+    }
+    if (copy_result != SUCCESS) {
+        return copy_result;
+    }
+
+    // Flush the destination according to the durability mode
+    return syncFile(dest_fd, dest, options->sync_mode, options->sync_group);
+}
+
+/**
+ * @brief Reads a copied file back from storage and checks it against the checksums taken while copying.
+ *
+ * @param dest_fd Descriptor the destination was written through.
+ * @param dest Path to the destination, reopened for reading if `dest_fd` is write-only.
+ * @param ranges Copied ranges, with their checksums.
+ * @param n_ranges Number of `ranges`.
+ * @return `SUCCESS` if every range reads back as copied, `ERROR_VERIFY_FAILED` if one does not,
+ *         or another error code.
+ *
+ * @details
+ * - The destination is flushed first, so the data has left the page cache for the device (or,
+ *   on NFS, the server). It is then read back with `O_DIRECT`, or through the page cache after
+ *   its pages are evicted where `O_DIRECT` is refused (e.g. tmpfs).
+ * - Ranges are read back concurrently, as they were copied.
+ */
+static int checkWritten(const int dest_fd, const char *dest, const copy_range_t *ranges, const size_t n_ranges) {
+    const uint64_t start_ns = traceNow();
+    if (STATS_SYSCALL(fdatasync(dest_fd)) == -1) {
+        return ERROR_SYNC_FAILED;
+    }
+    const int dest_flags = STATS_SYSCALL(fcntl(dest_fd, F_GETFL));
+    int read_fd = dest != NULL ? STATS_SYSCALL(open(dest, O_RDONLY | O_DIRECT | O_CLOEXEC)) : -1;
+    if (read_fd == -1 && dest != NULL) {
+        read_fd = STATS_SYSCALL(open(dest, O_RDONLY | O_CLOEXEC));
+    }
+    if (read_fd == -1 && dest_flags != -1 && (dest_flags & O_ACCMODE) == O_RDWR) {
+        read_fd = STATS_SYSCALL(dup(dest_fd));
+    }
+    if (read_fd == -1) {
+        return errno == EACCES ? ERROR_PERMISSION_DENIED : ERROR_COPY_FAILED;
+    }
+    STATS_SYSCALL(posix_fadvise(read_fd, 0, 0, POSIX_FADV_DONTNEED));
+
+    check_range_t checks[MAX_COPY_THREADS];
+    for (size_t i = 0; i < n_ranges; ++i) {
+        checks[i] = (check_range_t){.fd = read_fd, .range = &ranges[i]};
+    }
+    pthread_t threads[MAX_COPY_THREADS];
+    size_t n_started = 1;
+    for (; n_started < n_ranges; ++n_started) {
+        if (pthread_create(&threads[n_started], NULL, checkRange, &checks[n_started]) != 0) {
+            break;
+        }
+    }
+    checkRange(&checks[0]);
+    for (size_t i = 1; i < n_started; ++i) {
+        pthread_join(threads[i], NULL);
+    }
+    for (size_t i = n_started; i < n_ranges; ++i) {
+        checkRange(&checks[i]);
+    }
+    STATS_SYSCALL(close(read_fd));
+
+    int result = SUCCESS;
+    for (size_t i = 0; i < n_ranges && result == SUCCESS; ++i) {
+        result = checks[i].result;
+    }
+    traceSpan("copy", "checkWritten", start_ns, dest, ranges[n_ranges - 1].reached);
+    return result;
+}
 
-    return SUCCESS; // File copied successfully
+/**
+ * @brief Reads one copied range back and compares its checksum with the one taken while copying.
+ *
+ * @param arg Pointer to the `check_range_t` to check. Its `result` field is filled in.
+ * @return `NULL`, so it can run as a thread.
+ */
+static void *checkRange(void *arg) {
+    check_range_t *check = arg;
+    const copy_range_t *range = check->range;
+    check->result = SUCCESS;
+    uint8_t *buffer = NULL;
+    if (posix_memalign((void **) &buffer, DIRECT_IO_ALIGNMENT, DIRECT_IO_BUFFER_SIZE) != 0) {
+        check->result = ERROR_MEMORY_ALLOCATION;
+        return NULL;
+    }
+
+    uint32_t crc = 0;
+    for (off_t offset = range->start; offset < range->reached;) {
+        // O_DIRECT reads whole blocks; the bytes past the range are not checksummed
+        const off_t remaining = range->reached - offset;
+        const off_t aligned = (remaining + DIRECT_IO_ALIGNMENT - 1) & ~((off_t) DIRECT_IO_ALIGNMENT - 1);
+        const size_t length = aligned < DIRECT_IO_BUFFER_SIZE ? (size_t) aligned : DIRECT_IO_BUFFER_SIZE;
+        ssize_t n_read = statsPread(check->fd, buffer, length, offset);
+        if (n_read == -1 && errno == EINVAL) {
+            disableDirectIo(check->fd);
+            n_read = statsPread(check->fd, buffer, length, offset);
+        }
+        if (n_read == -1) {
+            check->result = ERROR_COPY_FAILED;
+            break;
+        }
+        if (n_read == 0) {
+            check->result = ERROR_VERIFY_FAILED; // Shorter than what was written
+            break;
+        }
+        const size_t used = n_read < remaining ? (size_t) n_read : (size_t) remaining;
+        crc = updateCrc32c(crc, buffer, used);
+        offset += (off_t) used;
+        if (range->throttle != NULL) {
+            throttleBytes(range->throttle, used);
+        }
+    }
+    if (check->result == SUCCESS && crc != range->crc) {
+        check->result = ERROR_VERIFY_FAILED;
+    }
+    free(buffer);
+    return NULL;
 }
 
 /**
@@ -130,7 +735,7 @@ int copyFile(const char *src, const char *dest) {
  */
 int changeFileOwner(const char *file_path, const uid_t user_uid) {
     const gid_t group_id = -1; // Keep the group ownership unchanged
-    if (chown(file_path, user_uid, group_id) == -1) {
+    if (STATS_SYSCALL(chown(file_path, user_uid, group_id)) == -1) {
         return ERROR_PERMISSION_DENIED;
     }
     return SUCCESS;
@@ -149,12 +754,12 @@ int changeFileOwner(const char *file_path, const uid_t user_uid) {
  */
 int addFilePermissions(const char *file_path, const mode_t add_mode) {
     struct stat file_stat;
-    if (stat(file_path, &file_stat) == -1) {
+    if (STATS_SYSCALL(stat(file_path, &file_stat)) == -1) {
         return ERROR_FILE_NOT_FOUND;
     }
     // Add the new specified permission bits
     const mode_t new_mode = file_stat.st_mode | add_mode;
-    if (chmod(file_path, new_mode) == -1) {
+    if (STATS_SYSCALL(chmod(file_path, new_mode)) == -1) {
         return ERROR_PERMISSION_DENIED;
     }
     return SUCCESS;
@@ -171,7 +776,7 @@ int addFilePermissions(const char *file_path, const mode_t add_mode) {
  * - Directly applies the specified permission bits using `chmod`.
  */
 int overwriteFilePermissions(const char *file_path, const mode_t new_mode) {
-    if (chmod(file_path, new_mode) == -1) {
+    if (STATS_SYSCALL(chmod(file_path, new_mode)) == -1) {
         return ERROR_PERMISSION_DENIED;
     }
     return SUCCESS;
@@ -217,5 +822,9 @@ int executeEditorCommand(const char *editor, const char copy_file_path[PATH_MAX]
         free(ed); // Free the duplicated editor string
     }
 
-    return system(command); // Execute the editor command and return the result
+    // Execute the editor command and return the result
+    const uint64_t start_ns = traceNow();
+    const int editor_result = system(command);
+    traceSpan("editor", "editor", start_ns, copy_file_path, -1);
+    return editor_result;
 }
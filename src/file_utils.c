@@ -5,10 +5,10 @@
 #include <sys/stat.h>
 #include <pwd.h>
 #include <string.h>
-#include <cargs.h>
 
 #include "../include/error_handler.h"
 #include "../include/file_utils.h"
+#include "../include/stats_handler.h"
 
 /**
  * @file file_utils.c
@@ -82,7 +82,7 @@ int getEffectiveUserId(uid_t *u_id) {
  */
 int getFilePermissions(const char *file_path, mode_t *permissions) {
     struct stat file_stat;
-    if (stat(file_path, &file_stat) == -1) {
+    if (STATS_SYSCALL(stat(file_path, &file_stat)) == -1) {
         return ERROR_FILE_NOT_FOUND;  // File does not exist or cannot be accessed
     }
     *permissions = file_stat.st_mode;  // Store file permissions
@@ -102,7 +102,7 @@ int getFilePermissions(const char *file_path, mode_t *permissions) {
  */
 int getFileOwner(const char *file_path, uid_t *file_owner) {
     struct stat file_stat;
-    if (stat(file_path, &file_stat) == -1) {
+    if (STATS_SYSCALL(stat(file_path, &file_stat)) == -1) {
         return ERROR_FILE_NOT_FOUND;  // File does not exist or cannot be accessed
     }
     *file_owner = file_stat.st_uid;  // Store the owner's user ID
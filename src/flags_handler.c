@@ -4,10 +4,12 @@
 
 #include "../include/flags_handler.h"
 
+#include <stdlib.h>
 #include <string.h>
 
 #include "../include/error_handler.h"
 #include "../include/file_utils.h"
+#include "../include/window_handler.h"
 
 /**
  * @file flags_handler.c
@@ -19,6 +21,14 @@
  * messages to guide the user on how to use the command-line tool effectively.
  */
 
+// Function prototypes
+static const cag_option *getProgramOptions();
+
+static size_t getProgramOptionsSize();
+
+static bool checkProgramFlags(bool copy_mode, bool overwrite_mode, bool copied_file_path, bool copied_dir_path,
+                              bool e_included, bool keep_copy);
+
 /**
  * @brief Defines the available command-line options for the `redit` program.
  */
@@ -65,6 +75,139 @@ cag_option options[] = {
         .value_name = NULL,
         .description = "Keep copy"
     },
+    {
+        .identifier = 'w',
+        .access_letters = NULL,
+        .access_name = "lock-timeout",
+        .value_name = "SECONDS",
+        .description = "Maximum time to wait for the file lock"
+    },
+    {
+        .identifier = 'y',
+        .access_letters = NULL,
+        .access_name = "sync",
+        .value_name = "MODE",
+        .description = "Durability mode: none, data, full or group"
+    },
+    {
+        .identifier = 'I',
+        .access_letters = NULL,
+        .access_name = "direct",
+        .value_name = NULL,
+        .description = "Bypass the page cache when copying"
+    },
+    {
+        .identifier = 'W',
+        .access_letters = NULL,
+        .access_name = "verify-write",
+        .value_name = NULL,
+        .description = "Read written files back from storage and check them"
+    },
+    {
+        .identifier = 'Z',
+        .access_letters = NULL,
+        .access_name = "raw",
+        .value_name = NULL,
+        .description = "Copy gzip and zstd files as they are, not decompressed"
+    },
+    {
+        .identifier = 'N',
+        .access_letters = NULL,
+        .access_name = "ionice",
+        .value_name = "CLASS",
+        .description = "I/O priority: idle or be:0 to be:7"
+    },
+    {
+        .identifier = 'M',
+        .access_letters = NULL,
+        .access_name = "bwlimit",
+        .value_name = "MB/S",
+        .description = "Most MB/s a copy may move"
+    },
+    {
+        .identifier = 'G',
+        .access_letters = NULL,
+        .access_name = "cpus",
+        .value_name = "COUNT",
+        .description = "Most CPUs the run may use"
+    },
+    {
+        .identifier = 'R',
+        .access_letters = NULL,
+        .access_name = "recalibrate",
+        .value_name = NULL,
+        .description = "Calibrate the copy parameters again"
+    },
+    {
+        .identifier = 'A',
+        .access_letters = NULL,
+        .access_name = "stats",
+        .value_name = "FORMAT",
+        .description = "Report time, system calls and bytes per phase: table or json"
+    },
+    {
+        .identifier = 'T',
+        .access_letters = NULL,
+        .access_name = "trace",
+        .value_name = "FILE",
+        .description = "Write a Chrome trace of the run to FILE"
+    },
+    {
+        .identifier = 'H',
+        .access_letters = NULL,
+        .access_name = "report",
+        .value_name = NULL,
+        .description = "Print latency percentiles of past runs"
+    },
+    {
+        .identifier = 'X',
+        .access_letters = NULL,
+        .access_name = "sessions",
+        .value_name = "clean",
+        .description = "List the copies taken, or clean up unedited and gone ones"
+    },
+    {
+        .identifier = 'B',
+        .access_letters = NULL,
+        .access_name = "broker",
+        .value_name = NULL,
+        .description = "Run the privileged broker daemon"
+    },
+    {
+        .identifier = 'U',
+        .access_letters = NULL,
+        .access_name = "restore",
+        .value_name = "VERSION",
+        .description = "List the backups of a privileged file, or restore one"
+    },
+    {
+        .identifier = 'S',
+        .access_letters = "S",
+        .access_name = "substitute",
+        .value_name = "EXPRESSION",
+        .description = "Rewrite the privileged file through a sed-style substitution"
+    },
+    {
+        .identifier = 'P',
+        .access_letters = "P",
+        .access_name = "patch",
+        .value_name = "PATCH_FILE",
+        .description = "Apply a unified diff to the privileged file"
+    },
+    {
+        .identifier = 'V',
+        .access_letters = NULL,
+        .access_name = "verify",
+        .value_name = NULL,
+        .description = "List the privileged files whose copies differ from them"
+    },
+    {
+        .identifier = 'L',
+        .access_letters = NULL,
+        .access_name = "lines",
+        .value_name = "FIRST:LAST",
+        .description = "Copy only a range of lines of the privileged file"
+    },
     {
         .identifier = 'h',
         .access_letters = "h",
@@ -102,7 +245,7 @@ struct option_info flags_info[] = {
  * 
  * @return Pointer to the array of cag_option structures defining the options.
  */
-const cag_option *getProgramOptions() {
+static const cag_option *getProgramOptions() {
     return options;
 }
 
@@ -111,7 +254,7 @@ const cag_option *getProgramOptions() {
  * 
  * @return Number of options defined in the program.
  */
-size_t getProgramOptionsSize() {
+static size_t getProgramOptionsSize() {
     return sizeof(options) / sizeof(options[0]);
 }
 
@@ -132,6 +275,8 @@ int handleFlags(const int argc, char *argv[], flag_state_t *flags) {
     const size_t OPTIONS_SIZE = getProgramOptionsSize();
     cag_option_context context;
 
+    flags->lock_timeout = -1; // Wait for the file lock indefinitely unless a timeout is given
+
     cag_option_init(&context, PROGRAM_OPTIONS, OPTIONS_SIZE, argc, argv);
     while (cag_option_fetch(&context)) {
         // Parse the options
@@ -158,6 +303,127 @@ int handleFlags(const int argc, char *argv[], flag_state_t *flags) {
             case 'k':
                 flags->keep_copy = true;
                 break;
+            case 'w': {
+                // Parse the lock timeout in seconds
+                const char *value = cag_option_get_value(&context);
+                char *end = NULL;
+                flags->lock_timeout = value != NULL ? strtod(value, &end) : -1;
+                if (value == NULL || end == value || *end != '\0' || flags->lock_timeout < 0) {
+                    fprintf(stderr, "Error: Invalid lock timeout '%s'.\n%s\n", value ? value : "", tryHelpMessage());
+                    return ERROR_INVALID_ARGUMENT;
+                }
+                break;
+            }
+            case 'y':
+                if (parseSyncMode(cag_option_get_value(&context), &flags->sync_mode) != SUCCESS) {
+                    fprintf(stderr, "Error: Invalid sync mode. Use none, data, full or group.\n%s\n",
+                            tryHelpMessage());
+                    return ERROR_INVALID_ARGUMENT;
+                }
+                break;
+            case 'I':
+                flags->direct_io = true;
+                break;
+            case 'W':
+                flags->verify_write = true;
+                break;
+            case 'Z':
+                flags->raw = true;
+                break;
+            case 'N':
+                if (parseIoPriority(cag_option_get_value(&context), &flags->io_priority) != SUCCESS) {
+                    fprintf(stderr, "Error: Invalid I/O priority. Use idle or be:0 to be:7.\n%s\n", tryHelpMessage());
+                    return ERROR_INVALID_ARGUMENT;
+                }
+                break;
+            case 'M': {
+                const char *value = cag_option_get_value(&context);
+                char *end = NULL;
+                flags->bandwidth_limit = value != NULL ? strtod(value, &end) : 0;
+                if (value == NULL || end == value || *end != '\0' || flags->bandwidth_limit <= 0) {
+                    fprintf(stderr, "Error: Invalid bandwidth limit '%s'.\n%s\n", value ? value : "", tryHelpMessage());
+                    return ERROR_INVALID_ARGUMENT;
+                }
+                break;
+            }
+            case 'G': {
+                const char *value = cag_option_get_value(&context);
+                char *end = NULL;
+                const unsigned long cpus = value != NULL ? strtoul(value, &end, 10) : 0;
+                if (value == NULL || end == value || *end != '\0' || cpus == 0 || value[0] == '-') {
+                    fprintf(stderr, "Error: Invalid CPU count '%s'.\n%s\n", value ? value : "", tryHelpMessage());
+                    return ERROR_INVALID_ARGUMENT;
+                }
+                flags->cpus = cpus;
+                break;
+            }
+            case 'R':
+                flags->recalibrate = true;
+                break;
+            case 'A':
+                if (parseStatsFormat(cag_option_get_value(&context), &flags->stats_format) != SUCCESS) {
+                    fprintf(stderr, "Error: Invalid stats format. Use table or json.\n%s\n", tryHelpMessage());
+                    return ERROR_INVALID_ARGUMENT;
+                }
+                break;
+            case 'H':
+                flags->report = true;
+                break;
+            case 'X': {
+                const char *value = cag_option_get_value(&context);
+                if (value != NULL && strcmp(value, "clean") != 0) {
+                    fprintf(stderr, "Error: Invalid sessions action '%s'. Use clean.\n%s\n", value, tryHelpMessage());
+                    return ERROR_INVALID_ARGUMENT;
+                }
+                flags->sessions = true;
+                flags->sessions_clean = value != NULL;
+                break;
+            }
+            case 'B':
+                flags->broker = true;
+                break;
+            case 'U': {
+                // Without '=', the next argument is taken as the value: if it is not a version, it is the file
+                flags->restore = true;
+                const char *value = cag_option_get_value(&context);
+                if (value != NULL && (value[0] == '\0' || strspn(value, "0123456789") != strlen(value))) {
+                    flags->restore_path = value;
+                } else {
+                    flags->restore_version = value;
+                }
+                break;
+            }
+            case 'S':
+                flags->substitute_expression = cag_option_get_value(&context);
+                if (flags->substitute_expression == NULL || flags->substitute_expression[0] == '\0') {
+                    fprintf(stderr, "Error: Missing substitution.\n%s\n", tryHelpMessage());
+                    return ERROR_INVALID_ARGUMENT;
+                }
+                break;
+            case 'P':
+                flags->patch_path = cag_option_get_value(&context);
+                if (flags->patch_path == NULL || flags->patch_path[0] == '\0') {
+                    fprintf(stderr, "Error: Missing patch file.\n%s\n", tryHelpMessage());
+                    return ERROR_INVALID_ARGUMENT;
+                }
+                break;
+            case 'V':
+                flags->verify = true;
+                break;
+            case 'L':
+                if (parseLineRange(cag_option_get_value(&context), &flags->first_line, &flags->last_line) != SUCCESS) {
+                    fprintf(stderr, "Error: Invalid line range. Use FIRST:LAST, FIRST: or LINE.\n%s\n",
+                            tryHelpMessage());
+                    return ERROR_INVALID_ARGUMENT;
+                }
+                break;
+            case 'T':
+                flags->trace_path = cag_option_get_value(&context);
+                if (flags->trace_path == NULL || flags->trace_path[0] == '\0') {
+                    fprintf(stderr, "Error: Missing trace file.\n%s\n", tryHelpMessage());
+                    return ERROR_INVALID_ARGUMENT;
+                }
+                break;
             case 'h':
                 displayHelp(); // Display help message if 'h' flag is provided
                 return HELP_DISPLAYED;
@@ -169,12 +435,50 @@ int handleFlags(const int argc, char *argv[], flag_state_t *flags) {
 
     flags->param_index = cag_option_get_index(&context); // Get the index of the first non-flag parameter
 
+    // The substitution and patch modes replace both copy and overwrite
+    if (flags->substitute_expression != NULL) {
+        if (flags->copy_mode || flags->overwrite_mode || flags->use_editor || flags->first_line != 0 ||
+            flags->patch_path != NULL) {
+            fprintf(stderr, "Error: -S cannot be combined with -C, -O, -e, -P or --lines.\n%s\n", tryHelpMessage());
+            return ERROR_INVALID_ARGUMENT;
+        }
+        return SUCCESS;
+    }
+    if (flags->verify) {
+        if (flags->copy_mode || flags->overwrite_mode || flags->copied_file_path || flags->use_editor ||
+            flags->first_line != 0 || flags->patch_path != NULL) {
+            fprintf(stderr, "Error: --verify cannot be combined with -C, -O, -d, -e, -S, -P or --lines.\n%s\n",
+                    tryHelpMessage());
+            return ERROR_INVALID_ARGUMENT;
+        }
+        return SUCCESS;
+    }
+    if (flags->patch_path != NULL) {
+        if (flags->copy_mode || flags->overwrite_mode || flags->use_editor || flags->first_line != 0) {
+            fprintf(stderr, "Error: -P cannot be combined with -C, -O, -e, -S or --lines.\n%s\n", tryHelpMessage());
+            return ERROR_INVALID_ARGUMENT;
+        }
+        return SUCCESS;
+    }
+
+    // On their own, --recalibrate, --report, --sessions, --broker and --restore are standalone commands
+    if ((flags->recalibrate || flags->report || flags->sessions || flags->broker || flags->restore) &&
+        !flags->copy_mode && !flags->overwrite_mode) {
+        return SUCCESS;
+    }
+
     // Check for incompatible flag combinations
     if (!checkProgramFlags(flags->copy_mode, flags->overwrite_mode, flags->copied_file_path,
                            flags->copied_dir_path, flags->use_editor, flags->keep_copy)) {
         return ERROR_INVALID_ARGUMENT;
     }
 
+    // A window is chosen when copying; the overwrite finds it recorded with the copy
+    if (flags->first_line != 0 && !flags->copy_mode) {
+        fprintf(stderr, "Error: --lines requires -C.\n%s\n", tryHelpMessage());
+        return ERROR_INVALID_ARGUMENT;
+    }
+
     return SUCCESS; // Flags are valid
 }
 
@@ -189,9 +493,9 @@ int handleFlags(const int argc, char *argv[], flag_state_t *flags) {
  * @param keep_copy Indicates if the copy should be kept after overwriting.
  * @return `true` if the flags are valid, `false` if there are conflicts.
  */
-bool checkProgramFlags(const bool copy_mode, const bool overwrite_mode, const bool copied_file_path,
-                       const bool copied_dir_path,
-                       const bool e_included, const bool keep_copy) {
+static bool checkProgramFlags(const bool copy_mode, const bool overwrite_mode, const bool copied_file_path,
+                              const bool copied_dir_path,
+                              const bool e_included, const bool keep_copy) {
     // Check if either copy or overwrite mode is active
     if (!(copy_mode || overwrite_mode)) {
         fprintf(stderr, "Error: Must use either -C or -O.\n%s\n", tryHelpMessage());
@@ -275,6 +579,8 @@ void displayHelp() {
     printf("                          make it editable for the original user.\n");
     printf("  -O, --overwrite         Overwrite the privileged file with the copy file using\n");
     printf("                          the original permissions of the privileged file.\n");
+    printf("                          Changes made to the privileged file after the copy was\n");
+    printf("                          taken are merged into it; conflicts abort the overwrite.\n");
     printf("  -d, --cfile             Specify the copy file destination as a file.\n");
     printf("  -D, --dfile             Specify the copy file destination as a directory.\n");
     printf("  -e, --editor <editor>   Use the specified editor for the operation.\n");
@@ -282,6 +588,62 @@ void displayHelp() {
     printf("                          the value of the REDIT_EDITOR environment variable,\n");
     printf("                          or the program's default editor if the env is null.\n");
     printf("  -k, --keep              Keep the copy file after overwriting.\n");
+    printf("  --lock-timeout <secs>   Maximum time to wait for another redit session to\n");
+    printf("                          release the privileged file. Waits indefinitely by\n");
+    printf("                          default; 0 fails immediately if the file is locked.\n");
+    printf("  --sync <mode>           Flush written files to disk: 'none' (default), 'data'\n");
+    printf("                          (fdatasync), 'full' (fsync file and directory) or\n");
+    printf("                          'group' (one syncfs per file system at the end).\n");
+    printf("  --direct                Copy with O_DIRECT, bypassing the page cache.\n");
+    printf("  --verify-write          Checksum (CRC32C) what is copied and read the written\n");
+    printf("                          file back from storage to check it. An overwrite that\n");
+    printf("                          does not read back is rolled back to its backup.\n");
+    printf("  --raw                   Copy gzip and zstd privileged files as they are. By\n");
+    printf("                          default the copy holds their decompressed content, and\n");
+    printf("                          -O compresses it back with the original codec and level.\n");
+    printf("  --ionice <class>        Run at a lower I/O priority: 'idle' (only when the disk\n");
+    printf("                          is otherwise unused) or 'be:0' to 'be:7' (best effort,\n");
+    printf("                          7 lowest). Honoured by the BFQ I/O scheduler.\n");
+    printf("  --bwlimit <MB/s>        Pace copies to at most <MB/s> across all their threads.\n");
+    printf("  --cpus <count>          Run on at most <count> CPUs, with at most that many\n");
+    printf("                          copy or --verify threads.\n");
+    printf("  --recalibrate           Measure the copy parameters for the file systems\n");
+    printf("                          involved again. Without -C or -O, clears the\n");
+    printf("                          calibration cache.\n");
+    printf("  --stats[=<format>]      Report the time, system calls and bytes of each phase\n");
+    printf("                          of the run on stderr, as a 'table' (default) or 'json'.\n");
+    printf("  --report                Print the p50/p95/p99 latency of past runs per phase,\n");
+    printf("                          mode and file system, from ~/.local/state/redit.\n");
+    printf("  --sessions[=clean]      List the copies taken with -C that were not overwritten\n");
+    printf("                          yet, and whether they differ from their privileged file.\n");
+    printf("                          'clean' removes the copies that do not, and forgets the\n");
+    printf("                          ones that are gone.\n");
+    printf("  --trace=<file>          Write the spans of the run (phases, path resolutions,\n");
+    printf("                          copies and their I/O calls, editor) to <file> in the\n");
+    printf("                          Chrome trace format, for chrome://tracing or Perfetto.\n");
+    printf("  --broker                Run as a root daemon opening privileged files for\n");
+    printf("                          unprivileged redit runs, as allowed by\n");
+    printf("                          /etc/redit/broker.policy. Runs without sudo then use it.\n");
+    printf("  --restore[=<version>] <privileged_file>\n");
+    printf("                          List the versions of the privileged file backed up\n");
+    printf("                          before each overwrite, or restore one of them\n");
+    printf("                          (1 is the newest). The current content is backed up too.\n");
+    printf("  -S, --substitute <expr> Rewrite the privileged file in one pass through a sed\n");
+    printf("                          substitution 's/regex/replacement/flags' (extended regex,\n");
+    printf("                          flags 'g' and 'i'), keeping its owner and permissions.\n");
+    printf("                          The file is not written if nothing matches.\n");
+    printf("  -P, --patch <patch>     Apply a unified diff (diff -u, git diff) of one file to\n");
+    printf("                          the privileged file, keeping its owner and permissions.\n");
+    printf("                          Hunks may have moved or need up to 2 lines of fuzz;\n");
+    printf("                          if any hunk does not apply, the file is not written.\n");
+    printf("  --verify [-D <copy_dir>] <privileged_file>...\n");
+    printf("                          Print the privileged files whose copy (in <copy_dir>,\n");
+    printf("                          or the current directory) differs from them, one per\n");
+    printf("                          line. Unedited copies are told apart by their size and\n");
+    printf("                          modification time; the rest are compared in parallel.\n");
+    printf("  --lines <first:last>    Copy only lines <first> to <last> (from 1, inclusive;\n");
+    printf("                          '<first>:' up to the end). The overwrite splices the\n");
+    printf("                          edited lines back, rewriting the file from them onward.\n");
     printf("  -h, --help              Display this help message.\n");
     printf("\n");
     printf("Examples:\n");
@@ -292,6 +654,18 @@ void displayHelp() {
     printf("      Overwrite '/privileged/privileged.txt' with a copy stored with the same\n");
     printf("      file name in the current working directory.\n");
     printf("\n");
+    printf("  redit -O ~/copies/privileged.txt\n");
+    printf("      Overwrite the privileged file that '~/copies/privileged.txt' was copied from.\n");
+    printf("\n");
+    printf("  redit -S 's/^Listen .*/Listen 8080/' /etc/httpd/conf/httpd.conf\n");
+    printf("      Change the Listen directive of 'httpd.conf' without opening an editor.\n");
+    printf("\n");
+    printf("  redit -P change.diff /etc/nginx/nginx.conf\n");
+    printf("      Apply the changes in 'change.diff' to 'nginx.conf'.\n");
+    printf("\n");
+    printf("  redit --verify /etc/nginx/*.conf | xargs -r -n1 redit -O\n");
+    printf("      Overwrite only the files of /etc/nginx whose copies were edited.\n");
+    printf("\n");
     printf("  redit -Cd privileged_2.txt /privileged/privileged.txt -e vim\n");
     printf("      Copy '/privileged/privileged.txt' to './privileged_2.txt' and open it with Vim.\n");
     printf("\n");
@@ -0,0 +1,407 @@
+#include <assert.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include <linux/limits.h>
+#include <sys/file.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <sys/statfs.h>
+
+#include "../include/error_handler.h"
+#include "../include/history_handler.h"
+#include "../include/paths_handler.h"
+#include "../include/stats_handler.h"
+
+/**
+ * @file history_handler.c
+ * @brief Keeps a ring of past runs and reports latency percentiles over it.
+ *
+ * Every run appends one fixed-size record to a memory-mapped ring file in the user's
+ * state directory. Concurrent runs claim slots with an atomic counter in the shared
+ * mapping, and a record is only trusted once its sequence number is published, so
+ * readers never see a half-written one. The report buckets the durations into
+ * log-linear (HDR-style) histograms, which keep percentiles within ~6% of the exact
+ * value at any magnitude with a fixed amount of memory.
+ */
+
+#define HISTORY_MAGIC 0x52454448U // "REDH"
+#define HISTORY_VERSION 1
+#define HISTORY_PHASES 16 // Phase slots in a record, fixed so new phases keep the file format
+
+#define HDR_SUB_BITS 4 // Each power of two is split into 2^HDR_SUB_BITS buckets
+#define HDR_SUB_COUNT (1 << HDR_SUB_BITS)
+#define HDR_BUCKETS (HDR_SUB_COUNT + (64 - HDR_SUB_BITS) * HDR_SUB_COUNT) // Covers every uint64_t value
+
+#define MAX_REPORT_FILE_SYSTEMS 16 // Distinct file systems listed by the report
+
+static_assert(STATS_PHASE_COUNT <= HISTORY_PHASES, "Run records have no room for every phase");
+
+/**
+ * @brief One run, as stored in the ring.
+ */
+typedef struct {
+    uint64_t sequence; ///< Position of the run in the history plus one, 0 while being written.
+    int64_t timestamp; ///< Wall clock time of the run, in seconds since the epoch.
+    uint64_t bytes; ///< Size of the privileged file after the run.
+    uint64_t fs_type; ///< `statfs` type of the privileged file's file system.
+    int32_t result; ///< Exit code of the run (see `error_handler.h`).
+    uint8_t copy_mode; ///< 1 for copy mode, 0 for overwrite mode.
+    uint8_t reserved;
+    uint16_t phase_mask; ///< Bit set for each phase the run went through.
+    uint32_t total_us; ///< Duration of the run in microseconds.
+    uint32_t phase_us[HISTORY_PHASES]; ///< Duration of each phase in microseconds.
+} run_record_t;
+
+/**
+ * @brief Header of the ring file, followed by `capacity` records.
+ */
+typedef struct {
+    uint32_t magic; ///< `HISTORY_MAGIC`.
+    uint32_t version; ///< `HISTORY_VERSION`.
+    uint32_t capacity; ///< Number of record slots.
+    uint32_t record_size; ///< `sizeof(run_record_t)`.
+    uint64_t next; ///< Number of runs ever recorded; the next one goes to `next % capacity`.
+} history_header_t;
+
+/**
+ * @brief Log-linear histogram of microsecond durations.
+ */
+typedef struct {
+    uint64_t count; ///< Number of recorded values.
+    uint32_t buckets[HDR_BUCKETS]; ///< Values per bucket.
+} hdr_histogram_t;
+
+/**
+ * @brief Returns the size of a ring file.
+ */
+static size_t historyFileSize() {
+    return sizeof(history_header_t) + (size_t) HISTORY_CAPACITY * sizeof(run_record_t);
+}
+
+/**
+ * @brief Maps the ring file, creating and initializing it if needed.
+ *
+ * @param writable Whether the ring will be appended to. A read-only ring is never created.
+ * @param header Pointer to a variable receiving the mapped header.
+ * @return `SUCCESS`, `ERROR_FILE_NOT_FOUND` if there is no history to read, or another error code.
+ *
+ * @details
+ * - The ring lives in the user's home but is written as root, so it is opened through the verified
+ *   state directory (see `openUserDataDir`) with `O_NOFOLLOW`, and only used if it is a regular
+ *   file with a single link owned by the user. A symlink or hard link to another file is refused
+ *   instead of being truncated and overwritten.
+ */
+static int mapHistory(const bool writable, history_header_t **header) {
+    int dir_fd;
+    uid_t ef_uid;
+    const int dir_result = openUserDataDir(HISTORY_DIR, &dir_fd, &ef_uid);
+    if (dir_result != SUCCESS) {
+        return dir_result;
+    }
+
+    int fd;
+    if (writable) {
+        fd = openat(dir_fd, HISTORY_FILE, O_RDWR | O_CREAT | O_EXCL | O_NOFOLLOW | O_CLOEXEC, S_IRUSR | S_IWUSR);
+        if (fd != -1) {
+            fchown(fd, ef_uid, -1); // The history belongs to the user running sudo
+        } else if (errno == EEXIST) {
+            fd = openat(dir_fd, HISTORY_FILE, O_RDWR | O_NOFOLLOW | O_CLOEXEC);
+        }
+    } else {
+        fd = openat(dir_fd, HISTORY_FILE, O_RDONLY | O_NOFOLLOW | O_CLOEXEC);
+    }
+    const int open_error = errno;
+    close(dir_fd);
+    if (fd == -1) {
+        return open_error == ENOENT ? ERROR_FILE_NOT_FOUND : ERROR_PERMISSION_DENIED;
+    }
+
+    struct stat file_stat;
+    if (fstat(fd, &file_stat) == -1 || !S_ISREG(file_stat.st_mode) || file_stat.st_nlink != 1 ||
+        file_stat.st_uid != ef_uid) {
+        close(fd);
+        return ERROR_PERMISSION_DENIED;
+    }
+
+    const size_t file_size = historyFileSize();
+    if (writable) {
+        // Size and initialize the ring once, even if several runs start at the same time
+        flock(fd, LOCK_EX);
+        if (fstat(fd, &file_stat) == -1 || (file_stat.st_size < (off_t) file_size &&
+                                            ftruncate(fd, (off_t) file_size) == -1)) {
+            close(fd);
+            return ERROR_PERMISSION_DENIED;
+        }
+    } else if (file_stat.st_size < (off_t) file_size) {
+        close(fd);
+        return ERROR_FILE_NOT_FOUND;
+    }
+
+    void *map = mmap(NULL, file_size, writable ? PROT_READ | PROT_WRITE : PROT_READ, MAP_SHARED, fd, 0);
+    if (map == MAP_FAILED) {
+        close(fd);
+        return ERROR_MEMORY_ALLOCATION;
+    }
+    *header = map;
+
+    const bool valid = (*header)->magic == HISTORY_MAGIC && (*header)->version == HISTORY_VERSION &&
+                       (*header)->capacity == HISTORY_CAPACITY && (*header)->record_size == sizeof(run_record_t);
+    if (!valid && writable) {
+        // New or incompatible ring: start over
+        memset(map, 0, file_size);
+        (*header)->version = HISTORY_VERSION;
+        (*header)->capacity = HISTORY_CAPACITY;
+        (*header)->record_size = sizeof(run_record_t);
+        __atomic_store_n(&(*header)->magic, HISTORY_MAGIC, __ATOMIC_RELEASE);
+    }
+    close(fd); // Also releases the lock; the mapping stays valid
+
+    if (!valid && !writable) {
+        munmap(map, file_size);
+        return ERROR_FILE_NOT_FOUND;
+    }
+    return SUCCESS;
+}
+
+/**
+ * @brief Converts nanoseconds to saturated microseconds.
+ */
+static uint32_t toMicroseconds(const uint64_t ns) {
+    const uint64_t us = ns / 1000;
+    return us > UINT32_MAX ? UINT32_MAX : (uint32_t) us;
+}
+
+/**
+ * @brief Appends the current run to the history.
+ *
+ * @param copy_mode Whether the run was in copy mode (`true`) or overwrite mode (`false`).
+ * @param privileged_file_path Path to the privileged file of the run.
+ * @param result Exit code of the run.
+ * @return `SUCCESS` if the run was recorded, or an error code otherwise.
+ *
+ * @details
+ * - Phase durations come from the `--stats` accounting, which always measures time.
+ * - Several runs may append at once: each claims its own slot atomically.
+ */
+int recordRun(const bool copy_mode, const char *privileged_file_path, const int result) {
+    stats_counters_t counters[STATS_PHASE_COUNT];
+    const uint64_t total_ns = statsSnapshot(counters);
+
+    history_header_t *header;
+    const int map_result = mapHistory(true, &header);
+    if (map_result != SUCCESS) {
+        return map_result;
+    }
+    run_record_t *records = (run_record_t *) (header + 1);
+
+    // Claim a slot, then publish the record once it is complete
+    const uint64_t position = __atomic_fetch_add(&header->next, 1, __ATOMIC_RELAXED);
+    run_record_t *record = &records[position % HISTORY_CAPACITY];
+    __atomic_store_n(&record->sequence, 0, __ATOMIC_RELAXED);
+    __atomic_thread_fence(__ATOMIC_RELEASE);
+
+    struct stat prv_stat;
+    struct statfs prv_fs;
+    record->timestamp = time(NULL);
+    record->bytes = stat(privileged_file_path, &prv_stat) == 0 ? (uint64_t) prv_stat.st_size : 0;
+    record->fs_type = statfs(privileged_file_path, &prv_fs) == 0 ? (uint64_t) prv_fs.f_type : 0;
+    record->result = result;
+    record->copy_mode = copy_mode ? 1 : 0;
+    record->reserved = 0;
+    record->phase_mask = 0;
+    record->total_us = toMicroseconds(total_ns);
+    for (size_t i = 0; i < HISTORY_PHASES; ++i) {
+        const bool has_phase = i < STATS_PHASE_COUNT && counters[i].entered;
+        record->phase_us[i] = has_phase ? toMicroseconds(counters[i].elapsed_ns) : 0;
+        if (has_phase) {
+            record->phase_mask |= (uint16_t) (1U << i);
+        }
+    }
+    __atomic_store_n(&record->sequence, position + 1, __ATOMIC_RELEASE);
+
+    munmap(header, historyFileSize());
+    return SUCCESS;
+}
+
+/**
+ * @brief Returns the histogram bucket of a value.
+ *
+ * @details
+ * - Values below `HDR_SUB_COUNT` get a bucket each. Larger ones are bucketed by their
+ *   power of two and the next `HDR_SUB_BITS` bits, so every bucket is at most 1/16th
+ *   of its value wide.
+ */
+static size_t hdrBucket(const uint64_t value) {
+    if (value < HDR_SUB_COUNT) {
+        return (size_t) value;
+    }
+    const int exponent = 63 - __builtin_clzll(value);
+    const size_t sub = (size_t) (value >> (exponent - HDR_SUB_BITS)) - HDR_SUB_COUNT;
+    return HDR_SUB_COUNT + (size_t) (exponent - HDR_SUB_BITS) * HDR_SUB_COUNT + sub;
+}
+
+/**
+ * @brief Returns the value represented by a histogram bucket (its midpoint).
+ */
+static double hdrBucketValue(const size_t bucket) {
+    if (bucket < HDR_SUB_COUNT) {
+        return (double) bucket;
+    }
+    const int shift = (int) ((bucket - HDR_SUB_COUNT) / HDR_SUB_COUNT);
+    const uint64_t sub = (bucket - HDR_SUB_COUNT) % HDR_SUB_COUNT;
+    const double width = (double) (1ULL << shift);
+    return (double) (HDR_SUB_COUNT + sub) * width + width / 2;
+}
+
+/**
+ * @brief Records a value in a histogram.
+ */
+static void hdrRecord(hdr_histogram_t *histogram, const uint64_t value) {
+    histogram->buckets[hdrBucket(value)]++;
+    histogram->count++;
+}
+
+/**
+ * @brief Returns the value below which a fraction of the recorded values fall.
+ */
+static double hdrPercentile(const hdr_histogram_t *histogram, const double fraction) {
+    uint64_t rank = (uint64_t) (fraction * (double) histogram->count + 0.999999);
+    if (rank == 0) {
+        rank = 1;
+    }
+    uint64_t seen = 0;
+    for (size_t i = 0; i < HDR_BUCKETS; ++i) {
+        seen += histogram->buckets[i];
+        if (seen >= rank) {
+            return hdrBucketValue(i);
+        }
+    }
+    return 0;
+}
+
+/**
+ * @brief Returns a printable name for common `statfs` file system types.
+ */
+static const char *getFileSystemName(const uint64_t fs_type) {
+    switch (fs_type) {
+        case 0xEF53: return "ext4";
+        case 0x58465342: return "xfs";
+        case 0x9123683E: return "btrfs";
+        case 0x01021994: return "tmpfs";
+        case 0x6969: return "nfs";
+        case 0x794C7630: return "overlay";
+        case 0x2FC12FC1: return "zfs";
+        case 0xF2F52010: return "f2fs";
+        case 0xFF534D42: return "cifs";
+        default: return NULL;
+    }
+}
+
+/**
+ * @brief Prints one report row.
+ */
+static void printReportRow(const char *scope, const char *name, const hdr_histogram_t *histogram) {
+    if (histogram->count == 0) {
+        return;
+    }
+    printf("%-10s %-12s %8llu %12.3f %12.3f %12.3f\n", scope, name, (unsigned long long) histogram->count,
+           hdrPercentile(histogram, 0.50) / 1e3, hdrPercentile(histogram, 0.95) / 1e3,
+           hdrPercentile(histogram, 0.99) / 1e3);
+}
+
+/**
+ * @brief Prints the p50/p95/p99 latencies of the recorded runs, per phase, mode and file system.
+ *
+ * @return `SUCCESS` if the report was printed, or an error code otherwise.
+ */
+int printHistoryReport() {
+    history_header_t *header;
+    const int map_result = mapHistory(false, &header);
+    if (map_result == ERROR_FILE_NOT_FOUND) {
+        printf("No runs recorded yet.\n");
+        return SUCCESS;
+    }
+    if (map_result != SUCCESS) {
+        return map_result;
+    }
+    const run_record_t *records = (const run_record_t *) (header + 1);
+
+    // Phases, total, copy/overwrite totals and file system totals, in that order
+    const size_t n_histograms = STATS_PHASE_COUNT + 3 + MAX_REPORT_FILE_SYSTEMS;
+    hdr_histogram_t *histograms = calloc(n_histograms, sizeof(hdr_histogram_t));
+    if (histograms == NULL) {
+        munmap(header, historyFileSize());
+        return ERROR_MEMORY_ALLOCATION;
+    }
+    hdr_histogram_t *phase_hist = histograms;
+    hdr_histogram_t *total_hist = &histograms[STATS_PHASE_COUNT];
+    hdr_histogram_t *mode_hist = &histograms[STATS_PHASE_COUNT + 1]; // Overwrite, then copy
+    hdr_histogram_t *fs_hist = &histograms[STATS_PHASE_COUNT + 3];
+    uint64_t fs_types[MAX_REPORT_FILE_SYSTEMS];
+    size_t n_fs = 0;
+    uint64_t failed = 0;
+
+    const uint64_t next = __atomic_load_n(&header->next, __ATOMIC_ACQUIRE);
+    for (size_t slot = 0; slot < HISTORY_CAPACITY; ++slot) {
+        const uint64_t sequence = __atomic_load_n(&records[slot].sequence, __ATOMIC_ACQUIRE);
+        if (sequence == 0 || sequence + HISTORY_CAPACITY <= next) {
+            continue; // Empty, being written, or about to be overwritten
+        }
+        const run_record_t record = records[slot];
+        if (__atomic_load_n(&records[slot].sequence, __ATOMIC_ACQUIRE) != sequence) {
+            continue; // Overwritten while reading it
+        }
+
+        if (record.result != SUCCESS) {
+            failed++;
+        }
+        for (size_t i = 0; i < STATS_PHASE_COUNT; ++i) {
+            if (record.phase_mask & (1U << i)) {
+                hdrRecord(&phase_hist[i], record.phase_us[i]);
+            }
+        }
+        hdrRecord(total_hist, record.total_us);
+        hdrRecord(&mode_hist[record.copy_mode ? 1 : 0], record.total_us);
+
+        size_t fs_index = 0;
+        while (fs_index < n_fs && fs_types[fs_index] != record.fs_type) {
+            fs_index++;
+        }
+        if (fs_index == n_fs && n_fs < MAX_REPORT_FILE_SYSTEMS) {
+            fs_types[n_fs++] = record.fs_type;
+        }
+        if (fs_index < n_fs) {
+            hdrRecord(&fs_hist[fs_index], record.total_us);
+        }
+    }
+    munmap(header, historyFileSize());
+
+    printf("%llu run/s recorded, %llu kept (%llu failed). Latencies in ms.\n\n", (unsigned long long) next,
+           (unsigned long long) total_hist->count, (unsigned long long) failed);
+    printf("%-10s %-12s %8s %12s %12s %12s\n", "scope", "name", "runs", "p50", "p95", "p99");
+    printReportRow("run", "total", total_hist);
+    printReportRow("mode", "copy", &mode_hist[1]);
+    printReportRow("mode", "overwrite", &mode_hist[0]);
+    for (size_t i = 0; i < STATS_PHASE_COUNT; ++i) {
+        printReportRow("phase", getStatsPhaseName(i), &phase_hist[i]);
+    }
+    for (size_t i = 0; i < n_fs; ++i) {
+        char fs_name[32];
+        const char *known_name = getFileSystemName(fs_types[i]);
+        if (known_name != NULL) {
+            snprintf(fs_name, sizeof(fs_name), "%s", known_name);
+        } else {
+            snprintf(fs_name, sizeof(fs_name), "%llx", (unsigned long long) fs_types[i]);
+        }
+        printReportRow("fs", fs_name, &fs_hist[i]);
+    }
+
+    free(histograms);
+    return SUCCESS;
+}
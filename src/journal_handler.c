@@ -0,0 +1,235 @@
+#include <errno.h>
+#include <fcntl.h>
+#include <stdio.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "../include/checksum_handler.h"
+#include "../include/error_handler.h"
+#include "../include/journal_handler.h"
+#include "../include/paths_handler.h"
+#include "../include/stats_handler.h"
+
+#define JOURNAL_MAGIC "REDITJ1" // Identifies a journal, and the version of its layout
+
+/**
+ * @file journal_handler.c
+ * @brief Records the progress of large copies, so they survive an interruption.
+ *
+ * A journal starts with a header identifying the source (device, inode, size and
+ * modification time) and the destination (device and inode) of the copy, followed by one
+ * entry per range of the copy. As a range progresses, its entry is rewritten in place with
+ * the offset reached and the CRC32C of what was written up to it. Each header and entry
+ * carries its own checksum, so a journal torn by a crash is discarded rather than trusted.
+ *
+ * The journal is not flushed. After a crash of the process, the destination and the journal
+ * are both in the page cache; after a power loss, the destination may lack data the journal
+ * records, which the resuming copy finds when it checks the checksums against the destination.
+ */
+
+/**
+ * @brief Header of a journal file.
+ */
+typedef struct {
+    char magic[8]; ///< `JOURNAL_MAGIC`.
+    uint64_t src_dev; ///< Device of the source.
+    uint64_t src_ino; ///< Inode of the source.
+    int64_t src_size; ///< Size of the source.
+    int64_t src_mtime_sec; ///< Modification time of the source, seconds.
+    int64_t src_mtime_nsec; ///< Modification time of the source, nanoseconds.
+    uint64_t dest_dev; ///< Device of the destination.
+    uint64_t dest_ino; ///< Inode of the destination.
+    uint32_t n_ranges; ///< Number of entries following the header.
+    uint32_t crc; ///< CRC32C of the fields above.
+} journal_header_t;
+
+/**
+ * @brief Entry of a journal file, one per range.
+ */
+typedef struct {
+    int64_t start; ///< First byte of the range.
+    int64_t end; ///< One past the last byte of the range.
+    int64_t checkpoint; ///< The range is known to be copied up to here.
+    uint32_t range_crc; ///< CRC32C of the destination from `start` to `checkpoint`.
+    uint32_t crc; ///< CRC32C of the fields above.
+} journal_entry_t;
+
+// Function prototypes
+static int getJournalPath(const char *dest, char journal_path[PATH_MAX]);
+
+static bool loadJournal(copy_journal_t *journal, const char *dest);
+
+static void fillHeader(journal_header_t *header, const struct stat *src_stat, const struct stat *dest_stat,
+                       size_t n_ranges);
+
+/**
+ * @brief Opens the journal of a destination, loading what an interrupted copy of the same source left.
+ *
+ * @param dest Absolute path to the destination of the copy.
+ * @param src_stat Metadata of the source of the copy.
+ * @param journal Journal to open. `resumed` is set, and `ranges` loaded, if the journal was
+ *                left by a copy of the same, unmodified source to the same destination file.
+ * @return `SUCCESS` if the journal is open, or an error code if it cannot be kept (e.g. the
+ *         state directory is not writable), in which case the copy goes unjournaled.
+ */
+int openJournal(const char *dest, const struct stat *src_stat, copy_journal_t *journal) {
+    *journal = (copy_journal_t){.fd = -1, .src_stat = *src_stat};
+
+    // Create the state directories if they don't exist
+    if (mkdir(REDIT_STATE_DIR, 0755) == -1 && errno != EEXIST) {
+        return errno == EACCES ? ERROR_PERMISSION_DENIED : ERROR_PATH_INVALID;
+    }
+    if (mkdir(JOURNAL_DIR, 0700) == -1 && errno != EEXIST) {
+        return errno == EACCES ? ERROR_PERMISSION_DENIED : ERROR_PATH_INVALID;
+    }
+    const int path_result = getJournalPath(dest, journal->path);
+    if (path_result != SUCCESS) {
+        return path_result;
+    }
+
+    journal->fd = STATS_SYSCALL(open(journal->path, O_RDWR | O_CREAT | O_CLOEXEC, S_IRUSR | S_IWUSR));
+    if (journal->fd == -1) {
+        return errno == EACCES ? ERROR_PERMISSION_DENIED : ERROR_PATH_INVALID;
+    }
+    journal->resumed = loadJournal(journal, dest);
+    return SUCCESS;
+}
+
+/**
+ * @brief Starts the journal of a new copy, discarding what it held.
+ *
+ * @param journal Open journal.
+ * @param dest_stat Metadata of the destination, as opened for the copy.
+ * @param ranges Ranges of the copy, with their checkpoints at their start.
+ * @param n_ranges Number of `ranges`, at most `JOURNAL_MAX_RANGES`.
+ * @return `SUCCESS` if the journal was written, or `ERROR_COPY_FAILED` otherwise.
+ */
+int startJournal(copy_journal_t *journal, const struct stat *dest_stat, const journal_range_t *ranges,
+                 const size_t n_ranges) {
+    journal->resumed = false;
+    journal->n_ranges = n_ranges;
+    memcpy(journal->ranges, ranges, n_ranges * sizeof(journal_range_t));
+
+    journal_header_t header;
+    fillHeader(&header, &journal->src_stat, dest_stat, n_ranges);
+    if (STATS_SYSCALL(ftruncate(journal->fd, 0)) == -1 ||
+        statsPwrite(journal->fd, &header, sizeof(header), 0) != (ssize_t) sizeof(header)) {
+        return ERROR_COPY_FAILED;
+    }
+    for (size_t i = 0; i < n_ranges; ++i) {
+        checkpointJournal(journal, i, ranges[i].checkpoint, ranges[i].crc);
+    }
+    return SUCCESS;
+}
+
+/**
+ * @brief Records how far a range of the copy got.
+ *
+ * @param journal Open journal.
+ * @param index Index of the range.
+ * @param checkpoint Offset up to which the range has been written.
+ * @param crc CRC32C of the range from its start to `checkpoint`.
+ *
+ * @details
+ * - Each range has its own entry, so the threads of a copy checkpoint without locking.
+ * - Best effort: a failed checkpoint only makes a resumed copy start further back.
+ */
+void checkpointJournal(const copy_journal_t *journal, const size_t index, const off_t checkpoint,
+                       const uint32_t crc) {
+    journal_entry_t entry = {
+        .start = journal->ranges[index].start,
+        .end = journal->ranges[index].end,
+        .checkpoint = checkpoint,
+        .range_crc = crc
+    };
+    entry.crc = updateCrc32c(0, &entry, offsetof(journal_entry_t, crc));
+    statsPwrite(journal->fd, &entry, sizeof(entry),
+                (off_t) (sizeof(journal_header_t) + index * sizeof(journal_entry_t)));
+}
+
+/**
+ * @brief Closes a journal, removing it once its copy is done.
+ *
+ * @param journal Open journal, or one whose opening failed.
+ * @param done Whether the copy completed; the journal of an unfinished one is kept for the next run.
+ */
+void closeJournal(copy_journal_t *journal, const bool done) {
+    if (journal->fd == -1) {
+        return;
+    }
+    STATS_SYSCALL(close(journal->fd));
+    journal->fd = -1;
+    if (done) {
+        STATS_SYSCALL(unlink(journal->path));
+    }
+}
+
+/**
+ * @brief Builds the path of the journal of a destination.
+ *
+ * @details
+ * - The journal name is the hash of the destination path (see `getStoreEntryPath`).
+ */
+static int getJournalPath(const char *dest, char journal_path[PATH_MAX]) {
+    return getStoreEntryPath(JOURNAL_DIR, dest, NULL, journal_path);
+}
+
+/**
+ * @brief Loads the ranges of a journal, if it was left by a copy of the same source to the same file.
+ *
+ * @return Whether the journal can be resumed from.
+ *
+ * @details
+ * - A torn entry loses the layout of the ranges, so it discards the whole journal.
+ */
+static bool loadJournal(copy_journal_t *journal, const char *dest) {
+    struct stat dest_stat;
+    if (STATS_SYSCALL(lstat(dest, &dest_stat)) == -1 || !S_ISREG(dest_stat.st_mode)) {
+        return false; // Nothing to resume into
+    }
+    journal_header_t header, expected;
+    if (statsPread(journal->fd, &header, sizeof(header), 0) != (ssize_t) sizeof(header)) {
+        return false;
+    }
+    fillHeader(&expected, &journal->src_stat, &dest_stat, header.n_ranges);
+    if (memcmp(&header, &expected, sizeof(header)) != 0 || header.n_ranges == 0 ||
+        header.n_ranges > JOURNAL_MAX_RANGES) {
+        return false; // Another source, a modified one, or another destination file
+    }
+
+    journal->n_ranges = header.n_ranges;
+    for (size_t i = 0; i < journal->n_ranges; ++i) {
+        journal_entry_t entry;
+        const off_t entry_offset = (off_t) (sizeof(header) + i * sizeof(entry));
+        if (statsPread(journal->fd, &entry, sizeof(entry), entry_offset) != (ssize_t) sizeof(entry) ||
+            entry.crc != updateCrc32c(0, &entry, offsetof(journal_entry_t, crc)) ||
+            entry.checkpoint < entry.start || entry.checkpoint > entry.end) {
+            return false;
+        }
+        journal->ranges[i] = (journal_range_t){
+            .start = entry.start,
+            .end = entry.end,
+            .checkpoint = entry.checkpoint,
+            .crc = entry.range_crc
+        };
+    }
+    return true;
+}
+
+/**
+ * @brief Fills the header of a journal, checksum included.
+ */
+static void fillHeader(journal_header_t *header, const struct stat *src_stat, const struct stat *dest_stat,
+                       const size_t n_ranges) {
+    memset(header, 0, sizeof(*header)); // Padding included, so headers compare with memcmp
+    memcpy(header->magic, JOURNAL_MAGIC, sizeof(JOURNAL_MAGIC));
+    header->src_dev = (uint64_t) src_stat->st_dev;
+    header->src_ino = (uint64_t) src_stat->st_ino;
+    header->src_size = (int64_t) src_stat->st_size;
+    header->src_mtime_sec = (int64_t) src_stat->st_mtim.tv_sec;
+    header->src_mtime_nsec = (int64_t) src_stat->st_mtim.tv_nsec;
+    header->dest_dev = (uint64_t) dest_stat->st_dev;
+    header->dest_ino = (uint64_t) dest_stat->st_ino;
+    header->n_ranges = (uint32_t) n_ranges;
+    header->crc = updateCrc32c(0, header, offsetof(journal_header_t, crc));
+}
@@ -0,0 +1,148 @@
+#define _GNU_SOURCE // F_OFD_SETLK and F_OFD_SETLKW
+
+#include <errno.h>
+#include <fcntl.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "../include/error_handler.h"
+#include "../include/lock_handler.h"
+#include "../include/stats_handler.h"
+
+/**
+ * @file lock_handler.c
+ * @brief Implements per-file advisory locking for the `redit` program.
+ *
+ * OFD locks belong to the open file description rather than the process, so they are
+ * not silently dropped when another descriptor of the same file is closed (as `copyFile`
+ * does) and they are released automatically if the program dies. Only the locked file
+ * is affected; there is no global lock.
+ */
+
+/**
+ * @brief Returns the seconds elapsed since a monotonic timestamp.
+ */
+static double secondsSince(const struct timespec *start) {
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return (double) (now.tv_sec - start->tv_sec) + (double) (now.tv_nsec - start->tv_nsec) / 1e9;
+}
+
+/**
+ * @brief Takes an advisory lock on a whole file.
+ *
+ * @param file_path Path to the file to lock.
+ * @param exclusive `true` for a write lock (overwrite), `false` for a shared read lock (copy).
+ * @param timeout Maximum seconds to wait for the lock. Negative to wait indefinitely, 0 to not wait.
+ * @param lock_fd Pointer to a variable where the descriptor holding the lock will be stored.
+ * @param waited Pointer to a variable where the seconds spent waiting will be stored.
+ * @return `SUCCESS` if the lock was taken, or an error code otherwise.
+ *
+ * @details
+ * - Opens the file and locks the descriptor with `lockDescriptor`.
+ */
+int acquireFileLock(const char *file_path, const bool exclusive, const double timeout, int *lock_fd,
+                    double *waited) {
+    *lock_fd = -1;
+    *waited = 0;
+
+    // A write lock needs a descriptor open for writing
+    const int fd = STATS_SYSCALL(open(file_path, exclusive ? O_RDWR : O_RDONLY));
+    if (fd == -1) {
+        return errno == EACCES ? ERROR_PERMISSION_DENIED : ERROR_FILE_NOT_FOUND;
+    }
+
+    const int lock_result = lockDescriptor(fd, exclusive, timeout, waited);
+    if (lock_result != SUCCESS) {
+        close(fd);
+        return lock_result;
+    }
+    *lock_fd = fd;
+    return SUCCESS;
+}
+
+/**
+ * @brief Takes an advisory lock on the whole file behind an open descriptor.
+ *
+ * @param fd Descriptor of the file, open for writing if `exclusive` is set. The lock lasts
+ *           until the last descriptor sharing its open file description is closed.
+ * @param exclusive `true` for a write lock (overwrite), `false` for a shared read lock (copy).
+ * @param timeout Maximum seconds to wait for the lock. Negative to wait indefinitely, 0 to not wait.
+ * @param waited Pointer to a variable where the seconds spent waiting will be stored.
+ * @return `SUCCESS` if the lock was taken, or an error code otherwise.
+ *
+ * @details
+ * - Tries a non-blocking lock first, so the uncontended case costs a single `fcntl`.
+ * - Waits with `F_OFD_SETLKW` when there is no timeout, or polls with an exponential
+ *   backoff (1 ms up to 100 ms) until the timeout expires.
+ * - File systems without lock support fall back to unlocked operation.
+ * - Also works on descriptors received from the `--broker` daemon, which shares locks with
+ *   sessions locking the file by path.
+ */
+int lockDescriptor(const int fd, const bool exclusive, const double timeout, double *waited) {
+    *waited = 0;
+
+    struct flock lock = {
+        .l_type = exclusive ? F_WRLCK : F_RDLCK,
+        .l_whence = SEEK_SET,
+        .l_start = 0,
+        .l_len = 0, // Whole file
+        .l_pid = 0 // Required to be 0 for OFD locks
+    };
+
+    // Uncontended fast path
+    if (STATS_SYSCALL(fcntl(fd, F_OFD_SETLK, &lock)) == 0) {
+        return SUCCESS;
+    }
+    if (errno != EAGAIN && errno != EACCES) {
+        return SUCCESS; // Locking not supported here
+    }
+    if (timeout == 0) {
+        return ERROR_LOCK_TIMEOUT;
+    }
+
+    struct timespec start;
+    clock_gettime(CLOCK_MONOTONIC, &start);
+
+    if (timeout < 0) {
+        // Block until the other session releases the lock
+        while (STATS_SYSCALL(fcntl(fd, F_OFD_SETLKW, &lock)) == -1) {
+            if (errno != EINTR) {
+                return ERROR_PERMISSION_DENIED;
+            }
+        }
+    } else {
+        // Poll until the lock is free or the timeout expires
+        long delay_ns = 1000000;
+        while (STATS_SYSCALL(fcntl(fd, F_OFD_SETLK, &lock)) == -1) {
+            if (errno != EAGAIN && errno != EACCES) {
+                return ERROR_PERMISSION_DENIED;
+            }
+            const double remaining = timeout - secondsSince(&start);
+            if (remaining <= 0) {
+                *waited = secondsSince(&start);
+                return ERROR_LOCK_TIMEOUT;
+            }
+            const long sleep_ns = (double) delay_ns / 1e9 < remaining ? delay_ns : (long) (remaining * 1e9);
+            const struct timespec pause = {.tv_sec = sleep_ns / 1000000000, .tv_nsec = sleep_ns % 1000000000};
+            nanosleep(&pause, NULL);
+            if (delay_ns < 100000000) {
+                delay_ns *= 2;
+            }
+        }
+    }
+
+    *waited = secondsSince(&start);
+    return SUCCESS;
+}
+
+/**
+ * @brief Releases a lock taken with `acquireFileLock`.
+ *
+ * @param lock_fd The descriptor holding the lock. Ignored if -1.
+ */
+void releaseFileLock(const int lock_fd) {
+    if (lock_fd != -1) {
+        STATS_SYSCALL(close(lock_fd)); // Closing the last descriptor of the description drops the OFD lock
+    }
+}
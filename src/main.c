@@ -1,11 +1,23 @@
 #include <stdio.h>
+#include <stdlib.h>
 #include <stdbool.h>
+#include <unistd.h>
 #include <linux/limits.h>
 
+#include "../include/broker_handler.h"
 #include "../include/error_handler.h"
 #include "../include/flags_handler.h"
-#include "../include/paths_handler.h"
+#include "../include/args_handler.h"
+#include "../include/progress_handler.h"
 #include "../include/modes_handler.h"
+#include "../include/history_handler.h"
+#include "../include/redit.h"
+#include "../include/report_handler.h"
+#include "../include/file_utils.h"
+#include "../include/stats_handler.h"
+#include "../include/throttle_handler.h"
+#include "../include/trace_handler.h"
+#include "../include/tuning_handler.h"
 
 /**
  * @file main.c
@@ -38,6 +50,7 @@ int main(const int argc, char *argv[]) {
      * Parses command-line arguments to determine the operation mode (copy or overwrite),
      * optional settings (e.g., editor to use), and validates flag compatibility.
      */
+    statsStart(); // Everything from here on is accounted to a phase
     flag_state_t flags = {0}; // Struct to store the state of flags
     const int flags_result = handleFlags(argc, argv, &flags);
     if (flags_result == HELP_DISPLAYED) {
@@ -47,6 +60,132 @@ int main(const int argc, char *argv[]) {
         return flags_result; // Return the error code if flag handling fails
     }
 
+    // Record the spans of the run in a trace file owned by the original user
+    if (flags.trace_path != NULL) {
+        uid_t user_ef_id;
+        int trace_result = getEffectiveUserId(&user_ef_id);
+        if (trace_result == SUCCESS) {
+            trace_result = traceOpen(flags.trace_path, user_ef_id);
+        }
+        if (trace_result != SUCCESS) {
+            return printError(trace_result, "creating trace file");
+        }
+    }
+
+    // Report where the time went on every exit path, failures included
+    if (flags.stats_format != STATS_OFF) {
+        statsEnable(flags.stats_format);
+    }
+    if (flags.stats_format != STATS_OFF || flags.trace_path != NULL) {
+        atexit(printStatsReport);
+    }
+
+    // Stay out of the way of the services of the host, before any thread is created
+    const int priority_result = setIoPriority(&flags.io_priority);
+    if (priority_result != SUCCESS) {
+        return printError(priority_result, "setting I/O priority");
+    }
+    const int cpus_result = limitCpus(flags.cpus);
+    if (cpus_result != SUCCESS) {
+        return printError(cpus_result, "limiting CPUs");
+    }
+
+    // Show the progress of long copies on a terminal, or on SIGUSR1 when the output goes to a log
+    progressStart(isatty(STDERR_FILENO));
+
+    /**
+     * @section Standalone Commands
+     * Commands that do not operate on a copy/privileged file pair.
+     */
+    if (flags.recalibrate && !flags.copy_mode && !flags.overwrite_mode) {
+        const int clear_result = clearCalibrationCache();
+        if (clear_result != SUCCESS) {
+            return printError(clear_result, "clearing calibration cache");
+        }
+        printf("Calibration cache cleared.\n");
+        return SUCCESS;
+    }
+    if (flags.report && !flags.copy_mode && !flags.overwrite_mode) {
+        const int report_result = printHistoryReport();
+        if (report_result != SUCCESS) {
+            return printError(report_result, "reading run history");
+        }
+        return SUCCESS;
+    }
+    if (flags.sessions && !flags.copy_mode && !flags.overwrite_mode) {
+        return executeSessionsMode(flags.sessions_clean);
+    }
+    if (flags.broker && !flags.copy_mode && !flags.overwrite_mode) {
+        return printError(runBroker(BROKER_SOCKET_PATH, BROKER_POLICY_PATH), "starting broker"); // Runs until killed
+    }
+    if (flags.substitute_expression != NULL) {
+        if (flags.param_index >= argc) {
+            fprintf(stderr, "Error: Missing privileged file.\n%s\n", tryHelpMessage());
+            return ERROR_INVALID_ARGUMENT;
+        }
+        statsEnterPhase(STATS_PHASE_PATHS);
+        char privileged_file_path[PATH_MAX];
+        const int resolve_result = reditResolvePath(argv[flags.param_index], true, privileged_file_path);
+        if (resolve_result != SUCCESS) {
+            return printError(resolve_result, "resolving privileged file path");
+        }
+        const int substitute_result = executeSubstituteMode(&flags, privileged_file_path);
+        recordRun(false, privileged_file_path, substitute_result); // Accounted as an overwrite
+        return substitute_result;
+    }
+    if (flags.patch_path != NULL) {
+        if (flags.param_index >= argc) {
+            fprintf(stderr, "Error: Missing privileged file.\n%s\n", tryHelpMessage());
+            return ERROR_INVALID_ARGUMENT;
+        }
+        statsEnterPhase(STATS_PHASE_PATHS);
+        char patch_file_path[PATH_MAX];
+        int resolve_result = reditResolvePath(flags.patch_path, true, patch_file_path);
+        if (resolve_result != SUCCESS) {
+            return printError(resolve_result, "resolving patch file path");
+        }
+        char privileged_file_path[PATH_MAX];
+        resolve_result = reditResolvePath(argv[flags.param_index], true, privileged_file_path);
+        if (resolve_result != SUCCESS) {
+            return printError(resolve_result, "resolving privileged file path");
+        }
+        const int patch_result = executePatchMode(&flags, patch_file_path, privileged_file_path);
+        recordRun(false, privileged_file_path, patch_result); // Accounted as an overwrite
+        return patch_result;
+    }
+    if (flags.verify) {
+        // With -D, the first parameter is the directory of the copies, as with -O
+        const int first_file = flags.param_index + (flags.copied_dir_path ? 1 : 0);
+        if (first_file >= argc) {
+            fprintf(stderr, "Error: Missing privileged file.\n%s\n", tryHelpMessage());
+            return ERROR_INVALID_ARGUMENT;
+        }
+        statsEnterPhase(STATS_PHASE_PATHS);
+        char copy_dir_path[PATH_MAX];
+        const int dir_result = flags.copied_dir_path ? reditResolvePath(argv[flags.param_index], true, copy_dir_path)
+                                                     : getCurrentWorkingDirectory(copy_dir_path);
+        if (dir_result != SUCCESS) {
+            return printError(dir_result, "resolving copy directory path");
+        }
+        return executeVerifyMode(copy_dir_path, (const char **) &argv[first_file], (size_t) (argc - first_file));
+    }
+    if (flags.restore && !flags.copy_mode && !flags.overwrite_mode) {
+        // The file is either the --restore value (when given without '=') or the first parameter
+        const char *restore_file = flags.restore_path != NULL ? flags.restore_path
+                                   : flags.param_index < argc ? argv[flags.param_index] : NULL;
+        if (restore_file == NULL) {
+            fprintf(stderr, "Error: Missing privileged file.\n%s\n", tryHelpMessage());
+            return ERROR_INVALID_ARGUMENT;
+        }
+        statsEnterPhase(STATS_PHASE_PATHS);
+        char privileged_file_path[PATH_MAX];
+        const int resolve_result = reditResolvePath(restore_file, true, privileged_file_path);
+        if (resolve_result != SUCCESS) {
+            return printError(resolve_result, "resolving privileged file path");
+        }
+        return executeRestoreMode(&flags, privileged_file_path);
+    }
+
     /**
      * @section Path Resolution and Validation
      * Resolves absolute paths for the copy and privileged files, validates the paths,
@@ -54,6 +193,7 @@ int main(const int argc, char *argv[]) {
      */
     char copy_file_path[PATH_MAX]; // Path to the copy file
     char privileged_file_path[PATH_MAX]; // Path to the privileged file
+    statsEnterPhase(STATS_PHASE_PATHS);
     const int paths_handle_result = resolveAndValidatePaths(argc, argv, &flags, copy_file_path, privileged_file_path);
     if (paths_handle_result != SUCCESS) {
         return paths_handle_result; // Return the error code if path handling fails
@@ -64,15 +204,10 @@ int main(const int argc, char *argv[]) {
      * Executes the selected mode (copy or overwrite). Depending on the flags provided,
      * it handles file ownership, permissions, and optionally opens the file in an editor.
      */
-    const int mode_result = executeFileMode(
-        flags.copy_mode, // True if copy mode is selected
-        copy_file_path, // Path to the copy file
-        privileged_file_path, // Path to the privileged file
-        flags.keep_copy, // True if the copy should be preserved after overwriting
-        flags.editor, // User-specified editor (if any)
-        flags.use_editor, // True if an editor should be used
-        PROGRAM_DEFAULT_EDITOR // Default editor fallback
-    );
+    const int mode_result = executeFileMode(&flags, copy_file_path, privileged_file_path, PROGRAM_DEFAULT_EDITOR);
+
+    // Keep the run in the history behind `--report`; failing to do so is not fatal
+    recordRun(flags.copy_mode, privileged_file_path, mode_result);
     if (mode_result != SUCCESS) {
         return mode_result; // Return the error code if mode execution fails
     }
@@ -0,0 +1,541 @@
+#include <errno.h>
+#include <fcntl.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/stat.h>
+#include <sys/types.h>
+
+#include "../include/error_handler.h"
+#include "../include/merge_handler.h"
+
+/**
+ * @file merge_handler.c
+ * @brief Implements the three-way merge used by the overwrite mode.
+ *
+ * Each file is loaded into memory and split into lines. Every line gets a 64-bit
+ * hash computed a machine word at a time, so the diff compares integers and only
+ * falls back to `memcmp` on hash hits. The baseline is diffed against both the
+ * edited copy and the current privileged file with the linear-space variant of
+ * Myers' O(ND) algorithm, and the two match tables are walked together diff3-style.
+ */
+
+/**
+ * @brief A single line of a loaded file, including its trailing newline.
+ */
+typedef struct {
+    const char *data; ///< Start of the line inside the file buffer.
+    size_t length; ///< Length of the line in bytes, newline included.
+    uint64_t hash; ///< Hash of the line contents.
+} line_t;
+
+/**
+ * @brief A file loaded into memory and split into lines.
+ */
+typedef struct {
+    char *buffer; ///< File contents.
+    line_t *lines; ///< Line table pointing into `buffer`.
+    size_t count; ///< Number of lines.
+} line_file_t;
+
+/**
+ * @brief Growable output buffer for the merge result.
+ */
+typedef struct {
+    char *data; ///< Buffer contents.
+    size_t size; ///< Bytes used.
+    size_t capacity; ///< Bytes allocated.
+    bool failed; ///< Set if an allocation failed.
+} merge_output_t;
+
+/**
+ * @brief State shared by the recursive diff steps.
+ */
+typedef struct {
+    const line_t *a; ///< Lines of the old sequence.
+    const line_t *b; ///< Lines of the new sequence.
+    ssize_t *forward; ///< Furthest reaching x per diagonal for the forward search.
+    ssize_t *backward; ///< Furthest reaching y per diagonal for the backward search.
+    ssize_t offset; ///< Offset added to diagonal indexes to address the vectors.
+    ssize_t *matches; ///< For each line of `a`, the matching line of `b` or -1.
+} diff_context_t;
+
+/**
+ * @brief Hashes a line a machine word at a time.
+ *
+ * @param data Start of the line.
+ * @param length Length of the line in bytes.
+ * @return uint64_t The hash of the line.
+ */
+static uint64_t hashLine(const char *data, size_t length) {
+    uint64_t hash = 0x9E3779B97F4A7C15ULL ^ length;
+    // Fold 8 bytes per step instead of one
+    while (length >= sizeof(uint64_t)) {
+        uint64_t word;
+        memcpy(&word, data, sizeof(word));
+        hash = (hash ^ word) * 0xFF51AFD7ED558CCDULL;
+        hash ^= hash >> 32;
+        data += sizeof(word);
+        length -= sizeof(word);
+    }
+    // Fold the remaining tail bytes
+    uint64_t tail = 0;
+    memcpy(&tail, data, length);
+    hash = (hash ^ tail) * 0xC4CEB9FE1A85EC53ULL;
+    hash ^= hash >> 29;
+    return hash;
+}
+
+/**
+ * @brief Compares two lines, using the hash as a fast reject.
+ */
+static bool linesEqual(const line_t *x, const line_t *y) {
+    return x->hash == y->hash && x->length == y->length && memcmp(x->data, y->data, x->length) == 0;
+}
+
+/**
+ * @brief Frees the memory held by a loaded file.
+ */
+static void freeLineFile(line_file_t *file) {
+    free(file->buffer);
+    free(file->lines);
+    file->buffer = NULL;
+    file->lines = NULL;
+    file->count = 0;
+}
+
+/**
+ * @brief Loads a file into memory and builds its line table.
+ *
+ * @param path Path to the file to load.
+ * @param file Pointer to the structure receiving the contents and line table.
+ * @return `SUCCESS` if the file was loaded, or an error code otherwise.
+ */
+static int loadLineFile(const char *path, line_file_t *file) {
+    *file = (line_file_t){0};
+
+    const int fd = open(path, O_RDONLY);
+    if (fd == -1) {
+        return errno == EACCES ? ERROR_PERMISSION_DENIED : ERROR_FILE_NOT_FOUND;
+    }
+    struct stat file_stat;
+    if (fstat(fd, &file_stat) == -1) {
+        close(fd);
+        return ERROR_FILE_NOT_FOUND;
+    }
+
+    const size_t size = file_stat.st_size;
+    file->buffer = malloc(size + 1);
+    if (!file->buffer) {
+        close(fd);
+        return ERROR_MEMORY_ALLOCATION;
+    }
+
+    // Read the whole file
+    size_t n_total = 0;
+    while (n_total < size) {
+        const ssize_t n_read = read(fd, file->buffer + n_total, size - n_total);
+        if (n_read == -1) {
+            close(fd);
+            freeLineFile(file);
+            return ERROR_COPY_FAILED;
+        }
+        if (n_read == 0) {
+            break; // File shrank while reading
+        }
+        n_total += n_read;
+    }
+    close(fd);
+
+    // Count the lines first so the table is allocated once
+    size_t count = 0;
+    for (const char *p = file->buffer, *end = file->buffer + n_total; p < end; ++count) {
+        const char *newline = memchr(p, '\n', end - p);
+        p = newline ? newline + 1 : end;
+    }
+
+    file->lines = malloc((count > 0 ? count : 1) * sizeof(line_t));
+    if (!file->lines) {
+        freeLineFile(file);
+        return ERROR_MEMORY_ALLOCATION;
+    }
+
+    // Split and hash every line
+    const char *p = file->buffer;
+    const char *end = file->buffer + n_total;
+    for (size_t i = 0; i < count; ++i) {
+        const char *newline = memchr(p, '\n', end - p);
+        const char *next = newline ? newline + 1 : end;
+        file->lines[i] = (line_t){.data = p, .length = next - p, .hash = hashLine(p, next - p)};
+        p = next;
+    }
+    file->count = count;
+    return SUCCESS;
+}
+
+/**
+ * @brief Finds the middle snake of the shortest edit script within a box.
+ *
+ * @param ctx The diff context.
+ * @param left First line of `a` in the box.
+ * @param top First line of `b` in the box.
+ * @param right One past the last line of `a` in the box.
+ * @param bottom One past the last line of `b` in the box.
+ * @param snake Receives the start and end points of the middle snake as {x0, y0, x1, y1}.
+ * @return `true` if the snake was found with the forward search, `false` if with the backward one.
+ *
+ * @details
+ * - A forward snake is one edit followed by diagonal moves.
+ * - A backward snake is diagonal moves followed by one edit.
+ */
+static bool findMiddleSnake(const diff_context_t *ctx, const ssize_t left, const ssize_t top, const ssize_t right,
+                            const ssize_t bottom, ssize_t snake[4]) {
+    const ssize_t delta = (right - left) - (bottom - top);
+    const ssize_t max = ((right - left) + (bottom - top) + 1) / 2;
+    ssize_t *vf = ctx->forward + ctx->offset;
+    ssize_t *vb = ctx->backward + ctx->offset;
+    vf[1] = left;
+    vb[1] = bottom;
+
+    for (ssize_t d = 0; d <= max; ++d) {
+        // Forward search from the top-left corner
+        for (ssize_t k = d; k >= -d; k -= 2) {
+            const ssize_t c = k - delta;
+            ssize_t px, x;
+            if (k == -d || (k != d && vf[k - 1] < vf[k + 1])) {
+                px = x = vf[k + 1];
+            } else {
+                px = vf[k - 1];
+                x = px + 1;
+            }
+            ssize_t y = top + (x - left) - k;
+            const ssize_t py = (d == 0 || x != px) ? y : y - 1;
+            while (x < right && y < bottom && linesEqual(&ctx->a[x], &ctx->b[y])) {
+                x++;
+                y++;
+            }
+            vf[k] = x;
+            if ((delta & 1) && c >= -(d - 1) && c <= d - 1 && y >= vb[c]) {
+                snake[0] = px;
+                snake[1] = py;
+                snake[2] = x;
+                snake[3] = y;
+                return true;
+            }
+        }
+
+        // Backward search from the bottom-right corner
+        for (ssize_t c = d; c >= -d; c -= 2) {
+            const ssize_t k = c + delta;
+            ssize_t py, y;
+            if (c == -d || (c != d && vb[c - 1] > vb[c + 1])) {
+                py = y = vb[c + 1];
+            } else {
+                py = vb[c - 1];
+                y = py - 1;
+            }
+            ssize_t x = left + (y - top) + k;
+            const ssize_t px = (d == 0 || y != py) ? x : x + 1;
+            while (x > left && y > top && linesEqual(&ctx->a[x - 1], &ctx->b[y - 1])) {
+                x--;
+                y--;
+            }
+            vb[c] = y;
+            if (!(delta & 1) && k >= -d && k <= d && x <= vf[k]) {
+                snake[0] = x;
+                snake[1] = y;
+                snake[2] = px;
+                snake[3] = py;
+                return false;
+            }
+        }
+    }
+
+    // Unreachable for a non-empty box: the searches always meet by d == max
+    snake[0] = snake[2] = right;
+    snake[1] = snake[3] = bottom;
+    return true;
+}
+
+/**
+ * @brief Recursively records the matching lines of `a` and `b` within a box.
+ */
+static void diffBox(const diff_context_t *ctx, ssize_t left, ssize_t top, ssize_t right, ssize_t bottom) {
+    // Strip the common prefix and suffix, which is where most lines of an edited file are
+    while (left < right && top < bottom && linesEqual(&ctx->a[left], &ctx->b[top])) {
+        ctx->matches[left++] = top++;
+    }
+    while (left < right && top < bottom && linesEqual(&ctx->a[right - 1], &ctx->b[bottom - 1])) {
+        ctx->matches[--right] = --bottom;
+    }
+    if (left == right || top == bottom) {
+        return; // Only insertions or deletions remain
+    }
+
+    ssize_t snake[4];
+    const bool is_forward = findMiddleSnake(ctx, left, top, right, bottom, snake);
+
+    // The diagonal part of the snake is a run of matching lines
+    const ssize_t dx = snake[2] - snake[0];
+    const ssize_t dy = snake[3] - snake[1];
+    const ssize_t diagonal = dx < dy ? dx : dy;
+    const ssize_t first_x = is_forward ? snake[2] - diagonal : snake[0];
+    const ssize_t first_y = is_forward ? snake[3] - diagonal : snake[1];
+    for (ssize_t i = 0; i < diagonal; ++i) {
+        ctx->matches[first_x + i] = first_y + i;
+    }
+
+    diffBox(ctx, left, top, snake[0], snake[1]);
+    diffBox(ctx, snake[2], snake[3], right, bottom);
+}
+
+/**
+ * @brief Computes which lines of `a` are kept in `b`.
+ *
+ * @param a The old file.
+ * @param b The new file.
+ * @param matches Array of `a->count` entries receiving the matching line of `b`, or -1 if deleted.
+ * @return `SUCCESS` on success, or an error code otherwise.
+ */
+static int diffLines(const line_file_t *a, const line_file_t *b, ssize_t *matches) {
+    for (size_t i = 0; i < a->count; ++i) {
+        matches[i] = -1;
+    }
+
+    const ssize_t max = (a->count + b->count + 1) / 2 + 1;
+    diff_context_t ctx = {
+        .a = a->lines,
+        .b = b->lines,
+        .forward = malloc((2 * max + 1) * sizeof(ssize_t)),
+        .backward = malloc((2 * max + 1) * sizeof(ssize_t)),
+        .offset = max,
+        .matches = matches
+    };
+    if (!ctx.forward || !ctx.backward) {
+        free(ctx.forward);
+        free(ctx.backward);
+        return ERROR_MEMORY_ALLOCATION;
+    }
+
+    diffBox(&ctx, 0, 0, a->count, b->count);
+
+    free(ctx.forward);
+    free(ctx.backward);
+    return SUCCESS;
+}
+
+/**
+ * @brief Appends raw bytes to the merge output.
+ */
+static void appendOutput(merge_output_t *out, const char *data, const size_t length) {
+    if (out->failed) {
+        return;
+    }
+    if (out->size + length > out->capacity) {
+        size_t new_capacity = out->capacity > 0 ? out->capacity * 2 : 4096;
+        while (new_capacity < out->size + length) {
+            new_capacity *= 2;
+        }
+        char *new_data = realloc(out->data, new_capacity);
+        if (!new_data) {
+            out->failed = true;
+            return;
+        }
+        out->data = new_data;
+        out->capacity = new_capacity;
+    }
+    memcpy(out->data + out->size, data, length);
+    out->size += length;
+}
+
+/**
+ * @brief Appends a range of lines to the merge output.
+ */
+static void appendLines(merge_output_t *out, const line_file_t *file, const size_t from, const size_t to) {
+    if (from < to) {
+        // Lines of a range are contiguous in the file buffer
+        const char *start = file->lines[from].data;
+        const char *end = file->lines[to - 1].data + file->lines[to - 1].length;
+        appendOutput(out, start, end - start);
+    }
+}
+
+/**
+ * @brief Appends a conflict marker line, terminating the previous line first if needed.
+ */
+static void appendMarker(merge_output_t *out, const char *marker, const char *label) {
+    if (out->size > 0 && out->data[out->size - 1] != '\n') {
+        appendOutput(out, "\n", 1);
+    }
+    appendOutput(out, marker, strlen(marker));
+    if (label) {
+        appendOutput(out, " ", 1);
+        appendOutput(out, label, strlen(label));
+    }
+    appendOutput(out, "\n", 1);
+}
+
+/**
+ * @brief Checks whether two line ranges hold the same lines.
+ */
+static bool rangesEqual(const line_file_t *x, const size_t x_from, const size_t x_to,
+                        const line_file_t *y, const size_t y_from, const size_t y_to) {
+    if (x_to - x_from != y_to - y_from) {
+        return false;
+    }
+    for (size_t i = 0; i < x_to - x_from; ++i) {
+        if (!linesEqual(&x->lines[x_from + i], &y->lines[y_from + i])) {
+            return false;
+        }
+    }
+    return true;
+}
+
+/**
+ * @brief Writes the whole merge output to a file, truncating it.
+ */
+static int writeOutput(const char *output_path, const merge_output_t *out) {
+    const int fd = open(output_path, O_WRONLY | O_CREAT | O_TRUNC, S_IRUSR | S_IWUSR | S_IRGRP | S_IROTH);
+    if (fd == -1) {
+        return errno == EACCES ? ERROR_PERMISSION_DENIED : ERROR_COPY_FAILED;
+    }
+    size_t n_written = 0;
+    while (n_written < out->size) {
+        const ssize_t result = write(fd, out->data + n_written, out->size - n_written);
+        if (result == -1) {
+            close(fd);
+            return ERROR_COPY_FAILED;
+        }
+        n_written += result;
+    }
+    if (close(fd) == -1) {
+        return ERROR_COPY_FAILED;
+    }
+    return SUCCESS;
+}
+
+/**
+ * @brief Performs a three-way merge of a baseline, an edited copy and the current file.
+ *
+ * @param base_path Path to the common ancestor (baseline snapshot).
+ * @param copy_path Path to the edited copy file.
+ * @param current_path Path to the current privileged file.
+ * @param output_path Path where the merged result is written. May be `copy_path`.
+ * @param conflicts Pointer to a variable where the number of conflicting hunks will be stored.
+ * @return `SUCCESS` if the merge result was written, or an error code otherwise.
+ *
+ * @details
+ * - All three files are fully read before the output is written, so the output may replace an input.
+ * - Stable regions (unchanged on both sides) are copied as-is.
+ * - An unstable region changed on one side only takes that side; identical changes on both sides are taken once.
+ * - Otherwise the region is written between `<<<<<<<`, `|||||||`, `=======` and `>>>>>>>` markers.
+ */
+int mergeFiles(const char *base_path, const char *copy_path, const char *current_path, const char *output_path,
+               size_t *conflicts) {
+    *conflicts = 0;
+
+    line_file_t base, copy, current;
+    int result = loadLineFile(base_path, &base);
+    if (result != SUCCESS) {
+        return result;
+    }
+    result = loadLineFile(copy_path, &copy);
+    if (result != SUCCESS) {
+        freeLineFile(&base);
+        return result;
+    }
+    result = loadLineFile(current_path, &current);
+    if (result != SUCCESS) {
+        freeLineFile(&base);
+        freeLineFile(&copy);
+        return result;
+    }
+
+    // Match the baseline lines against both descendants
+    const size_t table_size = (base.count > 0 ? base.count : 1) * sizeof(ssize_t);
+    ssize_t *copy_matches = malloc(table_size);
+    ssize_t *current_matches = malloc(table_size);
+    merge_output_t out = {0};
+    if (!copy_matches || !current_matches) {
+        result = ERROR_MEMORY_ALLOCATION;
+        goto cleanup;
+    }
+    result = diffLines(&base, &copy, copy_matches);
+    if (result != SUCCESS) {
+        goto cleanup;
+    }
+    result = diffLines(&base, &current, current_matches);
+    if (result != SUCCESS) {
+        goto cleanup;
+    }
+
+    /**
+     * @section Walk the three files in lockstep.
+     *
+     * `o`, `c` and `p` index the baseline, copy and current (privileged) files.
+     */
+    size_t o = 0, c = 0, p = 0;
+    while (true) {
+        // Stable run: the baseline line is kept, at the expected position, on both sides
+        size_t stable = 0;
+        while (o + stable < base.count &&
+               copy_matches[o + stable] == (ssize_t) (c + stable) &&
+               current_matches[o + stable] == (ssize_t) (p + stable)) {
+            stable++;
+        }
+        if (stable > 0) {
+            appendLines(&out, &base, o, o + stable);
+            o += stable;
+            c += stable;
+            p += stable;
+            continue;
+        }
+
+        // Unstable run: extends up to the next baseline line kept on both sides
+        size_t next_o = o;
+        while (next_o < base.count && (copy_matches[next_o] < 0 || current_matches[next_o] < 0)) {
+            next_o++;
+        }
+        const size_t next_c = next_o < base.count ? (size_t) copy_matches[next_o] : copy.count;
+        const size_t next_p = next_o < base.count ? (size_t) current_matches[next_o] : current.count;
+        if (next_o == o && next_c == c && next_p == p) {
+            break; // All three files are consumed
+        }
+
+        if (rangesEqual(&base, o, next_o, &current, p, next_p)) {
+            appendLines(&out, &copy, c, next_c); // Only the copy changed
+        } else if (rangesEqual(&base, o, next_o, &copy, c, next_c) ||
+                   rangesEqual(&copy, c, next_c, &current, p, next_p)) {
+            appendLines(&out, &current, p, next_p); // Only the privileged file changed, or both identically
+        } else {
+            appendMarker(&out, "<<<<<<<", copy_path);
+            appendLines(&out, &copy, c, next_c);
+            appendMarker(&out, "|||||||", "baseline");
+            appendLines(&out, &base, o, next_o);
+            appendMarker(&out, "=======", NULL);
+            appendLines(&out, &current, p, next_p);
+            appendMarker(&out, ">>>>>>>", current_path);
+            (*conflicts)++;
+        }
+        o = next_o;
+        c = next_c;
+        p = next_p;
+    }
+
+    if (out.failed) {
+        result = ERROR_MEMORY_ALLOCATION;
+        goto cleanup;
+    }
+    result = writeOutput(output_path, &out);
+
+cleanup:
+    free(out.data);
+    free(copy_matches);
+    free(current_matches);
+    freeLineFile(&base);
+    freeLineFile(&copy);
+    freeLineFile(&current);
+    return result;
+}
@@ -1,175 +1,519 @@
-#include <fcntl.h>
+#include <grp.h>
+#include <libgen.h>
+#include <pwd.h>
 #include <stdio.h>
 #include <stdbool.h>
+#include <stdlib.h>
+#include <time.h>
+#include <unistd.h>
+#include "../include/baseline_handler.h"
+#include "../include/broker_handler.h"
 #include "../include/file_operations.h"
 #include "../include/file_utils.h"
 #include "../include/error_handler.h"
+#include "../include/modes_handler.h"
+#include "../include/paths_handler.h"
+#include "../include/redit.h"
+#include "../include/session_handler.h"
+#include "../include/stats_handler.h"
 
 /**
  * @file modes_handler.c
  * @brief Handles the execution of copy and overwrite modes for the `redit` program.
  *
- * This file implements the logic for managing two primary modes: copying files
- * (`copyMode`) and overwriting files (`overwriteMode`). It ensures proper file
- * handling, user ownership, and permission management. Additionally, it allows
- * for editing files with a specified or default editor.
+ * This file runs the copy and overwrite operations of the `redit` library with the
+ * options given on the command line, and tells the user about their outcome. After
+ * a copy, it allows for editing the file with a specified or default editor. It also
+ * rewrites privileged files through substitutions, lists and restores the backups taken
+ * before each overwrite, and lists and cleans up the copies the user took.
  */
 
 // Function prototypes
-static int copyMode(const char *copy_file_path, const char *privileged_file_path, const char *editor,
-                    bool use_editor,
-                    const char *program_default_editor);
+static redit_options_t buildOptions(const flag_state_t *flags);
 
-static int overwriteMode(const char *copy_file_path, const char *privileged_file_path, bool keep_copy);
+static void reportOperation(const flag_state_t *flags, const char *copy_file_path, const char *privileged_file_path,
+                            const redit_result_t *result, int mode_result);
+
+static int runEditor(const flag_state_t *flags, const char *copy_file_path, const char *program_default_editor);
+
+static int listBackupVersions(const char *privileged_file_path);
 
 /**
  * @brief Executes the appropriate mode based on the specified parameters.
  *
- * @param is_copy Indicates if the operation is in copy mode (`true`) or overwrite mode (`false`).
+ * @param flags Pointer to the parsed flag states. `copy_mode` selects copy (`true`) or overwrite (`false`).
  * @param copy_file_path Path to the copy file used in the operation.
  * @param privileged_file_path Path to the privileged file involved in the operation.
- * @param keep_copy Indicates if the copy file should be kept after overwriting.
- * @param editor Editor to use if editor value is especified.
- * @param use_editor Indicates if an editor should be launched.
  * @param program_default_editor Default editor to use if no editor is specified.
  * @return `SUCCESS` if the operation completes successfully, or an error code otherwise.
  */
-int executeFileMode(const bool is_copy, const char *copy_file_path, const char *privileged_file_path,
-                    const bool keep_copy,
-                    const char *editor,
-                    const bool use_editor, const char *program_default_editor) {
-    if (is_copy) {
-        return copyMode(copy_file_path, privileged_file_path, editor, use_editor, program_default_editor);
-    }
-    return overwriteMode(copy_file_path, privileged_file_path, keep_copy);
+int executeFileMode(const flag_state_t *flags, const char *copy_file_path, const char *privileged_file_path,
+                    const char *program_default_editor) {
+    redit_options_t options = buildOptions(flags);
+    options.keep_copy = flags->keep_copy;
+    options.first_line = flags->first_line;
+    options.last_line = flags->last_line;
+    options.decompress = !flags->raw;
+
+    // Without sudo, go through the broker for privileged files the user cannot access
+    const int needed_access = flags->copy_mode ? R_OK : W_OK;
+    options.use_broker = geteuid() != 0 && access(privileged_file_path, needed_access) == -1 &&
+                         access(BROKER_SOCKET_PATH, F_OK) == 0;
+
+    redit_result_t result;
+    const int mode_result = flags->copy_mode
+                                ? reditCopy(privileged_file_path, copy_file_path, &options, &result)
+                                : reditOverwrite(copy_file_path, privileged_file_path, &options, &result);
+    reportOperation(flags, copy_file_path, privileged_file_path, &result, mode_result);
+    if (mode_result != SUCCESS) {
+        return printError(mode_result, result.failed_step);
+    }
+
+    // Remember which privileged file the copy belongs to, so `-O <copy>` finds it; failing to do so is not fatal
+    if (flags->copy_mode || flags->keep_copy) {
+        recordSession(copy_file_path, privileged_file_path);
+    } else {
+        removeSession(copy_file_path);
+    }
+
+    if (flags->copy_mode) {
+        return runEditor(flags, copy_file_path, program_default_editor);
+    }
+    return SUCCESS;
+}
+
+/**
+ * @brief Builds the library options shared by the modes that write privileged files.
+ *
+ * @param flags Pointer to the parsed flag states.
+ * @return The default options, with the sync mode, I/O, verification, throttling, calibration and
+ *         lock timeout flags applied.
+ */
+static redit_options_t buildOptions(const flag_state_t *flags) {
+    redit_options_t options = reditDefaultOptions();
+    options.sync_mode = flags->sync_mode;
+    options.direct_io = flags->direct_io;
+    options.verify_write = flags->verify_write;
+    options.bandwidth_limit = flags->bandwidth_limit * 1024 * 1024;
+    options.max_threads = flags->cpus;
+    options.recalibrate = flags->recalibrate;
+    options.lock_timeout = flags->lock_timeout;
+    return options;
 }
 
 /**
- * @brief Handles the file copying operation.
+ * @brief Tells the user what happened during an operation, besides its error.
+ *
+ * @param flags Pointer to the parsed flag states.
+ * @param copy_file_path Path to the copy file.
+ * @param privileged_file_path Path to the privileged file.
+ * @param result Outcome of the operation.
+ * @param mode_result Error code of the operation.
  *
- * @param copy_file_path Path to the destination copy file.
- * @param privileged_file_path Path to the source privileged file.
- * @param editor Editor to use if editor value is especified.
- * @param use_editor Indicates if an editor should be launched.
+ * @details
+ * - A calibration made for this copy, and its chosen parameters.
+ * - How long the file lock was held up by another session.
+ * - How much of an interrupted copy was kept.
+ * - Merge conflicts written to the copy, or a copy file that could not be removed.
+ * - The byte range of a window of lines, when one was copied or spliced back.
+ * - The codec of a compressed privileged file, decompressed into the copy or compressed back.
+ * - An overwrite that did not read back and was rolled back to its backup (--verify-write).
+ * - An overwrite whose previous content could not be backed up (windows are never backed up).
+ */
+static void reportOperation(const flag_state_t *flags, const char *copy_file_path, const char *privileged_file_path,
+                            const redit_result_t *result, const int mode_result) {
+    if (result->calibrated_throughput > 0) {
+        fprintf(stderr, "Calibrated copies between these file systems: %s, %zu KB buffer, %zu thread/s (%.1f MB/s).\n",
+                result->engine, result->buffer_size / 1024, result->threads, result->calibrated_throughput);
+    }
+    if (result->lock_waited > 0) {
+        fprintf(stderr, "Waited %.3f s for another session to release '%s'.\n", result->lock_waited,
+                privileged_file_path);
+    }
+    if (result->resumed_bytes > 0) {
+        fprintf(stderr, "Resumed an interrupted copy of '%s' after %.1f MB already copied.\n", privileged_file_path,
+                (double) result->resumed_bytes / (1024.0 * 1024.0));
+    }
+    if (result->rolled_back) {
+        fprintf(stderr, "'%s' did not read back as written; its previous content was restored.\n",
+                privileged_file_path);
+    }
+    if (mode_result == ERROR_MERGE_CONFLICT) {
+        fprintf(stderr, "The privileged file changed since it was copied. %zu conflict/s written to '%s'.\n"
+                "Resolve them and overwrite again.\n", result->conflicts, copy_file_path);
+    }
+    if (mode_result == SUCCESS && result->windowed) {
+        fprintf(stderr, "%s bytes %lld-%lld of '%s'.\n", flags->copy_mode ? "Copied" : "Spliced back",
+                (long long) result->window_offset, (long long) (result->window_offset + result->window_length),
+                privileged_file_path);
+    }
+    if (mode_result == SUCCESS && result->compression != NULL) {
+        fprintf(stderr, flags->copy_mode ? "Decompressed '%s' (%s) into the copy; overwriting compresses it back.\n"
+                                         : "Compressed the copy back into '%s' (%s).\n",
+                privileged_file_path, result->compression);
+    }
+    if (mode_result == SUCCESS && result->baseline_skipped) {
+        fprintf(stderr, "Warning: '%s' is over %d MB, so no merge baseline was kept: changes made to '%s' meanwhile "
+                "will be overwritten, not merged.\n", copy_file_path, BASELINE_MAX_SIZE / (1024 * 1024),
+                privileged_file_path);
+    }
+    if (mode_result == SUCCESS && !flags->copy_mode && !result->backed_up && !result->windowed && geteuid() == 0) {
+        fprintf(stderr, "Warning: The previous content of '%s' could not be backed up.\n", privileged_file_path);
+    }
+    if (mode_result == SUCCESS && !flags->copy_mode && !flags->keep_copy && !result->copy_removed) {
+        fprintf(stderr, "Error: Failed to remove the copy file.\n");
+    }
+}
+
+/**
+ * @brief Opens the copy file in the editor, or outputs its path.
+ *
+ * @param flags Pointer to the parsed flag states (editor).
+ * @param copy_file_path Path to the copy file.
  * @param program_default_editor Default editor to use if no editor is specified.
- * @return `SUCCESS` if the operation completes successfully, or an error code otherwise.
+ * @return `SUCCESS`, or an error code if the editor could not be run as the user.
  *
  * @details
- * - Copies the privileged file to the destination path.
- * - Changes the ownership of the copied file to the effective user.
- * - Updates the permissions of the copied file to allow editing.
- * - Optionally launches an editor to modify the copied file.
+ * - If the editor cannot be run, the copy file path is output instead.
  */
-static int copyMode(const char *copy_file_path, const char *privileged_file_path, const char *editor,
-                    const bool use_editor,
-                    const char *program_default_editor) {
-    // Retrieve the effective user ID
-    uid_t user_ef_id;
-    const int uid_result = getEffectiveUserId(&user_ef_id);
-    if (uid_result != SUCCESS) {
-        return printError(uid_result, "getting effective user id");
-    }
-
-    // Copy the privileged file to the destination path
-    const int copy_result = copyFile(privileged_file_path, copy_file_path);
-    if (copy_result != SUCCESS) {
-        return printError(copy_result, "copying file");
-    }
-
-    // Change the ownership of the copied file to the effective user
-    const int chown_result = changeFileOwner(copy_file_path, user_ef_id);
-    if (chown_result != SUCCESS) {
-        return printError(chown_result, "changing file owner");
-    }
-
-    // Add write permissions for the user to the copied file
-    const mode_t new_perms = S_IRUSR | S_IWUSR;
-    const int add_perms_result = addFilePermissions(copy_file_path, new_perms);
-    if (add_perms_result != SUCCESS) {
-        return printError(add_perms_result, "adding file permissions");
-    }
-
-    // Launch the editor if requested
-    if (use_editor) {
-        const int editor_result = executeEditorCommand(editor, copy_file_path, program_default_editor);
-        switch (editor_result) {
-            // Handle editor execution errors
-            case ERROR_USER_NOT_FOUND:
-                return printError(editor_result, "getting user id for the editor command");
-            case ERROR_MEMORY_ALLOCATION:
-                fprintf(stderr, "Error allocating memory for editor command.\nProceeding without the editor.\n");
-                printf("\n%s\n", copy_file_path);
-                break;
-            case ERROR_COMMAND_NOT_FOUND:
-                fprintf(stderr, "Proceeding without the editor.\n");
-                printf("\n%s\n", copy_file_path);
-                break;
-            case -1:
-                fprintf(stderr, "Proceeding without the editor.\n");
-                printf("\n%s\n", copy_file_path);
-                break;
-        }
-    } else {
+static int runEditor(const flag_state_t *flags, const char *copy_file_path, const char *program_default_editor) {
+    if (!flags->use_editor) {
         // Output the copy file path for the user
         printf("%s\n", copy_file_path);
+        return SUCCESS;
     }
 
+    statsEnterPhase(STATS_PHASE_EDITOR);
+    const int editor_result = executeEditorCommand(flags->editor, copy_file_path, program_default_editor);
+    switch (editor_result) {
+        // Handle editor execution errors
+        case ERROR_USER_NOT_FOUND:
+            return printError(editor_result, "getting user id for the editor command");
+        case ERROR_MEMORY_ALLOCATION:
+            fprintf(stderr, "Error allocating memory for editor command.\nProceeding without the editor.\n");
+            printf("\n%s\n", copy_file_path);
+            break;
+        case ERROR_COMMAND_NOT_FOUND:
+            fprintf(stderr, "Proceeding without the editor.\n");
+            printf("\n%s\n", copy_file_path);
+            break;
+        case -1:
+            fprintf(stderr, "Proceeding without the editor.\n");
+            printf("\n%s\n", copy_file_path);
+            break;
+    }
     return SUCCESS;
 }
 
 /**
- * @brief Handles the file overwriting operation.
+ * @brief Rewrites a privileged file through a sed-style substitution.
  *
- * @param copy_file_path Path to the source copy file.
- * @param privileged_file_path Path to the destination privileged file.
- * @param keep_copy Indicates if the copy file should be kept after overwriting.
- * @return `SUCCESS` if the operation completes successfully, or an error code otherwise.
+ * @param flags Pointer to the parsed flag states (substitution, sync mode, direct I/O, lock timeout).
+ * @param privileged_file_path Path to the privileged file.
+ * @return `SUCCESS` if the file was rewritten or nothing matched, or an error code otherwise.
+ */
+int executeSubstituteMode(const flag_state_t *flags, const char *privileged_file_path) {
+    redit_options_t options = buildOptions(flags);
+
+    redit_result_t result;
+    const int substitute_result = reditSubstitute(privileged_file_path, flags->substitute_expression, &options,
+                                                  &result);
+    if (result.lock_waited > 0) {
+        fprintf(stderr, "Waited %.3f s for another session to release '%s'.\n", result.lock_waited,
+                privileged_file_path);
+    }
+    if (substitute_result == ERROR_INVALID_ARGUMENT) {
+        fprintf(stderr, "Error: Invalid substitution '%s'. Use s/regex/replacement/flags.\n%s\n",
+                flags->substitute_expression, tryHelpMessage());
+        return substitute_result;
+    }
+    if (result.rolled_back) {
+        fprintf(stderr, "'%s' did not read back as written; its previous content was restored.\n",
+                privileged_file_path);
+    }
+    if (substitute_result != SUCCESS) {
+        return printError(substitute_result, result.failed_step);
+    }
+    if (result.substitutions == 0) {
+        printf("No match in '%s'; it was left unchanged.\n", privileged_file_path);
+        return SUCCESS;
+    }
+    if (!result.backed_up && geteuid() == 0) {
+        fprintf(stderr, "Warning: The previous content of '%s' could not be backed up.\n", privileged_file_path);
+    }
+    printf("Replaced %zu match/es in '%s'.\n", result.substitutions, privileged_file_path);
+    return SUCCESS;
+}
+
+/**
+ * @brief Applies a unified diff to a privileged file.
+ *
+ * @param flags Pointer to the parsed flag states (sync mode, direct I/O, lock timeout).
+ * @param patch_file_path Path to the patch file.
+ * @param privileged_file_path Path to the privileged file.
+ * @return `SUCCESS` if every hunk was applied, or an error code otherwise.
+ */
+int executePatchMode(const flag_state_t *flags, const char *patch_file_path, const char *privileged_file_path) {
+    redit_options_t options = buildOptions(flags);
+
+    redit_result_t result;
+    const int patch_result = reditPatch(privileged_file_path, patch_file_path, &options, &result);
+    if (result.lock_waited > 0) {
+        fprintf(stderr, "Waited %.3f s for another session to release '%s'.\n", result.lock_waited,
+                privileged_file_path);
+    }
+    if (patch_result == ERROR_INVALID_ARGUMENT) {
+        fprintf(stderr, "Error: '%s' is not a unified diff of one file.\n%s\n", patch_file_path, tryHelpMessage());
+        return patch_result;
+    }
+    if (patch_result == ERROR_PATCH_REJECTED) {
+        const size_t hunks = result.hunks_applied + result.hunks_rejected;
+        fprintf(stderr, "Error: Hunk #%zu does not apply; '%s' was left unchanged (%zu of %zu hunk/s rejected).\n",
+                result.first_rejected_hunk, privileged_file_path, result.hunks_rejected, hunks);
+        return patch_result;
+    }
+    if (result.rolled_back) {
+        fprintf(stderr, "'%s' did not read back as written; its previous content was restored.\n",
+                privileged_file_path);
+    }
+    if (patch_result != SUCCESS) {
+        return printError(patch_result, result.failed_step);
+    }
+    if (!result.backed_up && geteuid() == 0) {
+        fprintf(stderr, "Warning: The previous content of '%s' could not be backed up.\n", privileged_file_path);
+    }
+    printf("Applied %zu hunk/s to '%s'", result.hunks_applied, privileged_file_path);
+    if (result.hunks_moved > 0 || result.hunks_fuzzed > 0) {
+        printf(" (%zu at an offset, %zu with fuzz)", result.hunks_moved, result.hunks_fuzzed);
+    }
+    printf(".\n");
+    return SUCCESS;
+}
+
+/**
+ * @brief Prints the privileged files whose copies differ from them.
+ *
+ * @param copy_dir_path Directory holding the copies, named after their privileged files.
+ * @param privileged_files Privileged files, as given on the command line.
+ * @param count Number of `privileged_files`.
+ * @return `SUCCESS` if every copy was checked, or the error of the first that could not be.
  *
  * @details
- * - Retrieves the owner and permissions of the privileged file.
- * - Overwrites the privileged file with the content of the copy file.
- * - Restores the original owner and permissions of the privileged file.
- * - Optionally removes the copy file after overwriting.
+ * - The changed files are printed on stdout, one per line, to be fed to `redit -O`; problems
+ *   and the summary go to stderr.
  */
-static int overwriteMode(const char *copy_file_path, const char *privileged_file_path, const bool keep_copy) {
-    // Retrieve the owner of the privileged file
-    uid_t prv_file_owner;
-    const int own_result = getFileOwner(privileged_file_path, &prv_file_owner);
-    if (own_result != SUCCESS) {
-        return printError(own_result, "getting file owner");
+int executeVerifyMode(const char *copy_dir_path, const char **privileged_files, const size_t count) {
+    redit_verify_t *pairs = calloc(count, sizeof(redit_verify_t));
+    char (*paths)[2][PATH_MAX] = malloc(count * sizeof(*paths));
+    if (pairs == NULL || paths == NULL) {
+        free(pairs);
+        free(paths);
+        return printError(ERROR_MEMORY_ALLOCATION, "allocating verification pairs");
     }
 
-    // Retrieve the permissions of the privileged file
-    mode_t prv_file_perms;
-    const int perm_result = getFilePermissions(privileged_file_path, &prv_file_perms);
-    if (perm_result != SUCCESS) {
-        return printError(perm_result, "getting file permissions");
+    // Each copy is named after its privileged file, as the overwrite mode expects it
+    size_t n_pairs = 0;
+    int first_error = SUCCESS;
+    for (size_t i = 0; i < count; ++i) {
+        int resolve_result = reditResolvePath(privileged_files[i], true, paths[n_pairs][0]);
+        if (resolve_result == SUCCESS) {
+            snprintf(paths[n_pairs][1], PATH_MAX, "%s", copy_dir_path);
+            resolve_result = getAbsFilePathFromDir(paths[n_pairs][1], basename(paths[n_pairs][0]));
+        }
+        if (resolve_result != SUCCESS) {
+            fprintf(stderr, "Warning: Could not check '%s': %s\n", privileged_files[i],
+                    getErrorMessage(resolve_result));
+            first_error = first_error == SUCCESS ? resolve_result : first_error;
+            continue;
+        }
+        pairs[n_pairs] = (redit_verify_t){.privileged_file_path = paths[n_pairs][0],
+                                          .copy_file_path = paths[n_pairs][1]};
+        n_pairs++;
     }
 
-    // Overwrite the privileged file with the copy file
-    const int copy_result = copyFile(copy_file_path, privileged_file_path);
-    if (copy_result != SUCCESS) {
-        return printError(copy_result, "copying file");
+    const int verify_result = reditVerify(pairs, n_pairs);
+    if (verify_result != SUCCESS) {
+        free(pairs);
+        free(paths);
+        return printError(verify_result, "verifying copies");
+    }
+    size_t changed = 0, compared = 0;
+    for (size_t i = 0; i < n_pairs; ++i) {
+        if (pairs[i].error != SUCCESS) {
+            fprintf(stderr, "Warning: Could not check '%s' against '%s': %s\n", pairs[i].copy_file_path,
+                    pairs[i].privileged_file_path, getErrorMessage(pairs[i].error));
+            first_error = first_error == SUCCESS ? pairs[i].error : first_error;
+            continue;
+        }
+        compared += pairs[i].compared;
+        if (pairs[i].changed) {
+            printf("%s\n", pairs[i].privileged_file_path);
+            changed++;
+        }
+    }
+    fprintf(stderr, "%zu of %zu copy/ies differ from their privileged files (%zu compared by content).\n", changed,
+            count, compared);
+    free(pairs);
+    free(paths);
+    return first_error;
+}
+
+/**
+ * @brief Lists the backups of a privileged file, or restores one of them.
+ *
+ * @param flags Pointer to the parsed flag states (restore version, sync mode, lock timeout).
+ * @param privileged_file_path Path to the privileged file.
+ * @return `SUCCESS` if the backups were listed or the version restored, or an error code otherwise.
+ */
+int executeRestoreMode(const flag_state_t *flags, const char *privileged_file_path) {
+    if (flags->restore_version == NULL) {
+        return listBackupVersions(privileged_file_path);
+    }
+
+    redit_options_t options = reditDefaultOptions();
+    options.sync_mode = flags->sync_mode;
+    options.lock_timeout = flags->lock_timeout;
+
+    const size_t version = strtoul(flags->restore_version, NULL, 10);
+    redit_result_t result;
+    const int restore_result = reditRestore(privileged_file_path, version, &options, &result);
+    if (result.lock_waited > 0) {
+        fprintf(stderr, "Waited %.3f s for another session to release '%s'.\n", result.lock_waited,
+                privileged_file_path);
+    }
+    if (restore_result == ERROR_INVALID_ARGUMENT) {
+        fprintf(stderr, "Error: '%s' has no backup version %s.\n", privileged_file_path, flags->restore_version);
+        return restore_result;
     }
+    if (restore_result != SUCCESS) {
+        return printError(restore_result, result.failed_step);
+    }
+    printf("Restored version %zu of '%s' (%lld bytes).\n", version, privileged_file_path, (long long) result.bytes);
+    return SUCCESS;
+}
 
-    // Restore the original owner of the privileged file
-    const int chown_result = changeFileOwner(privileged_file_path, prv_file_owner);
-    if (chown_result != SUCCESS) {
-        return printError(chown_result, "changing file owner");
+/**
+ * @brief Lists the copies taken by the user, or cleans them up.
+ *
+ * @param clean Whether to remove the copies that do not differ from their privileged files, and forget gone ones.
+ * @return `SUCCESS` if every copy was listed or cleaned up, or the error of the first that could not be.
+ *
+ * @details
+ * - Copies that are still there are checked against their privileged files in one `reditVerify` call.
+ * - A copy that does not differ holds nothing the privileged file lacks, so removing it loses no edit.
+ */
+int executeSessionsMode(const bool clean) {
+    session_t *sessions;
+    size_t count;
+    const int list_result = listSessions(&sessions, &count);
+    if (list_result != SUCCESS) {
+        return printError(list_result, "listing sessions");
+    }
+    if (count == 0) {
+        printf("No copies to overwrite.\n");
+        free(sessions);
+        return SUCCESS;
     }
 
-    // Restore the original permissions of the privileged file
-    const int ovr_perms_result = overwriteFilePermissions(privileged_file_path, prv_file_perms);
-    if (ovr_perms_result != SUCCESS) {
-        return printError(ovr_perms_result, "overwriting file permissions");
+    redit_verify_t *pairs = calloc(count, sizeof(redit_verify_t));
+    if (pairs == NULL) {
+        free(sessions);
+        return printError(ERROR_MEMORY_ALLOCATION, "allocating verification pairs");
+    }
+    for (size_t i = 0; i < count; ++i) {
+        pairs[i] = (redit_verify_t){.privileged_file_path = sessions[i].privileged_file_path,
+                                    .copy_file_path = sessions[i].copy_file_path};
+    }
+    const int verify_result = reditVerify(pairs, count);
+    if (verify_result != SUCCESS) {
+        free(pairs);
+        free(sessions);
+        return printError(verify_result, "verifying copies");
     }
 
-    // Remove the copy file if the `keep_copy` flag is not set
-    if (!keep_copy) {
-        if (remove(copy_file_path) == -1) {
-            fprintf(stderr, "Error: Failed to remove the copy file.\n");
+    if (!clean) {
+        printf("%-8s %-19s %s\n", "STATE", "COPIED", "COPY -> PRIVILEGED FILE");
+    }
+    size_t removed = 0, forgotten = 0;
+    int first_error = SUCCESS;
+    for (size_t i = 0; i < count; ++i) {
+        const session_t *session = &sessions[i];
+        const bool gone = !session->copy_exists;
+        if (!gone && pairs[i].error != SUCCESS) {
+            fprintf(stderr, "Warning: Could not check '%s' against '%s': %s\n", session->copy_file_path,
+                    session->privileged_file_path, getErrorMessage(pairs[i].error));
+            first_error = first_error == SUCCESS ? pairs[i].error : first_error;
+            continue;
+        }
+        const char *state = gone ? "gone" : pairs[i].changed ? "differs" : "same";
+        if (!clean) {
+            char created[32];
+            const struct tm *local = localtime(&session->created);
+            strftime(created, sizeof(created), "%Y-%m-%d %H:%M:%S", local);
+            printf("%-8s %-19s %s -> %s%s\n", state, created, session->copy_file_path,
+                   session->privileged_file_path, session->prv_changed ? " (changed since copied)" : "");
+            continue;
+        }
+        if (!gone && pairs[i].changed) {
+            continue; // Edited: left for the user to overwrite or remove
+        }
+        const int discard_result = discardSession(session, !gone);
+        if (discard_result != SUCCESS) {
+            fprintf(stderr, "Warning: Could not clean up '%s': %s\n", session->copy_file_path,
+                    getErrorMessage(discard_result));
+            first_error = first_error == SUCCESS ? discard_result : first_error;
+            continue;
+        }
+        if (gone) {
+            forgotten++;
+        } else {
+            removed++;
         }
     }
+    if (clean) {
+        fprintf(stderr, "Removed %zu copy/ies not differing from their privileged files; forgot %zu gone one/s.\n",
+                removed, forgotten);
+    }
+    free(pairs);
+    free(sessions);
+    return first_error;
+}
 
+/**
+ * @brief Prints the backups of a privileged file, newest first, numbered for `--restore=<version>`.
+ *
+ * @param privileged_file_path Path to the privileged file.
+ * @return `SUCCESS` if the backups were listed, or an error code otherwise.
+ */
+static int listBackupVersions(const char *privileged_file_path) {
+    redit_backup_t *backups;
+    size_t count;
+    const int list_result = reditListBackups(privileged_file_path, &backups, &count);
+    if (list_result != SUCCESS) {
+        return printError(list_result, "listing backups");
+    }
+    if (count == 0) {
+        printf("No backups of '%s'.\n", privileged_file_path);
+        return SUCCESS;
+    }
+
+    printf("%-8s %-19s %12s  %-4s  %s\n", "VERSION", "BACKED UP", "SIZE", "MODE", "OWNER");
+    for (size_t i = 0; i < count; ++i) {
+        char created[32];
+        const struct tm *local = localtime(&backups[i].created.tv_sec);
+        strftime(created, sizeof(created), "%Y-%m-%d %H:%M:%S", local);
+
+        const struct passwd *user = getpwuid(backups[i].owner);
+        const struct group *group = getgrgid(backups[i].group);
+        char owner[128];
+        if (user != NULL && group != NULL) {
+            snprintf(owner, sizeof(owner), "%s:%s", user->pw_name, group->gr_name);
+        } else {
+            snprintf(owner, sizeof(owner), "%u:%u", (unsigned int) backups[i].owner, (unsigned int) backups[i].group);
+        }
+        printf("%-8zu %-19s %12lld  %04o  %s\n", i + 1, created, (long long) backups[i].size,
+               (unsigned int) backups[i].mode, owner);
+    }
+    free(backups);
     return SUCCESS;
 }
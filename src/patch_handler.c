@@ -0,0 +1,577 @@
+#include <errno.h>
+#include <fcntl.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/stat.h>
+
+#include "../include/error_handler.h"
+#include "../include/stats_handler.h"
+#include "../include/trace_handler.h"
+#include "../include/window_handler.h"
+#include "../include/patch_handler.h"
+
+/**
+ * @file patch_handler.c
+ * @brief Applies unified diffs in a single forward pass.
+ *
+ * Hunks are applied in order while the file is read front to back, like `patch` does once it
+ * has the whole file in memory, except that only a window of lines around each hunk is ever
+ * held: the lines between two hunks are counted, and their bytes are copied by the kernel
+ * (`copy_file_range`, see `copyByteRange`) instead of through user space.
+ *
+ * A hunk is first looked for at the line given in its header (shifted by how far the previous
+ * hunk moved), then up to `PATCH_SEARCH_LINES` lines before or after it. If its lines are not
+ * found, up to `PATCH_MAX_FUZZ` context lines are ignored at each end, as with `patch --fuzz`.
+ * A hunk whose lines are not found at all is rejected.
+ */
+
+/**
+ * @brief Lines of a file loaded around a hunk.
+ */
+typedef struct {
+    char *data; ///< Bytes of the lines.
+    size_t capacity; ///< Allocated bytes in `data`.
+    off_t offset; ///< Offset of the first line in the file.
+    size_t *starts; ///< Start of each line in `data`, and the end of the last one at index `count`.
+    size_t starts_capacity; ///< Allocated entries in `starts`.
+    size_t count; ///< Lines loaded.
+} line_window_t;
+
+// Function prototypes
+static int parseHunkHeader(const char *line, patch_hunk_t *hunk);
+
+static int addHunkLine(patch_hunk_t *hunk, char type, const char *text, size_t length);
+
+static void countContext(patch_hunk_t *hunk);
+
+static int skipLines(int fd, off_t size, off_t offset, size_t count, off_t *end_offset, size_t *skipped);
+
+static int loadLines(int fd, off_t size, off_t offset, size_t max_lines, line_window_t *window);
+
+static bool matchesAt(const patch_hunk_t *hunk, const line_window_t *window, size_t first, size_t lead,
+                      size_t trail);
+
+static int writeHunk(int dest_fd, off_t *dest_offset, const patch_hunk_t *hunk, const line_window_t *window,
+                     size_t first, size_t lead, size_t trail);
+
+/**
+ * @brief Reads and parses a unified diff.
+ *
+ * @param patch_file_path Path to the patch file.
+ * @param patch Filled with the patch, to be released with `freePatch`.
+ * @return `SUCCESS` if the patch was read, `ERROR_INVALID_ARGUMENT` if it is malformed, has no hunk
+ *         or changes several files, or another error code.
+ *
+ * @details
+ * - Lines before the `---`/`+++` header (e.g. `diff` or `Index:` lines) are ignored; the header
+ *   itself is optional, so bare hunks are accepted too.
+ * - An empty line inside a hunk is taken as an empty context line, since some tools strip the
+ *   trailing space of context lines.
+ */
+int loadPatch(const char *patch_file_path, patch_t *patch) {
+    *patch = (patch_t){0};
+    const int fd = STATS_SYSCALL(open(patch_file_path, O_RDONLY | O_CLOEXEC));
+    if (fd == -1) {
+        return errno == EACCES ? ERROR_PERMISSION_DENIED : ERROR_FILE_NOT_FOUND;
+    }
+    struct stat patch_stat;
+    if (STATS_SYSCALL(fstat(fd, &patch_stat)) == -1 || !S_ISREG(patch_stat.st_mode) ||
+        patch_stat.st_size > PATCH_MAX_SIZE) {
+        close(fd);
+        return ERROR_INVALID_ARGUMENT;
+    }
+    patch->content = malloc((size_t) patch_stat.st_size + 1);
+    if (patch->content == NULL) {
+        close(fd);
+        return ERROR_MEMORY_ALLOCATION;
+    }
+    const ssize_t bytes_read = statsPread(fd, patch->content, (size_t) patch_stat.st_size, 0);
+    close(fd);
+    if (bytes_read != patch_stat.st_size) {
+        freePatch(patch);
+        return ERROR_COPY_FAILED;
+    }
+    patch->content[bytes_read] = '\0';
+
+    int result = SUCCESS;
+    size_t old_left = 0; // Lines still expected in the current hunk
+    size_t new_left = 0;
+    size_t capacity = 0;
+    const char *end = patch->content + bytes_read;
+    for (const char *line = patch->content; line < end && result == SUCCESS;) {
+        const char *newline = memchr(line, '\n', end - line);
+        const char *line_end = newline != NULL ? newline : end;
+        const size_t length = line_end - line;
+        patch_hunk_t *hunk = patch->hunk_count > 0 ? &patch->hunks[patch->hunk_count - 1] : NULL;
+
+        if (line[0] == '\\' && hunk != NULL && hunk->line_count > 0) {
+            hunk->lines[hunk->line_count - 1].newline = false; // "\ No newline at end of file"
+        } else if (old_left > 0 || new_left > 0) {
+            const char type = length == 0 ? ' ' : line[0];
+            if (((type == ' ' || type == '-') && old_left == 0) || ((type == ' ' || type == '+') && new_left == 0) ||
+                (type != ' ' && type != '-' && type != '+')) {
+                result = ERROR_INVALID_ARGUMENT; // Hunk shorter or longer than its header says
+                break;
+            }
+            old_left -= type != '+';
+            new_left -= type != '-';
+            result = addHunkLine(hunk, type, length > 0 ? line + 1 : line, length > 0 ? length - 1 : 0);
+            if (result == SUCCESS && old_left == 0 && new_left == 0) {
+                countContext(hunk);
+            }
+        } else if (length >= 4 && strncmp(line, "--- ", 4) == 0 && patch->hunk_count > 0) {
+            result = ERROR_INVALID_ARGUMENT; // A second file
+        } else if (length >= 3 && strncmp(line, "@@ ", 3) == 0) {
+            if (patch->hunk_count == capacity) {
+                capacity = capacity == 0 ? 8 : capacity * 2;
+                patch_hunk_t *grown = realloc(patch->hunks, capacity * sizeof(patch_hunk_t));
+                if (grown == NULL) {
+                    result = ERROR_MEMORY_ALLOCATION;
+                    break;
+                }
+                patch->hunks = grown;
+            }
+            hunk = &patch->hunks[patch->hunk_count++];
+            *hunk = (patch_hunk_t){0};
+            result = parseHunkHeader(line, hunk);
+            old_left = hunk->old_count;
+            new_left = hunk->new_count;
+            if (result == SUCCESS && patch->hunk_count > 1 &&
+                hunk->old_start < hunk[-1].old_start + hunk[-1].old_count) {
+                result = ERROR_INVALID_ARGUMENT; // Hunks out of order or overlapping
+            }
+        }
+        line = newline != NULL ? newline + 1 : end;
+    }
+
+    if (result == SUCCESS && (patch->hunk_count == 0 || old_left > 0 || new_left > 0)) {
+        result = ERROR_INVALID_ARGUMENT; // No hunk, or a truncated one
+    }
+    if (result != SUCCESS) {
+        freePatch(patch);
+    }
+    return result;
+}
+
+/**
+ * @brief Releases a patch read by `loadPatch`.
+ */
+void freePatch(patch_t *patch) {
+    for (size_t i = 0; i < patch->hunk_count; ++i) {
+        free(patch->hunks[i].lines);
+    }
+    free(patch->hunks);
+    free(patch->content);
+    *patch = (patch_t){0};
+}
+
+/**
+ * @brief Applies a patch to a file, writing the patched content to another.
+ *
+ * @param src_fd Descriptor of the file to patch, open for reading.
+ * @param dest_fd Descriptor receiving the patched content, written from offset 0.
+ * @param patch Patch to apply.
+ * @param report Filled with how each hunk was applied.
+ * @return `SUCCESS` if every hunk was applied, `ERROR_PATCH_REJECTED` if some were not (the output
+ *         is then incomplete), or another error code.
+ *
+ * @details
+ * - Rejected hunks do not stop the pass, so the report covers every hunk.
+ */
+int applyPatch(const int src_fd, const int dest_fd, const patch_t *patch, patch_report_t *report) {
+    const uint64_t start_ns = traceNow();
+    *report = (patch_report_t){0};
+    struct stat src_stat;
+    if (STATS_SYSCALL(fstat(src_fd, &src_stat)) == -1) {
+        return ERROR_COPY_FAILED;
+    }
+    posix_fadvise(src_fd, 0, 0, POSIX_FADV_SEQUENTIAL);
+
+    int result = SUCCESS;
+    size_t cursor_line = 0; // First line not yet written out, from 0
+    off_t cursor_offset = 0; // Where it starts
+    off_t dest_offset = 0;
+    long long delta = 0; // How far the previous hunk was found from its header line
+    line_window_t window = {0};
+    size_t window_line = 0; // Line number of the first line in the window
+
+    for (size_t h = 0; h < patch->hunk_count && result == SUCCESS; ++h) {
+        const patch_hunk_t *hunk = &patch->hunks[h];
+
+        // Line before which the hunk is expected: an empty old range inserts after `old_start`
+        const size_t header_line = hunk->old_count == 0 ? hunk->old_start
+                                                        : hunk->old_start > 0 ? hunk->old_start - 1 : 0;
+        const long long shifted = (long long) header_line + delta;
+        const size_t expected = shifted > 0 ? (size_t) shifted : 0;
+
+        // Load the lines the hunk may be found at, counting the ones before them
+        size_t low = expected > PATCH_SEARCH_LINES ? expected - PATCH_SEARCH_LINES : 0;
+        low = low > cursor_line ? low : cursor_line;
+        off_t low_offset;
+        if (window.data != NULL && low >= window_line && low < window_line + window.count) {
+            low_offset = window.offset + (off_t) window.starts[low - window_line]; // Already counted
+        } else {
+            size_t skipped;
+            result = skipLines(src_fd, src_stat.st_size, cursor_offset, low - cursor_line, &low_offset, &skipped);
+            if (result != SUCCESS) {
+                break;
+            }
+            low = cursor_line + skipped;
+        }
+        const size_t high = (expected > low ? expected : low) + PATCH_SEARCH_LINES + hunk->old_count + 1;
+        result = loadLines(src_fd, src_stat.st_size, low_offset, high - low, &window);
+        if (result != SUCCESS) {
+            break;
+        }
+        window_line = low;
+
+        // Look for the hunk closest to where it is expected, ignoring more context only if needed
+        bool found = false;
+        bool fuzzed = false;
+        size_t at = 0, lead = 0, trail = 0;
+        for (size_t fuzz = 0; fuzz <= PATCH_MAX_FUZZ && !found; ++fuzz) {
+            const size_t next_lead = fuzz < hunk->leading_context ? fuzz : hunk->leading_context;
+            const size_t next_trail = fuzz < hunk->trailing_context ? fuzz : hunk->trailing_context;
+            if (fuzz > 0 && next_lead == lead && next_trail == trail) {
+                break; // No more context to ignore
+            }
+            lead = next_lead;
+            trail = next_trail;
+            fuzzed = fuzz > 0;
+            const size_t span = hunk->old_count - lead - trail;
+            for (size_t distance = 0; distance <= PATCH_SEARCH_LINES && !found; ++distance) {
+                for (int side = 0; side < 2 && !found; ++side) {
+                    if (side == 1 && (distance == 0 || distance > expected)) {
+                        continue;
+                    }
+                    const size_t candidate = side == 0 ? expected + distance : expected - distance;
+                    if (candidate + lead < low || candidate + lead - low + span > window.count ||
+                        (hunk->old_count == 0 && distance > 0)) {
+                        continue; // Outside the loaded lines, or an insertion away from its line
+                    }
+                    if (matchesAt(hunk, &window, candidate + lead - low, lead, trail)) {
+                        found = true;
+                        at = candidate;
+                    }
+                }
+            }
+        }
+        if (!found) {
+            report->rejected++;
+            if (report->first_rejected == 0) {
+                report->first_rejected = h + 1;
+            }
+            continue;
+        }
+
+        // Copy the untouched lines up to the hunk in the kernel, then write the hunk
+        const size_t first = at + lead - low;
+        const off_t hunk_offset = window.offset + (off_t) window.starts[first];
+        result = copyByteRange(src_fd, cursor_offset, dest_fd, dest_offset, hunk_offset - cursor_offset);
+        if (result != SUCCESS) {
+            break;
+        }
+        dest_offset += hunk_offset - cursor_offset;
+        result = writeHunk(dest_fd, &dest_offset, hunk, &window, first, lead, trail);
+        if (result != SUCCESS) {
+            break;
+        }
+        const size_t consumed = hunk->old_count - lead - trail;
+        cursor_line = at + lead + consumed;
+        cursor_offset = window.offset + (off_t) window.starts[first + consumed];
+        delta = (long long) at - (long long) header_line;
+
+        report->applied++;
+        report->moved += at != expected;
+        report->fuzzed += fuzzed;
+    }
+
+    // Copy the rest of the file
+    if (result == SUCCESS && cursor_offset < src_stat.st_size) {
+        result = copyByteRange(src_fd, cursor_offset, dest_fd, dest_offset, src_stat.st_size - cursor_offset);
+    }
+    free(window.data);
+    free(window.starts);
+    traceSpan("patch", "applyPatch", start_ns, NULL, (long long) src_stat.st_size);
+    if (result == SUCCESS && report->rejected > 0) {
+        return ERROR_PATCH_REJECTED;
+    }
+    return result;
+}
+
+/**
+ * @brief Parses a hunk header (`@@ -start[,count] +start[,count] @@`).
+ *
+ * @return `SUCCESS` if the header is valid, or `ERROR_INVALID_ARGUMENT` otherwise.
+ */
+static int parseHunkHeader(const char *line, patch_hunk_t *hunk) {
+    const char *cursor = line + 3;
+    size_t values[4] = {0, 1, 0, 1}; // Counts default to 1 when omitted
+    for (int side = 0; side < 2; ++side) {
+        if (*cursor != (side == 0 ? '-' : '+') || cursor[1] < '0' || cursor[1] > '9') {
+            return ERROR_INVALID_ARGUMENT;
+        }
+        char *end;
+        values[side * 2] = strtoul(cursor + 1, &end, 10);
+        if (*end == ',') {
+            if (end[1] < '0' || end[1] > '9') {
+                return ERROR_INVALID_ARGUMENT;
+            }
+            values[side * 2 + 1] = strtoul(end + 1, &end, 10);
+        }
+        if (*end != ' ') {
+            return ERROR_INVALID_ARGUMENT;
+        }
+        cursor = end + 1;
+    }
+    if (strncmp(cursor, "@@", 2) != 0 || (values[1] > 0 && values[0] == 0)) {
+        return ERROR_INVALID_ARGUMENT;
+    }
+    hunk->old_start = values[0];
+    hunk->old_count = values[1];
+    hunk->new_count = values[3];
+    return SUCCESS;
+}
+
+/**
+ * @brief Appends a line to a hunk.
+ */
+static int addHunkLine(patch_hunk_t *hunk, const char type, const char *text, const size_t length) {
+    if ((hunk->line_count & (hunk->line_count - 1)) == 0) {
+        // Grow at every power of two
+        const size_t capacity = hunk->line_count == 0 ? 8 : hunk->line_count * 2;
+        if (hunk->line_count == 0 || capacity > 8) {
+            patch_line_t *grown = realloc(hunk->lines, capacity * sizeof(patch_line_t));
+            if (grown == NULL) {
+                return ERROR_MEMORY_ALLOCATION;
+            }
+            hunk->lines = grown;
+        }
+    }
+    hunk->lines[hunk->line_count++] = (patch_line_t){.type = type, .text = text, .length = length, .newline = true};
+    return SUCCESS;
+}
+
+/**
+ * @brief Counts the context lines at each end of a complete hunk.
+ */
+static void countContext(patch_hunk_t *hunk) {
+    hunk->leading_context = 0;
+    while (hunk->leading_context < hunk->line_count && hunk->lines[hunk->leading_context].type == ' ') {
+        ++hunk->leading_context;
+    }
+    hunk->trailing_context = 0;
+    if (hunk->leading_context == hunk->line_count) {
+        return; // Context only: nothing changes, so all of it is leading
+    }
+    while (hunk->lines[hunk->line_count - 1 - hunk->trailing_context].type == ' ') {
+        ++hunk->trailing_context;
+    }
+}
+
+/**
+ * @brief Counts lines forward from an offset.
+ *
+ * @param fd Descriptor of the file.
+ * @param size Size of the file.
+ * @param offset Offset of the first line to skip.
+ * @param count Lines to skip.
+ * @param end_offset Set to the offset of the line after the skipped ones (or the file size).
+ * @param skipped Set to the number of lines skipped, fewer than `count` at the end of the file.
+ * @return `SUCCESS`, or `ERROR_COPY_FAILED` if the file could not be read.
+ */
+static int skipLines(const int fd, const off_t size, off_t offset, const size_t count, off_t *end_offset,
+                     size_t *skipped) {
+    *skipped = 0;
+    if (count == 0 || offset >= size) {
+        *end_offset = offset;
+        return SUCCESS;
+    }
+    char *buffer = malloc(PATCH_SCAN_SIZE);
+    if (buffer == NULL) {
+        return ERROR_MEMORY_ALLOCATION;
+    }
+    int result = SUCCESS;
+    while (*skipped < count && offset < size) {
+        const ssize_t bytes_read = statsPread(fd, buffer, PATCH_SCAN_SIZE, offset);
+        if (bytes_read <= 0) {
+            result = ERROR_COPY_FAILED;
+            break;
+        }
+        const char *cursor = buffer;
+        const char *end = buffer + bytes_read;
+        const char *newline;
+        while (*skipped < count && (newline = memchr(cursor, '\n', end - cursor)) != NULL) {
+            ++*skipped;
+            cursor = newline + 1;
+        }
+        offset += cursor - buffer;
+        if (*skipped < count && cursor == buffer + bytes_read) {
+            continue; // The chunk ended on a newline
+        }
+        if (*skipped < count) {
+            offset += end - cursor; // Partial line, continued in the next chunk
+            if (offset >= size) {
+                ++*skipped; // Last line, without a newline
+            }
+        }
+    }
+    free(buffer);
+    *end_offset = offset;
+    return result;
+}
+
+/**
+ * @brief Loads lines from an offset into a window, replacing its previous content.
+ *
+ * @return `SUCCESS`, or an error code if the file could not be read.
+ */
+static int loadLines(const int fd, const off_t size, const off_t offset, const size_t max_lines,
+                     line_window_t *window) {
+    window->offset = offset;
+    window->count = 0;
+    size_t length = 0;
+    size_t line_start = 0;
+    int result = SUCCESS;
+    while (window->count < max_lines && offset + (off_t) length < size && result == SUCCESS) {
+        if (window->capacity - length < PATCH_SCAN_SIZE) {
+            const size_t capacity = window->capacity == 0 ? PATCH_SCAN_SIZE * 2 : window->capacity * 2;
+            char *grown = realloc(window->data, capacity);
+            if (grown == NULL) {
+                result = ERROR_MEMORY_ALLOCATION;
+                break;
+            }
+            window->data = grown;
+            window->capacity = capacity;
+        }
+        const ssize_t bytes_read = statsPread(fd, window->data + length, PATCH_SCAN_SIZE, offset + (off_t) length);
+        if (bytes_read <= 0) {
+            result = ERROR_COPY_FAILED;
+            break;
+        }
+        const size_t scanned = length;
+        length += (size_t) bytes_read;
+        const bool at_end = offset + (off_t) length >= size;
+
+        for (size_t i = scanned; i <= length && window->count < max_lines; ++i) {
+            const bool line_ends = i < length ? window->data[i] == '\n' : at_end && line_start < length;
+            if (!line_ends) {
+                continue;
+            }
+            if (window->count + 1 >= window->starts_capacity) {
+                const size_t capacity = window->starts_capacity == 0 ? 1024 : window->starts_capacity * 2;
+                size_t *grown = realloc(window->starts, capacity * sizeof(size_t));
+                if (grown == NULL) {
+                    result = ERROR_MEMORY_ALLOCATION;
+                    break;
+                }
+                window->starts = grown;
+                window->starts_capacity = capacity;
+            }
+            window->starts[window->count++] = line_start;
+            line_start = i < length ? i + 1 : length;
+        }
+    }
+    if (result == SUCCESS && window->starts_capacity == 0) {
+        window->starts = malloc(sizeof(size_t));
+        window->starts_capacity = window->starts != NULL ? 1 : 0;
+        result = window->starts != NULL ? SUCCESS : ERROR_MEMORY_ALLOCATION;
+    }
+    if (result == SUCCESS) {
+        window->starts[window->count] = line_start; // End of the last loaded line
+    }
+    return result;
+}
+
+/**
+ * @brief Checks whether the old side of a hunk matches the window from a line on.
+ *
+ * @param hunk Hunk to match.
+ * @param window Loaded lines.
+ * @param first Window line matched against the first old line not ignored.
+ * @param lead Leading context lines ignored.
+ * @param trail Trailing context lines ignored.
+ */
+static bool matchesAt(const patch_hunk_t *hunk, const line_window_t *window, size_t first, const size_t lead,
+                      const size_t trail) {
+    size_t old_index = 0;
+    for (size_t i = 0; i < hunk->line_count; ++i) {
+        const patch_line_t *line = &hunk->lines[i];
+        if (line->type == '+') {
+            continue;
+        }
+        if (old_index++ < lead || old_index > hunk->old_count - trail) {
+            continue;
+        }
+        if (first >= window->count) {
+            return false;
+        }
+        const char *text = window->data + window->starts[first];
+        size_t length = window->starts[first + 1] - window->starts[first];
+        length -= length > 0 && text[length - 1] == '\n';
+        if (length != line->length || memcmp(text, line->text, length) != 0) {
+            return false;
+        }
+        ++first;
+    }
+    return true;
+}
+
+/**
+ * @brief Writes the new side of a hunk found in the window.
+ *
+ * @details
+ * - Context lines are written as they are in the file; ignored context lines are left out,
+ *   since they are copied with the untouched lines around the hunk.
+ */
+static int writeHunk(const int dest_fd, off_t *dest_offset, const patch_hunk_t *hunk, const line_window_t *window,
+                     size_t first, const size_t lead, const size_t trail) {
+    size_t length = 0;
+    for (size_t i = 0; i < hunk->line_count; ++i) {
+        length += hunk->lines[i].length + 1;
+    }
+    for (size_t i = 0; i < hunk->old_count && first + i < window->count; ++i) {
+        length += window->starts[first + i + 1] - window->starts[first + i];
+    }
+    char *buffer = malloc(length + 1);
+    if (buffer == NULL) {
+        return ERROR_MEMORY_ALLOCATION;
+    }
+
+    size_t used = 0;
+    size_t old_index = 0;
+    for (size_t i = 0; i < hunk->line_count; ++i) {
+        const patch_line_t *line = &hunk->lines[i];
+        if (line->type == '+') {
+            memcpy(buffer + used, line->text, line->length);
+            used += line->length;
+            if (line->newline) {
+                buffer[used++] = '\n';
+            }
+            continue;
+        }
+        if (old_index++ < lead || old_index > hunk->old_count - trail) {
+            continue;
+        }
+        if (line->type == ' ') {
+            const size_t line_length = window->starts[first + 1] - window->starts[first];
+            memcpy(buffer + used, window->data + window->starts[first], line_length);
+            used += line_length;
+        }
+        ++first;
+    }
+
+    int result = SUCCESS;
+    for (size_t done = 0; done < used && result == SUCCESS;) {
+        const ssize_t bytes_written = statsPwrite(dest_fd, buffer + done, used - done, *dest_offset);
+        if (bytes_written <= 0) {
+            result = ERROR_COPY_FAILED;
+            break;
+        }
+        done += (size_t) bytes_written;
+        *dest_offset += bytes_written;
+    }
+    free(buffer);
+    return result;
+}
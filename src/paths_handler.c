@@ -1,3 +1,4 @@
+#include <stdint.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <linux/limits.h>
@@ -10,12 +11,14 @@
 #include <pwd.h>
 #include <regex.h>
 #include <ctype.h>
+#include <fcntl.h>
 
 #include "../include/error_handler.h"
 #include "../include/paths_handler.h"
-#include "../include/flags_handler.h"
 #include "../include/file_operations.h"
 #include "../include/file_utils.h"
+#include "../include/stats_handler.h"
+#include "../include/trace_handler.h"
 
 /**
  * @file paths_handler.c
@@ -26,108 +29,10 @@
  * The goal is to ensure robust and error-free handling of paths for file operations.
  */
 
-/**
- * @brief Resolves and validates paths for copy and overwrite operations.
- *
- * @param argc The number of command-line arguments.
- * @param argv The array of command-line arguments.
- * @param flags Pointer to the structure storing the parsed flag states.
- * @param copy_file_path Buffer to store the resolved copy file path.
- * @param privileged_file_path Buffer to store the resolved privileged file path.
- * @return `SUCCESS` if paths are resolved and validated successfully, or an error code otherwise.
- *
- * @details
- * - Handles both file and directory copy paths.
- * - Resolves absolute paths for both source and destination files.
- * - Validates that paths exist and meet access requirements.
- */
-int resolveAndValidatePaths(const int argc, char *argv[], const flag_state_t *flags,
-                            char copy_file_path[PATH_MAX], char privileged_file_path[PATH_MAX]) {
-    // Checks if the 'd' or 'D' flag is set
-    // This means that the user has specified a directory or file path for the copy file
-    if (flags->copied_file_path || flags->copied_dir_path) {
-        // Check if there is the right number of arguments
-        if (flags->param_index + 1 >= argc) {
-            fprintf(stderr, "Usage: %s -C /path/to/copy/file /path/to/original/file\n%s\n", argv[0], tryHelpMessage());
-            return ERROR_INVALID_ARGUMENT;
-        }
-
-        // Get the absolute path of the privileged file
-        const int prv_path_result = getAbsolutePath(argv[flags->param_index + 1], privileged_file_path);
-        if (prv_path_result != SUCCESS) {
-            return printError(prv_path_result, "resolving privileged file path");
-        }
-
-        // Validate the privileged file path
-        const int prv_valid_result = validatePath(privileged_file_path, true, false);
-        if (prv_valid_result != SUCCESS) {
-            return printError(prv_valid_result, "validating privileged file path");
-        }
-
-        // Get the absolute path of the copy file
-        const int cpy_path_result = getAbsolutePathFuture(argv[flags->param_index], copy_file_path);
-        if (cpy_path_result != SUCCESS) {
-            return printError(cpy_path_result, "resolving copy file path");
-        }
-
-        // Check whether the user has specified a directory path for the copy file
-        if (flags->copied_dir_path) {
-            // Since the path is a directory, we need to get the base name of the privileged file
-            // and append it to the copy file path
-            const char *file_base_name = basename(privileged_file_path); // Get the base name of the privileged file
-            const int abs_file_path_result = getAbsFilePathFromDir(copy_file_path, file_base_name);
-            // Append the base name to the copy file path
-            if (abs_file_path_result != SUCCESS) {
-                return printError(abs_file_path_result, "getting absolute file path from directory");
-            }
-        }
-
-        // Validate the copy file path and create it if it doesn't exist
-        const int validation_result = validateOrCreatePath(copy_file_path, true, false);
-        if (validation_result != SUCCESS) {
-            return printError(validation_result, "validating copy file path");
-        }
-    } else {
-        // Check if there is the right number of arguments
-        if (flags->param_index >= argc) {
-            fprintf(stderr, "Usage: %s -C /path/to/original/file\n%s\n", argv[0], tryHelpMessage());
-            return ERROR_INVALID_ARGUMENT;
-        }
-
-        // Resolve current working directory
-        char cwd[PATH_MAX];
-        const int cwd_result = getCurrentWorkingDirectory(cwd);
-        if (cwd_result != SUCCESS) {
-            return printError(cwd_result, "resolving current working directory");
-        }
-
-        // Get the absolute path of the privileged file
-        const int prv_path_result = getAbsolutePath(argv[flags->param_index], privileged_file_path);
-        if (prv_path_result != SUCCESS) {
-            return printError(prv_path_result, "resolving privileged file path");
-        }
-
-        // Validate the privileged file path
-        const int prv_validation_result = validatePath(privileged_file_path, true, false);
-        if (prv_validation_result != SUCCESS) {
-            return printError(prv_validation_result, "validating privileged file path");
-        }
-
-        // Since the user has not specified a copy file path, we need to create one
-        // by appending the base name of the privileged file to the current working directory
-        const char *base_name = basename(privileged_file_path); // Get the base name of the privileged file
-        snprintf(copy_file_path, strlen(cwd) + strlen(base_name) + 2, "%s/%s", cwd, base_name);
-        // Append the base name to the current working directory
-
-        // Validate the copy file path and create it if it doesn't exist
-        const int validation_result = validatePath(copy_file_path, false, true);
-        if (validation_result != SUCCESS) {
-            return printError(validation_result, "validating copy file path");
-        }
-    }
+// Function prototypes
+static int resolvePathFuture(const char *original_path, char resolved_path[PATH_MAX]);
 
-    return SUCCESS;
-}
+static int getUserDataDir(const char *relative_dir, char dir_path[PATH_MAX], uid_t *ef_uid);
 
 /**
  * @brief Normalizes slashes in a file path.
@@ -180,7 +85,10 @@ void normalizeSlashes(const char *input_path, char normalized_path[PATH_MAX]) {
  * - It only works for existing files/directories.
  */
 int getAbsolutePath(const char *original_path, char resolved_path[PATH_MAX]) {
-    if (realpath(original_path, resolved_path) == NULL) {
+    const uint64_t start_ns = traceNow();
+    const char *real_path = STATS_SYSCALL(realpath(original_path, resolved_path));
+    traceSpan("path", "realpath", start_ns, original_path, -1);
+    if (real_path == NULL) {
         if (errno == ENOENT) {
             return ERROR_FILE_NOT_FOUND;
         }
@@ -201,6 +109,16 @@ int getAbsolutePath(const char *original_path, char resolved_path[PATH_MAX]) {
  * - Handles special cases like `.` (current directory), `..` (parent directory), `~` (home directory), and environment variables.
  */
 int getAbsolutePathFuture(const char *original_path, char resolved_path[PATH_MAX]) {
+    const uint64_t start_ns = traceNow();
+    const int result = resolvePathFuture(original_path, resolved_path);
+    traceSpan("path", "resolve", start_ns, original_path, -1);
+    return result;
+}
+
+/**
+ * @brief Does the work of `getAbsolutePathFuture`.
+ */
+static int resolvePathFuture(const char *original_path, char resolved_path[PATH_MAX]) {
     // Normalize the slashes in the original path
     // It also removes the end slashes if present
     char normalized_path[PATH_MAX];
@@ -209,7 +127,7 @@ int getAbsolutePathFuture(const char *original_path, char resolved_path[PATH_MAX
     // Path begins with '.' (current directory)
     if (normalized_path[0] == '.' && (normalized_path[1] == '\0' || normalized_path[1] == '/')) {
         // Get the absolute path of the current directory
-        if (realpath(".", resolved_path) == NULL) {
+        if (STATS_SYSCALL(realpath(".", resolved_path)) == NULL) {
             return ERROR_RESOLVING_PATH;
         }
         // If the path is just '.', return the current directory
@@ -226,7 +144,7 @@ int getAbsolutePathFuture(const char *original_path, char resolved_path[PATH_MAX
     // It is treated as if a "./" is prepended to the path (e.g., "./path/to/file")
     if (isalpha(normalized_path[0])) {
         // Get the absolute path of the current directory
-        if (realpath(".", resolved_path) == NULL) {
+        if (STATS_SYSCALL(realpath(".", resolved_path)) == NULL) {
             return ERROR_RESOLVING_PATH;
         }
 
@@ -250,7 +168,7 @@ int getAbsolutePathFuture(const char *original_path, char resolved_path[PATH_MAX
         // Get the absolute path of the all the '..' in the path
         char temp_resolved_path[PATH_MAX];
         strcpy(temp_resolved_path, resolved_path);
-        if (realpath(temp_resolved_path, resolved_path) == NULL) {
+        if (STATS_SYSCALL(realpath(temp_resolved_path, resolved_path)) == NULL) {
             return ERROR_RESOLVING_PATH;
         }
 
@@ -357,12 +275,12 @@ int validatePath(const char path[PATH_MAX], const bool check_read, const bool ch
     const char *path_dir = dirname(path_copy);
 
     // Check if the path has read permissions
-    if (check_read && access(path_dir, R_OK) == -1) {
+    if (check_read && STATS_SYSCALL(access(path_dir, R_OK)) == -1) {
         return ERROR_PERMISSION_DENIED;
     }
 
     // Check if the path has write permissions
-    if (check_write && access(path_dir, W_OK) == -1) {
+    if (check_write && STATS_SYSCALL(access(path_dir, W_OK)) == -1) {
         return ERROR_PERMISSION_DENIED;
     }
 
@@ -401,7 +319,10 @@ int createDirRecursively(const char *path) {
             temp_path[pos] = '\0'; // Temporarily truncate the path at the slash
 
             // Create the directory if it doesn't exist and user has permission
-            if (mkdir(temp_path, 0755) == SUCCESS) {
+            const uint64_t start_ns = traceNow();
+            const int mkdir_result = STATS_SYSCALL(mkdir(temp_path, 0755));
+            traceSpan("path", "mkdir", start_ns, temp_path, -1);
+            if (mkdir_result == SUCCESS) {
                 // Get the effective user ID to set as the owner of the directory
                 uid_t ef_uid;
                 const int user_result = getEffectiveUserId(&ef_uid);
@@ -429,51 +350,104 @@ int createDirRecursively(const char *path) {
 }
 
 /**
- * @brief Validates a path or creates it if it doesn't exist.
+ * @brief Builds the path of a per-user data directory, creating it if needed.
  *
- * @param path The path to validate or create.
- * @param check_read Check for read permissions.
- * @param check_write Check for write permissions.
- * @return `SUCCESS` if valid or created successfully, or an error code otherwise.
+ * @param relative_dir Directory relative to the effective user's home (e.g. ".cache/redit").
+ * @param dir_path Buffer to store the resulting path.
+ * @param ef_uid Pointer to a variable where the effective user ID will be stored.
+ * @return `SUCCESS` if the path was built and the directory exists, or an error code otherwise.
  */
-int validateOrCreatePath(const char path[PATH_MAX], const bool check_read, const bool check_write) {
-    struct stat path_stat;
-    char path_copy[PATH_MAX];
-    strcpy(path_copy, path); // Make a copy of the path to avoid modifying the original
-    const char *path_dir = dirname(path_copy); // Get the directory of the path
+static int getUserDataDir(const char *relative_dir, char dir_path[PATH_MAX], uid_t *ef_uid) {
+    // Get the home directory of the effective user
+    const int uid_result = getEffectiveUserId(ef_uid);
+    if (uid_result != SUCCESS) {
+        return uid_result;
+    }
+    const struct passwd *pw = getpwuid(*ef_uid);
+    if (pw == NULL) {
+        return ERROR_USER_NOT_FOUND;
+    }
 
-    // Check if the path exists
-    if (stat(path_dir, &path_stat) == -1) {
-        if (errno == ENOENT) {
-            // Prompt the user to create the directory if it doesn't exist
-            printf("The path '%s' does not exist. Do you want to create it? (y/n): ", path_copy);
-            char response;
-            while (scanf(" %c", &response) != 1 || (
-                       response != 'y' && response != 'Y' && response != 'n' && response != 'N')) {
-                printf("Invalid input. Please enter 'y' or 'n': ");
-            }
-            if (response == 'n' || response == 'N') {
-                return USER_EXIT;
-            }
+    const int written = snprintf(dir_path, PATH_MAX, "%s/%s", pw->pw_dir, relative_dir);
+    if (written < 0 || written >= PATH_MAX) {
+        return ERROR_PATH_TOO_LONG;
+    }
 
-            // Create the directory recursively
-            const int create_result = createDirRecursively(path_dir);
-            switch (create_result) {
-                case ERROR_PATH_TOO_LONG:
-                    return ERROR_PATH_TOO_LONG;
-                case ERROR_PATH_INVALID:
-                    return ERROR_PATH_INVALID;
-            }
-            return SUCCESS;
-        }
-        return ERROR_PATH_INVALID; // If the errno is not ENOENT, the path is invalid
+    // Create the directory if it doesn't exist
+    struct stat dir_stat;
+    if (STATS_SYSCALL(stat(dir_path, &dir_stat)) == -1) {
+        return createDirRecursively(dir_path);
     }
+    return SUCCESS;
+}
 
-    // Validate the path if it exists
-    const int val_result = validatePath(path, check_read, check_write);
-    if (val_result == ERROR_PERMISSION_DENIED) {
+/**
+ * @brief Opens a per-user data directory, creating it if needed, once it is known to belong to the user.
+ *
+ * @param relative_dir Directory relative to the effective user's home (e.g. ".cache/redit").
+ * @param dir_fd Pointer to a variable where the descriptor of the directory will be stored.
+ * @param ef_uid Pointer to a variable where the effective user ID will be stored.
+ * @return `SUCCESS` if the directory was opened, or an error code otherwise.
+ *
+ * @details
+ * - The home directory is the one of the effective user (the `sudo` caller), not root's.
+ * - Missing directories are created and owned by the effective user.
+ * - Running as root, a data file opened by path would follow whatever symlink the user left in
+ *   its place. Files are instead opened with `openat` on this descriptor and `O_NOFOLLOW`.
+ * - The directory itself is opened with `O_NOFOLLOW`, and refused (`ERROR_PERMISSION_DENIED`)
+ *   unless it is owned by the effective user and not writable by anyone else, so no other user
+ *   can swap the files in it.
+ */
+int openUserDataDir(const char *relative_dir, int *dir_fd, uid_t *ef_uid) {
+    char dir_path[PATH_MAX];
+    const int dir_result = getUserDataDir(relative_dir, dir_path, ef_uid);
+    if (dir_result != SUCCESS) {
+        return dir_result;
+    }
+
+    const int fd = STATS_SYSCALL(open(dir_path, O_RDONLY | O_DIRECTORY | O_NOFOLLOW | O_CLOEXEC));
+    if (fd == -1) {
+        return errno == EACCES ? ERROR_PERMISSION_DENIED : ERROR_PATH_INVALID;
+    }
+    struct stat dir_stat;
+    if (STATS_SYSCALL(fstat(fd, &dir_stat)) == -1 || dir_stat.st_uid != *ef_uid ||
+        (dir_stat.st_mode & (S_IWGRP | S_IWOTH)) != 0) {
+        close(fd);
         return ERROR_PERMISSION_DENIED;
     }
+    *dir_fd = fd;
+    return SUCCESS;
+}
 
+/**
+ * @brief Builds the path of the entry kept for one or two paths in a state store.
+ *
+ * @param store_dir Directory of the store (e.g. `BASELINE_DIR`).
+ * @param key_path Path the entry is kept for.
+ * @param second_key_path Second path the entry is kept for, or `NULL` if it is kept for `key_path` alone.
+ * @param entry_path Buffer to store the entry path.
+ * @return `SUCCESS` if the path was built, or `ERROR_PATH_TOO_LONG` otherwise.
+ *
+ * @details
+ * - The entry name is the 64-bit FNV-1a hash of the paths, separated by a NUL byte, so it has a
+ *   fixed length whatever the paths. Stores tell a hash collision apart by what their entries record.
+ */
+int getStoreEntryPath(const char *store_dir, const char *key_path, const char *second_key_path,
+                      char entry_path[PATH_MAX]) {
+    uint64_t hash = 0xCBF29CE484222325ULL;
+    for (const char *p = key_path; *p != '\0'; ++p) {
+        hash = (hash ^ (unsigned char) *p) * 0x100000001B3ULL;
+    }
+    if (second_key_path != NULL) {
+        hash = (hash ^ '\0') * 0x100000001B3ULL; // Separate both paths
+        for (const char *p = second_key_path; *p != '\0'; ++p) {
+            hash = (hash ^ (unsigned char) *p) * 0x100000001B3ULL;
+        }
+    }
+
+    const int written = snprintf(entry_path, PATH_MAX, "%s/%016llx", store_dir, (unsigned long long) hash);
+    if (written < 0 || written >= PATH_MAX) {
+        return ERROR_PATH_TOO_LONG;
+    }
     return SUCCESS;
 }
@@ -0,0 +1,286 @@
+#include <dirent.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include <linux/fs.h>
+#include <linux/limits.h>
+#include <sys/ioctl.h>
+#include <sys/stat.h>
+
+#include "../include/error_handler.h"
+#include "../include/pristine_handler.h"
+#include "../include/stats_handler.h"
+#include "../include/sync_handler.h"
+#include "../include/trace_handler.h"
+
+/**
+ * @file pristine_handler.c
+ * @brief Caches pristine copies of privileged files and clones them into new copies.
+ *
+ * A cached copy is named after the device, inode, size, modification time and status
+ * change time of the privileged file it was taken from. The change time moves on every
+ * write, truncation or metadata change, even one that resets the modification time, so
+ * an entry whose name still matches the privileged file holds exactly its content.
+ *
+ * Entries are created and materialized with `FICLONE`, which shares the extents of the
+ * file instead of copying them: both are instant and take no space until one side is
+ * modified. Where reflinks are not supported (different file systems, or ext4), nothing
+ * is cached and copies are made as usual. The least recently used entries are evicted
+ * once the cache holds `PRISTINE_MAX_ENTRIES` entries or `PRISTINE_MAX_BYTES` bytes.
+ */
+
+/**
+ * @brief A cached copy, as seen during eviction.
+ */
+typedef struct {
+    char name[NAME_MAX + 1]; ///< File name in `PRISTINE_DIR`.
+    struct timespec used; ///< Last time the entry was stored or cloned (its access time).
+    off_t size; ///< Apparent size.
+} pristine_entry_t;
+
+// Function prototypes
+static int getPristineName(const struct stat *prv_stat, char name[NAME_MAX + 1]);
+
+static int compareLeastRecentlyUsed(const void *a, const void *b);
+
+static void evictPristineCopies(const char *kept_name);
+
+/**
+ * @brief Clones the cached copy of an unchanged privileged file into a copy file.
+ *
+ * @param prv_stat Current metadata of the privileged file.
+ * @param dest Path to the copy file, created or replaced.
+ * @param options Copy options; only the durability settings are used.
+ * @return `SUCCESS` if the copy was cloned, `ERROR_FILE_NOT_FOUND` if there is no usable entry,
+ *         or another error code.
+ *
+ * @details
+ * - Anything but `SUCCESS` leaves the copy to be made by `copyFile`. The destination is left as it
+ *   was, or created empty.
+ * - The destination is not opened with `O_TRUNC`, as it could be the privileged file itself; it is
+ *   truncated to the size of the clone once the clone is done.
+ * - Marks the entry as used, for the LRU eviction.
+ */
+int clonePristineCopy(const struct stat *prv_stat, const char *dest, const copy_options_t *options) {
+    const uint64_t start_ns = traceNow();
+    char name[NAME_MAX + 1];
+    const int name_result = getPristineName(prv_stat, name);
+    if (name_result != SUCCESS) {
+        return name_result;
+    }
+
+    const int dir_fd = STATS_SYSCALL(open(PRISTINE_DIR, O_RDONLY | O_DIRECTORY | O_CLOEXEC));
+    if (dir_fd == -1) {
+        return ERROR_FILE_NOT_FOUND;
+    }
+    const int entry_fd = STATS_SYSCALL(openat(dir_fd, name, O_RDONLY | O_NOFOLLOW | O_CLOEXEC));
+    close(dir_fd);
+    if (entry_fd == -1) {
+        return ERROR_FILE_NOT_FOUND;
+    }
+    struct stat entry_stat;
+    if (STATS_SYSCALL(fstat(entry_fd, &entry_stat)) == -1 || entry_stat.st_size != prv_stat->st_size) {
+        close(entry_fd);
+        return ERROR_FILE_NOT_FOUND;
+    }
+
+    const int dest_fd = STATS_SYSCALL(open(dest, O_WRONLY | O_CREAT | O_CLOEXEC,
+                                           S_IRUSR | S_IWUSR | S_IRGRP | S_IROTH));
+    if (dest_fd == -1) {
+        close(entry_fd);
+        return errno == EACCES ? ERROR_PERMISSION_DENIED : ERROR_COPY_FAILED;
+    }
+
+    // Never truncate the privileged file itself, whatever path leads to it
+    struct stat dest_stat;
+    int clone_result = STATS_SYSCALL(fstat(dest_fd, &dest_stat)) == 0 &&
+                       (dest_stat.st_dev != prv_stat->st_dev || dest_stat.st_ino != prv_stat->st_ino)
+                           ? SUCCESS
+                           : ERROR_SAME_SOURCE;
+    if (clone_result == SUCCESS && STATS_SYSCALL(ioctl(dest_fd, FICLONE, entry_fd)) == -1) {
+        clone_result = ERROR_FILE_NOT_FOUND; // A failed clone leaves the destination untouched
+    }
+    if (clone_result == SUCCESS && STATS_SYSCALL(ftruncate(dest_fd, prv_stat->st_size)) == -1) {
+        clone_result = ERROR_COPY_FAILED; // A longer destination would keep its tail after the clone
+    }
+    if (clone_result == SUCCESS) {
+        const struct timespec times[2] = {{.tv_nsec = UTIME_NOW}, {.tv_nsec = UTIME_OMIT}};
+        STATS_SYSCALL(futimens(entry_fd, times));
+        clone_result = syncFile(dest_fd, dest, options->sync_mode, options->sync_group);
+    }
+    close(entry_fd);
+    if (STATS_SYSCALL(close(dest_fd)) == -1 && clone_result == SUCCESS) {
+        clone_result = ERROR_COPY_FAILED;
+    }
+    if (clone_result == SUCCESS) {
+        traceSpan("copy", "clonePristineCopy", start_ns, dest, prv_stat->st_size);
+    }
+    return clone_result;
+}
+
+/**
+ * @brief Caches a clone of a copy just made from a privileged file.
+ *
+ * @param copy_file_path Path to the copy file, which must still be owned by the caller.
+ * @param prv_stat Metadata of the privileged file when the copy was made.
+ * @return `SUCCESS` if the copy is cached, or an error code otherwise (for instance where
+ *         reflinks are not supported, since the cache would then cost a full copy).
+ *
+ * @details
+ * - Must be called before the copy is handed to its user. The copy is only cached if it is still
+ *   a single-link regular file owned by the caller with the privileged file's size, so a file put
+ *   in its place or written to by someone else never poisons the cache.
+ * - Replaces any older entry for the same privileged file, then evicts the least recently used.
+ */
+int storePristineCopy(const char *copy_file_path, const struct stat *prv_stat) {
+    char name[NAME_MAX + 1];
+    const int name_result = getPristineName(prv_stat, name);
+    if (name_result != SUCCESS) {
+        return name_result;
+    }
+    if (mkdir(REDIT_STATE_DIR, 0755) == -1 && errno != EEXIST) {
+        return errno == EACCES ? ERROR_PERMISSION_DENIED : ERROR_PATH_INVALID;
+    }
+    if (mkdir(PRISTINE_DIR, 0700) == -1 && errno != EEXIST) {
+        return errno == EACCES ? ERROR_PERMISSION_DENIED : ERROR_PATH_INVALID;
+    }
+
+    const int copy_fd = STATS_SYSCALL(open(copy_file_path, O_RDONLY | O_NOFOLLOW | O_CLOEXEC));
+    if (copy_fd == -1) {
+        return ERROR_FILE_NOT_FOUND;
+    }
+    struct stat copy_stat;
+    if (STATS_SYSCALL(fstat(copy_fd, &copy_stat)) == -1 || !S_ISREG(copy_stat.st_mode) ||
+        copy_stat.st_uid != geteuid() || copy_stat.st_nlink != 1 || copy_stat.st_size != prv_stat->st_size) {
+        close(copy_fd);
+        return ERROR_INVALID_SOURCE;
+    }
+
+    const int dir_fd = STATS_SYSCALL(open(PRISTINE_DIR, O_RDONLY | O_DIRECTORY | O_CLOEXEC));
+    if (dir_fd == -1) {
+        close(copy_fd);
+        return ERROR_PERMISSION_DENIED;
+    }
+    char temp_name[NAME_MAX + 1];
+    snprintf(temp_name, sizeof(temp_name), ".tmp.%ld", (long) getpid());
+    const int entry_fd = STATS_SYSCALL(openat(dir_fd, temp_name, O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC,
+                                              S_IRUSR | S_IWUSR));
+    int result = entry_fd == -1 ? ERROR_PERMISSION_DENIED : SUCCESS;
+    if (result == SUCCESS && STATS_SYSCALL(ioctl(entry_fd, FICLONE, copy_fd)) == -1) {
+        result = ERROR_COPY_FAILED; // No reflinks between these files: not worth a full copy
+    }
+    if (entry_fd != -1 && STATS_SYSCALL(close(entry_fd)) == -1 && result == SUCCESS) {
+        result = ERROR_COPY_FAILED;
+    }
+    if (result == SUCCESS && STATS_SYSCALL(renameat(dir_fd, temp_name, dir_fd, name)) == -1) {
+        result = ERROR_COPY_FAILED;
+    }
+    if (result != SUCCESS && entry_fd != -1) {
+        unlinkat(dir_fd, temp_name, 0);
+    }
+    close(dir_fd);
+    close(copy_fd);
+
+    if (result == SUCCESS) {
+        evictPristineCopies(name);
+    }
+    return result;
+}
+
+/**
+ * @brief Builds the cache entry name of a privileged file in its current state.
+ *
+ * @details
+ * - `<device>-<inode>-` comes first, so the entries of one privileged file share a prefix.
+ */
+static int getPristineName(const struct stat *prv_stat, char name[NAME_MAX + 1]) {
+    const int written = snprintf(name, NAME_MAX + 1, "%016llx-%016llx-%lld-%lld.%09ld-%lld.%09ld",
+                                 (unsigned long long) prv_stat->st_dev, (unsigned long long) prv_stat->st_ino,
+                                 (long long) prv_stat->st_size,
+                                 (long long) prv_stat->st_mtim.tv_sec, prv_stat->st_mtim.tv_nsec,
+                                 (long long) prv_stat->st_ctim.tv_sec, prv_stat->st_ctim.tv_nsec);
+    if (written < 0 || written > NAME_MAX) {
+        return ERROR_PATH_TOO_LONG;
+    }
+    return SUCCESS;
+}
+
+/**
+ * @brief Orders cache entries from the least to the most recently used.
+ */
+static int compareLeastRecentlyUsed(const void *a, const void *b) {
+    const struct timespec *used_a = &((const pristine_entry_t *) a)->used;
+    const struct timespec *used_b = &((const pristine_entry_t *) b)->used;
+    if (used_a->tv_sec != used_b->tv_sec) {
+        return used_a->tv_sec < used_b->tv_sec ? -1 : 1;
+    }
+    return used_a->tv_nsec < used_b->tv_nsec ? -1 : used_a->tv_nsec > used_b->tv_nsec;
+}
+
+/**
+ * @brief Removes stale entries of a privileged file and the least recently used entries beyond the limits.
+ *
+ * @param kept_name Entry just stored, which is never evicted.
+ *
+ * @details
+ * - Entries with the same device and inode as `kept_name` describe older states of the same file
+ *   and can never match again, so they go first.
+ * - Eviction is best effort: entries that cannot be listed or removed are left behind.
+ */
+static void evictPristineCopies(const char *kept_name) {
+    DIR *dir = opendir(PRISTINE_DIR);
+    if (dir == NULL) {
+        return;
+    }
+    const size_t prefix_length = 2 * 16 + 2; // "<device>-<inode>-"
+
+    pristine_entry_t *entries = NULL;
+    size_t count = 0, capacity = 0;
+    long long total_size = 0;
+    const struct dirent *entry;
+    while ((entry = readdir(dir)) != NULL) {
+        if (entry->d_name[0] == '.' || strcmp(entry->d_name, kept_name) == 0) {
+            continue;
+        }
+        if (strncmp(entry->d_name, kept_name, prefix_length) == 0) {
+            STATS_SYSCALL(unlinkat(dirfd(dir), entry->d_name, 0));
+            continue;
+        }
+        struct stat entry_stat;
+        if (STATS_SYSCALL(fstatat(dirfd(dir), entry->d_name, &entry_stat, AT_SYMLINK_NOFOLLOW)) == -1) {
+            continue;
+        }
+        if (count == capacity) {
+            capacity = capacity == 0 ? 64 : capacity * 2;
+            pristine_entry_t *grown = realloc(entries, capacity * sizeof(pristine_entry_t));
+            if (grown == NULL) {
+                break;
+            }
+            entries = grown;
+        }
+        pristine_entry_t *pristine_entry = &entries[count++];
+        strcpy(pristine_entry->name, entry->d_name);
+        pristine_entry->used = entry_stat.st_atim;
+        pristine_entry->size = entry_stat.st_size;
+        total_size += entry_stat.st_size;
+    }
+
+    // Make room for the kept entry too
+    struct stat kept_stat;
+    if (STATS_SYSCALL(fstatat(dirfd(dir), kept_name, &kept_stat, 0)) == 0) {
+        total_size += kept_stat.st_size;
+    }
+    qsort(entries, count, sizeof(pristine_entry_t), compareLeastRecentlyUsed);
+    for (size_t i = 0; i < count && (count - i + 1 > PRISTINE_MAX_ENTRIES || total_size > PRISTINE_MAX_BYTES); ++i) {
+        if (STATS_SYSCALL(unlinkat(dirfd(dir), entries[i].name, 0)) == 0) {
+            total_size -= entries[i].size;
+        }
+    }
+    free(entries);
+    closedir(dir);
+}
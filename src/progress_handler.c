@@ -0,0 +1,205 @@
+#include <pthread.h>
+#include <signal.h>
+#include <stdatomic.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <string.h>
+#include <time.h>
+#include <linux/limits.h>
+
+#include "../include/progress_handler.h"
+#include "../include/stats_handler.h"
+
+/**
+ * @file progress_handler.c
+ * @brief Reports the progress of long copies.
+ *
+ * The copy threads only add the bytes they move to a shared atomic counter, once per chunk,
+ * which costs nothing next to the chunk itself. Everything else happens in a reporting
+ * thread woken by a timer: on a terminal it redraws one status line on `stderr` twice a
+ * second, and in any case it prints one status line when the process receives `SIGUSR1`
+ * (e.g. `pkill -USR1 redit` from another terminal, for a run whose output goes to a log).
+ *
+ * The throughput is smoothed over the last few redraws, so the ETA does not jump with each
+ * page cache eviction or stall.
+ */
+
+static bool progress_enabled; // Set once the reporting thread runs
+static bool progress_live; // Whether the status line is redrawn continuously
+static pthread_mutex_t progress_mutex = PTHREAD_MUTEX_INITIALIZER; // Guards the copy description and the output
+static atomic_bool progress_active; // Whether a copy is in progress
+static atomic_llong progress_done; // Bytes moved by the copy in progress
+static off_t progress_total; // Bytes the copy in progress should move
+static char progress_label[PATH_MAX]; // What is being copied
+static const char *progress_engine; // Engine of the copy in progress
+static uint64_t progress_started_ns; // When the copy in progress started
+static bool progress_drawn; // Whether the status line is on the screen
+static volatile sig_atomic_t status_requested; // Set by SIGUSR1
+
+// Function prototypes
+static void *reportProgress(void *arg);
+
+static void requestStatus(int signal_number);
+
+static void formatStatus(char *line, size_t size, double throughput);
+
+/**
+ * @brief Starts reporting the progress of the copies of the run.
+ *
+ * @param live Whether to redraw a status line continuously (`stderr` is a terminal).
+ *
+ * @details
+ * - Installs the `SIGUSR1` handler, which otherwise terminates the process.
+ * - Without this call, the other functions do nothing, as when `redit` is used as a library.
+ */
+void progressStart(const bool live) {
+    progress_live = live;
+    struct sigaction action = {0};
+    action.sa_handler = requestStatus;
+    action.sa_flags = SA_RESTART;
+    sigemptyset(&action.sa_mask);
+
+    // Block the signals of the run in the reporting thread except SIGUSR1, which it alone handles
+    sigset_t others, previous;
+    sigfillset(&others);
+    sigdelset(&others, SIGUSR1);
+    pthread_sigmask(SIG_BLOCK, &others, &previous);
+    pthread_t thread;
+    if (pthread_create(&thread, NULL, reportProgress, NULL) == 0) {
+        pthread_detach(thread);
+        sigaction(SIGUSR1, &action, NULL);
+        progress_enabled = true;
+    }
+    pthread_sigmask(SIG_SETMASK, &previous, NULL);
+}
+
+/**
+ * @brief Marks the start of a copy.
+ *
+ * @param label What is being copied, shown in the status line.
+ * @param total Bytes the copy should move.
+ * @param engine Name of the copy engine.
+ */
+void progressBegin(const char *label, const off_t total, const char *engine) {
+    if (!progress_enabled) {
+        return;
+    }
+    pthread_mutex_lock(&progress_mutex);
+    snprintf(progress_label, sizeof(progress_label), "%s", label != NULL ? label : "file");
+    progress_total = total;
+    progress_engine = engine;
+    progress_started_ns = statsNow();
+    atomic_store(&progress_done, 0);
+    atomic_store(&progress_active, true);
+    pthread_mutex_unlock(&progress_mutex);
+}
+
+/**
+ * @brief Accounts bytes moved by the copy in progress; called by every copy thread once per chunk.
+ */
+void progressAdd(const off_t bytes) {
+    if (progress_enabled) {
+        atomic_fetch_add_explicit(&progress_done, bytes, memory_order_relaxed);
+    }
+}
+
+/**
+ * @brief Marks the end of the copy in progress, clearing its status line.
+ */
+void progressEnd() {
+    if (!progress_enabled) {
+        return;
+    }
+    pthread_mutex_lock(&progress_mutex);
+    atomic_store(&progress_active, false);
+    if (progress_drawn) {
+        fputs("\r\033[K", stderr);
+        progress_drawn = false;
+    }
+    pthread_mutex_unlock(&progress_mutex);
+}
+
+/**
+ * @brief Reports the progress of the copies until the process exits; the reporting thread.
+ *
+ * @param arg Unused.
+ * @return Never returns.
+ */
+static void *reportProgress(void *arg) {
+    (void) arg;
+    const struct timespec tick = {.tv_sec = 0, .tv_nsec = (long) PROGRESS_TICK_NS};
+    uint64_t last_ns = statsNow();
+    long long last_done = 0;
+    double throughput = 0;
+    while (true) {
+        nanosleep(&tick, NULL);
+        const uint64_t now_ns = statsNow();
+        const bool redraw = progress_live && now_ns - last_ns >= PROGRESS_REDRAW_NS;
+        if (!status_requested && !redraw) {
+            continue;
+        }
+
+        pthread_mutex_lock(&progress_mutex);
+        const long long done = atomic_load(&progress_done);
+        if (!atomic_load(&progress_active)) {
+            throughput = 0;
+        } else if (now_ns > last_ns && done >= last_done) {
+            const double instant = (double) (done - last_done) / ((double) (now_ns - last_ns) / 1e9);
+            throughput = throughput > 0 ? 0.7 * throughput + 0.3 * instant : instant;
+        }
+        last_ns = now_ns;
+        last_done = done;
+
+        char line[PATH_MAX + 128];
+        if (status_requested) {
+            status_requested = false;
+            if (atomic_load(&progress_active)) {
+                formatStatus(line, sizeof(line), throughput);
+                fprintf(stderr, "%sredit: %s\n", progress_drawn ? "\r\033[K" : "", line);
+            } else {
+                fprintf(stderr, "%sredit: no copy in progress.\n", progress_drawn ? "\r\033[K" : "");
+            }
+            progress_drawn = false;
+        }
+        if (redraw && atomic_load(&progress_active) && now_ns - progress_started_ns >= PROGRESS_DELAY_NS) {
+            formatStatus(line, sizeof(line), throughput);
+            fprintf(stderr, "\r\033[K%s", line);
+            progress_drawn = true;
+        }
+        fflush(stderr);
+        pthread_mutex_unlock(&progress_mutex);
+    }
+    return NULL;
+}
+
+/**
+ * @brief Handles `SIGUSR1` by asking the reporting thread for a status line.
+ */
+static void requestStatus(const int signal_number) {
+    (void) signal_number;
+    status_requested = true;
+}
+
+/**
+ * @brief Formats the status of the copy in progress, with the progress mutex held.
+ *
+ * @param line Buffer receiving the status.
+ * @param size Size of `line`.
+ * @param throughput Smoothed throughput, in bytes per second.
+ */
+static void formatStatus(char *line, const size_t size, const double throughput) {
+    const double mb = 1024.0 * 1024.0;
+    const long long done = atomic_load(&progress_done);
+    const double percent = progress_total > 0 ? 100.0 * (double) done / (double) progress_total : 100.0;
+    char eta[32] = "--:--";
+    if (throughput > 0 && progress_total > done) {
+        const long long seconds = (long long) ((double) (progress_total - done) / throughput);
+        if (seconds >= 3600) {
+            snprintf(eta, sizeof(eta), "%lld:%02lld:%02lld", seconds / 3600, seconds / 60 % 60, seconds % 60);
+        } else {
+            snprintf(eta, sizeof(eta), "%02lld:%02lld", seconds / 60, seconds % 60);
+        }
+    }
+    snprintf(line, size, "%s: %.1f of %.1f MB (%.0f%%), %.1f MB/s, ETA %s, %s", progress_label, (double) done / mb,
+             (double) progress_total / mb, percent, throughput / mb, eta, progress_engine);
+}
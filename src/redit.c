@@ -0,0 +1,1482 @@
+#include <errno.h>
+#include <fcntl.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/stat.h>
+#include "../include/redit.h"
+#include "../include/file_operations.h"
+#include "../include/file_utils.h"
+#include "../include/paths_handler.h"
+#include "../include/backup_handler.h"
+#include "../include/baseline_handler.h"
+#include "../include/broker_handler.h"
+#include "../include/compression_handler.h"
+#include "../include/merge_handler.h"
+#include "../include/pristine_handler.h"
+#include "../include/lock_handler.h"
+#include "../include/patch_handler.h"
+#include "../include/progress_handler.h"
+#include "../include/stats_handler.h"
+#include "../include/substitute_handler.h"
+#include "../include/throttle_handler.h"
+#include "../include/tuning_handler.h"
+#include "../include/verify_handler.h"
+#include "../include/window_handler.h"
+
+/**
+ * @file redit.c
+ * @brief Implements the C API of the `redit` library.
+ *
+ * This file implements the copy and overwrite operations (locking, merging, copying,
+ * and restoring ownership and permissions), their windowed variants splicing a range of
+ * lines, substitutions and patches, drift checks of copies, backups and their restoration,
+ * metadata snapshots and path resolution.
+ * Nothing is printed: every outcome is returned as an error code and described in a
+ * `redit_result_t`, so the caller decides what to show.
+ */
+
+/**
+ * @brief Writes the new content of a file being rewritten (see `rewritePrivileged`).
+ */
+typedef int (*rewrite_stream_t)(int src_fd, int dest_fd, const void *context, bool *changed, redit_result_t *result);
+
+// Function prototypes
+static int setFailure(redit_result_t *result, int error_code, const char *step);
+
+static void prepareCopyOptions(const char *src, const char *dest, const redit_options_t *options,
+                               sync_group_t *sync_group, copy_options_t *copy_options, redit_result_t *result);
+
+static int finishOperation(sync_group_t *sync_group, int operation_result, redit_result_t *result);
+
+static int resolveCopyOwner(const redit_options_t *options, uid_t *copy_owner, redit_result_t *result);
+
+static int handOverCopy(const char *copy_file_path, uid_t copy_owner, const copy_options_t *copy_options,
+                        redit_result_t *result);
+
+static copy_options_t deferFullSync(const copy_options_t *copy_options);
+
+static int syncRestored(const char *file_path, const copy_options_t *copy_options, redit_result_t *result);
+
+static int copyLocked(const char *privileged_file_path, const char *copy_file_path, const redit_options_t *options,
+                      const copy_options_t *copy_options, redit_result_t *result);
+
+static int copyWindowLocked(const char *privileged_file_path, const char *copy_file_path,
+                            const redit_options_t *options, const copy_options_t *copy_options,
+                            redit_result_t *result);
+
+static void stampCopy(const char *copy_file_path, const struct stat *prv_stat);
+
+static void detectPrivileged(const char *privileged_file_path, compression_t *compression);
+
+static int expandFile(const char *src, const char *dest, const compression_t *compression,
+                      const copy_options_t *copy_options, off_t *written);
+
+static int compressInto(const char *copy_file_path, const char *privileged_file_path,
+                        const compression_t *compression, const redit_options_t *options,
+                        const copy_options_t *copy_options);
+
+static int saveCompressedBaseline(const char *source_path, const char *copy_file_path,
+                                  const char *privileged_file_path, const compression_t *compression,
+                                  const struct stat *prv_stat);
+
+static bool isOverBaselineSize(const char *copy_file_path);
+
+static int rollBack(const char *privileged_file_path, const redit_options_t *options);
+
+static int overwriteLocked(const char *copy_file_path, const char *privileged_file_path,
+                           const redit_options_t *options, const copy_options_t *copy_options,
+                           redit_result_t *result);
+
+static int overwriteWindowLocked(const char *copy_file_path, const char *privileged_file_path,
+                                 const window_t *window, const redit_options_t *options,
+                                 const copy_options_t *copy_options, redit_result_t *result);
+
+static int copyBrokered(const char *privileged_file_path, const char *copy_file_path,
+                        const redit_options_t *options, const copy_options_t *copy_options, redit_result_t *result);
+
+static int overwriteBrokered(const char *copy_file_path, const char *privileged_file_path,
+                             const redit_options_t *options, const copy_options_t *copy_options,
+                             redit_result_t *result);
+
+static int substituteInto(int src_fd, int dest_fd, const void *context, bool *changed, redit_result_t *result);
+
+static int patchInto(int src_fd, int dest_fd, const void *context, bool *changed, redit_result_t *result);
+
+static int rewritePrivileged(const char *privileged_file_path, stats_phase_t phase, rewrite_stream_t stream,
+                             const void *context, const redit_options_t *options, redit_result_t *result);
+
+/**
+ * @brief Returns the options used by the `redit` executable when no flag is given.
+ *
+ * @return Options with no syncing, buffered I/O, no lock timeout, the copy owned by the
+ *         effective user, the copy removed after overwriting, backups, the pristine-copy
+ *         cache, no broker, the whole file copied, no bandwidth or thread limit,
+ *         resumable large copies and compressed files edited decompressed.
+ */
+redit_options_t reditDefaultOptions() {
+    return (redit_options_t){
+        .sync_mode = SYNC_NONE,
+        .direct_io = false,
+        .recalibrate = false,
+        .lock_timeout = -1,
+        .copy_owner = REDIT_EFFECTIVE_USER,
+        .keep_copy = false,
+        .use_broker = false,
+        .backup = true,
+        .pristine_cache = true,
+        .first_line = 0,
+        .last_line = 0,
+        .verify_write = false,
+        .bandwidth_limit = 0,
+        .max_threads = 0,
+        .resumable = true,
+        .decompress = true
+    };
+}
+
+/**
+ * @brief Records the step that failed in the result.
+ *
+ * @return The input `error_code` for propagation.
+ */
+static int setFailure(redit_result_t *result, const int error_code, const char *step) {
+    result->failed_step = step;
+    return error_code;
+}
+
+/**
+ * @brief Builds the copy options of an operation and tunes them for its file systems.
+ *
+ * @param src Path to the file that will be copied.
+ * @param dest Path to the destination file.
+ * @param options Options of the operation.
+ * @param sync_group Sync group collecting the files written by the operation.
+ * @param copy_options Copy options to fill.
+ * @param result Result receiving the calibration and copy parameters.
+ *
+ * @details
+ * - Direct I/O has its own buffer size, so it is not tuned.
+ * - A failed calibration just keeps the built-in defaults.
+ */
+static void prepareCopyOptions(const char *src, const char *dest, const redit_options_t *options,
+                               sync_group_t *sync_group, copy_options_t *copy_options, redit_result_t *result) {
+    *copy_options = (copy_options_t){
+        .sync_mode = options->sync_mode,
+        .sync_group = sync_group,
+        .direct_io = options->direct_io,
+        .verify_write = options->verify_write,
+        .bandwidth_limit = options->bandwidth_limit,
+        .progress = true
+    };
+
+    statsEnterPhase(STATS_PHASE_TUNING);
+    if (!options->direct_io) {
+        tuneCopyOptions(src, dest, options->recalibrate, copy_options, &result->calibrated_throughput);
+    }
+    if (options->verify_write) {
+        copy_options->engine = COPY_ENGINE_READ_WRITE; // The data must pass through user space to be checksummed
+    }
+    if (options->max_threads > 0 && copy_options->threads > options->max_threads) {
+        copy_options->threads = options->max_threads;
+    }
+    result->engine = getCopyEngineName(copy_options->engine);
+    result->buffer_size = copy_options->buffer_size;
+    result->threads = copy_options->threads;
+}
+
+/**
+ * @brief Flushes the files written by an operation and settles its result.
+ *
+ * @param sync_group Sync group of the operation.
+ * @param operation_result Result of the operation itself.
+ * @param result Result receiving the failed step, if the flush fails.
+ * @return `operation_result`, or the flush error if the operation succeeded but the flush did not.
+ *
+ * @details
+ * - Pending files are flushed also after a failure, since they were written anyway.
+ */
+static int finishOperation(sync_group_t *sync_group, const int operation_result, redit_result_t *result) {
+    statsEnterPhase(STATS_PHASE_SYNC);
+    const int sync_result = flushSyncGroup(sync_group);
+    if (operation_result == SUCCESS && sync_result != SUCCESS) {
+        return setFailure(result, sync_result, "flushing written files");
+    }
+    return operation_result;
+}
+
+/**
+ * @brief Copies a privileged file to a copy file editable by its owner.
+ *
+ * @param privileged_file_path Absolute path to the privileged file.
+ * @param copy_file_path Absolute path to the copy file, created or replaced.
+ * @param options Options of the copy.
+ * @param result Filled with the outcome of the copy.
+ * @return `SUCCESS` if the copy completes successfully, or an error code otherwise.
+ *
+ * @details
+ * - Takes a shared lock on the privileged file for the duration of the copy.
+ * - If the privileged file did not change since an earlier copy of it was cached, the copy is
+ *   cloned from the cache (see `clonePristineCopy`) instead of read from it; a new copy file is
+ *   cached in turn, unless `options->pristine_cache` is unset.
+ * - Stores a baseline snapshot of the copied content for merging on overwrite.
+ * - Gives the copy to `options->copy_owner` and makes it readable and writable by them.
+ * - The copy is flushed according to `options->sync_mode` before returning.
+ * - With `options->decompress` set, a gzip or Zstandard privileged file is decompressed into the
+ *   copy, and its codec and level recorded so the overwrite compresses the copy back.
+ * - With `options->first_line` set, only that range of lines is copied (see `copyWindowLocked`).
+ *   A window of a compressed file is refused unless `options->decompress` is unset, which copies
+ *   lines of its compressed bytes.
+ * - With `options->use_broker`, see `copyBrokered`.
+ */
+int reditCopy(const char *privileged_file_path, const char *copy_file_path, const redit_options_t *options,
+              redit_result_t *result) {
+    *result = (redit_result_t){0};
+    sync_group_t sync_group = {0};
+    copy_options_t copy_options;
+    prepareCopyOptions(privileged_file_path, copy_file_path, options, &sync_group, &copy_options, result);
+
+    int copy_result;
+    if (options->first_line != 0) {
+        // The window record lives in the root-only state directory, out of reach of brokered runs
+        compression_t compression = {.format = COMPRESSION_NONE};
+        if (options->decompress && !options->use_broker) {
+            detectPrivileged(privileged_file_path, &compression);
+        }
+        if (options->use_broker) {
+            copy_result = setFailure(result, ERROR_INVALID_ARGUMENT, "copying a window through the broker");
+        } else if (compression.format != COMPRESSION_NONE) {
+            // Lines are located in the bytes of the file, which would be the compressed ones
+            copy_result = setFailure(result, ERROR_INVALID_ARGUMENT, "copying a window of a compressed file");
+        } else {
+            copy_result = copyWindowLocked(privileged_file_path, copy_file_path, options, &copy_options, result);
+        }
+    } else {
+        copy_result = options->use_broker
+                          ? copyBrokered(privileged_file_path, copy_file_path, options, &copy_options, result)
+                          : copyLocked(privileged_file_path, copy_file_path, options, &copy_options, result);
+    }
+    return finishOperation(&sync_group, copy_result, result);
+}
+
+/**
+ * @brief Resolves who a copy file is for.
+ *
+ * @return `SUCCESS` if the owner was resolved, or an error code otherwise.
+ */
+static int resolveCopyOwner(const redit_options_t *options, uid_t *copy_owner, redit_result_t *result) {
+    statsEnterPhase(STATS_PHASE_IDENTITY);
+    *copy_owner = options->copy_owner;
+    if (*copy_owner == REDIT_EFFECTIVE_USER) {
+        const int uid_result = getEffectiveUserId(copy_owner);
+        if (uid_result != SUCCESS) {
+            return setFailure(result, uid_result, "getting effective user id");
+        }
+    }
+    return SUCCESS;
+}
+
+/**
+ * @brief Hands a copy file over to its owner, with write permissions.
+ *
+ * @return `SUCCESS` if the copy was handed over, or an error code otherwise.
+ *
+ * @details
+ * - In `SYNC_FULL` mode, the copy is flushed here, once it has its owner (see `deferFullSync`).
+ */
+static int handOverCopy(const char *copy_file_path, const uid_t copy_owner, const copy_options_t *copy_options,
+                        redit_result_t *result) {
+    statsEnterPhase(STATS_PHASE_OWNERSHIP);
+    const int chown_result = changeFileOwner(copy_file_path, copy_owner);
+    if (chown_result != SUCCESS) {
+        return setFailure(result, chown_result, "changing file owner");
+    }
+    const int add_perms_result = addFilePermissions(copy_file_path, S_IRUSR | S_IWUSR);
+    if (add_perms_result != SUCCESS) {
+        return setFailure(result, add_perms_result, "adding file permissions");
+    }
+    return syncRestored(copy_file_path, copy_options, result);
+}
+
+/**
+ * @brief Returns the options to write a file whose owner or permissions are set afterwards.
+ *
+ * @details
+ * - `SYNC_FULL` promises that the file is on stable storage as it is left, metadata included, so
+ *   the write is not flushed: `syncRestored` does it once the owner and permissions are set.
+ */
+static copy_options_t deferFullSync(const copy_options_t *copy_options) {
+    copy_options_t write_options = *copy_options;
+    if (write_options.sync_mode == SYNC_FULL) {
+        write_options.sync_mode = SYNC_NONE;
+    }
+    return write_options;
+}
+
+/**
+ * @brief Flushes a file written with `deferFullSync` options, once its owner and permissions are set.
+ *
+ * @return `SUCCESS` if the file was flushed, or did not need to be, or an error code otherwise.
+ */
+static int syncRestored(const char *file_path, const copy_options_t *copy_options, redit_result_t *result) {
+    if (copy_options->sync_mode != SYNC_FULL) {
+        return SUCCESS;
+    }
+    statsEnterPhase(STATS_PHASE_SYNC);
+    const int fd = STATS_SYSCALL(open(file_path, O_RDONLY | O_CLOEXEC));
+    if (fd == -1) {
+        return setFailure(result, ERROR_SYNC_FAILED, "flushing file");
+    }
+    const int sync_result = syncFile(fd, file_path, SYNC_FULL, NULL);
+    STATS_SYSCALL(close(fd));
+    return sync_result == SUCCESS ? SUCCESS : setFailure(result, sync_result, "flushing file");
+}
+
+/**
+ * @brief Performs the copy, taking and releasing the privileged file lock.
+ *
+ * @return `SUCCESS` if the copy completes successfully, or an error code otherwise.
+ */
+static int copyLocked(const char *privileged_file_path, const char *copy_file_path, const redit_options_t *options,
+                      const copy_options_t *copy_options, redit_result_t *result) {
+    uid_t copy_owner;
+    const int owner_result = resolveCopyOwner(options, &copy_owner, result);
+    if (owner_result != SUCCESS) {
+        return owner_result;
+    }
+
+    // Keep concurrent overwrites out while the privileged file is being read
+    statsEnterPhase(STATS_PHASE_LOCK);
+    int lock_fd;
+    const int lock_result = acquireFileLock(privileged_file_path, false, options->lock_timeout, &lock_fd,
+                                            &result->lock_waited);
+    if (lock_result != SUCCESS) {
+        return setFailure(result, lock_result, "locking privileged file");
+    }
+
+    // Record the privileged file metadata before copying, so a change during the copy is detected later
+    statsEnterPhase(STATS_PHASE_IDENTITY);
+    struct stat prv_stat;
+    if (STATS_SYSCALL(stat(privileged_file_path, &prv_stat)) == -1) {
+        releaseFileLock(lock_fd);
+        return setFailure(result, ERROR_FILE_NOT_FOUND, "getting privileged file metadata");
+    }
+
+    // Clone the cached copy of an unchanged privileged file, or copy it to the destination path
+    statsEnterPhase(STATS_PHASE_COPY);
+    const copy_options_t write_options = deferFullSync(copy_options);
+    struct stat copy_stat;
+    const bool copy_existed = STATS_SYSCALL(lstat(copy_file_path, &copy_stat)) == 0;
+    compression_t compression = {.format = COMPRESSION_NONE};
+    if (options->decompress) {
+        detectPrivileged(privileged_file_path, &compression);
+    }
+    if (compression.format != COMPRESSION_NONE) {
+        // The pristine-copy cache holds files as they are, so a decompressed copy is made every time
+        const int expand_result = expandFile(privileged_file_path, copy_file_path, &compression, &write_options,
+                                             &result->bytes);
+        if (expand_result != SUCCESS) {
+            releaseFileLock(lock_fd);
+            return setFailure(result, expand_result, "decompressing file");
+        }
+        result->compression = getCompressionName(compression.format);
+    } else {
+        result->cloned = options->pristine_cache &&
+                         clonePristineCopy(&prv_stat, copy_file_path, &write_options) == SUCCESS;
+        result->bytes = prv_stat.st_size;
+    }
+    if (compression.format == COMPRESSION_NONE && !result->cloned) {
+        copy_options_t resumable_options = write_options;
+        resumable_options.resumable = options->resumable;
+        resumable_options.resumed = &result->resumed_bytes;
+        const int copy_result = copyFile(privileged_file_path, copy_file_path, &resumable_options);
+        if (copy_result != SUCCESS) {
+            if (copy_result == ERROR_VERIFY_FAILED) {
+                STATS_SYSCALL(remove(copy_file_path)); // Not to be edited and written back
+            }
+            releaseFileLock(lock_fd);
+            return setFailure(result, copy_result, "copying file");
+        }
+
+        // Only a copy created just now is sure to be unwritten by anyone else; caching it is not fatal
+        if (options->pristine_cache && !copy_existed) {
+            storePristineCopy(copy_file_path, &prv_stat);
+        }
+    }
+    stampCopy(copy_file_path, &prv_stat);
+
+    // Snapshot the copied content as the merge baseline, replacing any window the copy held
+    // Failing to do so only disables merging on overwrite, so it is not fatal
+    statsEnterPhase(STATS_PHASE_BASELINE);
+    removeWindow(copy_file_path, privileged_file_path);
+    int record_result = SUCCESS;
+    if (compression.format != COMPRESSION_NONE) {
+        record_result = saveCompressedBaseline(copy_file_path, copy_file_path, privileged_file_path, &compression,
+                                               &prv_stat);
+    } else {
+        saveBaseline(copy_file_path, copy_file_path, privileged_file_path, &prv_stat);
+        removeCompression(copy_file_path, privileged_file_path);
+    }
+    result->baseline_skipped = isOverBaselineSize(copy_file_path);
+    releaseFileLock(lock_fd);
+    if (compression.format != COMPRESSION_NONE && record_result != SUCCESS) {
+        STATS_SYSCALL(remove(copy_file_path)); // Without its record, the overwrite would not compress the copy
+        return setFailure(result, record_result, "recording compression");
+    }
+
+    return handOverCopy(copy_file_path, copy_owner, copy_options, result);
+}
+
+/**
+ * @brief Copies a range of lines of the privileged file, taking and releasing its lock.
+ *
+ * @return `SUCCESS` if the copy completes successfully, `ERROR_INVALID_ARGUMENT` if the file
+ *         has fewer than `options->first_line` lines, or another error code otherwise.
+ *
+ * @details
+ * - The range is found through the line index of the privileged file (see `locateLines`), and
+ *   recorded with the state of the file so the overwrite can splice it back.
+ * - Neither the pristine-copy cache nor a merge baseline is used: both hold whole files.
+ */
+static int copyWindowLocked(const char *privileged_file_path, const char *copy_file_path,
+                            const redit_options_t *options, const copy_options_t *copy_options,
+                            redit_result_t *result) {
+    uid_t copy_owner;
+    const int owner_result = resolveCopyOwner(options, &copy_owner, result);
+    if (owner_result != SUCCESS) {
+        return owner_result;
+    }
+
+    statsEnterPhase(STATS_PHASE_LOCK);
+    int lock_fd;
+    const int lock_result = acquireFileLock(privileged_file_path, false, options->lock_timeout, &lock_fd,
+                                            &result->lock_waited);
+    if (lock_result != SUCCESS) {
+        return setFailure(result, lock_result, "locking privileged file");
+    }
+
+    statsEnterPhase(STATS_PHASE_IDENTITY);
+    const int prv_fd = STATS_SYSCALL(open(privileged_file_path, O_RDONLY | O_CLOEXEC));
+    struct stat prv_stat;
+    if (prv_fd == -1 || STATS_SYSCALL(fstat(prv_fd, &prv_stat)) == -1) {
+        if (prv_fd != -1) {
+            close(prv_fd);
+        }
+        releaseFileLock(lock_fd);
+        return setFailure(result, ERROR_FILE_NOT_FOUND, "opening privileged file");
+    }
+
+    // Find the byte range of the lines
+    statsEnterPhase(STATS_PHASE_INDEX);
+    window_t window = {
+        .first_line = options->first_line,
+        .last_line = options->last_line,
+        .device = prv_stat.st_dev,
+        .inode = prv_stat.st_ino,
+        .size = prv_stat.st_size,
+        .modified = prv_stat.st_mtim,
+        .changed = prv_stat.st_ctim
+    };
+    const int locate_result = locateLines(prv_fd, privileged_file_path, &prv_stat, window.first_line,
+                                          window.last_line, &window.offset, &window.length);
+    if (locate_result != SUCCESS) {
+        close(prv_fd);
+        releaseFileLock(lock_fd);
+        return setFailure(result, locate_result, "locating lines");
+    }
+
+    // Copy the range alone
+    statsEnterPhase(STATS_PHASE_COPY);
+    const int copy_fd = STATS_SYSCALL(open(copy_file_path, O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC,
+                                           S_IRUSR | S_IWUSR | S_IRGRP | S_IROTH));
+    if (copy_fd == -1) {
+        close(prv_fd);
+        releaseFileLock(lock_fd);
+        return setFailure(result, errno == EACCES ? ERROR_PERMISSION_DENIED : ERROR_COPY_FAILED, "creating copy file");
+    }
+    int copy_result = copyByteRange(prv_fd, window.offset, copy_fd, 0, window.length);
+    if (copy_result == SUCCESS) {
+        const copy_options_t write_options = deferFullSync(copy_options);
+        copy_result = syncFile(copy_fd, copy_file_path, write_options.sync_mode, write_options.sync_group);
+    }
+    STATS_SYSCALL(close(prv_fd));
+    if (STATS_SYSCALL(close(copy_fd)) == -1 && copy_result == SUCCESS) {
+        copy_result = ERROR_COPY_FAILED;
+    }
+    if (copy_result != SUCCESS) {
+        releaseFileLock(lock_fd);
+        return setFailure(result, copy_result, "copying file");
+    }
+    stampCopy(copy_file_path, &prv_stat);
+    result->bytes = window.length;
+    result->windowed = true;
+    result->window_offset = window.offset;
+    result->window_length = window.length;
+
+    // Record the window in place of a baseline, which would make the overwrite merge the whole file
+    statsEnterPhase(STATS_PHASE_BASELINE);
+    removeBaseline(copy_file_path, privileged_file_path);
+    const int save_result = saveWindow(copy_file_path, privileged_file_path, &window);
+    releaseFileLock(lock_fd);
+    if (save_result != SUCCESS) {
+        STATS_SYSCALL(remove(copy_file_path)); // Without its record, the copy would replace the whole file
+        return setFailure(result, save_result, "recording window");
+    }
+
+    return handOverCopy(copy_file_path, copy_owner, copy_options, result);
+}
+
+/**
+ * @brief Gives a new copy the modification time of the privileged file it was copied from.
+ *
+ * @details
+ * - Until it is edited, the copy keeps that time, which is how `reditVerify` tells it is unedited
+ *   without reading it. Failing to set it only makes `reditVerify` read the copy.
+ */
+static void stampCopy(const char *copy_file_path, const struct stat *prv_stat) {
+    const struct timespec times[2] = {{.tv_nsec = UTIME_OMIT}, prv_stat->st_mtim};
+    STATS_SYSCALL(utimensat(AT_FDCWD, copy_file_path, times, 0));
+}
+
+/**
+ * @brief Tells whether a privileged file is compressed in a format edited decompressed.
+ *
+ * @details
+ * - Best effort: a file that cannot be read here fails the copy right after, as uncompressed.
+ */
+static void detectPrivileged(const char *privileged_file_path, compression_t *compression) {
+    *compression = (compression_t){.format = COMPRESSION_NONE};
+    const int prv_fd = STATS_SYSCALL(open(privileged_file_path, O_RDONLY | O_CLOEXEC));
+    if (prv_fd != -1) {
+        detectCompression(prv_fd, compression);
+        STATS_SYSCALL(close(prv_fd));
+    }
+}
+
+/**
+ * @brief Decompresses a file into another, created or replaced.
+ *
+ * @param src Path to the compressed file.
+ * @param dest Path to the decompressed file.
+ * @param compression Codec of `src`.
+ * @param copy_options Durability of `dest`, or `NULL` for a scratch file that is not flushed.
+ * @param written Set to the size of `dest`, or `NULL`.
+ * @return `SUCCESS` if the file was decompressed, or an error code otherwise.
+ */
+static int expandFile(const char *src, const char *dest, const compression_t *compression,
+                      const copy_options_t *copy_options, off_t *written) {
+    const int src_fd = STATS_SYSCALL(open(src, O_RDONLY | O_CLOEXEC));
+    struct stat src_stat;
+    if (src_fd == -1 || STATS_SYSCALL(fstat(src_fd, &src_stat)) == -1) {
+        const int open_error = errno;
+        if (src_fd != -1) {
+            close(src_fd);
+        }
+        return open_error == EACCES ? ERROR_PERMISSION_DENIED : ERROR_FILE_NOT_FOUND;
+    }
+    const int dest_fd = STATS_SYSCALL(open(dest, O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC,
+                                           S_IRUSR | S_IWUSR | S_IRGRP | S_IROTH));
+    if (dest_fd == -1) {
+        const int open_error = errno;
+        close(src_fd);
+        return open_error == EACCES ? ERROR_PERMISSION_DENIED : ERROR_COPY_FAILED;
+    }
+
+    progressBegin(dest, src_stat.st_size, getCompressionName(compression->format));
+    int expand_result = decompressFile(src_fd, dest_fd, compression->format, NULL, written);
+    progressEnd();
+    if (expand_result == SUCCESS && copy_options != NULL) {
+        expand_result = syncFile(dest_fd, dest, copy_options->sync_mode, copy_options->sync_group);
+    }
+    STATS_SYSCALL(close(src_fd));
+    if (STATS_SYSCALL(close(dest_fd)) == -1 && expand_result == SUCCESS) {
+        expand_result = ERROR_COPY_FAILED;
+    }
+    return expand_result;
+}
+
+/**
+ * @brief Overwrites a compressed privileged file with its decompressed copy, compressed back.
+ *
+ * @return `SUCCESS` if the file was written, `ERROR_VERIFY_FAILED` if it was written but does not
+ *         decompress to the copy, or another error code otherwise.
+ *
+ * @details
+ * - Uses as many threads as the run may use CPUs (`--cpus`), or `options->max_threads`.
+ * - With `options->verify_write`, the written file is flushed, evicted from the page cache and
+ *   decompressed again; its checksum must match the one of the copy.
+ */
+static int compressInto(const char *copy_file_path, const char *privileged_file_path,
+                        const compression_t *compression, const redit_options_t *options,
+                        const copy_options_t *copy_options) {
+    const int copy_fd = STATS_SYSCALL(open(copy_file_path, O_RDONLY | O_CLOEXEC));
+    struct stat copy_stat;
+    if (copy_fd == -1 || STATS_SYSCALL(fstat(copy_fd, &copy_stat)) == -1) {
+        const int open_error = errno;
+        if (copy_fd != -1) {
+            close(copy_fd);
+        }
+        return open_error == EACCES ? ERROR_PERMISSION_DENIED : ERROR_FILE_NOT_FOUND;
+    }
+    const int prv_fd = STATS_SYSCALL(open(privileged_file_path, O_RDWR | O_TRUNC | O_CLOEXEC));
+    if (prv_fd == -1) {
+        const int open_error = errno;
+        close(copy_fd);
+        return open_error == EACCES ? ERROR_PERMISSION_DENIED : ERROR_COPY_FAILED;
+    }
+
+    size_t threads = countCpus();
+    if (options->max_threads > 0 && threads > options->max_threads) {
+        threads = options->max_threads;
+    }
+    uint32_t copy_crc;
+    off_t copy_size;
+    progressBegin(privileged_file_path, copy_stat.st_size, getCompressionName(compression->format));
+    int compress_result = compressFile(copy_fd, prv_fd, compression, threads, &copy_crc, &copy_size);
+    progressEnd();
+
+    // Check that what reached storage decompresses to the copy
+    if (compress_result == SUCCESS && options->verify_write) {
+        uint32_t written_crc;
+        off_t written_size;
+        if (STATS_SYSCALL(fdatasync(prv_fd)) == -1) {
+            compress_result = ERROR_SYNC_FAILED;
+        } else {
+            STATS_SYSCALL(posix_fadvise(prv_fd, 0, 0, POSIX_FADV_DONTNEED));
+            if (decompressFile(prv_fd, -1, compression->format, &written_crc, &written_size) != SUCCESS ||
+                written_crc != copy_crc || written_size != copy_size) {
+                compress_result = ERROR_VERIFY_FAILED;
+            }
+        }
+    }
+    if (compress_result == SUCCESS) {
+        compress_result = syncFile(prv_fd, privileged_file_path, copy_options->sync_mode, copy_options->sync_group);
+    }
+    STATS_SYSCALL(close(copy_fd));
+    if (STATS_SYSCALL(close(prv_fd)) == -1 && compress_result == SUCCESS) {
+        compress_result = ERROR_COPY_FAILED;
+    }
+    return compress_result;
+}
+
+/**
+ * @brief Snapshots the decompressed content of a compressed pair as its baseline, and records the compression.
+ *
+ * @param source_path Path to a file holding the decompressed content of the privileged file.
+ * @param prv_stat Metadata of the privileged file at the time `source_path` matched it.
+ * @return The result of recording the compression; the baseline is best effort, as for other pairs.
+ *
+ * @details
+ * - The baseline size cap applies to the decompressed content, which is what merges read.
+ * - The record keeps the identity of the compressed file, against which later changes are detected.
+ */
+static int saveCompressedBaseline(const char *source_path, const char *copy_file_path,
+                                  const char *privileged_file_path, const compression_t *compression,
+                                  const struct stat *prv_stat) {
+    struct stat content_stat = *prv_stat;
+    struct stat source_stat;
+    if (STATS_SYSCALL(stat(source_path, &source_stat)) == 0) {
+        content_stat.st_size = source_stat.st_size;
+    }
+    saveBaseline(source_path, copy_file_path, privileged_file_path, &content_stat);
+    return saveCompression(copy_file_path, privileged_file_path, compression, prv_stat);
+}
+
+/**
+ * @brief Tells whether a copy is too large for `saveBaseline` to snapshot, so that it will not be merged.
+ */
+static bool isOverBaselineSize(const char *copy_file_path) {
+    struct stat copy_stat;
+    return STATS_SYSCALL(stat(copy_file_path, &copy_stat)) == 0 && copy_stat.st_size > BASELINE_MAX_SIZE;
+}
+
+/**
+ * @brief Overwrites a privileged file with the content of its copy.
+ *
+ * @param copy_file_path Absolute path to the copy file.
+ * @param privileged_file_path Absolute path to the privileged file.
+ * @param options Options of the overwrite.
+ * @param result Filled with the outcome of the overwrite.
+ * @return `SUCCESS` if the overwrite completes successfully, or an error code otherwise.
+ *
+ * @details
+ * - Takes an exclusive lock on the privileged file until its metadata is restored.
+ * - If the privileged file changed since the copy was taken, merges those changes into the copy.
+ *   Conflicting hunks are written to the copy with markers, and `ERROR_MERGE_CONFLICT` is returned
+ *   with their number in `result->conflicts`.
+ * - Backs up the privileged file before replacing it, unless `options->backup` is unset.
+ *   A failed backup is reported in `result->backed_up` but does not stop the overwrite.
+ * - Restores the original owner and permissions of the privileged file.
+ * - A copy holding the decompressed content of the privileged file is compressed back with the
+ *   recorded codec and level, on every available CPU (see `compressFile`).
+ * - Removes the copy file and its baseline unless `options->keep_copy` is set.
+ * - If the copy holds a range of lines, splices it back instead (see `overwriteWindowLocked`).
+ * - With `options->use_broker`, see `overwriteBrokered`.
+ */
+int reditOverwrite(const char *copy_file_path, const char *privileged_file_path, const redit_options_t *options,
+                   redit_result_t *result) {
+    *result = (redit_result_t){0};
+    sync_group_t sync_group = {0};
+    copy_options_t copy_options;
+    prepareCopyOptions(copy_file_path, privileged_file_path, options, &sync_group, &copy_options, result);
+    if (options->use_broker) {
+        const int brokered_result = overwriteBrokered(copy_file_path, privileged_file_path, options, &copy_options,
+                                                      result);
+        return finishOperation(&sync_group, brokered_result, result);
+    }
+
+    // Serialize with other sessions reading or writing the privileged file
+    statsEnterPhase(STATS_PHASE_LOCK);
+    int lock_fd;
+    const int lock_result = acquireFileLock(privileged_file_path, true, options->lock_timeout, &lock_fd,
+                                            &result->lock_waited);
+    if (lock_result != SUCCESS) {
+        return finishOperation(&sync_group, setFailure(result, lock_result, "locking privileged file"), result);
+    }
+
+    window_t window;
+    const int overwrite_result =
+        loadWindow(copy_file_path, privileged_file_path, &window) == SUCCESS
+            ? overwriteWindowLocked(copy_file_path, privileged_file_path, &window, options, &copy_options, result)
+            : overwriteLocked(copy_file_path, privileged_file_path, options, &copy_options, result);
+    releaseFileLock(lock_fd);
+    return finishOperation(&sync_group, overwrite_result, result);
+}
+
+/**
+ * @brief Performs the overwrite while the privileged file lock is held.
+ *
+ * @return `SUCCESS` if the overwrite completes successfully, or an error code otherwise.
+ */
+static int overwriteLocked(const char *copy_file_path, const char *privileged_file_path,
+                           const redit_options_t *options, const copy_options_t *copy_options,
+                           redit_result_t *result) {
+    // Retrieve the owner and permissions of the privileged file
+    statsEnterPhase(STATS_PHASE_IDENTITY);
+    uid_t prv_file_owner;
+    const int own_result = getFileOwner(privileged_file_path, &prv_file_owner);
+    if (own_result != SUCCESS) {
+        return setFailure(result, own_result, "getting file owner");
+    }
+    mode_t prv_file_perms;
+    const int perm_result = getFilePermissions(privileged_file_path, &prv_file_perms);
+    if (perm_result != SUCCESS) {
+        return setFailure(result, perm_result, "getting file permissions");
+    }
+    compression_t compression;
+    bool compressed_changed = false;
+    const bool compressed = loadCompression(copy_file_path, privileged_file_path, &compression,
+                                            &compressed_changed) == SUCCESS;
+    if (compressed) {
+        result->compression = getCompressionName(compression.format);
+    }
+
+    // Merge the changes made to the privileged file since the copy was taken
+    // The baseline of a compressed pair holds decompressed content, so its record tells the change instead
+    statsEnterPhase(STATS_PHASE_MERGE);
+    bool prv_changed = false;
+    const bool has_baseline = checkBaseline(copy_file_path, privileged_file_path, &prv_changed) == SUCCESS;
+    if (compressed) {
+        prv_changed = compressed_changed;
+    }
+    if (has_baseline && prv_changed) {
+        char baseline_path[PATH_MAX];
+        const int base_path_result = getBaselinePath(copy_file_path, privileged_file_path, baseline_path);
+        if (base_path_result != SUCCESS) {
+            return setFailure(result, base_path_result, "getting baseline path");
+        }
+
+        // A compressed privileged file is merged through its decompressed content, next to the baseline
+        char theirs_path[PATH_MAX];
+        const char *theirs = privileged_file_path;
+        if (compressed) {
+            const int written = snprintf(theirs_path, sizeof(theirs_path), "%s.theirs", baseline_path);
+            if (written < 0 || written >= (int) sizeof(theirs_path)) {
+                return setFailure(result, ERROR_PATH_TOO_LONG, "getting baseline path");
+            }
+            const int expand_result = expandFile(privileged_file_path, theirs_path, &compression, NULL, NULL);
+            if (expand_result != SUCCESS) {
+                STATS_SYSCALL(remove(theirs_path));
+                return setFailure(result, expand_result, "decompressing privileged file");
+            }
+            theirs = theirs_path;
+        }
+
+        const int merge_result = mergeFiles(baseline_path, copy_file_path, theirs, copy_file_path,
+                                            &result->conflicts);
+        if (merge_result == SUCCESS) {
+            result->merged = true;
+        }
+
+        if (merge_result == SUCCESS && result->conflicts > 0) {
+            // Rebase the snapshot on the current privileged file, so the resolved copy is not merged twice
+            struct stat prv_stat;
+            if (STATS_SYSCALL(stat(privileged_file_path, &prv_stat)) == 0) {
+                if (compressed) {
+                    saveCompressedBaseline(theirs, copy_file_path, privileged_file_path, &compression, &prv_stat);
+                } else {
+                    saveBaseline(theirs, copy_file_path, privileged_file_path, &prv_stat);
+                }
+            }
+        }
+        if (compressed) {
+            STATS_SYSCALL(remove(theirs_path));
+        }
+        if (merge_result != SUCCESS) {
+            return setFailure(result, merge_result, "merging privileged file changes");
+        }
+        if (result->conflicts > 0) {
+            return setFailure(result, ERROR_MERGE_CONFLICT, "merging privileged file changes");
+        }
+    }
+
+    // Keep the content about to be replaced, so it can be restored later
+    if (options->backup) {
+        statsEnterPhase(STATS_PHASE_BACKUP);
+        result->backed_up = backupFile(privileged_file_path, options->sync_mode != SYNC_NONE,
+                                       &result->backup_bytes) == SUCCESS;
+    }
+
+    // Overwrite the privileged file with the copy file, putting the backup back if it does not read back
+    statsEnterPhase(STATS_PHASE_COPY);
+    const copy_options_t write_options = deferFullSync(copy_options);
+    const int copy_result = compressed
+                                ? compressInto(copy_file_path, privileged_file_path, &compression, options,
+                                               &write_options)
+                                : copyFile(copy_file_path, privileged_file_path, &write_options);
+    if (copy_result == ERROR_VERIFY_FAILED && result->backed_up) {
+        statsEnterPhase(STATS_PHASE_BACKUP);
+        result->rolled_back = rollBack(privileged_file_path, options) == SUCCESS;
+    }
+    if (copy_result != SUCCESS) {
+        return setFailure(result, copy_result, "copying file");
+    }
+    struct stat prv_stat;
+    const bool has_prv_stat = STATS_SYSCALL(stat(privileged_file_path, &prv_stat)) == 0;
+    if (has_prv_stat) {
+        result->bytes = prv_stat.st_size;
+    }
+
+    // Restore the original owner and permissions of the privileged file
+    statsEnterPhase(STATS_PHASE_OWNERSHIP);
+    const int chown_result = changeFileOwner(privileged_file_path, prv_file_owner);
+    if (chown_result != SUCCESS) {
+        return setFailure(result, chown_result, "changing file owner");
+    }
+    const int ovr_perms_result = overwriteFilePermissions(privileged_file_path, prv_file_perms);
+    if (ovr_perms_result != SUCCESS) {
+        return setFailure(result, ovr_perms_result, "overwriting file permissions");
+    }
+    const int sync_result = syncRestored(privileged_file_path, copy_options, result);
+    if (sync_result != SUCCESS) {
+        return sync_result;
+    }
+
+    // Remove the copy, or make the kept copy (now matching the privileged file) the new baseline
+    statsEnterPhase(STATS_PHASE_BASELINE);
+    if (!options->keep_copy) {
+        result->copy_removed = STATS_SYSCALL(remove(copy_file_path)) == 0;
+        removeBaseline(copy_file_path, privileged_file_path);
+        removeCompression(copy_file_path, privileged_file_path);
+    } else if (has_prv_stat && compressed) {
+        saveCompressedBaseline(copy_file_path, copy_file_path, privileged_file_path, &compression, &prv_stat);
+        stampCopy(copy_file_path, &prv_stat); // Unedited again, as far as `reditVerify` can tell
+    } else if (has_prv_stat) {
+        saveBaseline(copy_file_path, copy_file_path, privileged_file_path, &prv_stat);
+    }
+    result->baseline_skipped = options->keep_copy && isOverBaselineSize(copy_file_path);
+    return SUCCESS;
+}
+
+/**
+ * @brief Puts back the version of a privileged file backed up just before it was overwritten.
+ *
+ * @return `SUCCESS` if the version was restored, or an error code otherwise.
+ *
+ * @details
+ * - Used when the overwritten file does not read back as copied; the lock is still held.
+ */
+static int rollBack(const char *privileged_file_path, const redit_options_t *options) {
+    backup_version_t *versions;
+    size_t count;
+    const int list_result = listBackups(privileged_file_path, &versions, &count);
+    if (list_result != SUCCESS || count == 0) {
+        return list_result != SUCCESS ? list_result : ERROR_FILE_NOT_FOUND;
+    }
+    const int prv_fd = STATS_SYSCALL(open(privileged_file_path, O_WRONLY | O_CLOEXEC));
+    int restore_result = prv_fd != -1 ? SUCCESS : ERROR_PERMISSION_DENIED;
+    if (restore_result == SUCCESS) {
+        off_t restored_bytes;
+        restore_result = restoreBackup(privileged_file_path, versions[0].id, prv_fd, &restored_bytes);
+        if (restore_result == SUCCESS && options->sync_mode != SYNC_NONE && STATS_SYSCALL(fdatasync(prv_fd)) == -1) {
+            restore_result = ERROR_SYNC_FAILED;
+        }
+        STATS_SYSCALL(close(prv_fd));
+    }
+    free(versions);
+    return restore_result;
+}
+
+/**
+ * @brief Splices a copied range of lines back into the privileged file, while its lock is held.
+ *
+ * @return `SUCCESS` if the overwrite completes successfully, `ERROR_WINDOW_CHANGED` if the
+ *         privileged file changed since the window was copied, or another error code otherwise.
+ *
+ * @details
+ * - The privileged file is rewritten in place from the window onward (see `spliceRange`), so its
+ *   owner and permissions never change, and only `result->bytes` bytes are written.
+ * - Concurrent changes are refused rather than merged: the window offsets would no longer hold.
+ * - No backup is taken, since backing up hashes the whole file, which is what windows avoid.
+ * - The line index is kept up to the window, so the next window does not rescan the head of the file.
+ */
+static int overwriteWindowLocked(const char *copy_file_path, const char *privileged_file_path,
+                                 const window_t *window, const redit_options_t *options,
+                                 const copy_options_t *copy_options, redit_result_t *result) {
+    statsEnterPhase(STATS_PHASE_IDENTITY);
+    result->windowed = true;
+    result->window_offset = window->offset;
+    result->window_length = window->length;
+    struct stat prv_stat;
+    if (STATS_SYSCALL(stat(privileged_file_path, &prv_stat)) == -1) {
+        return setFailure(result, ERROR_FILE_NOT_FOUND, "getting privileged file metadata");
+    }
+    if (prv_stat.st_dev != window->device || prv_stat.st_ino != window->inode || prv_stat.st_size != window->size ||
+        prv_stat.st_mtim.tv_sec != window->modified.tv_sec || prv_stat.st_mtim.tv_nsec != window->modified.tv_nsec ||
+        prv_stat.st_ctim.tv_sec != window->changed.tv_sec || prv_stat.st_ctim.tv_nsec != window->changed.tv_nsec) {
+        return setFailure(result, ERROR_WINDOW_CHANGED, "checking privileged file");
+    }
+
+    statsEnterPhase(STATS_PHASE_COPY);
+    const int copy_fd = STATS_SYSCALL(open(copy_file_path, O_RDONLY | O_CLOEXEC));
+    struct stat copy_stat;
+    if (copy_fd == -1 || STATS_SYSCALL(fstat(copy_fd, &copy_stat)) == -1) {
+        if (copy_fd != -1) {
+            close(copy_fd);
+        }
+        return setFailure(result, errno == EACCES ? ERROR_PERMISSION_DENIED : ERROR_FILE_NOT_FOUND,
+                          "opening copy file");
+    }
+    const int prv_fd = STATS_SYSCALL(open(privileged_file_path, O_RDWR | O_CLOEXEC));
+    if (prv_fd == -1) {
+        close(copy_fd);
+        return setFailure(result, errno == EACCES ? ERROR_PERMISSION_DENIED : ERROR_FILE_NOT_FOUND,
+                          "opening privileged file");
+    }
+    int splice_result = spliceRange(prv_fd, window->offset, window->length, copy_fd, copy_stat.st_size,
+                                    &result->bytes);
+    if (splice_result == SUCCESS) {
+        splice_result = syncFile(prv_fd, privileged_file_path, copy_options->sync_mode, copy_options->sync_group);
+    }
+    STATS_SYSCALL(close(copy_fd));
+    if (STATS_SYSCALL(close(prv_fd)) == -1 && splice_result == SUCCESS) {
+        splice_result = ERROR_COPY_FAILED;
+    }
+    if (splice_result != SUCCESS) {
+        return setFailure(result, splice_result, "splicing window");
+    }
+
+    // Keep the index up to the window, and the record in step with a kept copy
+    statsEnterPhase(STATS_PHASE_BASELINE);
+    struct stat new_stat;
+    if (STATS_SYSCALL(stat(privileged_file_path, &new_stat)) == -1) {
+        return SUCCESS;
+    }
+    truncateLineIndex(privileged_file_path, &prv_stat, &new_stat, window->offset);
+    if (!options->keep_copy) {
+        result->copy_removed = STATS_SYSCALL(remove(copy_file_path)) == 0;
+        removeWindow(copy_file_path, privileged_file_path);
+    } else {
+        window_t kept = *window;
+        kept.length = copy_stat.st_size;
+        kept.size = new_stat.st_size;
+        kept.modified = new_stat.st_mtim;
+        kept.changed = new_stat.st_ctim;
+        saveWindow(copy_file_path, privileged_file_path, &kept);
+    }
+    return SUCCESS;
+}
+
+/**
+ * @brief Performs the copy on a descriptor received from the `--broker` daemon.
+ *
+ * @return `SUCCESS` if the copy completes successfully, or an error code otherwise.
+ *
+ * @details
+ * - Runs as the user, who receives a descriptor open for reading the privileged file,
+ *   so the copy file is created by (and belongs to) the user; `options->copy_owner` is ignored.
+ * - The lock is taken on the received descriptor, which shares it with sessions locking by path.
+ * - No baseline is stored, since baselines live in a root-only directory, so the overwrite
+ *   of this copy cannot merge concurrent changes.
+ */
+static int copyBrokered(const char *privileged_file_path, const char *copy_file_path,
+                        const redit_options_t *options, const copy_options_t *copy_options, redit_result_t *result) {
+    statsEnterPhase(STATS_PHASE_LOCK);
+    int prv_fd;
+    const int broker_result = requestBrokerFile(BROKER_SOCKET_PATH, privileged_file_path, false, &prv_fd);
+    if (broker_result != SUCCESS) {
+        return setFailure(result, broker_result, "opening privileged file through the broker");
+    }
+    const int lock_result = lockDescriptor(prv_fd, false, options->lock_timeout, &result->lock_waited);
+    if (lock_result != SUCCESS) {
+        close(prv_fd);
+        return setFailure(result, lock_result, "locking privileged file");
+    }
+
+    statsEnterPhase(STATS_PHASE_COPY);
+    const int copy_fd = STATS_SYSCALL(open(copy_file_path, O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC,
+                                           S_IRUSR | S_IWUSR | S_IRGRP | S_IROTH));
+    if (copy_fd == -1) {
+        close(prv_fd);
+        return setFailure(result, errno == EACCES ? ERROR_PERMISSION_DENIED : ERROR_COPY_FAILED, "creating copy file");
+    }
+    const int copy_result = copyDescriptors(prv_fd, copy_fd, copy_file_path, copy_options, &result->bytes);
+    STATS_SYSCALL(close(prv_fd)); // Releases the lock
+    if (STATS_SYSCALL(close(copy_fd)) == -1 && copy_result == SUCCESS) {
+        return setFailure(result, ERROR_COPY_FAILED, "copying file");
+    }
+    if (copy_result != SUCCESS) {
+        return setFailure(result, copy_result, "copying file");
+    }
+
+    // An existing copy keeps its mode, so make sure the user can edit it
+    statsEnterPhase(STATS_PHASE_OWNERSHIP);
+    const int add_perms_result = addFilePermissions(copy_file_path, S_IRUSR | S_IWUSR);
+    if (add_perms_result != SUCCESS) {
+        return setFailure(result, add_perms_result, "adding file permissions");
+    }
+    return SUCCESS;
+}
+
+/**
+ * @brief Performs the overwrite on a descriptor received from the `--broker` daemon.
+ *
+ * @return `SUCCESS` if the overwrite completes successfully, or an error code otherwise.
+ *
+ * @details
+ * - Runs as the user, who receives a descriptor open for writing the privileged file and
+ *   truncates it once the lock is held.
+ * - The privileged file is written in place, so its owner and permissions never change.
+ * - Concurrent changes are not merged (see `copyBrokered`), only serialized by the lock.
+ * - No backup is taken either, since the backup store is root-only too.
+ */
+static int overwriteBrokered(const char *copy_file_path, const char *privileged_file_path,
+                             const redit_options_t *options, const copy_options_t *copy_options,
+                             redit_result_t *result) {
+    if (options->verify_write) {
+        // The broker hands out a write-only descriptor, and there is no backup to roll back to
+        return setFailure(result, ERROR_INVALID_ARGUMENT, "verifying writes through the broker");
+    }
+    statsEnterPhase(STATS_PHASE_LOCK);
+    int prv_fd;
+    const int broker_result = requestBrokerFile(BROKER_SOCKET_PATH, privileged_file_path, true, &prv_fd);
+    if (broker_result != SUCCESS) {
+        return setFailure(result, broker_result, "opening privileged file through the broker");
+    }
+    const int lock_result = lockDescriptor(prv_fd, true, options->lock_timeout, &result->lock_waited);
+    if (lock_result != SUCCESS) {
+        close(prv_fd);
+        return setFailure(result, lock_result, "locking privileged file");
+    }
+
+    statsEnterPhase(STATS_PHASE_COPY);
+    const int copy_fd = STATS_SYSCALL(open(copy_file_path, O_RDONLY | O_CLOEXEC));
+    if (copy_fd == -1) {
+        close(prv_fd);
+        return setFailure(result, errno == EACCES ? ERROR_PERMISSION_DENIED : ERROR_FILE_NOT_FOUND,
+                          "opening copy file");
+    }
+    int copy_result = STATS_SYSCALL(ftruncate(prv_fd, 0)) == 0 ? SUCCESS : ERROR_COPY_FAILED;
+    if (copy_result == SUCCESS) {
+        copy_result = copyDescriptors(copy_fd, prv_fd, privileged_file_path, copy_options, &result->bytes);
+    }
+    STATS_SYSCALL(close(copy_fd));
+    if (STATS_SYSCALL(close(prv_fd)) == -1 && copy_result == SUCCESS) {
+        copy_result = ERROR_COPY_FAILED; // Delayed write errors are reported on close
+    }
+    if (copy_result != SUCCESS) {
+        return setFailure(result, copy_result, "copying file");
+    }
+
+    statsEnterPhase(STATS_PHASE_BASELINE);
+    if (!options->keep_copy) {
+        result->copy_removed = STATS_SYSCALL(remove(copy_file_path)) == 0;
+    }
+    return SUCCESS;
+}
+
+/**
+ * @brief Rewrites a privileged file through a sed-style substitution, without a copy to edit.
+ *
+ * @param privileged_file_path Absolute path to the privileged file.
+ * @param expression Substitution in the `s/regex/replacement/flags` form (see substitute_handler.c).
+ * @param options Options of the overwrite (`keep_copy`, `first_line` and `last_line` are ignored).
+ * @param result Filled with the outcome; `substitutions` is the number of replaced matches.
+ * @return `SUCCESS` if the file was rewritten or nothing matched, `ERROR_INVALID_ARGUMENT` if the
+ *         expression is invalid, or another error code otherwise.
+ *
+ * @details
+ * - The file is streamed once through the substitution by `rewritePrivileged`. If nothing
+ *   matched, the privileged file is not written at all.
+ */
+int reditSubstitute(const char *privileged_file_path, const char *expression, const redit_options_t *options,
+                    redit_result_t *result) {
+    *result = (redit_result_t){0};
+
+    statsEnterPhase(STATS_PHASE_SUBSTITUTE);
+    substitution_t substitution;
+    const int parse_result = parseSubstitution(expression, &substitution);
+    if (parse_result != SUCCESS) {
+        return setFailure(result, parse_result, "parsing substitution");
+    }
+    const int substitute_result = rewritePrivileged(privileged_file_path, STATS_PHASE_SUBSTITUTE, substituteInto,
+                                                    &substitution, options, result);
+    freeSubstitution(&substitution);
+    return substitute_result;
+}
+
+/**
+ * @brief Streams a file through a substitution, as a `rewritePrivileged` stream.
+ *
+ * @param context The `substitution_t` to apply.
+ */
+static int substituteInto(const int src_fd, const int dest_fd, const void *context, bool *changed,
+                          redit_result_t *result) {
+    off_t staged_bytes;
+    const int substitute_result = substituteStream(src_fd, dest_fd, context, &result->substitutions, &staged_bytes);
+    *changed = result->substitutions > 0;
+    return substitute_result != SUCCESS ? setFailure(result, substitute_result, "substituting") : SUCCESS;
+}
+
+/**
+ * @brief Applies a unified diff to a privileged file, without a copy to edit.
+ *
+ * @param privileged_file_path Absolute path to the privileged file.
+ * @param patch_file_path Path to the patch (one file of a `diff -u` or `git diff` output).
+ * @param options Options of the overwrite (`keep_copy`, `first_line` and `last_line` are ignored).
+ * @param result Filled with the outcome; `hunks_*` describe how the hunks were applied.
+ * @return `SUCCESS` if every hunk was applied, `ERROR_PATCH_REJECTED` if some hunk was not found
+ *         (the file is then left unchanged), `ERROR_INVALID_ARGUMENT` if the patch is malformed,
+ *         or another error code otherwise.
+ *
+ * @details
+ * - The file is read once, front to back, by `rewritePrivileged`; the lines between hunks are
+ *   copied by the kernel (see patch_handler.c).
+ */
+int reditPatch(const char *privileged_file_path, const char *patch_file_path, const redit_options_t *options,
+               redit_result_t *result) {
+    *result = (redit_result_t){0};
+
+    statsEnterPhase(STATS_PHASE_PATCH);
+    patch_t patch;
+    const int load_result = loadPatch(patch_file_path, &patch);
+    if (load_result != SUCCESS) {
+        return setFailure(result, load_result, "reading patch");
+    }
+    const int patch_result = rewritePrivileged(privileged_file_path, STATS_PHASE_PATCH, patchInto, &patch, options,
+                                               result);
+    freePatch(&patch);
+    return patch_result;
+}
+
+/**
+ * @brief Applies a patch to a file, as a `rewritePrivileged` stream.
+ *
+ * @param context The `patch_t` to apply.
+ */
+static int patchInto(const int src_fd, const int dest_fd, const void *context, bool *changed,
+                     redit_result_t *result) {
+    patch_report_t report;
+    const int patch_result = applyPatch(src_fd, dest_fd, context, &report);
+    result->hunks_applied = report.applied;
+    result->hunks_moved = report.moved;
+    result->hunks_fuzzed = report.fuzzed;
+    result->hunks_rejected = report.rejected;
+    result->first_rejected_hunk = report.first_rejected;
+    *changed = report.applied > 0;
+    return patch_result != SUCCESS ? setFailure(result, patch_result, "applying patch") : SUCCESS;
+}
+
+/**
+ * @brief Rewrites a privileged file by streaming it into a staged file, then overwriting it.
+ *
+ * @param privileged_file_path Absolute path to the privileged file.
+ * @param phase Phase the stream is accounted in.
+ * @param stream Writes the new content of the file read from `src_fd` to `dest_fd` (from offset 0)
+ *               and sets `changed`, or fails and records the step in the result.
+ * @param context Passed to `stream`.
+ * @param options Options of the overwrite (`keep_copy` is ignored).
+ * @param result Filled with the outcome.
+ * @return `SUCCESS` if the file was rewritten or left unchanged, or an error code otherwise.
+ *
+ * @details
+ * - Holds the exclusive lock on the privileged file from the read to the end of the write, so
+ *   no other session writes to it in between.
+ * - The file is streamed into a hidden file staged next to it, which then goes through the
+ *   overwrite (backup, owner and permissions, sync) and is removed. If the stream fails or
+ *   changes nothing, the staged file is dropped and the privileged file is not written at all.
+ * - The broker is not used: it hands out one descriptor per request, not a directory to stage in.
+ */
+static int rewritePrivileged(const char *privileged_file_path, const stats_phase_t phase, const rewrite_stream_t stream,
+                             const void *context, const redit_options_t *options, redit_result_t *result) {
+    sync_group_t sync_group = {0};
+    if (options->use_broker) {
+        return setFailure(result, ERROR_INVALID_ARGUMENT, "rewriting through the broker");
+    }
+
+    // Stage the result as a hidden file in the same directory
+    char staged_path[PATH_MAX];
+    const char *name = strrchr(privileged_file_path, '/') + 1;
+    const int path_length = snprintf(staged_path, PATH_MAX, "%.*s.%s.redit-XXXXXX",
+                                     (int) (name - privileged_file_path), privileged_file_path, name);
+    if (path_length < 0 || path_length >= PATH_MAX) {
+        return setFailure(result, ERROR_PATH_TOO_LONG, "building staged file path");
+    }
+
+    statsEnterPhase(STATS_PHASE_LOCK);
+    int lock_fd;
+    const int lock_result = acquireFileLock(privileged_file_path, true, options->lock_timeout, &lock_fd,
+                                            &result->lock_waited);
+    if (lock_result != SUCCESS) {
+        return setFailure(result, lock_result, "locking privileged file");
+    }
+
+    statsEnterPhase(phase);
+    int rewrite_result = SUCCESS;
+    bool changed = false;
+    const int prv_fd = STATS_SYSCALL(open(privileged_file_path, O_RDONLY | O_CLOEXEC));
+    if (prv_fd == -1) {
+        rewrite_result = setFailure(result, errno == EACCES ? ERROR_PERMISSION_DENIED : ERROR_FILE_NOT_FOUND,
+                                    "opening privileged file");
+    }
+    const int staged_fd = prv_fd != -1 ? STATS_SYSCALL(mkstemp(staged_path)) : -1;
+    if (prv_fd != -1 && staged_fd == -1) {
+        rewrite_result = setFailure(result, errno == EACCES ? ERROR_PERMISSION_DENIED : ERROR_COPY_FAILED,
+                                    "creating staged file");
+    }
+    if (rewrite_result == SUCCESS) {
+        rewrite_result = stream(prv_fd, staged_fd, context, &changed, result);
+        if (STATS_SYSCALL(close(staged_fd)) == -1 && rewrite_result == SUCCESS) {
+            rewrite_result = setFailure(result, ERROR_COPY_FAILED, "closing staged file");
+        }
+    }
+    if (prv_fd != -1) {
+        STATS_SYSCALL(close(prv_fd));
+    }
+
+    // Write the staged content over the privileged file, unless it is unchanged
+    if (rewrite_result == SUCCESS && changed) {
+        copy_options_t copy_options;
+        prepareCopyOptions(staged_path, privileged_file_path, options, &sync_group, &copy_options, result);
+        redit_options_t overwrite_options = *options;
+        overwrite_options.keep_copy = false;
+        rewrite_result = overwriteLocked(staged_path, privileged_file_path, &overwrite_options, &copy_options,
+                                         result);
+    }
+    if (staged_fd != -1 && !result->copy_removed) {
+        STATS_SYSCALL(unlink(staged_path));
+    }
+    releaseFileLock(lock_fd);
+    return finishOperation(&sync_group, rewrite_result, result);
+}
+
+/**
+ * @brief Checks which copies differ from their privileged files.
+ *
+ * @param pairs Copies and privileged files to check, by absolute path; `changed`, `compared`
+ *              and `error` are set in each.
+ * @param count Number of `pairs`.
+ * @return `SUCCESS` if every pair was checked or failed on its own (see its `error`), or an
+ *         error code otherwise.
+ *
+ * @details
+ * - Pairs are decided on size and modification time when possible (see verify_handler.c);
+ *   the rest are compared across a pool of threads, one per online CPU.
+ * - No lock is taken: the result is a snapshot, to be confirmed by the overwrite that follows.
+ */
+int reditVerify(redit_verify_t *pairs, const size_t count) {
+    statsEnterPhase(STATS_PHASE_VERIFY);
+    verify_pair_t *verify_pairs = malloc((count > 0 ? count : 1) * sizeof(verify_pair_t));
+    if (verify_pairs == NULL) {
+        return ERROR_MEMORY_ALLOCATION;
+    }
+    for (size_t i = 0; i < count; ++i) {
+        verify_pairs[i] = (verify_pair_t){
+            .copy_file_path = pairs[i].copy_file_path,
+            .privileged_file_path = pairs[i].privileged_file_path
+        };
+    }
+    const int verify_result = verifyPairs(verify_pairs, count, 0);
+    for (size_t i = 0; i < count && verify_result == SUCCESS; ++i) {
+        pairs[i].changed = verify_pairs[i].changed;
+        pairs[i].compared = verify_pairs[i].compared;
+        pairs[i].error = verify_pairs[i].error;
+    }
+    free(verify_pairs);
+    return verify_result;
+}
+
+/**
+ * @brief Lists the backed up versions of a privileged file.
+ *
+ * @param privileged_file_path Absolute path to the privileged file.
+ * @param backups Set to an array of versions, newest first, to be freed by the caller.
+ * @param count Set to the number of versions; version `i + 1` of `reditRestore` is `(*backups)[i]`.
+ * @return `SUCCESS` if the versions were listed (possibly none), or an error code otherwise.
+ */
+int reditListBackups(const char *privileged_file_path, redit_backup_t **backups, size_t *count) {
+    *backups = NULL;
+    backup_version_t *versions;
+    const int list_result = listBackups(privileged_file_path, &versions, count);
+    if (list_result != SUCCESS || *count == 0) {
+        return list_result;
+    }
+
+    *backups = malloc(*count * sizeof(redit_backup_t));
+    if (*backups == NULL) {
+        free(versions);
+        *count = 0;
+        return ERROR_MEMORY_ALLOCATION;
+    }
+    for (size_t i = 0; i < *count; ++i) {
+        (*backups)[i] = (redit_backup_t){
+            .created = versions[i].created,
+            .size = versions[i].size,
+            .mode = versions[i].mode,
+            .owner = versions[i].owner,
+            .group = versions[i].group
+        };
+    }
+    free(versions);
+    return SUCCESS;
+}
+
+/**
+ * @brief Restores a backed up version of a privileged file.
+ *
+ * @param privileged_file_path Absolute path to the privileged file.
+ * @param version Version to restore: 1 for the newest, as numbered by `reditListBackups`.
+ * @param options Options of the restore (`sync_mode`, `lock_timeout` and `backup` are used).
+ * @param result Filled with the outcome of the restore; `bytes` is the restored size.
+ * @return `SUCCESS` if the version was restored, `ERROR_INVALID_ARGUMENT` if there is no such
+ *         version, or another error code otherwise.
+ *
+ * @details
+ * - Takes an exclusive lock on the privileged file, like an overwrite.
+ * - The current content is backed up first (unless `options->backup` is unset), so a restore
+ *   can itself be undone; if that backup fails, nothing is restored.
+ * - The file is rewritten in place with the owner, group and permissions of the version.
+ * - The broker is never used: the backup store is only readable by root.
+ */
+int reditRestore(const char *privileged_file_path, const size_t version, const redit_options_t *options,
+                 redit_result_t *result) {
+    *result = (redit_result_t){0};
+    sync_group_t sync_group = {0};
+
+    // Pick the version before anything is backed up, so the numbering matches the listing
+    statsEnterPhase(STATS_PHASE_BACKUP);
+    backup_version_t *versions;
+    size_t count;
+    const int list_result = listBackups(privileged_file_path, &versions, &count);
+    if (list_result != SUCCESS) {
+        return setFailure(result, list_result, "listing backups");
+    }
+    if (version == 0 || version > count) {
+        free(versions);
+        return setFailure(result, ERROR_INVALID_ARGUMENT, "selecting backup version");
+    }
+    char version_id[sizeof(versions[0].id)];
+    strcpy(version_id, versions[version - 1].id);
+    free(versions);
+
+    statsEnterPhase(STATS_PHASE_LOCK);
+    int lock_fd;
+    const int lock_result = acquireFileLock(privileged_file_path, true, options->lock_timeout, &lock_fd,
+                                            &result->lock_waited);
+    if (lock_result != SUCCESS) {
+        return setFailure(result, lock_result, "locking privileged file");
+    }
+
+    int restore_result = SUCCESS;
+    if (options->backup) {
+        statsEnterPhase(STATS_PHASE_BACKUP);
+        restore_result = backupFile(privileged_file_path, options->sync_mode != SYNC_NONE, &result->backup_bytes);
+        result->backed_up = restore_result == SUCCESS;
+        if (restore_result != SUCCESS) {
+            setFailure(result, restore_result, "backing up privileged file");
+        }
+    }
+
+    statsEnterPhase(STATS_PHASE_COPY);
+    if (restore_result == SUCCESS) {
+        const int prv_fd = STATS_SYSCALL(open(privileged_file_path, O_WRONLY | O_CLOEXEC));
+        if (prv_fd == -1) {
+            restore_result = setFailure(result, errno == EACCES ? ERROR_PERMISSION_DENIED : ERROR_FILE_NOT_FOUND,
+                                        "opening privileged file");
+        } else {
+            restore_result = restoreBackup(privileged_file_path, version_id, prv_fd, &result->bytes);
+            if (restore_result == SUCCESS) {
+                restore_result = syncFile(prv_fd, privileged_file_path, options->sync_mode, &sync_group);
+            }
+            if (STATS_SYSCALL(close(prv_fd)) == -1 && restore_result == SUCCESS) {
+                restore_result = ERROR_COPY_FAILED;
+            }
+            if (restore_result != SUCCESS) {
+                setFailure(result, restore_result, "restoring backup");
+            }
+        }
+    }
+    releaseFileLock(lock_fd);
+    return finishOperation(&sync_group, restore_result, result);
+}
+
+/**
+ * @brief Takes a snapshot of the identity, ownership and modification state of a file.
+ *
+ * @param file_path Path to the file.
+ * @param metadata Filled with the metadata of the file.
+ * @return `SUCCESS` if the snapshot was taken, or an error code otherwise.
+ *
+ * @details
+ * - Comparing two snapshots tells whether a file was replaced (device, inode) or modified
+ *   (size, modification and change times) in between.
+ */
+int reditSnapshotMetadata(const char *file_path, redit_metadata_t *metadata) {
+    struct stat file_stat;
+    if (STATS_SYSCALL(stat(file_path, &file_stat)) == -1) {
+        return errno == EACCES ? ERROR_PERMISSION_DENIED : ERROR_FILE_NOT_FOUND;
+    }
+    *metadata = (redit_metadata_t){
+        .device = file_stat.st_dev,
+        .inode = file_stat.st_ino,
+        .owner = file_stat.st_uid,
+        .group = file_stat.st_gid,
+        .mode = file_stat.st_mode,
+        .size = file_stat.st_size,
+        .modified = file_stat.st_mtim,
+        .changed = file_stat.st_ctim
+    };
+    return SUCCESS;
+}
+
+/**
+ * @brief Resolves a path to an absolute path, the way the `redit` executable does.
+ *
+ * @param path Path to resolve. May use `~`, `~user` and `$VARIABLE` prefixes.
+ * @param must_exist Whether the path must exist; symbolic links are then resolved too.
+ * @param resolved_path Buffer to store the resolved absolute path.
+ * @return `SUCCESS` if resolved successfully, or an error code otherwise.
+ */
+int reditResolvePath(const char *path, const bool must_exist, char resolved_path[PATH_MAX]) {
+    if (must_exist) {
+        char expanded_path[PATH_MAX];
+        const int expand_result = getAbsolutePathFuture(path, expanded_path);
+        if (expand_result != SUCCESS) {
+            return expand_result;
+        }
+        return getAbsolutePath(expanded_path, resolved_path);
+    }
+    return getAbsolutePathFuture(path, resolved_path);
+}
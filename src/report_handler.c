@@ -0,0 +1,72 @@
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+
+#include "../include/report_handler.h"
+#include "../include/stats_handler.h"
+
+/**
+ * @file report_handler.c
+ * @brief Prints the per-phase report behind `--stats`.
+ *
+ * The counters are kept by stats_handler.c, which is part of the library; printing them
+ * is left to the executable, so that the library never writes to the terminal.
+ */
+
+/**
+ * @brief Ends the run and prints the per-phase report to `stderr` if `--stats` was given.
+ *
+ * @details
+ * - Ends the run with `statsFinish` first, so the phase times add up to the total and the
+ *   trace file is completed.
+ * - Only phases the run went through are listed. The report goes to `stderr` so it never
+ *   mixes with the copy file path printed on `stdout`.
+ * - Has the `atexit` signature, so every exit path of `main` reports.
+ */
+void printStatsReport() {
+    statsFinish();
+    const stats_format_t format = getStatsFormat();
+    if (format == STATS_OFF) {
+        return;
+    }
+    stats_counters_t phases[STATS_PHASE_COUNT];
+    const double total_ms = (double) statsSnapshot(phases) / 1e6;
+
+    uint64_t total_syscalls = 0, total_read = 0, total_written = 0;
+    for (size_t i = 0; i < STATS_PHASE_COUNT; ++i) {
+        total_syscalls += phases[i].syscalls;
+        total_read += phases[i].bytes_read;
+        total_written += phases[i].bytes_written;
+    }
+
+    if (format == STATS_JSON) {
+        fprintf(stderr, "{\"total_ms\":%.3f,\"syscalls\":%llu,\"bytes_read\":%llu,\"bytes_written\":%llu,\"phases\":[",
+                total_ms, (unsigned long long) total_syscalls, (unsigned long long) total_read,
+                (unsigned long long) total_written);
+        bool first = true;
+        for (size_t i = 0; i < STATS_PHASE_COUNT; ++i) {
+            if (!phases[i].entered) {
+                continue;
+            }
+            fprintf(stderr, "%s{\"phase\":\"%s\",\"ms\":%.3f,\"syscalls\":%llu,\"bytes_read\":%llu,"
+                    "\"bytes_written\":%llu}", first ? "" : ",", getStatsPhaseName(i),
+                    (double) phases[i].elapsed_ns / 1e6, (unsigned long long) phases[i].syscalls,
+                    (unsigned long long) phases[i].bytes_read, (unsigned long long) phases[i].bytes_written);
+            first = false;
+        }
+        fprintf(stderr, "]}\n");
+        return;
+    }
+
+    fprintf(stderr, "%-10s %12s %10s %14s %14s\n", "phase", "time (ms)", "syscalls", "read (B)", "written (B)");
+    for (size_t i = 0; i < STATS_PHASE_COUNT; ++i) {
+        if (!phases[i].entered) {
+            continue;
+        }
+        fprintf(stderr, "%-10s %12.3f %10llu %14llu %14llu\n", getStatsPhaseName(i),
+                (double) phases[i].elapsed_ns / 1e6, (unsigned long long) phases[i].syscalls,
+                (unsigned long long) phases[i].bytes_read, (unsigned long long) phases[i].bytes_written);
+    }
+    fprintf(stderr, "%-10s %12.3f %10llu %14llu %14llu\n", "total", total_ms, (unsigned long long) total_syscalls,
+            (unsigned long long) total_read, (unsigned long long) total_written);
+}
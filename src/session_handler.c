@@ -0,0 +1,581 @@
+#include <errno.h>
+#include <fcntl.h>
+#include <libgen.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include <linux/limits.h>
+#include <sys/file.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+#include "../include/baseline_handler.h"
+#include "../include/compression_handler.h"
+#include "../include/error_handler.h"
+#include "../include/file_utils.h"
+#include "../include/session_handler.h"
+#include "../include/stats_handler.h"
+#include "../include/window_handler.h"
+
+/**
+ * @file session_handler.c
+ * @brief Keeps the index of the copies each user took, keyed by the inode of the copy.
+ *
+ * Every copy records its copy path, its privileged path and the metadata the privileged
+ * file had at that time in a memory-mapped, open-addressing hash table, one per user, in
+ * the root-only state directory: an entry decides which file a root run overwrites, so
+ * users must not be able to forge one. Looking up a copy is one `stat` and a few probes.
+ *
+ * Editors that save by writing a new file and renaming it over the copy give it a new
+ * inode. A copy that misses by inode is then found by path, and its entry moved to the
+ * new inode, so the next lookup is direct again.
+ */
+
+#define SESSION_MAGIC 0x53444552U // "REDS"
+#define SESSION_VERSION 1
+
+/**
+ * @brief One session, as stored in the index.
+ */
+typedef struct {
+    uint64_t device; ///< Device of the copy file.
+    uint64_t inode; ///< Inode of the copy file, 0 for an empty slot (inode numbers start at 1).
+    int64_t created; ///< Wall clock time of the copy, in seconds since the epoch.
+    int64_t prv_size; ///< Size of the privileged file when it was copied.
+    int64_t prv_modified_sec, prv_modified_nsec; ///< Modification time of the privileged file then.
+    char copy_path[SESSION_PATH_SIZE]; ///< Absolute path to the copy file.
+    char privileged_path[SESSION_PATH_SIZE]; ///< Absolute path to the privileged file.
+} session_entry_t;
+
+/**
+ * @brief Header of an index file, followed by `capacity` slots.
+ */
+typedef struct {
+    uint32_t magic; ///< `SESSION_MAGIC`.
+    uint32_t version; ///< `SESSION_VERSION`.
+    uint32_t capacity; ///< Number of slots.
+    uint32_t entry_size; ///< `sizeof(session_entry_t)`.
+    uint64_t count; ///< Number of used slots.
+} session_header_t;
+
+/**
+ * @brief An index mapped by the current run, locked until it is unmapped.
+ */
+typedef struct {
+    int fd; ///< Index file, holding the lock.
+    session_header_t *header; ///< Mapped header.
+    session_entry_t *entries; ///< Mapped slots, following the header.
+} session_index_t;
+
+// Function prototypes
+static int resolveCopyPath(const char *copy_file_path, char resolved_path[PATH_MAX]);
+
+static int mapSessions(bool writable, session_index_t *index);
+
+static void unmapSessions(const session_index_t *index);
+
+static size_t homeSlot(uint64_t device, uint64_t inode);
+
+static long findSlot(const session_index_t *index, const char *copy_file_path, const struct stat *copy_stat);
+
+static void clearSlot(const session_index_t *index, size_t slot);
+
+static void forgetSlot(const session_index_t *index, size_t slot, const session_entry_t *replacement);
+
+static int insertEntry(const session_index_t *index, const session_entry_t *entry);
+
+static bool entryAlive(const session_entry_t *entry, struct stat *copy_stat);
+
+static void pruneSessions(const session_index_t *index);
+
+/**
+ * @brief Remembers which privileged file a copy was taken from.
+ *
+ * @param copy_file_path Absolute path to the copy file, which must exist.
+ * @param privileged_file_path Absolute path to the privileged file.
+ * @return `SUCCESS` if the session was recorded, or an error code otherwise.
+ *
+ * @details
+ * - Replaces any session recorded for the same copy, by inode or by path.
+ * - A full index is first pruned of copies that are gone; `ERROR_BUFFER_TOO_SMALL` if it stays full.
+ * - Paths of `SESSION_PATH_SIZE` bytes or more are not recorded (`ERROR_PATH_TOO_LONG`).
+ */
+int recordSession(const char *copy_file_path, const char *privileged_file_path) {
+    char copy_path[PATH_MAX];
+    const int resolve_result = resolveCopyPath(copy_file_path, copy_path);
+    if (resolve_result != SUCCESS) {
+        return resolve_result;
+    }
+    session_entry_t entry = {0};
+    const int copy_written = snprintf(entry.copy_path, sizeof(entry.copy_path), "%s", copy_path);
+    const int prv_written = snprintf(entry.privileged_path, sizeof(entry.privileged_path), "%s",
+                                     privileged_file_path);
+    if (copy_written < 0 || copy_written >= (int) sizeof(entry.copy_path) || prv_written < 0 ||
+        prv_written >= (int) sizeof(entry.privileged_path)) {
+        return ERROR_PATH_TOO_LONG;
+    }
+
+    struct stat copy_stat, prv_stat;
+    if (STATS_SYSCALL(stat(copy_file_path, &copy_stat)) == -1 ||
+        STATS_SYSCALL(stat(privileged_file_path, &prv_stat)) == -1) {
+        return ERROR_FILE_NOT_FOUND;
+    }
+    entry.device = (uint64_t) copy_stat.st_dev;
+    entry.inode = (uint64_t) copy_stat.st_ino;
+    entry.created = time(NULL);
+    entry.prv_size = prv_stat.st_size;
+    entry.prv_modified_sec = prv_stat.st_mtim.tv_sec;
+    entry.prv_modified_nsec = prv_stat.st_mtim.tv_nsec;
+
+    session_index_t index;
+    const int map_result = mapSessions(true, &index);
+    if (map_result != SUCCESS) {
+        return map_result;
+    }
+
+    // Drop the session of an earlier copy at the same path, then the one of a gone copy this inode was reused from
+    long slot;
+    while ((slot = findSlot(&index, copy_path, NULL)) != -1) {
+        forgetSlot(&index, (size_t) slot, &entry);
+    }
+    const size_t home = homeSlot(entry.device, entry.inode);
+    for (size_t i = home; index.entries[i].inode != 0; i = (i + 1) & (SESSION_CAPACITY - 1)) {
+        if (index.entries[i].device == entry.device && index.entries[i].inode == entry.inode) {
+            forgetSlot(&index, i, &entry);
+            break;
+        }
+    }
+
+    if (index.header->count >= SESSION_MAX_LOAD) {
+        pruneSessions(&index);
+    }
+    const int insert_result = insertEntry(&index, &entry);
+    unmapSessions(&index);
+    return insert_result;
+}
+
+/**
+ * @brief Finds the privileged file a copy was taken from.
+ *
+ * @param copy_file_path Absolute path to the copy file.
+ * @param privileged_file_path Buffer receiving the absolute path to the privileged file.
+ * @return `SUCCESS` if the copy has a session, `ERROR_FILE_NOT_FOUND` if it has none, or another error code.
+ *
+ * @details
+ * - The entry must match both the inode and the path of the copy, so a reused inode is not mistaken for it.
+ * - A copy saved under a new inode is found by path, and its entry moved to the new inode.
+ */
+int findSession(const char *copy_file_path, char privileged_file_path[PATH_MAX]) {
+    char copy_path[PATH_MAX];
+    const int resolve_result = resolveCopyPath(copy_file_path, copy_path);
+    if (resolve_result != SUCCESS) {
+        return resolve_result;
+    }
+    struct stat copy_stat;
+    if (STATS_SYSCALL(stat(copy_path, &copy_stat)) == -1) {
+        return ERROR_FILE_NOT_FOUND;
+    }
+
+    session_index_t index;
+    const int map_result = mapSessions(true, &index);
+    if (map_result != SUCCESS) {
+        return map_result;
+    }
+
+    long slot = findSlot(&index, copy_path, &copy_stat);
+    if (slot == -1) {
+        // Saved under a new inode: look the copy up by path, and key its entry on the new inode
+        slot = findSlot(&index, copy_path, NULL);
+        if (slot != -1) {
+            session_entry_t entry = index.entries[slot];
+            clearSlot(&index, (size_t) slot);
+            entry.device = (uint64_t) copy_stat.st_dev;
+            entry.inode = (uint64_t) copy_stat.st_ino;
+            insertEntry(&index, &entry);
+            slot = findSlot(&index, copy_path, &copy_stat);
+        }
+    }
+    if (slot == -1) {
+        unmapSessions(&index);
+        return ERROR_FILE_NOT_FOUND;
+    }
+    snprintf(privileged_file_path, PATH_MAX, "%s", index.entries[slot].privileged_path);
+    unmapSessions(&index);
+    return SUCCESS;
+}
+
+/**
+ * @brief Forgets the session of a copy, if any.
+ *
+ * @param copy_file_path Absolute path to the copy file, which may be gone already.
+ * @return `SUCCESS` if the copy has no session anymore, or an error code otherwise.
+ */
+int removeSession(const char *copy_file_path) {
+    char copy_path[PATH_MAX];
+    const int resolve_result = resolveCopyPath(copy_file_path, copy_path);
+    if (resolve_result == ERROR_FILE_NOT_FOUND) {
+        snprintf(copy_path, PATH_MAX, "%s", copy_file_path); // Its directory is gone: as recorded, if at all
+    } else if (resolve_result != SUCCESS) {
+        return resolve_result;
+    }
+    session_index_t index;
+    const int map_result = mapSessions(true, &index);
+    if (map_result != SUCCESS) {
+        return map_result == ERROR_FILE_NOT_FOUND ? SUCCESS : map_result;
+    }
+
+    struct stat copy_stat;
+    const bool has_stat = STATS_SYSCALL(stat(copy_path, &copy_stat)) == 0;
+    long slot = has_stat ? findSlot(&index, copy_path, &copy_stat) : -1;
+    if (slot == -1) {
+        slot = findSlot(&index, copy_path, NULL);
+    }
+    if (slot != -1) {
+        clearSlot(&index, (size_t) slot);
+    }
+    unmapSessions(&index);
+    return SUCCESS;
+}
+
+/**
+ * @brief Lists the sessions of the user, oldest first.
+ *
+ * @param sessions Pointer receiving an array of `count` sessions, to be freed by the caller.
+ * @param count Pointer receiving the number of sessions.
+ * @return `SUCCESS` if the sessions were listed (possibly none), or an error code otherwise.
+ */
+int listSessions(session_t **sessions, size_t *count) {
+    *sessions = NULL;
+    *count = 0;
+    session_index_t index;
+    const int map_result = mapSessions(false, &index);
+    if (map_result == ERROR_FILE_NOT_FOUND) {
+        return SUCCESS;
+    }
+    if (map_result != SUCCESS) {
+        return map_result;
+    }
+
+    session_t *list = calloc(index.header->count > 0 ? index.header->count : 1, sizeof(session_t));
+    if (list == NULL) {
+        unmapSessions(&index);
+        return ERROR_MEMORY_ALLOCATION;
+    }
+    size_t n_sessions = 0;
+    for (size_t i = 0; i < SESSION_CAPACITY && n_sessions < index.header->count; ++i) {
+        const session_entry_t *entry = &index.entries[i];
+        if (entry->inode == 0) {
+            continue;
+        }
+        session_t *session = &list[n_sessions++];
+        memcpy(session->copy_file_path, entry->copy_path, sizeof(session->copy_file_path));
+        memcpy(session->privileged_file_path, entry->privileged_path, sizeof(session->privileged_file_path));
+        session->copy_file_path[SESSION_PATH_SIZE - 1] = session->privileged_file_path[SESSION_PATH_SIZE - 1] = '\0';
+        session->created = (time_t) entry->created;
+        session->device = (dev_t) entry->device;
+        session->inode = (ino_t) entry->inode;
+
+        struct stat copy_stat, prv_stat;
+        session->copy_exists = entryAlive(entry, &copy_stat);
+        session->prv_changed = STATS_SYSCALL(stat(entry->privileged_path, &prv_stat)) == -1 ||
+                               prv_stat.st_size != entry->prv_size ||
+                               prv_stat.st_mtim.tv_sec != entry->prv_modified_sec ||
+                               prv_stat.st_mtim.tv_nsec != entry->prv_modified_nsec;
+    }
+    unmapSessions(&index);
+
+    // Slots follow the hash of the inodes; sort by age for the listing
+    for (size_t i = 1; i < n_sessions; ++i) {
+        const session_t session = list[i];
+        size_t j = i;
+        for (; j > 0 && list[j - 1].created > session.created; --j) {
+            list[j] = list[j - 1];
+        }
+        list[j] = session;
+    }
+    *sessions = list;
+    *count = n_sessions;
+    return SUCCESS;
+}
+
+/**
+ * @brief Forgets a session with the state kept for its copy, optionally removing the copy itself.
+ *
+ * @param session Session to discard, as listed by `listSessions`.
+ * @param remove_copy Whether to remove the copy file as well.
+ * @return `SUCCESS` if the session was discarded, `ERROR_INVALID_SOURCE` if the file at the copy
+ *         path is not the recorded copy, `ERROR_SAME_SOURCE` if it is the privileged file, or
+ *         another error code otherwise.
+ *
+ * @details
+ * - The baseline snapshot, window and compression records of the pair go with it.
+ * - The copy is only removed if the file at its path still has the recorded device and inode,
+ *   and is not the privileged file itself. It is unlinked with `unlinkat` on its directory,
+ *   opened with `O_NOFOLLOW`, so a symbolic link swapped in for the directory or the copy never
+ *   leads the removal elsewhere. Otherwise nothing is removed or forgotten.
+ */
+int discardSession(const session_t *session, const bool remove_copy) {
+    if (remove_copy) {
+        char dir_path[PATH_MAX], name_path[PATH_MAX];
+        snprintf(dir_path, sizeof(dir_path), "%s", session->copy_file_path);
+        snprintf(name_path, sizeof(name_path), "%s", session->copy_file_path);
+        const char *name = basename(name_path);
+        const int dir_fd = STATS_SYSCALL(open(dirname(dir_path), O_RDONLY | O_DIRECTORY | O_NOFOLLOW | O_CLOEXEC));
+        if (dir_fd == -1) {
+            return errno == EACCES ? ERROR_PERMISSION_DENIED : ERROR_PATH_INVALID;
+        }
+
+        struct stat copy_stat, prv_stat;
+        int remove_result = SUCCESS;
+        if (STATS_SYSCALL(fstatat(dir_fd, name, &copy_stat, AT_SYMLINK_NOFOLLOW)) == -1) {
+            remove_result = errno == ENOENT ? SUCCESS : ERROR_PATH_INVALID;
+        } else if (!S_ISREG(copy_stat.st_mode) || copy_stat.st_dev != session->device ||
+                   copy_stat.st_ino != session->inode) {
+            remove_result = ERROR_INVALID_SOURCE; // Not the file the copy was recorded as
+        } else if (STATS_SYSCALL(stat(session->privileged_file_path, &prv_stat)) == 0 &&
+                   prv_stat.st_dev == copy_stat.st_dev && prv_stat.st_ino == copy_stat.st_ino) {
+            remove_result = ERROR_SAME_SOURCE;
+        } else if (STATS_SYSCALL(unlinkat(dir_fd, name, 0)) == -1 && errno != ENOENT) {
+            remove_result = errno == EACCES || errno == EPERM ? ERROR_PERMISSION_DENIED : ERROR_PATH_INVALID;
+        }
+        close(dir_fd);
+        if (remove_result != SUCCESS) {
+            return remove_result;
+        }
+    }
+    removeBaseline(session->copy_file_path, session->privileged_file_path);
+    removeWindow(session->copy_file_path, session->privileged_file_path);
+    removeCompression(session->copy_file_path, session->privileged_file_path);
+    return removeSession(session->copy_file_path);
+}
+
+/**
+ * @brief Resolves the directory of a copy file, which may be gone, so every run names the copy alike.
+ *
+ * @param copy_file_path Path to the copy file.
+ * @param resolved_path Buffer receiving the real path of its directory, followed by its name.
+ * @return `SUCCESS` if the path was resolved, or an error code otherwise.
+ */
+static int resolveCopyPath(const char *copy_file_path, char resolved_path[PATH_MAX]) {
+    char dir_path[PATH_MAX], name_path[PATH_MAX], real_dir[PATH_MAX];
+    snprintf(dir_path, sizeof(dir_path), "%s", copy_file_path);
+    snprintf(name_path, sizeof(name_path), "%s", copy_file_path);
+    if (STATS_SYSCALL(realpath(dirname(dir_path), real_dir)) == NULL) {
+        return errno == ENOENT ? ERROR_FILE_NOT_FOUND : ERROR_RESOLVING_PATH;
+    }
+    const int written = snprintf(resolved_path, PATH_MAX, "%s/%s", strcmp(real_dir, "/") == 0 ? "" : real_dir,
+                                 basename(name_path));
+    if (written < 0 || written >= PATH_MAX) {
+        return ERROR_PATH_TOO_LONG;
+    }
+    return SUCCESS;
+}
+
+/**
+ * @brief Maps and locks the index of the user, creating and initializing it if needed.
+ *
+ * @param writable Whether the index will be changed. A read-only index is never created.
+ * @param index Index to fill; release it with `unmapSessions`.
+ * @return `SUCCESS`, `ERROR_FILE_NOT_FOUND` if there is no index to read, or another error code.
+ *
+ * @details
+ * - The lock is held until the index is unmapped: shared for reading, exclusive for writing.
+ */
+static int mapSessions(const bool writable, session_index_t *index) {
+    uid_t ef_uid;
+    const int uid_result = getEffectiveUserId(&ef_uid);
+    if (uid_result != SUCCESS) {
+        return uid_result;
+    }
+    char index_path[PATH_MAX];
+    const int written = snprintf(index_path, sizeof(index_path), "%s/%u", SESSION_DIR, (unsigned) ef_uid);
+    if (written < 0 || written >= (int) sizeof(index_path)) {
+        return ERROR_PATH_TOO_LONG;
+    }
+
+    // Create the state directories if they don't exist
+    if (writable && mkdir(REDIT_STATE_DIR, 0755) == -1 && errno != EEXIST) {
+        return errno == EACCES ? ERROR_PERMISSION_DENIED : ERROR_PATH_INVALID;
+    }
+    if (writable && mkdir(SESSION_DIR, 0700) == -1 && errno != EEXIST) {
+        return errno == EACCES ? ERROR_PERMISSION_DENIED : ERROR_PATH_INVALID;
+    }
+
+    index->fd = writable
+                    ? STATS_SYSCALL(open(index_path, O_RDWR | O_CREAT | O_CLOEXEC, S_IRUSR | S_IWUSR))
+                    : STATS_SYSCALL(open(index_path, O_RDONLY | O_CLOEXEC));
+    if (index->fd == -1) {
+        return errno == ENOENT ? ERROR_FILE_NOT_FOUND : ERROR_PERMISSION_DENIED;
+    }
+    flock(index->fd, writable ? LOCK_EX : LOCK_SH);
+
+    // The index is sparse: only the slots in use take up disk space
+    const size_t file_size = sizeof(session_header_t) + SESSION_CAPACITY * sizeof(session_entry_t);
+    struct stat file_stat;
+    if (STATS_SYSCALL(fstat(index->fd, &file_stat)) == -1 ||
+        (file_stat.st_size < (off_t) file_size &&
+         (!writable || STATS_SYSCALL(ftruncate(index->fd, (off_t) file_size)) == -1))) {
+        STATS_SYSCALL(close(index->fd));
+        return writable ? ERROR_PERMISSION_DENIED : ERROR_FILE_NOT_FOUND;
+    }
+
+    void *map = mmap(NULL, file_size, writable ? PROT_READ | PROT_WRITE : PROT_READ, MAP_SHARED, index->fd, 0);
+    if (map == MAP_FAILED) {
+        STATS_SYSCALL(close(index->fd));
+        return ERROR_MEMORY_ALLOCATION;
+    }
+    index->header = map;
+    index->entries = (session_entry_t *) (index->header + 1);
+
+    const bool valid = index->header->magic == SESSION_MAGIC && index->header->version == SESSION_VERSION &&
+                       index->header->capacity == SESSION_CAPACITY &&
+                       index->header->entry_size == sizeof(session_entry_t);
+    if (!valid && writable) {
+        // New or incompatible index: start over
+        memset(map, 0, file_size);
+        index->header->magic = SESSION_MAGIC;
+        index->header->version = SESSION_VERSION;
+        index->header->capacity = SESSION_CAPACITY;
+        index->header->entry_size = sizeof(session_entry_t);
+    } else if (!valid) {
+        unmapSessions(index);
+        return ERROR_FILE_NOT_FOUND;
+    }
+    return SUCCESS;
+}
+
+/**
+ * @brief Unmaps an index, releasing its lock.
+ */
+static void unmapSessions(const session_index_t *index) {
+    munmap(index->header, sizeof(session_header_t) + SESSION_CAPACITY * sizeof(session_entry_t));
+    STATS_SYSCALL(close(index->fd));
+}
+
+/**
+ * @brief Returns the slot a copy is first looked up in, from its device and inode.
+ *
+ * @details
+ * - Inode numbers are often sequential, so they are mixed (MurmurHash3 finalizer) before taking the low bits.
+ */
+static size_t homeSlot(const uint64_t device, const uint64_t inode) {
+    uint64_t hash = inode ^ (device * 0x9E3779B97F4A7C15ULL);
+    hash ^= hash >> 33;
+    hash *= 0xFF51AFD7ED558CCDULL;
+    hash ^= hash >> 33;
+    return (size_t) (hash & (SESSION_CAPACITY - 1));
+}
+
+/**
+ * @brief Finds the slot of a copy.
+ *
+ * @param index Mapped index.
+ * @param copy_file_path Absolute path to the copy file.
+ * @param copy_stat Metadata of the copy file to probe by inode, or `NULL` to scan every slot by path.
+ * @return The slot of the copy, or -1 if it has none.
+ */
+static long findSlot(const session_index_t *index, const char *copy_file_path, const struct stat *copy_stat) {
+    if (copy_stat == NULL) {
+        for (size_t i = 0; i < SESSION_CAPACITY; ++i) {
+            if (index->entries[i].inode != 0 &&
+                strncmp(index->entries[i].copy_path, copy_file_path, SESSION_PATH_SIZE) == 0) {
+                return (long) i;
+            }
+        }
+        return -1;
+    }
+
+    const uint64_t device = (uint64_t) copy_stat->st_dev, inode = (uint64_t) copy_stat->st_ino;
+    for (size_t i = homeSlot(device, inode), probes = 0; index->entries[i].inode != 0 && probes < SESSION_CAPACITY;
+         i = (i + 1) & (SESSION_CAPACITY - 1), ++probes) {
+        const session_entry_t *entry = &index->entries[i];
+        if (entry->device == device && entry->inode == inode &&
+            strncmp(entry->copy_path, copy_file_path, SESSION_PATH_SIZE) == 0) {
+            return (long) i;
+        }
+    }
+    return -1;
+}
+
+/**
+ * @brief Empties a slot, moving later entries of its probe run back so lookups need no tombstones.
+ */
+static void clearSlot(const session_index_t *index, const size_t slot) {
+    const size_t mask = SESSION_CAPACITY - 1;
+    size_t hole = slot;
+    for (size_t next = (hole + 1) & mask; index->entries[next].inode != 0; next = (next + 1) & mask) {
+        // An entry may fill the hole if the hole lies between its home slot and where it sits
+        const size_t home = homeSlot(index->entries[next].device, index->entries[next].inode);
+        if (((next - home) & mask) >= ((next - hole) & mask)) {
+            index->entries[hole] = index->entries[next];
+            hole = next;
+        }
+    }
+    memset(&index->entries[hole], 0, sizeof(session_entry_t));
+    index->header->count--;
+}
+
+/**
+ * @brief Empties a slot along with the state kept for its copy, unless the replacing entry is the same pair.
+ *
+ * @param index Mapped index.
+ * @param slot Slot to empty.
+ * @param replacement Entry about to be recorded, whose baseline the copy just saved, or `NULL`.
+ */
+static void forgetSlot(const session_index_t *index, const size_t slot, const session_entry_t *replacement) {
+    const session_entry_t *entry = &index->entries[slot];
+    if (replacement == NULL || strncmp(entry->copy_path, replacement->copy_path, SESSION_PATH_SIZE) != 0 ||
+        strncmp(entry->privileged_path, replacement->privileged_path, SESSION_PATH_SIZE) != 0) {
+        removeBaseline(entry->copy_path, entry->privileged_path);
+        removeWindow(entry->copy_path, entry->privileged_path);
+        removeCompression(entry->copy_path, entry->privileged_path);
+    }
+    clearSlot(index, slot);
+}
+
+/**
+ * @brief Stores an entry in the first free slot from its home slot.
+ *
+ * @return `SUCCESS`, or `ERROR_BUFFER_TOO_SMALL` if the index is full.
+ */
+static int insertEntry(const session_index_t *index, const session_entry_t *entry) {
+    if (index->header->count >= SESSION_MAX_LOAD) {
+        return ERROR_BUFFER_TOO_SMALL;
+    }
+    size_t slot = homeSlot(entry->device, entry->inode);
+    while (index->entries[slot].inode != 0) {
+        slot = (slot + 1) & (SESSION_CAPACITY - 1);
+    }
+    index->entries[slot] = *entry;
+    index->header->count++;
+    return SUCCESS;
+}
+
+/**
+ * @brief Tells whether the copy of an entry is still there.
+ *
+ * @param entry Entry of the copy.
+ * @param copy_stat Receives the metadata of the copy file.
+ * @return `true` if a regular file is at the copy path, under the recorded inode or a new one.
+ */
+static bool entryAlive(const session_entry_t *entry, struct stat *copy_stat) {
+    return STATS_SYSCALL(stat(entry->copy_path, copy_stat)) == 0 && S_ISREG(copy_stat->st_mode);
+}
+
+/**
+ * @brief Forgets the sessions whose copy is gone, with the state kept for them.
+ */
+static void pruneSessions(const session_index_t *index) {
+    for (size_t i = 0; i < SESSION_CAPACITY;) {
+        const session_entry_t *entry = &index->entries[i];
+        struct stat copy_stat;
+        if (entry->inode == 0 || entryAlive(entry, &copy_stat)) {
+            ++i;
+            continue;
+        }
+        forgetSlot(index, i, NULL); // May move a later entry into slot i, which is checked next
+    }
+}
@@ -0,0 +1,224 @@
+#define _GNU_SOURCE // copy_file_range
+
+#include <stdatomic.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "../include/error_handler.h"
+#include "../include/stats_handler.h"
+#include "../include/trace_handler.h"
+
+/**
+ * @file stats_handler.c
+ * @brief Implements the per-phase accounting behind `--stats`.
+ *
+ * The run is a sequence of phases switched by the main thread. Time is measured with
+ * the monotonic clock between switches, so every nanosecond of the run belongs to
+ * exactly one phase. System calls and bytes are counted by thin wrappers around the
+ * I/O calls; copy threads may run them concurrently, hence the atomic counters.
+ * Counting is skipped entirely unless `--stats` was given. Phases and I/O calls are
+ * also recorded as spans when `--trace` is given.
+ */
+
+/**
+ * @brief Counters of a single phase.
+ */
+typedef struct {
+    uint64_t elapsed_ns; ///< Time spent in the phase.
+    bool entered; ///< Whether the run went through the phase.
+    atomic_uint_fast64_t syscalls; ///< System calls made.
+    atomic_uint_fast64_t bytes_read; ///< Bytes read from files.
+    atomic_uint_fast64_t bytes_written; ///< Bytes written to files.
+} phase_stats_t;
+
+static const char *PHASE_NAMES[STATS_PHASE_COUNT] = {
+    "flags", "paths", "tuning", "identity", "lock", "merge", "copy", "baseline", "ownership", "sync", "editor",
+    "backup", "index", "substitute", "patch", "verify"
+};
+
+static stats_format_t stats_format = STATS_OFF; // Report format, STATS_OFF while disabled
+static stats_phase_t current_phase = STATS_PHASE_FLAGS; // Phase being accounted
+static uint64_t run_start_ns; // Start of the run
+static uint64_t phase_start_ns; // Start of the current phase
+static phase_stats_t phases[STATS_PHASE_COUNT];
+
+/**
+ * @brief Reads the monotonic clock in nanoseconds.
+ *
+ * @details
+ * - Unlike `traceNow`, reads the clock whether or not the run is accounted or traced.
+ */
+uint64_t statsNow() {
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return (uint64_t) now.tv_sec * 1000000000ULL + (uint64_t) now.tv_nsec;
+}
+
+/**
+ * @brief Parses the value of the `--stats` flag.
+ *
+ * @param value The flag value (`table` or `json`), or `NULL` for the table.
+ * @param format Pointer to a variable where the parsed format will be stored.
+ * @return `SUCCESS` if the value is valid, or `ERROR_INVALID_ARGUMENT` otherwise.
+ */
+int parseStatsFormat(const char *value, stats_format_t *format) {
+    if (value == NULL || strcmp(value, "table") == 0) {
+        *format = STATS_TABLE;
+    } else if (strcmp(value, "json") == 0) {
+        *format = STATS_JSON;
+    } else {
+        return ERROR_INVALID_ARGUMENT;
+    }
+    return SUCCESS;
+}
+
+/**
+ * @brief Marks the start of the run. Must be called before anything else.
+ */
+void statsStart() {
+    run_start_ns = statsNow();
+    phase_start_ns = run_start_ns;
+    current_phase = STATS_PHASE_FLAGS;
+    phases[current_phase].entered = true;
+}
+
+/**
+ * @brief Turns on system call and byte accounting and selects the report format.
+ *
+ * @param format Format of the report printed by `printStatsReport`.
+ */
+void statsEnable(const stats_format_t format) {
+    stats_format = format;
+}
+
+/**
+ * @brief Closes the current phase and starts accounting another one.
+ *
+ * @param phase The phase the run enters.
+ * @return The phase that was current, so a nested step can switch back to it.
+ *
+ * @details
+ * - A phase may be entered several times; its counters accumulate.
+ * - Must only be called from the main thread, while no copy threads are running.
+ */
+stats_phase_t statsEnterPhase(const stats_phase_t phase) {
+    const stats_phase_t previous = current_phase;
+    traceSpan("phase", PHASE_NAMES[current_phase], phase_start_ns, NULL, -1);
+    const uint64_t now = statsNow();
+    phases[current_phase].elapsed_ns += now - phase_start_ns;
+    phase_start_ns = now;
+    current_phase = phase;
+    phases[phase].entered = true;
+    return previous;
+}
+
+/**
+ * @brief Counts one system call in the current phase.
+ */
+void statsCountSyscall() {
+    if (stats_format != STATS_OFF) {
+        atomic_fetch_add_explicit(&phases[current_phase].syscalls, 1, memory_order_relaxed);
+    }
+}
+
+/**
+ * @brief Adds transferred bytes to the current phase.
+ */
+static void countBytes(atomic_uint_fast64_t *counter, const ssize_t count) {
+    if (stats_format != STATS_OFF && count > 0) {
+        atomic_fetch_add_explicit(counter, (uint64_t) count, memory_order_relaxed);
+    }
+}
+
+/**
+ * @brief `pread` that accounts the call and the bytes read.
+ */
+ssize_t statsPread(const int fd, void *buffer, const size_t count, const off_t offset) {
+    statsCountSyscall();
+    const uint64_t start_ns = traceNow();
+    const ssize_t result = pread(fd, buffer, count, offset);
+    traceSpan("io", "pread", start_ns, NULL, result);
+    countBytes(&phases[current_phase].bytes_read, result);
+    return result;
+}
+
+/**
+ * @brief `pwrite` that accounts the call and the bytes written.
+ */
+ssize_t statsPwrite(const int fd, const void *buffer, const size_t count, const off_t offset) {
+    statsCountSyscall();
+    const uint64_t start_ns = traceNow();
+    const ssize_t result = pwrite(fd, buffer, count, offset);
+    traceSpan("io", "pwrite", start_ns, NULL, result);
+    countBytes(&phases[current_phase].bytes_written, result);
+    return result;
+}
+
+/**
+ * @brief `copy_file_range` that accounts the call, and the bytes as both read and written.
+ */
+ssize_t statsCopyFileRange(const int fd_in, off_t *off_in, const int fd_out, off_t *off_out, const size_t length,
+                           const unsigned int flags) {
+    statsCountSyscall();
+    const uint64_t start_ns = traceNow();
+    const ssize_t result = copy_file_range(fd_in, off_in, fd_out, off_out, length, flags);
+    traceSpan("io", "copy_file_range", start_ns, NULL, result);
+    countBytes(&phases[current_phase].bytes_read, result);
+    countBytes(&phases[current_phase].bytes_written, result);
+    return result;
+}
+
+/**
+ * @brief Reads what the run has spent so far in each phase.
+ *
+ * @param counters Array receiving the counters of each phase.
+ * @return The time elapsed since the start of the run, in nanoseconds.
+ *
+ * @details
+ * - Closes the current phase first, so the phase times add up to the total. Time spent
+ *   afterwards keeps being accounted to the same phase.
+ */
+uint64_t statsSnapshot(stats_counters_t counters[STATS_PHASE_COUNT]) {
+    statsEnterPhase(current_phase);
+    for (size_t i = 0; i < STATS_PHASE_COUNT; ++i) {
+        counters[i] = (stats_counters_t) {
+            .elapsed_ns = phases[i].elapsed_ns,
+            .entered = phases[i].entered,
+            .syscalls = atomic_load(&phases[i].syscalls),
+            .bytes_read = atomic_load(&phases[i].bytes_read),
+            .bytes_written = atomic_load(&phases[i].bytes_written),
+        };
+    }
+    return phase_start_ns - run_start_ns;
+}
+
+/**
+ * @brief Returns the report format selected by `statsEnable`, or `STATS_OFF`.
+ */
+stats_format_t getStatsFormat() {
+    return stats_format;
+}
+
+/**
+ * @brief Returns the printable name of a phase.
+ *
+ * @param phase The phase.
+ * @return A static string naming the phase.
+ */
+const char *getStatsPhaseName(const stats_phase_t phase) {
+    return phase < STATS_PHASE_COUNT ? PHASE_NAMES[phase] : "unknown";
+}
+
+/**
+ * @brief Ends the run: closes the current phase, and completes the trace file if `--trace` was given.
+ *
+ * @details
+ * - Has the `atexit` signature; the `--stats` report is printed by `printStatsReport`, which calls it.
+ */
+void statsFinish() {
+    statsEnterPhase(current_phase);
+    traceClose();
+}
@@ -0,0 +1,478 @@
+#define _GNU_SOURCE // memrchr, memmem and REG_STARTEND
+
+#include <ctype.h>
+#include <fcntl.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#if defined(__SSE2__)
+#include <immintrin.h>
+#endif
+
+#include "../include/error_handler.h"
+#include "../include/stats_handler.h"
+#include "../include/trace_handler.h"
+#include "../include/substitute_handler.h"
+
+/**
+ * @file substitute_handler.c
+ * @brief Streams a file through a sed-style substitution.
+ *
+ * The expression is `s/regex/replacement/flags`, with any delimiter in place of `/`. The
+ * regex is a POSIX extended regular expression (as with `sed -E`) matched against each line
+ * without its newline; in the replacement, `&` stands for the match, `\1` to `\9` for its
+ * groups and `\n` for a newline. The flags are `g` (every match of a line) and `i` (ignore case).
+ *
+ * Most lines of a configuration file do not match. Before compiling the regex, the longest
+ * literal that every match must contain is extracted from it (e.g. "Listen " out of
+ * `^Listen .*`); the input is then searched for that literal 16 bytes at a time, and only the
+ * lines containing it are handed to `regexec`. Everything in between is copied as is.
+ */
+
+#define MAX_GROUPS 10 // Match and group references \1 to \9
+
+/**
+ * @brief Buffered output of a substitution.
+ */
+typedef struct {
+    int fd; ///< Destination descriptor.
+    char *buffer; ///< Pending bytes.
+    size_t used; ///< Pending bytes in `buffer`.
+    off_t written; ///< Bytes written to `fd` so far.
+    int error; ///< First error met, `SUCCESS` if none.
+} output_t;
+
+// Function prototypes
+static const char *readPart(const char *cursor, char delimiter, char **part);
+
+static void extractLiteral(const char *pattern, substitution_t *substitution);
+
+static const char *findLiteral(const char *haystack, size_t length, const char *needle, size_t needle_length);
+
+static size_t substituteLine(const substitution_t *substitution, const char *line, size_t length, output_t *output);
+
+static void emit(output_t *output, const char *data, size_t length);
+
+static void flushOutput(output_t *output);
+
+/**
+ * @brief Parses and compiles a substitution expression.
+ *
+ * @param expression Expression in the `s/regex/replacement/flags` form.
+ * @param substitution Filled with the compiled substitution, to be released with `freeSubstitution`.
+ * @return `SUCCESS` if the expression is valid, `ERROR_INVALID_ARGUMENT` if it is malformed, its
+ *         regex does not compile or its replacement refers to a missing group, or another error code.
+ */
+int parseSubstitution(const char *expression, substitution_t *substitution) {
+    *substitution = (substitution_t){0};
+    if (expression == NULL || expression[0] != 's' || expression[1] == '\0' || expression[1] == '\\' ||
+        expression[1] == '\n') {
+        return ERROR_INVALID_ARGUMENT;
+    }
+    const char delimiter = expression[1];
+
+    char *pattern = NULL;
+    const char *cursor = readPart(expression + 2, delimiter, &pattern);
+    if (cursor == NULL) {
+        const int parse_result = pattern == NULL ? ERROR_MEMORY_ALLOCATION : ERROR_INVALID_ARGUMENT;
+        free(pattern);
+        return parse_result;
+    }
+    cursor = readPart(cursor, delimiter, &substitution->replacement);
+    if (cursor == NULL) {
+        free(pattern);
+        const int parse_result = substitution->replacement == NULL ? ERROR_MEMORY_ALLOCATION : ERROR_INVALID_ARGUMENT;
+        free(substitution->replacement);
+        substitution->replacement = NULL;
+        return parse_result;
+    }
+
+    int regex_flags = REG_EXTENDED;
+    for (; *cursor != '\0'; ++cursor) {
+        if (*cursor == 'g') {
+            substitution->global = true;
+        } else if (*cursor == 'i' || *cursor == 'I') {
+            regex_flags |= REG_ICASE;
+        } else {
+            free(pattern);
+            free(substitution->replacement);
+            substitution->replacement = NULL;
+            return ERROR_INVALID_ARGUMENT;
+        }
+    }
+
+    // Case-insensitive matches may not contain the literal as written, so no line is skipped then
+    if (!(regex_flags & REG_ICASE)) {
+        extractLiteral(pattern, substitution);
+    }
+    const int compile_result = regcomp(&substitution->regex, pattern, regex_flags);
+    free(pattern);
+    if (compile_result != 0) {
+        free(substitution->replacement);
+        substitution->replacement = NULL;
+        return compile_result == REG_ESPACE ? ERROR_MEMORY_ALLOCATION : ERROR_INVALID_ARGUMENT;
+    }
+
+    // Group references must name groups of the regex
+    for (const char *r = substitution->replacement; *r != '\0'; ++r) {
+        if (*r == '\\' && r[1] != '\0') {
+            ++r;
+            if (*r >= '1' && *r <= '9' && (size_t) (*r - '0') > substitution->regex.re_nsub) {
+                freeSubstitution(substitution);
+                return ERROR_INVALID_ARGUMENT;
+            }
+        }
+    }
+    return SUCCESS;
+}
+
+/**
+ * @brief Releases a compiled substitution.
+ */
+void freeSubstitution(substitution_t *substitution) {
+    if (substitution->replacement != NULL) {
+        regfree(&substitution->regex);
+        free(substitution->replacement);
+        substitution->replacement = NULL;
+    }
+}
+
+/**
+ * @brief Streams a file through a substitution.
+ *
+ * @param src_fd Descriptor of the file to read, from offset 0.
+ * @param dest_fd Descriptor receiving the substituted content, written from offset 0.
+ * @param substitution Compiled substitution.
+ * @param substitutions Set to the number of replaced matches.
+ * @param bytes_written Set to the number of bytes written to `dest_fd`.
+ * @return `SUCCESS` if the whole file was streamed, or an error code otherwise.
+ *
+ * @details
+ * - Reads `SUBSTITUTE_BUFFER_SIZE` bytes at a time, carrying an incomplete last line over to the
+ *   next read; a line longer than the buffer grows it.
+ * - A last line without a newline is substituted too, and still has none afterwards.
+ */
+int substituteStream(const int src_fd, const int dest_fd, const substitution_t *substitution, size_t *substitutions,
+                     off_t *bytes_written) {
+    const uint64_t start_ns = traceNow();
+    *substitutions = 0;
+    *bytes_written = 0;
+    size_t capacity = SUBSTITUTE_BUFFER_SIZE;
+    char *input = malloc(capacity);
+    output_t output = {.fd = dest_fd, .buffer = malloc(SUBSTITUTE_BUFFER_SIZE), .error = SUCCESS};
+    if (input == NULL || output.buffer == NULL) {
+        free(input);
+        free(output.buffer);
+        return ERROR_MEMORY_ALLOCATION;
+    }
+    posix_fadvise(src_fd, 0, 0, POSIX_FADV_SEQUENTIAL);
+
+    off_t src_offset = 0;
+    size_t carried = 0; // Bytes of an incomplete line kept from the previous read
+    bool at_end = false;
+    while (!at_end && output.error == SUCCESS) {
+        if (carried == capacity) {
+            char *grown = realloc(input, capacity * 2);
+            if (grown == NULL) {
+                output.error = ERROR_MEMORY_ALLOCATION;
+                break;
+            }
+            input = grown;
+            capacity *= 2;
+        }
+        const ssize_t bytes_read = statsPread(src_fd, input + carried, capacity - carried, src_offset);
+        if (bytes_read < 0) {
+            output.error = ERROR_COPY_FAILED;
+            break;
+        }
+        src_offset += bytes_read;
+        at_end = bytes_read == 0;
+        const size_t length = carried + (size_t) bytes_read;
+
+        // Only complete lines are processed, except for the last line of the file
+        const char *last_newline = memrchr(input, '\n', length);
+        const size_t complete = at_end ? length : last_newline != NULL ? (size_t) (last_newline - input) + 1 : 0;
+
+        const char *cursor = input;
+        const char *end = input + complete;
+        while (cursor < end && output.error == SUCCESS) {
+            if (substitution->literal_length > 0) {
+                // Copy the lines up to the next one containing the literal, as they cannot match
+                const char *hit = findLiteral(cursor, end - cursor, substitution->literal,
+                                              substitution->literal_length);
+                if (hit == NULL) {
+                    emit(&output, cursor, end - cursor);
+                    break;
+                }
+                const char *previous_newline = hit > cursor ? memrchr(cursor, '\n', hit - cursor) : NULL;
+                const char *line_start = previous_newline != NULL ? previous_newline + 1 : cursor;
+                emit(&output, cursor, line_start - cursor);
+                cursor = line_start;
+            }
+            const char *newline = memchr(cursor, '\n', end - cursor);
+            const char *line_end = newline != NULL ? newline : end;
+            *substitutions += substituteLine(substitution, cursor, line_end - cursor, &output);
+            if (newline != NULL) {
+                emit(&output, "\n", 1);
+            }
+            cursor = newline != NULL ? newline + 1 : end;
+        }
+
+        carried = length - complete;
+        memmove(input, input + complete, carried);
+    }
+    flushOutput(&output);
+    free(input);
+    free(output.buffer);
+    *bytes_written = output.written;
+    traceSpan("substitute", "substituteStream", start_ns, NULL, output.written);
+    return output.error;
+}
+
+/**
+ * @brief Reads one part of an expression, up to an unescaped delimiter.
+ *
+ * @param cursor Start of the part.
+ * @param delimiter Delimiter ending the part.
+ * @param part Set to the part, with `\<delimiter>` turned into the delimiter, to be freed by the caller.
+ * @return The position after the delimiter, or `NULL` if it is missing (or the part could not be allocated).
+ */
+static const char *readPart(const char *cursor, const char delimiter, char **part) {
+    *part = malloc(strlen(cursor) + 1);
+    if (*part == NULL) {
+        return NULL;
+    }
+    size_t length = 0;
+    for (; *cursor != '\0' && *cursor != delimiter; ++cursor) {
+        if (*cursor == '\\' && cursor[1] == delimiter) {
+            ++cursor;
+        } else if (*cursor == '\\' && cursor[1] != '\0') {
+            (*part)[length++] = *cursor++;
+        }
+        (*part)[length++] = *cursor;
+    }
+    (*part)[length] = '\0';
+    return *cursor == delimiter ? cursor + 1 : NULL;
+}
+
+/**
+ * @brief Finds the longest literal that every match of an extended regex contains.
+ *
+ * @param pattern Regex pattern.
+ * @param substitution Receives the literal, or a length of 0 if none could be proven.
+ *
+ * @details
+ * - Only characters outside groups and bracket expressions count, and only if they are not made
+ *   optional by `*`, `?` or `{`. Any alternation (`|`) gives up, since a match may then take
+ *   another branch.
+ */
+static void extractLiteral(const char *pattern, substitution_t *substitution) {
+    char current[SUBSTITUTE_MAX_LITERAL];
+    size_t current_length = 0;
+    size_t depth = 0;
+    substitution->literal_length = 0;
+
+    for (const char *p = pattern; *p != '\0';) {
+        char literal;
+        if (*p == '|') {
+            substitution->literal_length = 0;
+            return;
+        }
+        if (*p == '\\') {
+            if (p[1] == '\0' || isalnum((unsigned char) p[1]) || strchr("<>`'", p[1]) != NULL) {
+                // Back references and GNU extensions (\w, \b...) match no fixed text
+                current_length = 0;
+                p += p[1] != '\0' ? 2 : 1;
+                continue;
+            }
+            literal = p[1];
+            p += 2;
+        } else if (*p == '[') {
+            // Skip the bracket expression, where a leading ']' is a member
+            p += p[1] == '^' ? 2 : 1;
+            p += *p == ']' ? 1 : 0;
+            while (*p != '\0' && *p != ']') {
+                p += *p == '[' && (p[1] == ':' || p[1] == '.' || p[1] == '=') && strchr(p + 2, ']') != NULL
+                         ? strchr(p + 2, ']') - p + 1
+                         : 1;
+            }
+            p += *p == ']' ? 1 : 0;
+            current_length = 0;
+            continue;
+        } else if (*p == '{') {
+            // An interval may make the previous atom optional
+            const char *close = strchr(p, '}');
+            p = close != NULL ? close + 1 : p + 1;
+            current_length = 0;
+            continue;
+        } else if (strchr("().^$*+?", *p) != NULL || *p == '\n') {
+            depth += *p == '(';
+            depth -= *p == ')' && depth > 0;
+            current_length = 0;
+            ++p;
+            continue;
+        } else {
+            literal = *p++;
+        }
+
+        // A quantified character is not part of every match, unless it is required at least once
+        if (depth > 0 || *p == '*' || *p == '?' || *p == '{') {
+            current_length = 0;
+            continue;
+        }
+        if (current_length < SUBSTITUTE_MAX_LITERAL) {
+            current[current_length++] = literal;
+        }
+        if (current_length > substitution->literal_length) {
+            memcpy(substitution->literal, current, current_length);
+            substitution->literal_length = current_length;
+        }
+        if (*p == '+') {
+            current_length = 0; // The next character does not directly follow this one in every match
+        }
+    }
+}
+
+/**
+ * @brief Finds the first occurrence of a literal in a buffer.
+ *
+ * @details
+ * - With SSE2, compares 16 candidate positions at once against the first and the last byte of
+ *   the literal, and checks the rest of the literal only where both match.
+ */
+static const char *findLiteral(const char *haystack, const size_t length, const char *needle,
+                               const size_t needle_length) {
+    if (needle_length == 1) {
+        return memchr(haystack, needle[0], length);
+    }
+    size_t i = 0;
+#if defined(__SSE2__)
+    const __m128i first = _mm_set1_epi8(needle[0]);
+    const __m128i last = _mm_set1_epi8(needle[needle_length - 1]);
+    for (; i + needle_length - 1 + 16 <= length; i += 16) {
+        const __m128i block_first = _mm_loadu_si128((const __m128i *) (haystack + i));
+        const __m128i block_last = _mm_loadu_si128((const __m128i *) (haystack + i + needle_length - 1));
+        unsigned int mask = (unsigned int) _mm_movemask_epi8(
+            _mm_and_si128(_mm_cmpeq_epi8(block_first, first), _mm_cmpeq_epi8(block_last, last)));
+        while (mask != 0) {
+            const int bit = __builtin_ctz(mask);
+            if (memcmp(haystack + i + bit + 1, needle + 1, needle_length - 2) == 0) {
+                return haystack + i + bit;
+            }
+            mask &= mask - 1;
+        }
+    }
+#endif
+    return i < length ? memmem(haystack + i, length - i, needle, needle_length) : NULL;
+}
+
+/**
+ * @brief Substitutes the matches of one line and writes it out, without its newline.
+ *
+ * @return The number of replaced matches.
+ *
+ * @details
+ * - As in sed, an empty match right after the previous match is not replaced.
+ */
+static size_t substituteLine(const substitution_t *substitution, const char *line, const size_t length,
+                             output_t *output) {
+    size_t replaced = 0;
+    size_t offset = 0;
+    size_t previous_end = (size_t) -1;
+    regmatch_t matches[MAX_GROUPS];
+    while (offset <= length) {
+        matches[0].rm_so = (regoff_t) offset;
+        matches[0].rm_eo = (regoff_t) length;
+        if (regexec(&substitution->regex, line, MAX_GROUPS, matches, REG_STARTEND | (offset > 0 ? REG_NOTBOL : 0))
+            != 0) {
+            break;
+        }
+        const size_t match_start = (size_t) matches[0].rm_so;
+        const size_t match_end = (size_t) matches[0].rm_eo;
+        emit(output, line + offset, match_start - offset);
+
+        if (match_start == match_end && match_start == previous_end) {
+            // Skip an empty match adjoining the previous one
+            if (match_start < length) {
+                emit(output, line + match_start, 1);
+            }
+            offset = match_start + 1;
+            continue;
+        }
+
+        // Expand the replacement for this match
+        for (const char *r = substitution->replacement; *r != '\0'; ++r) {
+            int group = -1;
+            if (*r == '&') {
+                group = 0;
+            } else if (*r == '\\' && r[1] >= '0' && r[1] <= '9') {
+                group = *++r - '0';
+            } else if (*r == '\\' && r[1] == 'n') {
+                ++r;
+                emit(output, "\n", 1);
+                continue;
+            } else if (*r == '\\' && r[1] != '\0') {
+                ++r;
+            }
+            if (group < 0) {
+                emit(output, r, 1);
+            } else if (matches[group].rm_so >= 0) {
+                emit(output, line + matches[group].rm_so, matches[group].rm_eo - matches[group].rm_so);
+            }
+        }
+        ++replaced;
+        previous_end = match_end;
+
+        if (match_start == match_end) {
+            if (match_start < length) {
+                emit(output, line + match_start, 1);
+            }
+            offset = match_end + 1;
+        } else {
+            offset = match_end;
+        }
+        if (!substitution->global) {
+            break;
+        }
+    }
+    if (offset < length) {
+        emit(output, line + offset, length - offset);
+    }
+    return replaced;
+}
+
+/**
+ * @brief Appends bytes to the output, writing it out when the buffer is full.
+ */
+static void emit(output_t *output, const char *data, size_t length) {
+    while (length > 0 && output->error == SUCCESS) {
+        const size_t room = SUBSTITUTE_BUFFER_SIZE - output->used;
+        const size_t chunk = length < room ? length : room;
+        memcpy(output->buffer + output->used, data, chunk);
+        output->used += chunk;
+        data += chunk;
+        length -= chunk;
+        if (output->used == SUBSTITUTE_BUFFER_SIZE) {
+            flushOutput(output);
+        }
+    }
+}
+
+/**
+ * @brief Writes the pending output bytes.
+ */
+static void flushOutput(output_t *output) {
+    size_t done = 0;
+    while (done < output->used && output->error == SUCCESS) {
+        const ssize_t bytes_written = statsPwrite(output->fd, output->buffer + done, output->used - done,
+                                                  output->written);
+        if (bytes_written <= 0) {
+            output->error = ERROR_COPY_FAILED;
+            break;
+        }
+        done += (size_t) bytes_written;
+        output->written += bytes_written;
+    }
+    output->used = 0;
+}
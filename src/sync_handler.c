@@ -0,0 +1,155 @@
+#define _GNU_SOURCE // syncfs
+
+#include <fcntl.h>
+#include <libgen.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <linux/limits.h>
+#include <sys/stat.h>
+
+#include "../include/error_handler.h"
+#include "../include/stats_handler.h"
+#include "../include/sync_handler.h"
+
+/**
+ * @file sync_handler.c
+ * @brief Implements the durability modes of the `redit` program.
+ *
+ * A full flush per file is the safest option but the slowest one when many files are
+ * written. The group mode records which file systems were written to and issues a
+ * single `syncfs` for each of them once the run is done, which flushes data and
+ * metadata of every file at the cost of one journal commit per file system.
+ */
+
+/**
+ * @brief Parses the value of the `--sync` flag.
+ *
+ * @param value The flag value (`none`, `data`, `full` or `group`).
+ * @param mode Pointer to a variable where the parsed mode will be stored.
+ * @return `SUCCESS` if the value is valid, or `ERROR_INVALID_ARGUMENT` otherwise.
+ */
+int parseSyncMode(const char *value, sync_mode_t *mode) {
+    if (value == NULL) {
+        return ERROR_INVALID_ARGUMENT;
+    }
+    if (strcmp(value, "none") == 0) {
+        *mode = SYNC_NONE;
+    } else if (strcmp(value, "data") == 0) {
+        *mode = SYNC_DATA;
+    } else if (strcmp(value, "full") == 0) {
+        *mode = SYNC_FULL;
+    } else if (strcmp(value, "group") == 0) {
+        *mode = SYNC_GROUP;
+    } else {
+        return ERROR_INVALID_ARGUMENT;
+    }
+    return SUCCESS;
+}
+
+/**
+ * @brief Records the file system of a descriptor in a sync group.
+ */
+static int addToSyncGroup(sync_group_t *group, const int fd) {
+    struct stat fd_stat;
+    if (STATS_SYSCALL(fstat(fd, &fd_stat)) == -1) {
+        return ERROR_SYNC_FAILED;
+    }
+    // Already recorded: the final syncfs covers this file too
+    for (size_t i = 0; i < group->count; ++i) {
+        if (group->devices[i] == fd_stat.st_dev) {
+            return SUCCESS;
+        }
+    }
+
+    if (group->count == group->capacity) {
+        const size_t new_capacity = group->capacity > 0 ? group->capacity * 2 : 4;
+        dev_t *new_devices = realloc(group->devices, new_capacity * sizeof(dev_t));
+        if (!new_devices) {
+            return ERROR_MEMORY_ALLOCATION;
+        }
+        group->devices = new_devices;
+        int *new_fds = realloc(group->fds, new_capacity * sizeof(int));
+        if (!new_fds) {
+            return ERROR_MEMORY_ALLOCATION;
+        }
+        group->fds = new_fds;
+        group->capacity = new_capacity;
+    }
+
+    // Keep a descriptor open on the file system until the group is flushed
+    const int group_fd = STATS_SYSCALL(dup(fd));
+    if (group_fd == -1) {
+        return ERROR_SYNC_FAILED;
+    }
+    group->devices[group->count] = fd_stat.st_dev;
+    group->fds[group->count] = group_fd;
+    group->count++;
+    return SUCCESS;
+}
+
+/**
+ * @brief Flushes a freshly written file according to the durability mode.
+ *
+ * @param fd Descriptor of the written file. Must still be open.
+ * @param file_path Path to the written file, used to flush its directory in `SYNC_FULL` mode.
+ * @param mode The durability mode.
+ * @param group The sync group used in `SYNC_GROUP` mode. May be `NULL` for the other modes.
+ * @return `SUCCESS` if the file was flushed (or deferred), or an error code otherwise.
+ *
+ * @details
+ * - `SYNC_FULL` also flushes the parent directory, so a newly created file's entry survives a crash.
+ * - `SYNC_GROUP` without a group falls back to `SYNC_DATA`.
+ */
+int syncFile(const int fd, const char *file_path, const sync_mode_t mode, sync_group_t *group) {
+    switch (mode) {
+        case SYNC_NONE:
+            return SUCCESS;
+        case SYNC_DATA:
+            return STATS_SYSCALL(fdatasync(fd)) == -1 ? ERROR_SYNC_FAILED : SUCCESS;
+        case SYNC_FULL: {
+            if (STATS_SYSCALL(fsync(fd)) == -1) {
+                return ERROR_SYNC_FAILED;
+            }
+            char path_copy[PATH_MAX];
+            strlcpy(path_copy, file_path, PATH_MAX);
+            const int dir_fd = STATS_SYSCALL(open(dirname(path_copy), O_RDONLY | O_DIRECTORY));
+            if (dir_fd == -1) {
+                return ERROR_SYNC_FAILED;
+            }
+            const int dir_result = STATS_SYSCALL(fsync(dir_fd));
+            STATS_SYSCALL(close(dir_fd));
+            return dir_result == -1 ? ERROR_SYNC_FAILED : SUCCESS;
+        }
+        case SYNC_GROUP:
+            if (group == NULL) {
+                return STATS_SYSCALL(fdatasync(fd)) == -1 ? ERROR_SYNC_FAILED : SUCCESS;
+            }
+            return addToSyncGroup(group, fd);
+    }
+    return SUCCESS;
+}
+
+/**
+ * @brief Flushes every file system recorded in a sync group and empties it.
+ *
+ * @param group The sync group to flush.
+ * @return `SUCCESS` if every file system was flushed, or `ERROR_SYNC_FAILED` otherwise.
+ *
+ * @details
+ * - Issues one `syncfs` per file system, however many files were written to it.
+ * - Safe to call on an empty or already flushed group.
+ */
+int flushSyncGroup(sync_group_t *group) {
+    int result = SUCCESS;
+    for (size_t i = 0; i < group->count; ++i) {
+        if (STATS_SYSCALL(syncfs(group->fds[i])) == -1) {
+            result = ERROR_SYNC_FAILED;
+        }
+        STATS_SYSCALL(close(group->fds[i]));
+    }
+    free(group->devices);
+    free(group->fds);
+    *group = (sync_group_t){0};
+    return result;
+}
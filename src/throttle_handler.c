@@ -0,0 +1,167 @@
+#define _GNU_SOURCE // sched_setaffinity and the CPU_* macros
+
+#include <errno.h>
+#include <sched.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/syscall.h>
+
+#include "../include/error_handler.h"
+#include "../include/stats_handler.h"
+#include "../include/throttle_handler.h"
+
+#define IOPRIO_WHO_PROCESS 1 // ioprio_set target: a single thread, inherited by the threads it creates
+#define IOPRIO_CLASS_SHIFT 13 // Position of the class in an I/O priority value
+#define IOPRIO_CLASS_BE 2 // Kernel number of the best-effort class
+#define IOPRIO_CLASS_IDLE 3 // Kernel number of the idle class
+
+/**
+ * @file throttle_handler.c
+ * @brief Lowers the impact of a run on the rest of the host.
+ *
+ * The I/O priority is honoured by the BFQ scheduler (and by CFQ on older kernels); in the
+ * idle class, the run only gets the disk when no one else wants it. The CPU limit pins the
+ * run to the highest-numbered CPUs it may use, away from CPU 0, which most interrupts land
+ * on, and every thread pool of the run sizes itself to it.
+ *
+ * The bandwidth limit is a token bucket shared by the threads of a copy: each chunk moved is
+ * paid for in time at the configured rate, and a thread that gets ahead sleeps until its
+ * bytes are paid for. Up to `THROTTLE_BURST_NS` of unused bandwidth is carried over, so a
+ * pause (e.g. for a page cache eviction) is caught up without exceeding the rate for long.
+ */
+
+/**
+ * @brief Parses the value of the `--ionice` flag.
+ *
+ * @param value The flag value: `idle`, or `be:N` with N from 0 (highest) to 7 (lowest).
+ * @param priority Pointer to a variable where the parsed priority will be stored.
+ * @return `SUCCESS` if the value is valid, or `ERROR_INVALID_ARGUMENT` otherwise.
+ */
+int parseIoPriority(const char *value, io_priority_t *priority) {
+    if (value == NULL) {
+        return ERROR_INVALID_ARGUMENT;
+    }
+    if (strcmp(value, "idle") == 0) {
+        *priority = (io_priority_t){.io_class = IO_CLASS_IDLE, .level = 0};
+        return SUCCESS;
+    }
+    if (strncmp(value, "be:", 3) == 0 && value[3] >= '0' && value[3] < '0' + IO_PRIORITY_LEVELS &&
+        value[4] == '\0') {
+        *priority = (io_priority_t){.io_class = IO_CLASS_BEST_EFFORT, .level = value[3] - '0'};
+        return SUCCESS;
+    }
+    return ERROR_INVALID_ARGUMENT;
+}
+
+/**
+ * @brief Sets the I/O priority of the calling thread, and of the threads it creates from then on.
+ *
+ * @param priority Priority to set. `IO_CLASS_DEFAULT` leaves the current one.
+ * @return `SUCCESS` if the priority was set, `ERROR_PERMISSION_DENIED` if the kernel refused
+ *         it, or `ERROR_INVALID_ARGUMENT` if it is not supported.
+ *
+ * @details
+ * - Called before any other thread is created, so the whole run gets the priority.
+ */
+int setIoPriority(const io_priority_t *priority) {
+    if (priority->io_class == IO_CLASS_DEFAULT) {
+        return SUCCESS;
+    }
+    const int kernel_class = priority->io_class == IO_CLASS_IDLE ? IOPRIO_CLASS_IDLE : IOPRIO_CLASS_BE;
+    const int value = kernel_class << IOPRIO_CLASS_SHIFT | priority->level;
+    if (syscall(SYS_ioprio_set, IOPRIO_WHO_PROCESS, 0, value) == -1) {
+        return errno == EPERM ? ERROR_PERMISSION_DENIED : ERROR_INVALID_ARGUMENT;
+    }
+    return SUCCESS;
+}
+
+/**
+ * @brief Confines the process to at most `cpus` of the CPUs it may run on.
+ *
+ * @param cpus Number of CPUs to keep, 0 to keep them all.
+ * @return `SUCCESS` if the process was confined, or `ERROR_INVALID_ARGUMENT` otherwise.
+ *
+ * @details
+ * - The highest-numbered CPUs are kept.
+ */
+int limitCpus(const size_t cpus) {
+    cpu_set_t allowed;
+    if (cpus == 0 || sched_getaffinity(0, sizeof(allowed), &allowed) == -1) {
+        return cpus == 0 ? SUCCESS : ERROR_INVALID_ARGUMENT;
+    }
+    cpu_set_t kept;
+    CPU_ZERO(&kept);
+    size_t n_kept = 0;
+    for (int cpu = CPU_SETSIZE - 1; cpu >= 0 && n_kept < cpus; --cpu) {
+        if (CPU_ISSET(cpu, &allowed)) {
+            CPU_SET(cpu, &kept);
+            n_kept++;
+        }
+    }
+    return sched_setaffinity(0, sizeof(kept), &kept) == 0 ? SUCCESS : ERROR_INVALID_ARGUMENT;
+}
+
+/**
+ * @brief Counts the CPUs the process may run on.
+ *
+ * @return The number of CPUs in the affinity mask of the process, at least 1.
+ *
+ * @details
+ * - Unlike the number of online CPUs, this honours `--cpus`, `taskset` and cgroup cpusets.
+ */
+size_t countCpus() {
+    cpu_set_t allowed;
+    if (sched_getaffinity(0, sizeof(allowed), &allowed) == 0) {
+        return (size_t) CPU_COUNT(&allowed);
+    }
+    const long online = sysconf(_SC_NPROCESSORS_ONLN);
+    return online > 0 ? (size_t) online : 1;
+}
+
+/**
+ * @brief Initializes a token bucket with no tokens carried over.
+ *
+ * @param throttle Token bucket to initialize; `destroyThrottle` releases it.
+ * @param bytes_per_second Bandwidth to pace to, greater than 0.
+ */
+void initThrottle(throttle_t *throttle, const double bytes_per_second) {
+    pthread_mutex_init(&throttle->mutex, NULL);
+    throttle->bytes_per_second = bytes_per_second;
+    throttle->next_ns = statsNow();
+}
+
+/**
+ * @brief Pays for bytes moved, sleeping until the bandwidth allows them.
+ *
+ * @param throttle Token bucket shared by the threads of the copy.
+ * @param bytes Bytes just moved.
+ *
+ * @details
+ * - The sleep happens outside the lock, so other threads keep accounting their bytes meanwhile.
+ */
+void throttleBytes(throttle_t *throttle, const size_t bytes) {
+    pthread_mutex_lock(&throttle->mutex);
+    const uint64_t now_ns = statsNow();
+    if (throttle->next_ns + THROTTLE_BURST_NS < now_ns) {
+        throttle->next_ns = now_ns - THROTTLE_BURST_NS; // Idle for long: carry over one burst at most
+    }
+    throttle->next_ns += (uint64_t) ((double) bytes / throttle->bytes_per_second * 1e9);
+    const uint64_t wake_ns = throttle->next_ns;
+    pthread_mutex_unlock(&throttle->mutex);
+
+    if (wake_ns > now_ns) {
+        const uint64_t wait_ns = wake_ns - now_ns;
+        const struct timespec wait = {.tv_sec = (time_t) (wait_ns / 1000000000ULL),
+                                      .tv_nsec = (long) (wait_ns % 1000000000ULL)};
+        nanosleep(&wait, NULL); // If a signal cuts it short, the next chunk sleeps the rest
+    }
+}
+
+/**
+ * @brief Releases a token bucket.
+ */
+void destroyThrottle(throttle_t *throttle) {
+    pthread_mutex_destroy(&throttle->mutex);
+}
@@ -0,0 +1,146 @@
+#define _GNU_SOURCE // gettid
+
+#include <fcntl.h>
+#include <pthread.h>
+#include <pwd.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/fsuid.h>
+#include <sys/stat.h>
+
+#include "../include/error_handler.h"
+#include "../include/trace_handler.h"
+
+/**
+ * @file trace_handler.c
+ * @brief Writes the spans of a run in the Chrome trace event format (`--trace`).
+ *
+ * Every span is a complete ("X") event with its start, duration, process and thread
+ * id, so copy threads get a lane of their own. Events are streamed to the trace file
+ * as they end instead of being kept in memory, since a large copy makes one event per
+ * I/O call. Copy threads may end spans concurrently, hence the mutex.
+ */
+
+static FILE *trace_file = NULL; // Open trace file, NULL while tracing is disabled
+static pthread_mutex_t trace_mutex = PTHREAD_MUTEX_INITIALIZER;
+
+/**
+ * @brief Writes a string as a JSON string literal.
+ */
+static void writeJsonString(FILE *file, const char *value) {
+    fputc('"', file);
+    for (const unsigned char *c = (const unsigned char *) value; *c != '\0'; ++c) {
+        if (*c == '"' || *c == '\\') {
+            fprintf(file, "\\%c", *c);
+        } else if (*c < 0x20) {
+            fprintf(file, "\\u%04x", *c);
+        } else {
+            fputc(*c, file);
+        }
+    }
+    fputc('"', file);
+}
+
+/**
+ * @brief Starts writing a trace of the run.
+ *
+ * @param trace_path Path of the trace file to create.
+ * @param owner User the trace file is created for.
+ * @return `SUCCESS` if the file was created, or an error code otherwise.
+ *
+ * @details
+ * - The file is opened with the file system identity of `owner` (`setfsuid`), so running as
+ *   root it is created as theirs and can only be created or replaced where they could write it.
+ * - It is opened with `O_NOFOLLOW`, and an existing file is only truncated if it is a regular
+ *   file owned by `owner`.
+ */
+int traceOpen(const char *trace_path, const uid_t owner) {
+    const struct passwd *pw = getpwuid(owner);
+    if (pw == NULL) {
+        return ERROR_USER_NOT_FOUND;
+    }
+    const gid_t previous_gid = (gid_t) setfsgid(pw->pw_gid);
+    const uid_t previous_uid = (uid_t) setfsuid(owner);
+    const int trace_fd = open(trace_path, O_WRONLY | O_CREAT | O_NOFOLLOW | O_CLOEXEC,
+                              S_IRUSR | S_IWUSR | S_IRGRP | S_IROTH);
+    setfsuid(previous_uid);
+    setfsgid(previous_gid);
+    if (trace_fd == -1) {
+        return ERROR_PERMISSION_DENIED;
+    }
+
+    struct stat trace_stat;
+    if (fstat(trace_fd, &trace_stat) == -1 || !S_ISREG(trace_stat.st_mode) || trace_stat.st_uid != owner ||
+        ftruncate(trace_fd, 0) == -1 || (trace_file = fdopen(trace_fd, "w")) == NULL) {
+        close(trace_fd);
+        return ERROR_PERMISSION_DENIED;
+    }
+    fprintf(trace_file, "{\"displayTimeUnit\":\"ms\",\"traceEvents\":[\n");
+    // Metadata event first, so every span can be written with a leading comma
+    fprintf(trace_file, "{\"name\":\"process_name\",\"ph\":\"M\",\"pid\":%d,\"args\":{\"name\":\"redit\"}}",
+            (int) getpid());
+    return SUCCESS;
+}
+
+/**
+ * @brief Completes and closes the trace file, if tracing.
+ */
+void traceClose() {
+    pthread_mutex_lock(&trace_mutex);
+    if (trace_file != NULL) {
+        fprintf(trace_file, "\n]}\n");
+        fclose(trace_file);
+        trace_file = NULL;
+    }
+    pthread_mutex_unlock(&trace_mutex);
+}
+
+/**
+ * @brief Returns the start time of a span.
+ *
+ * @return The monotonic clock in nanoseconds, or 0 while tracing is disabled, so untraced
+ *         runs skip the clock read.
+ */
+uint64_t traceNow() {
+    if (trace_file == NULL) {
+        return 0;
+    }
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return (uint64_t) now.tv_sec * 1000000000ULL + (uint64_t) now.tv_nsec;
+}
+
+/**
+ * @brief Records a span that started at `start_ns` and ends now.
+ *
+ * @param category Trace category (e.g. "phase", "io", "path").
+ * @param name Span name.
+ * @param start_ns Start time returned by `traceNow`, or by the monotonic clock.
+ * @param path File the span operated on, or `NULL`.
+ * @param bytes Bytes transferred by the span, or a negative value if not applicable.
+ */
+void traceSpan(const char *category, const char *name, const uint64_t start_ns, const char *path,
+               const long long bytes) {
+    if (trace_file == NULL || start_ns == 0) {
+        return;
+    }
+    const uint64_t end_ns = traceNow();
+
+    pthread_mutex_lock(&trace_mutex);
+    if (trace_file != NULL) {
+        fprintf(trace_file, ",\n{\"name\":\"%s\",\"cat\":\"%s\",\"ph\":\"X\",\"ts\":%.3f,\"dur\":%.3f,"
+                "\"pid\":%d,\"tid\":%d,\"args\":{", name, category,
+                (double) start_ns / 1e3, (double) (end_ns - start_ns) / 1e3, (int) getpid(), (int) gettid());
+        if (path != NULL) {
+            fprintf(trace_file, "\"path\":");
+            writeJsonString(trace_file, path);
+        }
+        if (bytes >= 0) {
+            fprintf(trace_file, "%s\"bytes\":%lld", path != NULL ? "," : "", bytes);
+        }
+        fprintf(trace_file, "}}");
+    }
+    pthread_mutex_unlock(&trace_mutex);
+}
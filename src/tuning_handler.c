@@ -0,0 +1,386 @@
+#define _GNU_SOURCE // O_TMPFILE
+#include <errno.h>
+#include <fcntl.h>
+#include <libgen.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include <linux/limits.h>
+#include <sys/stat.h>
+#include <sys/statfs.h>
+
+#include "../include/error_handler.h"
+#include "../include/file_utils.h"
+#include "../include/file_operations.h"
+#include "../include/paths_handler.h"
+#include "../include/tuning_handler.h"
+
+/**
+ * @file tuning_handler.c
+ * @brief Calibrates copy parameters per pair of file systems.
+ *
+ * The best way to copy depends on where the data lives: `copy_file_range` lets NFS and
+ * some local file systems copy server- or kernel-side, large requests suit fast SSDs,
+ * and several concurrent streams help high-latency storage. Instead of guessing, the
+ * first large copy between two file systems times a handful of configurations on a
+ * sample of the real source file and caches the fastest one in
+ * `~/.cache/redit/calibration`, keyed by device and file system type.
+ */
+
+#define MAX_CALIBRATION_ENTRIES 64 // Entries kept in the cache file
+
+/**
+ * @brief Cached calibration result for a pair of file systems.
+ */
+typedef struct {
+    dev_t src_dev; ///< Device of the source file system.
+    dev_t dest_dev; ///< Device of the destination file system.
+    unsigned long src_fs_type; ///< `statfs` type of the source file system.
+    unsigned long dest_fs_type; ///< `statfs` type of the destination file system.
+    copy_engine_t engine; ///< Fastest engine.
+    size_t buffer_size; ///< Fastest buffer size.
+    size_t threads; ///< Fastest number of threads.
+    double throughput; ///< Measured throughput in MB/s.
+} calibration_entry_t;
+
+/**
+ * @brief Configurations timed by a calibration, first without threads.
+ */
+static const struct {
+    copy_engine_t engine;
+    size_t buffer_size;
+} CANDIDATES[] = {
+    {COPY_ENGINE_READ_WRITE, 64 * 1024},
+    {COPY_ENGINE_READ_WRITE, 256 * 1024},
+    {COPY_ENGINE_READ_WRITE, 1024 * 1024},
+    {COPY_ENGINE_KERNEL, 1024 * 1024},
+    {COPY_ENGINE_KERNEL, 8 * 1024 * 1024}
+};
+
+/**
+ * @brief Thread counts tried with the fastest configuration.
+ */
+static const size_t THREAD_CANDIDATES[] = {2, 4};
+
+/**
+ * @brief Checks that a cached configuration is one a calibration could have picked.
+ *
+ * @details
+ * - The cache lives in the user's home, so anything in it may have been written by the user.
+ *   Applying an arbitrary buffer size or thread count to a root copy would let them exhaust
+ *   memory or threads.
+ */
+static bool isCandidate(const calibration_entry_t *entry) {
+    bool is_known = false;
+    for (size_t i = 0; i < sizeof(CANDIDATES) / sizeof(CANDIDATES[0]); ++i) {
+        is_known |= CANDIDATES[i].engine == entry->engine && CANDIDATES[i].buffer_size == entry->buffer_size;
+    }
+    if (!is_known) {
+        return false;
+    }
+    if (entry->threads == 1) {
+        return true;
+    }
+    for (size_t i = 0; i < sizeof(THREAD_CANDIDATES) / sizeof(THREAD_CANDIDATES[0]); ++i) {
+        if (THREAD_CANDIDATES[i] == entry->threads) {
+            return true;
+        }
+    }
+    return false;
+}
+
+/**
+ * @brief Loads the calibration cache.
+ *
+ * @param entries Array receiving up to `MAX_CALIBRATION_ENTRIES` entries.
+ * @param count Pointer to a variable where the number of entries will be stored.
+ * @return `SUCCESS` (a missing cache is an empty one), or an error code otherwise.
+ *
+ * @details
+ * - Entries that are not a candidate configuration are skipped, so their pair is calibrated again.
+ */
+static int loadCalibrationCache(calibration_entry_t entries[MAX_CALIBRATION_ENTRIES], size_t *count) {
+    *count = 0;
+    int dir_fd;
+    uid_t ef_uid;
+    const int dir_result = openUserDataDir(CALIBRATION_DIR, &dir_fd, &ef_uid);
+    if (dir_result != SUCCESS) {
+        return dir_result;
+    }
+
+    const int cache_fd = openat(dir_fd, CALIBRATION_FILE, O_RDONLY | O_NOFOLLOW | O_CLOEXEC);
+    close(dir_fd);
+    FILE *cache = cache_fd != -1 ? fdopen(cache_fd, "r") : NULL;
+    if (cache == NULL) {
+        if (cache_fd != -1) {
+            close(cache_fd);
+        }
+        return SUCCESS;
+    }
+    char line[256];
+    while (*count < MAX_CALIBRATION_ENTRIES && fgets(line, sizeof(line), cache) != NULL) {
+        if (line[0] == '#') {
+            continue; // Header
+        }
+        unsigned long src_dev, dest_dev;
+        int engine;
+        calibration_entry_t *entry = &entries[*count];
+        if (sscanf(line, "%lu %lu %lx %lx %d %zu %zu %lf", &src_dev, &dest_dev, &entry->src_fs_type,
+                   &entry->dest_fs_type, &engine, &entry->buffer_size, &entry->threads, &entry->throughput) == 8) {
+            entry->src_dev = src_dev;
+            entry->dest_dev = dest_dev;
+            entry->engine = engine == COPY_ENGINE_KERNEL ? COPY_ENGINE_KERNEL : COPY_ENGINE_READ_WRITE;
+            if (isCandidate(entry)) {
+                (*count)++;
+            }
+        }
+    }
+    fclose(cache);
+    return SUCCESS;
+}
+
+/**
+ * @brief Writes the calibration cache atomically and hands it to the effective user.
+ *
+ * @details
+ * - The file is created next to the cache with `O_CREAT | O_EXCL | O_NOFOLLOW` on the descriptor
+ *   of the verified cache directory, given to the user with `fchown`, then renamed over the cache,
+ *   so no symlink planted in the directory is ever followed.
+ */
+static int saveCalibrationCache(const calibration_entry_t *entries, const size_t count) {
+    int dir_fd;
+    uid_t ef_uid;
+    const int dir_result = openUserDataDir(CALIBRATION_DIR, &dir_fd, &ef_uid);
+    if (dir_result != SUCCESS) {
+        return dir_result;
+    }
+
+    // A leftover temporary file (or whatever took its name) is replaced
+    const char *temp_name = CALIBRATION_FILE ".tmp";
+    unlinkat(dir_fd, temp_name, 0);
+    const int temp_fd = openat(dir_fd, temp_name, O_WRONLY | O_CREAT | O_EXCL | O_NOFOLLOW | O_CLOEXEC,
+                               S_IRUSR | S_IWUSR);
+    FILE *cache = temp_fd != -1 ? fdopen(temp_fd, "w") : NULL;
+    if (cache == NULL) {
+        if (temp_fd != -1) {
+            close(temp_fd);
+            unlinkat(dir_fd, temp_name, 0);
+        }
+        close(dir_fd);
+        return ERROR_PERMISSION_DENIED;
+    }
+
+    // The cache lives in the user's home, so it belongs to the user
+    fchown(temp_fd, ef_uid, (gid_t) -1);
+    fprintf(cache, "# redit calibration: src_dev dest_dev src_fs dest_fs engine buffer threads MB/s\n");
+    for (size_t i = 0; i < count; ++i) {
+        fprintf(cache, "%lu %lu %lx %lx %d %zu %zu %.1f\n", (unsigned long) entries[i].src_dev,
+                (unsigned long) entries[i].dest_dev, entries[i].src_fs_type, entries[i].dest_fs_type,
+                (int) entries[i].engine, entries[i].buffer_size, entries[i].threads, entries[i].throughput);
+    }
+    if (fclose(cache) != 0 || renameat(dir_fd, temp_name, dir_fd, CALIBRATION_FILE) == -1) {
+        unlinkat(dir_fd, temp_name, 0);
+        close(dir_fd);
+        return ERROR_COPY_FAILED;
+    }
+    close(dir_fd);
+    return SUCCESS;
+}
+
+/**
+ * @brief Times one copy of the calibration sample.
+ *
+ * @return The throughput in MB/s, or 0 if the copy failed.
+ */
+static double timeCopy(const int src_fd, const int sample_fd, const copy_options_t *options) {
+    if (ftruncate(sample_fd, 0) == -1) {
+        return 0;
+    }
+    struct timespec start, end;
+    off_t copied = 0;
+    clock_gettime(CLOCK_MONOTONIC, &start);
+    if (copyDescriptors(src_fd, sample_fd, NULL, options, &copied) != SUCCESS) {
+        return 0;
+    }
+    clock_gettime(CLOCK_MONOTONIC, &end);
+    const double seconds = (double) (end.tv_sec - start.tv_sec) + (double) (end.tv_nsec - start.tv_nsec) / 1e9;
+    return seconds > 0 ? (double) copied / (1024.0 * 1024.0) / seconds : 0;
+}
+
+/**
+ * @brief Measures the candidate configurations between two file systems.
+ *
+ * @param src Path to the source file, used as sample data.
+ * @param dest_dir Directory on the destination file system, where the sample is written.
+ * @param src_size Size of the source file.
+ * @param entry Entry whose tuning fields are filled with the fastest configuration.
+ * @return `SUCCESS` if at least one configuration worked, or an error code otherwise.
+ *
+ * @details
+ * - The sample is an unnamed `O_TMPFILE` on the destination file system: nothing ever appears in
+ *   the destination directory, and its space is freed even if `redit` is killed. File systems
+ *   without `O_TMPFILE` are not calibrated.
+ * - A first untimed run warms the page cache, so every timed run reads the same cached sample.
+ * - Each timed run ends with `fdatasync`, so the destination device is part of the measurement.
+ */
+static int calibrate(const char *src, const char *dest_dir, const off_t src_size, calibration_entry_t *entry) {
+    const int src_fd = open(src, O_RDONLY | O_CLOEXEC);
+    if (src_fd == -1) {
+        return errno == EACCES ? ERROR_PERMISSION_DENIED : ERROR_FILE_NOT_FOUND;
+    }
+    const int sample_fd = open(dest_dir, O_TMPFILE | O_RDWR | O_CLOEXEC, S_IRUSR | S_IWUSR);
+    if (sample_fd == -1) {
+        const int open_error = errno;
+        close(src_fd);
+        return open_error == EACCES ? ERROR_PERMISSION_DENIED : ERROR_PATH_INVALID;
+    }
+
+    const off_t sample_size = src_size < CALIBRATION_SAMPLE_SIZE ? src_size : CALIBRATION_SAMPLE_SIZE;
+    copy_options_t options = {.sync_mode = SYNC_NONE, .max_length = sample_size};
+
+    // Warm up the source pages
+    timeCopy(src_fd, sample_fd, &options);
+    options.sync_mode = SYNC_DATA;
+
+    // Pick the fastest engine and buffer size
+    entry->throughput = 0;
+    for (size_t i = 0; i < sizeof(CANDIDATES) / sizeof(CANDIDATES[0]); ++i) {
+        options.engine = CANDIDATES[i].engine;
+        options.buffer_size = CANDIDATES[i].buffer_size;
+        options.threads = 1;
+        const double throughput = timeCopy(src_fd, sample_fd, &options);
+        if (throughput > entry->throughput) {
+            entry->throughput = throughput;
+            entry->engine = options.engine;
+            entry->buffer_size = options.buffer_size;
+            entry->threads = 1;
+        }
+    }
+
+    // Then check whether concurrent streams help with it
+    options.engine = entry->engine;
+    options.buffer_size = entry->buffer_size;
+    for (size_t i = 0; i < sizeof(THREAD_CANDIDATES) / sizeof(THREAD_CANDIDATES[0]); ++i) {
+        options.threads = THREAD_CANDIDATES[i];
+        const double throughput = timeCopy(src_fd, sample_fd, &options);
+        if (throughput > entry->throughput) {
+            entry->throughput = throughput;
+            entry->threads = options.threads;
+        }
+    }
+
+    close(sample_fd);
+    close(src_fd);
+    return entry->throughput > 0 ? SUCCESS : ERROR_COPY_FAILED;
+}
+
+/**
+ * @brief Fills the engine, buffer size and thread count of the copy options for a copy.
+ *
+ * @param src Path to the file that will be copied.
+ * @param dest Path to the destination file (it may not exist yet).
+ * @param recalibrate Forces a new calibration for this pair of file systems.
+ * @param options Copy options to tune. Left untouched if there is no calibration to apply.
+ * @param calibrated_throughput Set to the measured MB/s if a calibration ran, or 0 otherwise.
+ * @return `SUCCESS` if the options were tuned or left at their defaults, or an error code otherwise.
+ *
+ * @details
+ * - Uses the cached calibration of the source and destination file systems if there is one.
+ * - Otherwise calibrates if the file is at least `CALIBRATION_MIN_SIZE` bytes (or a
+ *   recalibration is forced); smaller copies keep the built-in heuristic.
+ * - An entry whose file system types no longer match its devices is considered stale.
+ */
+int tuneCopyOptions(const char *src, const char *dest, const bool recalibrate, copy_options_t *options,
+                    double *calibrated_throughput) {
+    *calibrated_throughput = 0;
+
+    // Identify both file systems; the destination may not exist yet, so use its directory
+    char dest_copy[PATH_MAX];
+    strlcpy(dest_copy, dest, PATH_MAX);
+    const char *dest_dir = dirname(dest_copy);
+
+    struct stat src_stat, dest_stat;
+    struct statfs src_fs, dest_fs;
+    if (stat(src, &src_stat) == -1 || statfs(src, &src_fs) == -1) {
+        return ERROR_FILE_NOT_FOUND;
+    }
+    if (stat(dest_dir, &dest_stat) == -1 || statfs(dest_dir, &dest_fs) == -1) {
+        return ERROR_FILE_NOT_FOUND;
+    }
+
+    calibration_entry_t entries[MAX_CALIBRATION_ENTRIES];
+    size_t count;
+    const int load_result = loadCalibrationCache(entries, &count);
+    if (load_result != SUCCESS) {
+        return load_result;
+    }
+
+    // Look for this pair of file systems in the cache
+    size_t index = count;
+    for (size_t i = 0; i < count; ++i) {
+        if (entries[i].src_dev == src_stat.st_dev && entries[i].dest_dev == dest_stat.st_dev) {
+            index = i;
+            break;
+        }
+    }
+    const bool is_stale = index < count && (entries[index].src_fs_type != (unsigned long) src_fs.f_type ||
+                                            entries[index].dest_fs_type != (unsigned long) dest_fs.f_type);
+
+    if (index == count || is_stale || recalibrate) {
+        if (src_stat.st_size < CALIBRATION_MIN_SIZE && !recalibrate) {
+            return SUCCESS; // Too small to be worth measuring
+        }
+
+        calibration_entry_t entry = {
+            .src_dev = src_stat.st_dev,
+            .dest_dev = dest_stat.st_dev,
+            .src_fs_type = (unsigned long) src_fs.f_type,
+            .dest_fs_type = (unsigned long) dest_fs.f_type
+        };
+        const int calibrate_result = calibrate(src, dest_dir, src_stat.st_size, &entry);
+        if (calibrate_result != SUCCESS) {
+            return calibrate_result;
+        }
+        *calibrated_throughput = entry.throughput;
+
+        // Replace the old entry, or add a new one (evicting the oldest if the cache is full)
+        if (index == count) {
+            if (count == MAX_CALIBRATION_ENTRIES) {
+                memmove(entries, entries + 1, (count - 1) * sizeof(calibration_entry_t));
+                count--;
+            }
+            index = count++;
+        }
+        entries[index] = entry;
+        saveCalibrationCache(entries, count); // A cache write failure only means calibrating again later
+    }
+
+    options->engine = entries[index].engine;
+    options->buffer_size = entries[index].buffer_size;
+    options->threads = entries[index].threads;
+    return SUCCESS;
+}
+
+/**
+ * @brief Deletes the calibration cache, so the next large copies calibrate again.
+ *
+ * @return `SUCCESS` if the cache was deleted or did not exist, or an error code otherwise.
+ */
+int clearCalibrationCache() {
+    int dir_fd;
+    uid_t ef_uid;
+    const int dir_result = openUserDataDir(CALIBRATION_DIR, &dir_fd, &ef_uid);
+    if (dir_result != SUCCESS) {
+        return dir_result;
+    }
+    const int unlink_result = unlinkat(dir_fd, CALIBRATION_FILE, 0);
+    const int unlink_error = errno;
+    close(dir_fd);
+    if (unlink_result == -1 && unlink_error != ENOENT) {
+        return ERROR_PERMISSION_DENIED;
+    }
+    return SUCCESS;
+}
@@ -0,0 +1,454 @@
+#include <errno.h>
+#include <fcntl.h>
+#include <pthread.h>
+#include <stdatomic.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/stat.h>
+
+#include "../include/compression_handler.h"
+#include "../include/device_handler.h"
+#include "../include/error_handler.h"
+#include "../include/stats_handler.h"
+#include "../include/throttle_handler.h"
+#include "../include/trace_handler.h"
+#include "../include/window_handler.h"
+#include "../include/verify_handler.h"
+
+/**
+ * @file verify_handler.c
+ * @brief Finds which copies differ from their privileged files.
+ *
+ * Most pairs are decided without reading them, like `rsync` does: a copy whose size is not
+ * the size of what it was copied from has changed, and a copy that still has the modification
+ * time of the privileged file it was copied from (`redit -C` gives it that time) has not, as
+ * long as the privileged file has not been modified since either.
+ *
+ * The remaining pairs are split into `VERIFY_CHUNK_SIZE` chunks that a pool of threads takes
+ * in turn and compares with `memcmp`, which glibc vectorizes. A pair is dropped as soon as one
+ * of its chunks differs, so a changed file is seldom read whole.
+ *
+ * The pool is shared, but each device only serves as many chunks at once as its limit allows
+ * (see `getDeviceConcurrency`): a thread takes the first chunk whose devices both have a free
+ * slot, so a spinning disk is read one stream at a time while an SSD next to it is read by
+ * every other thread. On a spinning disk, pairs are taken in the order their privileged files
+ * lie on it, and each file front to back, which keeps the head sweeping in one direction.
+ */
+
+/**
+ * @brief A pair whose content is being compared.
+ */
+typedef struct {
+    verify_pair_t *pair; ///< Pair being compared.
+    off_t offset; ///< Offset in the privileged file of what the copy holds.
+    dev_t copy_device; ///< Device of the copy.
+    dev_t prv_device; ///< Device of the privileged file.
+    size_t slots[2]; ///< Indexes in the device table of the devices of the copy and the privileged file.
+    uint64_t position; ///< Where the privileged file lies on a rotational device, 0 on others.
+    atomic_bool changed; ///< Set by the first chunk found to differ.
+    atomic_int error; ///< Set by the first chunk that could not be compared.
+} pair_state_t;
+
+/**
+ * @brief A device the compared files are on, and how many chunks it is serving.
+ */
+typedef struct {
+    dev_t device; ///< Device, as in `st_dev`.
+    size_t limit; ///< Most chunks read from the device at once.
+    bool rotational; ///< Whether the device is a spinning disk.
+    size_t active; ///< Chunks being read from the device.
+} device_slot_t;
+
+/**
+ * @brief A chunk of a pair, the unit of work of the thread pool.
+ */
+typedef struct {
+    pair_state_t *state; ///< Pair the chunk belongs to.
+    off_t start; ///< Offset of the chunk in the copy.
+    off_t end; ///< End of the chunk in the copy.
+    bool taken; ///< Whether a thread took the chunk.
+} verify_chunk_t;
+
+/**
+ * @brief Chunks left to compare, shared by the thread pool.
+ */
+typedef struct {
+    verify_chunk_t *chunks; ///< Every chunk, in the order they should be taken.
+    size_t count; ///< Number of `chunks`.
+    size_t first_pending; ///< No chunk before this one is left to take.
+    device_slot_t *devices; ///< Devices the chunks are read from.
+    size_t n_devices; ///< Number of `devices`.
+    pthread_mutex_t mutex; ///< Guards the chunks and the devices.
+    pthread_cond_t released; ///< Signaled when a chunk is done, freeing a slot of its devices.
+    atomic_llong compared; ///< Bytes of the copies compared.
+} verify_queue_t;
+
+// Function prototypes
+static int checkMetadata(verify_pair_t *pair, pair_state_t *state, off_t *length, bool *decided);
+
+static size_t findDeviceSlot(verify_queue_t *queue, dev_t device);
+
+static void positionPair(pair_state_t *state, const verify_queue_t *queue);
+
+static int comparePairOrder(const void *a, const void *b);
+
+static void *compareChunks(void *arg);
+
+static verify_chunk_t *takeChunk(verify_queue_t *queue);
+
+static void compareChunk(const verify_chunk_t *chunk, char *copy_buffer, char *prv_buffer, atomic_llong *compared);
+
+/**
+ * @brief Checks which copies differ from their privileged files.
+ *
+ * @param pairs Pairs to check; `changed`, `compared` and `error` are set in each.
+ * @param count Number of `pairs`.
+ * @param threads Threads comparing content, or 0 for one per CPU the process may run on (at most
+ *                `VERIFY_MAX_THREADS`).
+ * @return `SUCCESS` if every pair was checked or failed on its own (see its `error`), or
+ *         `ERROR_MEMORY_ALLOCATION`.
+ *
+ * @details
+ * - A copy holding a range of lines (`--lines`) is compared with that range of its privileged file.
+ */
+int verifyPairs(verify_pair_t *pairs, const size_t count, size_t threads) {
+    const uint64_t start_ns = traceNow();
+    pair_state_t *states = calloc(count > 0 ? count : 1, sizeof(pair_state_t));
+    pair_state_t **order = calloc(count > 0 ? count : 1, sizeof(pair_state_t *));
+    off_t *lengths = calloc(count > 0 ? count : 1, sizeof(off_t));
+    verify_queue_t queue = {.devices = calloc(2 * (count > 0 ? count : 1), sizeof(device_slot_t))};
+    if (states == NULL || order == NULL || lengths == NULL || queue.devices == NULL) {
+        free(states);
+        free(order);
+        free(lengths);
+        free(queue.devices);
+        return ERROR_MEMORY_ALLOCATION;
+    }
+
+    // Decide what the metadata can, and count the chunks of the rest
+    size_t chunk_count = 0, n_compared = 0;
+    for (size_t i = 0; i < count; ++i) {
+        verify_pair_t *pair = &pairs[i];
+        bool decided;
+        pair->compared = false;
+        pair->error = checkMetadata(pair, &states[i], &lengths[i], &decided);
+        states[i].pair = pair;
+        atomic_init(&states[i].changed, false);
+        atomic_init(&states[i].error, SUCCESS);
+        if (pair->error == SUCCESS && !decided) {
+            pair->compared = true;
+            chunk_count += (size_t) ((lengths[i] + VERIFY_CHUNK_SIZE - 1) / VERIFY_CHUNK_SIZE);
+            states[i].slots[0] = findDeviceSlot(&queue, states[i].copy_device);
+            states[i].slots[1] = findDeviceSlot(&queue, states[i].prv_device);
+            positionPair(&states[i], &queue);
+            order[n_compared++] = &states[i];
+        }
+    }
+
+    // Group the pairs by the device of their privileged file, in disk order on rotational ones
+    qsort(order, n_compared, sizeof(pair_state_t *), comparePairOrder);
+    queue.chunks = malloc((chunk_count > 0 ? chunk_count : 1) * sizeof(verify_chunk_t));
+    if (queue.chunks == NULL) {
+        free(states);
+        free(order);
+        free(lengths);
+        free(queue.devices);
+        return ERROR_MEMORY_ALLOCATION;
+    }
+    for (size_t i = 0; i < n_compared; ++i) {
+        const off_t length = lengths[order[i] - states];
+        for (off_t start = 0; start < length; start += VERIFY_CHUNK_SIZE) {
+            const off_t end = length - start > VERIFY_CHUNK_SIZE ? start + VERIFY_CHUNK_SIZE : length;
+            queue.chunks[queue.count++] = (verify_chunk_t){.state = order[i], .start = start, .end = end};
+        }
+    }
+    pthread_mutex_init(&queue.mutex, NULL);
+    pthread_cond_init(&queue.released, NULL);
+    atomic_init(&queue.compared, 0);
+
+    // Compare the chunks in a pool of threads, the calling one included, as many as the devices take
+    size_t device_capacity = 0;
+    for (size_t i = 0; i < queue.n_devices; ++i) {
+        device_capacity += queue.devices[i].limit;
+    }
+    if (threads == 0) {
+        threads = countCpus();
+    }
+    if (threads > VERIFY_MAX_THREADS) {
+        threads = VERIFY_MAX_THREADS;
+    }
+    if (threads > device_capacity) {
+        threads = device_capacity > 0 ? device_capacity : 1;
+    }
+    if (threads > queue.count) {
+        threads = queue.count > 0 ? queue.count : 1;
+    }
+    pthread_t workers[VERIFY_MAX_THREADS];
+    size_t n_started = 1;
+    for (; n_started < threads; ++n_started) {
+        if (pthread_create(&workers[n_started], NULL, compareChunks, &queue) != 0) {
+            break; // The threads started take the chunks of the others
+        }
+    }
+    compareChunks(&queue);
+    for (size_t i = 1; i < n_started; ++i) {
+        pthread_join(workers[i], NULL);
+    }
+
+    for (size_t i = 0; i < count; ++i) {
+        if (pairs[i].compared) {
+            pairs[i].changed = atomic_load(&states[i].changed);
+            pairs[i].error = atomic_load(&states[i].error);
+        }
+    }
+    traceSpan("verify", "verifyPairs", start_ns, NULL, atomic_load(&queue.compared));
+    pthread_cond_destroy(&queue.released);
+    pthread_mutex_destroy(&queue.mutex);
+    free(queue.chunks);
+    free(queue.devices);
+    free(states);
+    free(order);
+    free(lengths);
+    return SUCCESS;
+}
+
+/**
+ * @brief Decides whether a copy differs from its privileged file from their metadata alone.
+ *
+ * @param pair Pair to check. Its `changed` field is set if the copy differs, when `decided`.
+ * @param state State of the pair, receiving the offset in the privileged file of what the copy
+ *              holds and the devices of both files.
+ * @param length Set to the length of what the copy holds.
+ * @param decided Set if the metadata is enough to decide.
+ * @return `SUCCESS`, `ERROR_FILE_NOT_FOUND` if a file is missing, `ERROR_INVALID_SOURCE` if
+ *         the copy is not a regular file, or `ERROR_SAME_SOURCE` if both paths lead to the same file.
+ */
+static int checkMetadata(verify_pair_t *pair, pair_state_t *state, off_t *length, bool *decided) {
+    off_t *offset = &state->offset;
+    bool *changed = &pair->changed;
+    *decided = false;
+    *changed = false;
+    struct stat copy_stat, prv_stat;
+    if (STATS_SYSCALL(stat(pair->copy_file_path, &copy_stat)) == -1) {
+        return errno == EACCES ? ERROR_PERMISSION_DENIED : ERROR_FILE_NOT_FOUND;
+    }
+    if (!S_ISREG(copy_stat.st_mode)) {
+        return ERROR_INVALID_SOURCE;
+    }
+    if (STATS_SYSCALL(stat(pair->privileged_file_path, &prv_stat)) == -1) {
+        return errno == EACCES ? ERROR_PERMISSION_DENIED : ERROR_FILE_NOT_FOUND;
+    }
+
+    if (copy_stat.st_dev == prv_stat.st_dev && copy_stat.st_ino == prv_stat.st_ino) {
+        return ERROR_SAME_SOURCE; // Both paths lead to one file, which is no copy of the other
+    }
+
+    state->copy_device = copy_stat.st_dev;
+    state->prv_device = prv_stat.st_dev;
+
+    // What the copy was taken from: a recorded range of lines, or the whole file
+    window_t window;
+    struct timespec copied_modified = prv_stat.st_mtim;
+    *offset = 0;
+    *length = prv_stat.st_size;
+    if (loadWindow(pair->copy_file_path, pair->privileged_file_path, &window) == SUCCESS) {
+        *offset = window.offset;
+        *length = window.offset + window.length <= prv_stat.st_size ? window.length : -1;
+        copied_modified = window.modified;
+    }
+
+    // A decompressed copy cannot be compared with the file; unless neither was touched, the overwrite rewrites it
+    compression_t compression;
+    if (loadCompression(pair->copy_file_path, pair->privileged_file_path, &compression, NULL) == SUCCESS) {
+        *decided = true;
+        *changed = copy_stat.st_mtim.tv_sec != prv_stat.st_mtim.tv_sec ||
+                   copy_stat.st_mtim.tv_nsec != prv_stat.st_mtim.tv_nsec;
+        return SUCCESS;
+    }
+
+    if (copy_stat.st_size != *length) {
+        *decided = *changed = true;
+    } else if (*length == 0) {
+        *decided = true;
+    } else {
+        // Unedited since it was copied from a privileged file that has not been modified since
+        *decided = copy_stat.st_mtim.tv_sec == copied_modified.tv_sec &&
+                   copy_stat.st_mtim.tv_nsec == copied_modified.tv_nsec &&
+                   prv_stat.st_mtim.tv_sec == copied_modified.tv_sec &&
+                   prv_stat.st_mtim.tv_nsec == copied_modified.tv_nsec;
+    }
+    return SUCCESS;
+}
+
+/**
+ * @brief Finds the slot of a device in the device table, adding it if it is not there yet.
+ *
+ * @return The index of the slot.
+ */
+static size_t findDeviceSlot(verify_queue_t *queue, const dev_t device) {
+    for (size_t i = 0; i < queue->n_devices; ++i) {
+        if (queue->devices[i].device == device) {
+            return i;
+        }
+    }
+    device_slot_t *slot = &queue->devices[queue->n_devices];
+    *slot = (device_slot_t){.device = device};
+    slot->limit = getDeviceConcurrency(device, &slot->rotational);
+    return queue->n_devices++;
+}
+
+/**
+ * @brief Finds where the privileged file of a pair lies, if it is on a rotational device.
+ */
+static void positionPair(pair_state_t *state, const verify_queue_t *queue) {
+    state->position = 0;
+    if (!queue->devices[state->slots[1]].rotational) {
+        return;
+    }
+    const int prv_fd = STATS_SYSCALL(open(state->pair->privileged_file_path, O_RDONLY | O_CLOEXEC));
+    struct stat prv_stat;
+    if (prv_fd != -1 && STATS_SYSCALL(fstat(prv_fd, &prv_stat)) == 0) {
+        state->position = getPhysicalOffset(prv_fd, &prv_stat) + (uint64_t) state->offset;
+    }
+    if (prv_fd != -1) {
+        STATS_SYSCALL(close(prv_fd));
+    }
+}
+
+/**
+ * @brief Orders pairs by the device of their privileged file, then by where it lies on it.
+ *
+ * @details
+ * - Pairs on the same position (all of them, off rotational devices) keep the order they were given in.
+ */
+static int comparePairOrder(const void *a, const void *b) {
+    const pair_state_t *first = *(pair_state_t *const *) a;
+    const pair_state_t *second = *(pair_state_t *const *) b;
+    if (first->slots[1] != second->slots[1]) {
+        return first->slots[1] < second->slots[1] ? -1 : 1;
+    }
+    if (first->position != second->position) {
+        return first->position < second->position ? -1 : 1;
+    }
+    return first < second ? -1 : first > second;
+}
+
+/**
+ * @brief Compares chunks until none is left; run by every thread of the pool.
+ *
+ * @param arg The shared `verify_queue_t`.
+ * @return `NULL`.
+ */
+static void *compareChunks(void *arg) {
+    verify_queue_t *queue = arg;
+    char *buffers = malloc(2 * VERIFY_BUFFER_SIZE);
+    pthread_mutex_lock(&queue->mutex);
+    for (verify_chunk_t *chunk; (chunk = takeChunk(queue)) != NULL;) {
+        pthread_mutex_unlock(&queue->mutex);
+        if (buffers == NULL) {
+            atomic_store(&chunk->state->error, ERROR_MEMORY_ALLOCATION);
+        } else {
+            compareChunk(chunk, buffers, buffers + VERIFY_BUFFER_SIZE, &queue->compared);
+        }
+
+        // Give the slots of its devices back
+        pthread_mutex_lock(&queue->mutex);
+        queue->devices[chunk->state->slots[0]].active--;
+        if (chunk->state->slots[1] != chunk->state->slots[0]) {
+            queue->devices[chunk->state->slots[1]].active--;
+        }
+        pthread_cond_broadcast(&queue->released);
+    }
+    pthread_mutex_unlock(&queue->mutex);
+    free(buffers);
+    return NULL;
+}
+
+/**
+ * @brief Takes the first chunk whose devices can serve one more, waiting for one if needed.
+ *
+ * @param queue The shared queue, whose mutex is held.
+ * @return The chunk taken, with a slot of its devices held, or `NULL` when none is left.
+ *
+ * @details
+ * - Chunks of pairs already decided by another chunk are dropped on the way.
+ */
+static verify_chunk_t *takeChunk(verify_queue_t *queue) {
+    while (true) {
+        while (queue->first_pending < queue->count && queue->chunks[queue->first_pending].taken) {
+            queue->first_pending++;
+        }
+        bool pending = false;
+        for (size_t i = queue->first_pending; i < queue->count; ++i) {
+            verify_chunk_t *chunk = &queue->chunks[i];
+            if (chunk->taken) {
+                continue;
+            }
+            const pair_state_t *state = chunk->state;
+            if (atomic_load(&state->changed) || atomic_load(&state->error) != SUCCESS) {
+                chunk->taken = true; // Already decided by another chunk
+                continue;
+            }
+            pending = true;
+            device_slot_t *copy_slot = &queue->devices[state->slots[0]];
+            device_slot_t *prv_slot = &queue->devices[state->slots[1]];
+            const bool same_device = copy_slot == prv_slot;
+            if (copy_slot->active < copy_slot->limit && (same_device || prv_slot->active < prv_slot->limit)) {
+                chunk->taken = true;
+                copy_slot->active++;
+                if (!same_device) {
+                    prv_slot->active++;
+                }
+                return chunk;
+            }
+        }
+        if (!pending) {
+            return NULL;
+        }
+        pthread_cond_wait(&queue->released, &queue->mutex); // Every pending chunk waits for a busy device
+    }
+}
+
+/**
+ * @brief Compares one chunk of a copy with the same bytes of its privileged file.
+ *
+ * @details
+ * - Stops early once another chunk of the same pair is found to differ.
+ */
+static void compareChunk(const verify_chunk_t *chunk, char *copy_buffer, char *prv_buffer, atomic_llong *compared) {
+    pair_state_t *state = chunk->state;
+    const int copy_fd = STATS_SYSCALL(open(state->pair->copy_file_path, O_RDONLY | O_CLOEXEC));
+    const int prv_fd = copy_fd != -1 ? STATS_SYSCALL(open(state->pair->privileged_file_path, O_RDONLY | O_CLOEXEC))
+                                     : -1;
+    if (copy_fd == -1 || prv_fd == -1) {
+        atomic_store(&state->error, errno == EACCES ? ERROR_PERMISSION_DENIED : ERROR_FILE_NOT_FOUND);
+        if (copy_fd != -1) {
+            close(copy_fd);
+        }
+        return;
+    }
+    STATS_SYSCALL(posix_fadvise(copy_fd, chunk->start, chunk->end - chunk->start, POSIX_FADV_SEQUENTIAL));
+    STATS_SYSCALL(posix_fadvise(prv_fd, state->offset + chunk->start, chunk->end - chunk->start,
+                                POSIX_FADV_SEQUENTIAL));
+
+    for (off_t position = chunk->start; position < chunk->end && !atomic_load(&state->changed);) {
+        const size_t wanted = chunk->end - position > VERIFY_BUFFER_SIZE ? VERIFY_BUFFER_SIZE
+                                                                         : (size_t) (chunk->end - position);
+        const ssize_t copy_read = statsPread(copy_fd, copy_buffer, wanted, position);
+        const ssize_t prv_read = statsPread(prv_fd, prv_buffer, wanted, state->offset + position);
+        if (copy_read == -1 || prv_read == -1) {
+            atomic_store(&state->error, ERROR_COPY_FAILED);
+            break;
+        }
+        // A short read means a file was truncated since it was checked
+        if (copy_read != prv_read || copy_read == 0 || memcmp(copy_buffer, prv_buffer, copy_read) != 0) {
+            atomic_store(&state->changed, true);
+            break;
+        }
+        atomic_fetch_add(compared, copy_read);
+        position += copy_read;
+    }
+    close(copy_fd);
+    close(prv_fd);
+}
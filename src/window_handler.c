@@ -0,0 +1,742 @@
+#include <errno.h>
+#include <fcntl.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <linux/limits.h>
+#include <sys/stat.h>
+
+#if defined(__AVX2__) || defined(__SSE2__)
+#include <immintrin.h>
+#endif
+
+#include "../include/error_handler.h"
+#include "../include/paths_handler.h"
+#include "../include/stats_handler.h"
+#include "../include/trace_handler.h"
+#include "../include/window_handler.h"
+
+/**
+ * @file window_handler.c
+ * @brief Copies line ranges out of large files and splices them back.
+ *
+ * Finding line N of a file means counting the newlines before it. The scanner compares 64
+ * bytes at a time against '\n' with SSE2 or AVX2 and counts the matching bits, so it runs
+ * at memory speed and only looks at individual newlines around the offsets it records.
+ * Every `LINE_INDEX_STRIDE`th line start goes into an index stamped with the identity and
+ * change state of the file, stored between runs: later windows only scan from the nearest
+ * recorded offset, and the index is extended lazily as windows further down are asked for.
+ *
+ * On overwrite the edited range replaces the original one in place. Only the bytes from the
+ * range onward are rewritten, and only the range itself when its length did not change.
+ */
+
+#define LINE_INDEX_MAGIC 0x4C444552U // "REDL"
+#define LINE_INDEX_VERSION 1
+#define WINDOW_MAGIC 0x57444552U // "REDW"
+#define LINE_WALK_SIZE (64 * 1024) // Bytes read at once while walking from a recorded offset to a line
+
+/**
+ * @brief Header of a stored line index, followed by `count` offsets.
+ */
+typedef struct {
+    uint32_t magic; ///< `LINE_INDEX_MAGIC`.
+    uint32_t version; ///< `LINE_INDEX_VERSION`.
+    uint64_t stride; ///< `LINE_INDEX_STRIDE` when the index was built.
+    uint64_t device; ///< Device of the indexed file.
+    uint64_t inode; ///< Inode of the indexed file.
+    int64_t size; ///< Size of the indexed file.
+    int64_t modified_sec, modified_nsec; ///< Modification time of the indexed file.
+    int64_t changed_sec, changed_nsec; ///< Status change time of the indexed file.
+    uint64_t scanned_offset; ///< Bytes scanned from the start of the file.
+    uint64_t scanned_lines; ///< Newlines found in the scanned bytes.
+    uint64_t count; ///< Recorded offsets: offset `i` is where line `i * stride + 1` starts.
+} line_index_header_t;
+
+/**
+ * @brief A line index in memory.
+ */
+typedef struct {
+    line_index_header_t header; ///< Stamp and scan progress.
+    uint64_t *offsets; ///< Start offset of every `stride`th line, from line 1.
+    size_t capacity; ///< Allocated entries in `offsets`.
+    bool dirty; ///< Extended since it was loaded.
+} line_index_t;
+
+/**
+ * @brief A window record, as stored next to the baseline of its copy/privileged pair.
+ */
+typedef struct {
+    uint32_t magic; ///< `WINDOW_MAGIC`.
+    window_t window; ///< The window.
+} window_record_t;
+
+// Function prototypes
+static uint64_t newlineMask(const uint8_t *block);
+
+static int getLineIndexPath(const char *file_path, char index_path[PATH_MAX]);
+
+static bool matchesFile(const line_index_header_t *header, const struct stat *file_stat);
+
+static void stampLineIndex(line_index_header_t *header, const struct stat *file_stat);
+
+static int loadLineIndex(const char *file_path, const struct stat *file_stat, bool check_stamp, line_index_t *index);
+
+static int saveLineIndex(const char *file_path, const line_index_t *index);
+
+static int addLineOffset(line_index_t *index, uint64_t offset);
+
+static int extendLineIndex(int fd, const struct stat *file_stat, uint64_t target_lines, line_index_t *index);
+
+static int findLineStart(int fd, const line_index_t *index, uint64_t newlines, off_t *offset);
+
+static int moveRange(int fd, off_t from, off_t to, off_t length);
+
+static int getWindowPath(const char *copy_file_path, const char *privileged_file_path, char window_path[PATH_MAX]);
+
+/**
+ * @brief Parses a `--lines` value.
+ *
+ * @param value `FIRST:LAST` (inclusive, from 1), `FIRST:` up to the end of the file, or a single line `N`.
+ * @param first_line Set to the first line.
+ * @param last_line Set to the last line, or 0 for the end of the file.
+ * @return `SUCCESS` if the value is valid, or `ERROR_INVALID_ARGUMENT` otherwise.
+ */
+int parseLineRange(const char *value, size_t *first_line, size_t *last_line) {
+    if (value == NULL || value[0] < '0' || value[0] > '9') {
+        return ERROR_INVALID_ARGUMENT;
+    }
+    char *end = NULL;
+    errno = 0;
+    const unsigned long long first = strtoull(value, &end, 10);
+    unsigned long long last = first;
+    if (*end == ':') {
+        const char *last_value = end + 1;
+        last = 0;
+        if (*last_value != '\0') {
+            if (*last_value < '0' || *last_value > '9') {
+                return ERROR_INVALID_ARGUMENT;
+            }
+            last = strtoull(last_value, &end, 10);
+        } else {
+            end = (char *) last_value;
+        }
+    }
+    if (errno != 0 || *end != '\0' || first == 0 || (last != 0 && last < first)) {
+        return ERROR_INVALID_ARGUMENT;
+    }
+    *first_line = first;
+    *last_line = last;
+    return SUCCESS;
+}
+
+/**
+ * @brief Finds the byte range of a range of lines.
+ *
+ * @param fd Descriptor of the file, open for reading.
+ * @param file_path Absolute path to the file, naming its line index.
+ * @param file_stat Current metadata of the file.
+ * @param first_line First line of the range, from 1.
+ * @param last_line Last line of the range, or 0 for the end of the file. Clamped to the end of the file.
+ * @param offset Set to the offset where `first_line` starts.
+ * @param length Set to the length of the range, including the newline of `last_line`.
+ * @return `SUCCESS` if the range was found, `ERROR_INVALID_ARGUMENT` if the file has fewer
+ *         than `first_line` lines, or another error code.
+ *
+ * @details
+ * - A stored index is reused if the file did not change since it was built, and saved again
+ *   if the range lay beyond it. Failing to load or save it only costs a rescan.
+ */
+int locateLines(const int fd, const char *file_path, const struct stat *file_stat, const size_t first_line,
+                const size_t last_line, off_t *offset, off_t *length) {
+    const uint64_t start_ns = traceNow();
+    line_index_t index = {0};
+    if (loadLineIndex(file_path, file_stat, true, &index) != SUCCESS) {
+        free(index.offsets);
+        index = (line_index_t){.header.stride = LINE_INDEX_STRIDE};
+        stampLineIndex(&index.header, file_stat);
+        const int add_result = addLineOffset(&index, 0); // Line 1
+        if (add_result != SUCCESS) {
+            return add_result;
+        }
+        index.dirty = true;
+    }
+
+    // Line N starts after N - 1 newlines, and the range ends where line `last_line + 1` starts
+    const uint64_t target_lines = last_line != 0 ? last_line : first_line - 1;
+    int result = extendLineIndex(fd, file_stat, target_lines, &index);
+
+    off_t start = 0;
+    off_t end = file_stat->st_size;
+    if (result == SUCCESS) {
+        result = findLineStart(fd, &index, first_line - 1, &start);
+    }
+    if (result == SUCCESS && start >= file_stat->st_size && first_line > 1) {
+        result = ERROR_INVALID_ARGUMENT; // The file ends before that line
+    }
+    if (result == SUCCESS && last_line != 0 && findLineStart(fd, &index, last_line, &end) != SUCCESS) {
+        end = file_stat->st_size; // The file ends within the range
+    }
+
+    if (index.dirty) {
+        saveLineIndex(file_path, &index);
+    }
+    free(index.offsets);
+    if (result != SUCCESS) {
+        return result;
+    }
+    *offset = start;
+    *length = end - start;
+    traceSpan("index", "locateLines", start_ns, file_path, *length);
+    return SUCCESS;
+}
+
+/**
+ * @brief Keeps the part of a file's line index that is still valid after the file was modified.
+ *
+ * @param file_path Absolute path to the file.
+ * @param old_stat Metadata of the file the index was built for.
+ * @param new_stat Metadata of the file after the modification.
+ * @param valid_offset Offset before which the file did not change.
+ * @return `SUCCESS` if the index was kept, or an error code otherwise (the index is then rebuilt when needed).
+ */
+int truncateLineIndex(const char *file_path, const struct stat *old_stat, const struct stat *new_stat,
+                      const off_t valid_offset) {
+    line_index_t index = {0};
+    int result = loadLineIndex(file_path, old_stat, true, &index);
+    if (result == SUCCESS) {
+        // Keep the recorded offsets up to the change; the scan resumes from the last of them
+        size_t kept = 1;
+        while (kept < index.header.count && index.offsets[kept] <= (uint64_t) valid_offset) {
+            ++kept;
+        }
+        index.header.count = kept;
+        index.header.scanned_offset = index.offsets[kept - 1];
+        index.header.scanned_lines = (kept - 1) * index.header.stride;
+        stampLineIndex(&index.header, new_stat);
+        result = saveLineIndex(file_path, &index);
+    }
+    free(index.offsets);
+    return result;
+}
+
+/**
+ * @brief Copies a byte range from one file to another.
+ *
+ * @param src_fd Descriptor of the source file, open for reading.
+ * @param src_offset Offset of the range in the source.
+ * @param dest_fd Descriptor of the destination file, open for writing.
+ * @param dest_offset Offset to copy the range to.
+ * @param length Length of the range.
+ * @return `SUCCESS` if the range was copied, or `ERROR_COPY_FAILED` otherwise.
+ *
+ * @details
+ * - Uses `copy_file_range`, falling back to `pread`/`pwrite` where the kernel refuses it
+ *   (across file systems on older kernels, or the same file).
+ */
+int copyByteRange(const int src_fd, off_t src_offset, const int dest_fd, off_t dest_offset, off_t length) {
+    while (length > 0) {
+        const ssize_t copied = statsCopyFileRange(src_fd, &src_offset, dest_fd, &dest_offset, (size_t) length, 0);
+        if (copied > 0) {
+            length -= copied;
+            continue;
+        }
+        if (copied == 0) {
+            return ERROR_COPY_FAILED; // The source is shorter than expected
+        }
+        if (errno != EXDEV && errno != EINVAL && errno != ENOSYS && errno != EOPNOTSUPP) {
+            return ERROR_COPY_FAILED;
+        }
+        break;
+    }
+    if (length == 0) {
+        return SUCCESS;
+    }
+
+    uint8_t *buffer = malloc(LINE_SCAN_SIZE);
+    if (buffer == NULL) {
+        return ERROR_MEMORY_ALLOCATION;
+    }
+    int result = SUCCESS;
+    while (result == SUCCESS && length > 0) {
+        const size_t chunk = length < LINE_SCAN_SIZE ? (size_t) length : LINE_SCAN_SIZE;
+        const ssize_t bytes_read = statsPread(src_fd, buffer, chunk, src_offset);
+        if (bytes_read <= 0) {
+            result = ERROR_COPY_FAILED;
+            break;
+        }
+        for (ssize_t done = 0; done < bytes_read;) {
+            const ssize_t bytes_written = statsPwrite(dest_fd, buffer + done, bytes_read - done, dest_offset + done);
+            if (bytes_written <= 0) {
+                result = ERROR_COPY_FAILED;
+                break;
+            }
+            done += bytes_written;
+        }
+        src_offset += bytes_read;
+        dest_offset += bytes_read;
+        length -= bytes_read;
+    }
+    free(buffer);
+    return result;
+}
+
+/**
+ * @brief Replaces a byte range of a file with the content of another file.
+ *
+ * @param fd Descriptor of the file, open for reading and writing.
+ * @param offset Offset of the range to replace.
+ * @param old_length Length of the range to replace.
+ * @param src_fd Descriptor of the file holding the new range, open for reading.
+ * @param new_length Length of the new range.
+ * @param written Set to the number of bytes written to `fd`, moved tail included.
+ * @return `SUCCESS` if the range was replaced, or an error code otherwise.
+ *
+ * @details
+ * - Bytes before `offset` are never touched. With equal lengths only the range is written;
+ *   otherwise the rest of the file is moved to its new place first (growing) or after (shrinking).
+ * - The file is modified in place, so an interrupted splice leaves it partially shifted.
+ */
+int spliceRange(const int fd, const off_t offset, const off_t old_length, const int src_fd, const off_t new_length,
+                off_t *written) {
+    struct stat file_stat;
+    if (STATS_SYSCALL(fstat(fd, &file_stat)) == -1) {
+        return ERROR_COPY_FAILED;
+    }
+    const off_t tail_offset = offset + old_length;
+    const off_t tail_length = file_stat.st_size - tail_offset;
+    *written = new_length;
+
+    // Make room for a longer range before writing it over the start of the tail
+    if (new_length > old_length && tail_length > 0) {
+        const int move_result = moveRange(fd, tail_offset, offset + new_length, tail_length);
+        if (move_result != SUCCESS) {
+            return move_result;
+        }
+        *written += tail_length;
+    }
+
+    const int copy_result = copyByteRange(src_fd, 0, fd, offset, new_length);
+    if (copy_result != SUCCESS) {
+        return copy_result;
+    }
+
+    if (new_length < old_length) {
+        if (tail_length > 0) {
+            const int move_result = moveRange(fd, tail_offset, offset + new_length, tail_length);
+            if (move_result != SUCCESS) {
+                return move_result;
+            }
+            *written += tail_length;
+        }
+        if (STATS_SYSCALL(ftruncate(fd, offset + new_length + tail_length)) == -1) {
+            return ERROR_COPY_FAILED;
+        }
+    }
+    return SUCCESS;
+}
+
+/**
+ * @brief Records the window a copy file holds.
+ *
+ * @param copy_file_path Absolute path to the copy file.
+ * @param privileged_file_path Absolute path to the privileged file.
+ * @param window Window copied to the copy file.
+ * @return `SUCCESS` if the window was recorded, or an error code otherwise.
+ *
+ * @details
+ * - The record lives next to the baseline snapshot of the pair, in the root-only state directory.
+ */
+int saveWindow(const char *copy_file_path, const char *privileged_file_path, const window_t *window) {
+    if (mkdir(REDIT_STATE_DIR, 0755) == -1 && errno != EEXIST) {
+        return errno == EACCES ? ERROR_PERMISSION_DENIED : ERROR_PATH_INVALID;
+    }
+    if (mkdir(BASELINE_DIR, 0700) == -1 && errno != EEXIST) {
+        return errno == EACCES ? ERROR_PERMISSION_DENIED : ERROR_PATH_INVALID;
+    }
+    char window_path[PATH_MAX];
+    const int path_result = getWindowPath(copy_file_path, privileged_file_path, window_path);
+    if (path_result != SUCCESS) {
+        return path_result;
+    }
+
+    const window_record_t record = {.magic = WINDOW_MAGIC, .window = *window};
+    const int fd = STATS_SYSCALL(open(window_path, O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, S_IRUSR | S_IWUSR));
+    if (fd == -1) {
+        return ERROR_PERMISSION_DENIED;
+    }
+    const bool written = statsPwrite(fd, &record, sizeof(record), 0) == (ssize_t) sizeof(record);
+    if (STATS_SYSCALL(close(fd)) == -1 || !written) {
+        unlink(window_path);
+        return ERROR_COPY_FAILED;
+    }
+    return SUCCESS;
+}
+
+/**
+ * @brief Reads the window a copy file holds.
+ *
+ * @param copy_file_path Absolute path to the copy file.
+ * @param privileged_file_path Absolute path to the privileged file.
+ * @param window Filled with the window.
+ * @return `SUCCESS` if the copy file holds a window, `ERROR_FILE_NOT_FOUND` if it holds the whole
+ *         file, or another error code.
+ */
+int loadWindow(const char *copy_file_path, const char *privileged_file_path, window_t *window) {
+    char window_path[PATH_MAX];
+    const int path_result = getWindowPath(copy_file_path, privileged_file_path, window_path);
+    if (path_result != SUCCESS) {
+        return path_result;
+    }
+    const int fd = STATS_SYSCALL(open(window_path, O_RDONLY | O_CLOEXEC));
+    if (fd == -1) {
+        return errno == ENOENT ? ERROR_FILE_NOT_FOUND : ERROR_PERMISSION_DENIED;
+    }
+    window_record_t record;
+    const bool complete = statsPread(fd, &record, sizeof(record), 0) == (ssize_t) sizeof(record);
+    close(fd);
+    if (!complete || record.magic != WINDOW_MAGIC) {
+        return ERROR_FILE_NOT_FOUND;
+    }
+    *window = record.window;
+    return SUCCESS;
+}
+
+/**
+ * @brief Forgets the window of a copy file, if any.
+ *
+ * @param copy_file_path Absolute path to the copy file.
+ * @param privileged_file_path Absolute path to the privileged file.
+ * @return `SUCCESS` if the record was removed or did not exist, or an error code otherwise.
+ */
+int removeWindow(const char *copy_file_path, const char *privileged_file_path) {
+    char window_path[PATH_MAX];
+    const int path_result = getWindowPath(copy_file_path, privileged_file_path, window_path);
+    if (path_result != SUCCESS) {
+        return path_result;
+    }
+    if (STATS_SYSCALL(unlink(window_path)) == -1 && errno != ENOENT) {
+        return ERROR_PERMISSION_DENIED;
+    }
+    return SUCCESS;
+}
+
+/**
+ * @brief Returns a bit mask of the newlines in a 64-byte block, bit `i` standing for byte `i`.
+ */
+static uint64_t newlineMask(const uint8_t *block) {
+#if defined(__AVX2__)
+    const __m256i newline = _mm256_set1_epi8('\n');
+    const uint32_t low = (uint32_t) _mm256_movemask_epi8(
+        _mm256_cmpeq_epi8(_mm256_loadu_si256((const __m256i *) block), newline));
+    const uint32_t high = (uint32_t) _mm256_movemask_epi8(
+        _mm256_cmpeq_epi8(_mm256_loadu_si256((const __m256i *) (block + 32)), newline));
+    return (uint64_t) high << 32 | low;
+#elif defined(__SSE2__)
+    const __m128i newline = _mm_set1_epi8('\n');
+    uint64_t mask = 0;
+    for (int i = 0; i < 4; ++i) {
+        const __m128i bytes = _mm_loadu_si128((const __m128i *) (block + 16 * i));
+        mask |= (uint64_t) (uint16_t) _mm_movemask_epi8(_mm_cmpeq_epi8(bytes, newline)) << (16 * i);
+    }
+    return mask;
+#else
+    uint64_t mask = 0;
+    for (int i = 0; i < 64; ++i) {
+        mask |= (uint64_t) (block[i] == '\n') << i;
+    }
+    return mask;
+#endif
+}
+
+/**
+ * @brief Builds the path of the line index of a file.
+ *
+ * @details
+ * - The index name is the hash of the path (see `getStoreEntryPath`); the index itself is stamped
+ *   with the device and inode of the file, so a hash collision only causes a rebuild.
+ */
+static int getLineIndexPath(const char *file_path, char index_path[PATH_MAX]) {
+    return getStoreEntryPath(LINE_INDEX_DIR, file_path, NULL, index_path);
+}
+
+/**
+ * @brief Checks whether an index was built for a file in its current state.
+ */
+static bool matchesFile(const line_index_header_t *header, const struct stat *file_stat) {
+    return header->device == (uint64_t) file_stat->st_dev && header->inode == (uint64_t) file_stat->st_ino &&
+           header->size == file_stat->st_size &&
+           header->modified_sec == file_stat->st_mtim.tv_sec && header->modified_nsec == file_stat->st_mtim.tv_nsec &&
+           header->changed_sec == file_stat->st_ctim.tv_sec && header->changed_nsec == file_stat->st_ctim.tv_nsec;
+}
+
+/**
+ * @brief Stamps an index with the identity and change state of a file.
+ */
+static void stampLineIndex(line_index_header_t *header, const struct stat *file_stat) {
+    header->magic = LINE_INDEX_MAGIC;
+    header->version = LINE_INDEX_VERSION;
+    header->device = file_stat->st_dev;
+    header->inode = file_stat->st_ino;
+    header->size = file_stat->st_size;
+    header->modified_sec = file_stat->st_mtim.tv_sec;
+    header->modified_nsec = file_stat->st_mtim.tv_nsec;
+    header->changed_sec = file_stat->st_ctim.tv_sec;
+    header->changed_nsec = file_stat->st_ctim.tv_nsec;
+}
+
+/**
+ * @brief Loads the stored index of a file.
+ *
+ * @param file_path Absolute path to the file.
+ * @param file_stat Metadata the index must have been built for.
+ * @param check_stamp Whether to reject an index built for another state of the file.
+ * @param index Filled with the index; `index->offsets` is to be freed by the caller.
+ * @return `SUCCESS` if a usable index was loaded, or an error code otherwise.
+ */
+static int loadLineIndex(const char *file_path, const struct stat *file_stat, const bool check_stamp,
+                         line_index_t *index) {
+    char index_path[PATH_MAX];
+    const int path_result = getLineIndexPath(file_path, index_path);
+    if (path_result != SUCCESS) {
+        return path_result;
+    }
+    const int fd = STATS_SYSCALL(open(index_path, O_RDONLY | O_CLOEXEC));
+    if (fd == -1) {
+        return ERROR_FILE_NOT_FOUND;
+    }
+
+    int result = SUCCESS;
+    line_index_header_t *header = &index->header;
+    if (statsPread(fd, header, sizeof(*header), 0) != (ssize_t) sizeof(*header) ||
+        header->magic != LINE_INDEX_MAGIC || header->version != LINE_INDEX_VERSION ||
+        header->stride != LINE_INDEX_STRIDE || header->count == 0 ||
+        header->count > (uint64_t) file_stat->st_size / LINE_INDEX_STRIDE + 1 ||
+        (check_stamp && !matchesFile(header, file_stat))) {
+        result = ERROR_FILE_NOT_FOUND;
+    }
+    if (result == SUCCESS) {
+        index->capacity = header->count;
+        index->offsets = malloc(index->capacity * sizeof(uint64_t));
+        const ssize_t expected = (ssize_t) (index->capacity * sizeof(uint64_t));
+        if (index->offsets == NULL) {
+            result = ERROR_MEMORY_ALLOCATION;
+        } else if (statsPread(fd, index->offsets, expected, sizeof(*header)) != expected) {
+            result = ERROR_FILE_NOT_FOUND;
+        }
+    }
+    close(fd);
+    return result;
+}
+
+/**
+ * @brief Stores the index of a file, replacing the previous one atomically.
+ */
+static int saveLineIndex(const char *file_path, const line_index_t *index) {
+    if (mkdir(REDIT_STATE_DIR, 0755) == -1 && errno != EEXIST) {
+        return errno == EACCES ? ERROR_PERMISSION_DENIED : ERROR_PATH_INVALID;
+    }
+    if (mkdir(LINE_INDEX_DIR, 0700) == -1 && errno != EEXIST) {
+        return errno == EACCES ? ERROR_PERMISSION_DENIED : ERROR_PATH_INVALID;
+    }
+    char index_path[PATH_MAX];
+    char temp_path[PATH_MAX];
+    const int path_result = getLineIndexPath(file_path, index_path);
+    if (path_result != SUCCESS) {
+        return path_result;
+    }
+    snprintf(temp_path, PATH_MAX, "%s/.tmp.%ld", LINE_INDEX_DIR, (long) getpid());
+
+    const int fd = STATS_SYSCALL(open(temp_path, O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, S_IRUSR | S_IWUSR));
+    if (fd == -1) {
+        return ERROR_PERMISSION_DENIED;
+    }
+    const ssize_t offsets_size = (ssize_t) (index->header.count * sizeof(uint64_t));
+    bool written = statsPwrite(fd, &index->header, sizeof(index->header), 0) == (ssize_t) sizeof(index->header) &&
+                   statsPwrite(fd, index->offsets, offsets_size, sizeof(index->header)) == offsets_size;
+    written = STATS_SYSCALL(close(fd)) == 0 && written;
+    if (!written || STATS_SYSCALL(rename(temp_path, index_path)) == -1) {
+        unlink(temp_path);
+        return ERROR_COPY_FAILED;
+    }
+    return SUCCESS;
+}
+
+/**
+ * @brief Records the start offset of the next `stride`th line.
+ */
+static int addLineOffset(line_index_t *index, const uint64_t offset) {
+    if (index->header.count == index->capacity) {
+        const size_t capacity = index->capacity == 0 ? 1024 : index->capacity * 2;
+        uint64_t *grown = realloc(index->offsets, capacity * sizeof(uint64_t));
+        if (grown == NULL) {
+            return ERROR_MEMORY_ALLOCATION;
+        }
+        index->offsets = grown;
+        index->capacity = capacity;
+    }
+    index->offsets[index->header.count++] = offset;
+    return SUCCESS;
+}
+
+/**
+ * @brief Scans a file further until the index covers a number of newlines, or the end of the file.
+ *
+ * @param fd Descriptor of the file, open for reading.
+ * @param file_stat Metadata of the file.
+ * @param target_lines Newlines the index must cover.
+ * @param index Index to extend.
+ * @return `SUCCESS` if the index covers `target_lines` or the whole file, or an error code otherwise.
+ *
+ * @details
+ * - Whole 64-byte blocks are skipped with one population count unless they hold the next line
+ *   to record, in which case their newlines are walked bit by bit.
+ */
+static int extendLineIndex(const int fd, const struct stat *file_stat, const uint64_t target_lines,
+                           line_index_t *index) {
+    line_index_header_t *header = &index->header;
+    if (header->scanned_lines >= target_lines || header->scanned_offset >= (uint64_t) file_stat->st_size) {
+        return SUCCESS;
+    }
+    const uint64_t start_ns = traceNow();
+    uint8_t *buffer = malloc(LINE_SCAN_SIZE);
+    if (buffer == NULL) {
+        return ERROR_MEMORY_ALLOCATION;
+    }
+    posix_fadvise(fd, (off_t) header->scanned_offset, 0, POSIX_FADV_SEQUENTIAL);
+
+    int result = SUCCESS;
+    uint64_t lines = header->scanned_lines;
+    uint64_t next_record = header->count * header->stride; // Newlines before the next line to record
+    const uint64_t scan_start = header->scanned_offset;
+    while (result == SUCCESS && lines < target_lines && header->scanned_offset < (uint64_t) file_stat->st_size) {
+        const ssize_t bytes_read = statsPread(fd, buffer, LINE_SCAN_SIZE, (off_t) header->scanned_offset);
+        if (bytes_read <= 0) {
+            result = bytes_read == 0 ? SUCCESS : ERROR_COPY_FAILED;
+            break;
+        }
+
+        const size_t length = (size_t) bytes_read;
+        size_t i = 0;
+        for (; i + 64 <= length && result == SUCCESS; i += 64) {
+            uint64_t mask = newlineMask(buffer + i);
+            const uint64_t count = (uint64_t) __builtin_popcountll(mask);
+            if (lines + count < next_record) {
+                lines += count;
+                continue;
+            }
+            while (mask != 0 && result == SUCCESS) {
+                const int bit = __builtin_ctzll(mask);
+                mask &= mask - 1;
+                if (++lines == next_record) {
+                    result = addLineOffset(index, header->scanned_offset + i + bit + 1);
+                    next_record += header->stride;
+                }
+            }
+        }
+        for (; i < length && result == SUCCESS; ++i) {
+            if (buffer[i] == '\n' && ++lines == next_record) {
+                result = addLineOffset(index, header->scanned_offset + i + 1);
+                next_record += header->stride;
+            }
+        }
+        header->scanned_offset += length;
+        header->scanned_lines = lines;
+    }
+    free(buffer);
+    index->dirty = true;
+    traceSpan("index", "extendLineIndex", start_ns, NULL, (long long) (header->scanned_offset - scan_start));
+    return result;
+}
+
+/**
+ * @brief Finds where the line following a number of newlines starts.
+ *
+ * @param fd Descriptor of the file, open for reading.
+ * @param index Index covering at least `newlines` newlines.
+ * @param newlines Newlines before the line.
+ * @param offset Set to the start offset of the line.
+ * @return `SUCCESS` if found, or `ERROR_INVALID_ARGUMENT` if the file has fewer newlines.
+ */
+static int findLineStart(const int fd, const line_index_t *index, const uint64_t newlines, off_t *offset) {
+    if (newlines > index->header.scanned_lines) {
+        return ERROR_INVALID_ARGUMENT;
+    }
+    const uint64_t record = newlines / index->header.stride;
+    off_t position = (off_t) index->offsets[record];
+    uint64_t remaining = newlines - record * index->header.stride;
+    if (remaining == 0) {
+        *offset = position;
+        return SUCCESS;
+    }
+
+    // Walk the few lines between the recorded offset and the wanted one
+    uint8_t *buffer = malloc(LINE_WALK_SIZE);
+    if (buffer == NULL) {
+        return ERROR_MEMORY_ALLOCATION;
+    }
+    int result = ERROR_INVALID_ARGUMENT;
+    while (result == ERROR_INVALID_ARGUMENT) {
+        const ssize_t bytes_read = statsPread(fd, buffer, LINE_WALK_SIZE, position);
+        if (bytes_read <= 0) {
+            break;
+        }
+        const uint8_t *cursor = buffer;
+        const uint8_t *end = buffer + bytes_read;
+        while (remaining > 0 && (cursor = memchr(cursor, '\n', end - cursor)) != NULL) {
+            ++cursor;
+            --remaining;
+        }
+        if (remaining == 0) {
+            *offset = position + (cursor - buffer);
+            result = SUCCESS;
+        }
+        position += bytes_read;
+    }
+    free(buffer);
+    return result;
+}
+
+/**
+ * @brief Moves a byte range within a file, possibly overlapping its old place.
+ *
+ * @details
+ * - Moving towards the end copies from the last block backwards, and towards the start from
+ *   the first block forwards, so no byte is overwritten before it is read.
+ */
+static int moveRange(const int fd, const off_t from, const off_t to, const off_t length) {
+    uint8_t *buffer = malloc(LINE_SCAN_SIZE);
+    if (buffer == NULL) {
+        return ERROR_MEMORY_ALLOCATION;
+    }
+    int result = SUCCESS;
+    for (off_t done = 0; done < length && result == SUCCESS;) {
+        const size_t chunk = length - done < LINE_SCAN_SIZE ? (size_t) (length - done) : LINE_SCAN_SIZE;
+        const off_t chunk_offset = to > from ? length - done - (off_t) chunk : done;
+        if (statsPread(fd, buffer, chunk, from + chunk_offset) != (ssize_t) chunk ||
+            statsPwrite(fd, buffer, chunk, to + chunk_offset) != (ssize_t) chunk) {
+            result = ERROR_COPY_FAILED;
+        }
+        done += (off_t) chunk;
+    }
+    free(buffer);
+    return result;
+}
+
+/**
+ * @brief Builds the path of the window record of a copy/privileged pair.
+ */
+static int getWindowPath(const char *copy_file_path, const char *privileged_file_path, char window_path[PATH_MAX]) {
+    char baseline_path[PATH_MAX];
+    const int path_result = getBaselinePath(copy_file_path, privileged_file_path, baseline_path);
+    if (path_result != SUCCESS) {
+        return path_result;
+    }
+    const int written = snprintf(window_path, PATH_MAX, "%s.window", baseline_path);
+    if (written < 0 || written >= PATH_MAX) {
+        return ERROR_PATH_TOO_LONG;
+    }
+    return SUCCESS;
+}
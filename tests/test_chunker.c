@@ -0,0 +1,155 @@
+#define _GNU_SOURCE // syncfs, used by the included backup_handler.c
+
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "test_utils.h"
+#include "../src/backup_handler.c" // For the static chunker
+
+/**
+ * @file test_chunker.c
+ * @brief Tests the content-defined chunking of the backup store.
+ *
+ * Pseudo-random data is cut with `findChunkEnd` the way `backupFile` does. Chunks must
+ * stay within the size bounds and cover the data, cutting must be deterministic, and
+ * after bytes are inserted or deleted the boundaries must realign, so that the chunks
+ * after the edit are shared with the original data and deduplicated in the store.
+ */
+
+#define CHUNKER_DATA_SIZE (16 * 1024 * 1024) // Data cut in each check
+#define CHUNKER_MAX_CHUNKS (CHUNKER_DATA_SIZE / BACKUP_CHUNK_MIN_SIZE + 2) // Upper bound on chunks
+#define CHUNKER_EDIT_SIZE 100 // Bytes inserted or deleted
+
+// Function prototypes
+static void fillRandom(uint8_t *data, size_t length, uint64_t seed);
+static size_t cutChunks(const uint64_t gear[256], const uint8_t *data, size_t length, size_t *ends);
+static void checkBounds(const size_t *ends, size_t count, size_t length);
+static size_t countSharedChunks(const size_t *ends, size_t count, const size_t *edited_ends, size_t edited_count,
+                                size_t edit_offset, ssize_t shift);
+
+int main() {
+    uint64_t gear[256];
+    fillGearTable(gear);
+
+    uint8_t *data = malloc(CHUNKER_DATA_SIZE + CHUNKER_EDIT_SIZE);
+    uint8_t *edited = malloc(CHUNKER_DATA_SIZE + CHUNKER_EDIT_SIZE);
+    size_t *ends = malloc(CHUNKER_MAX_CHUNKS * sizeof(size_t));
+    size_t *edited_ends = malloc(CHUNKER_MAX_CHUNKS * sizeof(size_t));
+    if (!data || !edited || !ends || !edited_ends) {
+        perror("malloc");
+        return EXIT_FAILURE;
+    }
+    fillRandom(data, CHUNKER_DATA_SIZE, 1);
+
+    // Bounds, and an average chunk size close to the minimum plus the mask
+    const size_t count = cutChunks(gear, data, CHUNKER_DATA_SIZE, ends);
+    checkBounds(ends, count, CHUNKER_DATA_SIZE);
+    const size_t average = CHUNKER_DATA_SIZE / count;
+    CHECK(average > BACKUP_CHUNK_MIN_SIZE + BACKUP_CHUNK_MASK / 2);
+    CHECK(average < BACKUP_CHUNK_MIN_SIZE + 2 * BACKUP_CHUNK_MASK);
+
+    // Determinism, including with a freshly built gear table
+    uint64_t other_gear[256];
+    fillGearTable(other_gear);
+    CHECK(memcmp(gear, other_gear, sizeof(gear)) == 0);
+    CHECK(cutChunks(other_gear, data, CHUNKER_DATA_SIZE, edited_ends) == count);
+    CHECK(memcmp(ends, edited_ends, count * sizeof(size_t)) == 0);
+
+    // Bytes inserted at the front: all but the first chunks are shared once shifted
+    fillRandom(edited, CHUNKER_EDIT_SIZE, 2);
+    memcpy(edited + CHUNKER_EDIT_SIZE, data, CHUNKER_DATA_SIZE);
+    size_t edited_count = cutChunks(gear, edited, CHUNKER_DATA_SIZE + CHUNKER_EDIT_SIZE, edited_ends);
+    checkBounds(edited_ends, edited_count, CHUNKER_DATA_SIZE + CHUNKER_EDIT_SIZE);
+    CHECK(countSharedChunks(ends, count, edited_ends, edited_count, 0, CHUNKER_EDIT_SIZE) + 2 >= count);
+
+    // Bytes deleted in the middle: the chunks before are unchanged and those after realign
+    const size_t middle = CHUNKER_DATA_SIZE / 2;
+    memcpy(edited, data, middle);
+    memcpy(edited + middle, data + middle + CHUNKER_EDIT_SIZE, CHUNKER_DATA_SIZE - middle - CHUNKER_EDIT_SIZE);
+    edited_count = cutChunks(gear, edited, CHUNKER_DATA_SIZE - CHUNKER_EDIT_SIZE, edited_ends);
+    checkBounds(edited_ends, edited_count, CHUNKER_DATA_SIZE - CHUNKER_EDIT_SIZE);
+    CHECK(countSharedChunks(ends, count, edited_ends, edited_count, middle, -CHUNKER_EDIT_SIZE) + 2 >= count);
+
+    // Data without boundaries is cut at the maximum size
+    memset(edited, 0, CHUNKER_DATA_SIZE);
+    edited_count = cutChunks(gear, edited, CHUNKER_DATA_SIZE, edited_ends);
+    checkBounds(edited_ends, edited_count, CHUNKER_DATA_SIZE);
+
+    // Short data is a single chunk
+    CHECK(findChunkEnd(gear, data, 0) == 0);
+    CHECK(findChunkEnd(gear, data, BACKUP_CHUNK_MIN_SIZE) == BACKUP_CHUNK_MIN_SIZE);
+
+    free(data);
+    free(edited);
+    free(ends);
+    free(edited_ends);
+    return testResult("test_chunker");
+}
+
+/**
+ * @brief Fills a buffer with reproducible pseudo-random bytes (xorshift64).
+ */
+static void fillRandom(uint8_t *data, const size_t length, uint64_t seed) {
+    uint64_t state = 0x9E3779B97F4A7C15ULL * seed;
+    for (size_t i = 0; i < length; ++i) {
+        state ^= state << 13;
+        state ^= state >> 7;
+        state ^= state << 17;
+        data[i] = (uint8_t) (state >> 56);
+    }
+}
+
+/**
+ * @brief Cuts data into chunks as `backupFile` does, recording the end offset of each chunk.
+ *
+ * @return The number of chunks.
+ */
+static size_t cutChunks(const uint64_t gear[256], const uint8_t *data, const size_t length, size_t *ends) {
+    size_t count = 0;
+    for (size_t position = 0; position < length && count < CHUNKER_MAX_CHUNKS; ++count) {
+        position += findChunkEnd(gear, data + position, length - position);
+        ends[count] = position;
+    }
+    return count;
+}
+
+/**
+ * @brief Checks that chunks cover the data and that all but the last one are within the size bounds.
+ */
+static void checkBounds(const size_t *ends, const size_t count, const size_t length) {
+    CHECK(count > 0 && ends[count - 1] == length);
+    size_t start = 0;
+    for (size_t i = 0; i < count; ++i) {
+        const size_t chunk_length = ends[i] - start;
+        CHECK(chunk_length <= BACKUP_CHUNK_MAX_SIZE);
+        CHECK(chunk_length >= BACKUP_CHUNK_MIN_SIZE || i == count - 1);
+        start = ends[i];
+    }
+}
+
+/**
+ * @brief Counts the chunks of the original data found again in the edited data.
+ *
+ * A chunk is shared if the edited data has a chunk with the same bounds, once the
+ * bounds after the edit are moved by the number of bytes inserted or deleted.
+ */
+static size_t countSharedChunks(const size_t *ends, const size_t count, const size_t *edited_ends,
+                                const size_t edited_count, const size_t edit_offset, const ssize_t shift) {
+    size_t shared = 0;
+    size_t j = 0;
+    size_t start = 0, edited_start = 0;
+    for (size_t i = 0; i < count; ++i) {
+        const size_t expected_start = start < edit_offset ? start : start + shift;
+        const size_t expected_end = ends[i] <= edit_offset ? ends[i] : ends[i] + shift;
+        while (j < edited_count && edited_start < expected_start) {
+            edited_start = edited_ends[j++];
+        }
+        if (j < edited_count && edited_start == expected_start && edited_ends[j] == expected_end) {
+            ++shared;
+        }
+        start = ends[i];
+    }
+    return shared;
+}
@@ -0,0 +1,228 @@
+#include <fcntl.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <linux/limits.h>
+#include <zlib.h>
+
+#ifdef REDIT_HAVE_ZSTD
+#include <zstd.h>
+#endif
+
+#include "test_utils.h"
+#include "../include/checksum_handler.h"
+#include "../include/compression_handler.h"
+#include "../include/error_handler.h"
+
+/**
+ * @file test_compression.c
+ * @brief Tests the block-parallel gzip and Zstandard compression of privileged files.
+ *
+ * Content spanning several `COMPRESSION_BLOCK_SIZE` blocks is compressed with one and
+ * several threads. The output must hold one gzip member (Zstandard frame) per block,
+ * decode with the codec's own library as the original content, be detected with its
+ * format and level, and decompress back through `decompressFile` with the checksum of
+ * the content. A truncated file must be reported as invalid.
+ */
+
+#define TEST_CONTENT_SIZE (5 * COMPRESSION_BLOCK_SIZE / 2 + 123) // Two full blocks and a partial one
+
+// Function prototypes
+static void fillText(uint8_t *data, size_t length);
+static void checkFormat(const char *dir, const uint8_t *data, size_t length, compression_t compression,
+                        size_t threads);
+static size_t countGzipMembers(const uint8_t *compressed, size_t length, uint8_t *output, size_t capacity,
+                               size_t *output_length);
+#ifdef REDIT_HAVE_ZSTD
+static size_t countZstdFrames(const uint8_t *compressed, size_t length, uint8_t *output, size_t capacity,
+                              size_t *output_length);
+#endif
+
+int main() {
+    char dir[PATH_MAX];
+    makeTempDir(dir);
+
+    uint8_t *data = malloc(TEST_CONTENT_SIZE);
+    if (!data) {
+        perror("malloc");
+        return EXIT_FAILURE;
+    }
+    fillText(data, TEST_CONTENT_SIZE);
+
+    const size_t sizes[] = {0, 1, COMPRESSION_BLOCK_SIZE, TEST_CONTENT_SIZE};
+    for (size_t i = 0; i < sizeof(sizes) / sizeof(sizes[0]); ++i) {
+        for (size_t threads = 1; threads <= 4; threads += 3) {
+            checkFormat(dir, data, sizes[i], (compression_t){COMPRESSION_GZIP, 6}, threads);
+#ifdef REDIT_HAVE_ZSTD
+            checkFormat(dir, data, sizes[i], (compression_t){COMPRESSION_ZSTD, ZSTD_CLEVEL_DEFAULT}, threads);
+#endif
+        }
+    }
+
+    // The fastest and best gzip levels are told apart by the header
+    checkFormat(dir, data, TEST_CONTENT_SIZE, (compression_t){COMPRESSION_GZIP, Z_BEST_SPEED}, 2);
+    checkFormat(dir, data, TEST_CONTENT_SIZE, (compression_t){COMPRESSION_GZIP, Z_BEST_COMPRESSION}, 2);
+
+    // Plain content is not taken for a compressed file
+    char path[PATH_MAX];
+    writeTestFile(path, dir, "plain", data, TEST_CONTENT_SIZE);
+    const int fd = open(path, O_RDONLY);
+    compression_t detected;
+    CHECK(fd != -1 && detectCompression(fd, &detected) == SUCCESS && detected.format == COMPRESSION_NONE);
+    close(fd);
+
+    free(data);
+    removeTempDir(dir);
+    return testResult("test_compression");
+}
+
+/**
+ * @brief Fills a buffer with compressible, log-like text.
+ */
+static void fillText(uint8_t *data, const size_t length) {
+    static const char *const WORDS[] = {"open", "read", "write", "close", "sync", "rename", "lock", "unlock"};
+    uint32_t state = 42;
+    size_t position = 0;
+    while (position < length) {
+        state = state * 1103515245 + 12345;
+        char line[64];
+        const int line_length = snprintf(line, sizeof(line), "%08x %s fd=%u\n", state, WORDS[state >> 29],
+                                         (state >> 8) & 0xFF);
+        for (int i = 0; i < line_length && position < length; ++i) {
+            data[position++] = (uint8_t) line[i];
+        }
+    }
+}
+
+/**
+ * @brief Compresses content, then checks the framing, the detected format and the round trip.
+ */
+static void checkFormat(const char *dir, const uint8_t *data, const size_t length, const compression_t compression,
+                        const size_t threads) {
+    char plain_path[PATH_MAX], compressed_path[PATH_MAX], output_path[PATH_MAX];
+    writeTestFile(plain_path, dir, "plain", data, length);
+    testPath(compressed_path, dir, "compressed");
+    testPath(output_path, dir, "output");
+
+    // Compress
+    const int plain_fd = open(plain_path, O_RDONLY);
+    const int compressed_fd = open(compressed_path, O_RDWR | O_CREAT | O_TRUNC, 0600);
+    uint32_t crc = 0;
+    off_t size = -1;
+    CHECK(plain_fd != -1 && compressed_fd != -1);
+    CHECK(compressFile(plain_fd, compressed_fd, &compression, threads, &crc, &size) == SUCCESS);
+    CHECK(crc == updateCrc32c(0, data, length));
+    CHECK(size == (off_t) length);
+    close(plain_fd);
+
+    // Detect the format and level
+    compression_t detected;
+    CHECK(detectCompression(compressed_fd, &detected) == SUCCESS);
+    CHECK(detected.format == compression.format);
+    CHECK(compression.format != COMPRESSION_GZIP || detected.level == compression.level);
+
+    // One member (frame) per block, decoded by the codec's own library
+    size_t compressed_length = 0;
+    uint8_t *compressed = (uint8_t *) readTestFile(compressed_path, &compressed_length);
+    uint8_t *decoded = malloc(length + 1);
+    size_t decoded_length = 0;
+    size_t members = 0;
+    CHECK(compressed && decoded);
+    if (compressed && decoded && compression.format == COMPRESSION_GZIP) {
+        members = countGzipMembers(compressed, compressed_length, decoded, length + 1, &decoded_length);
+    }
+#ifdef REDIT_HAVE_ZSTD
+    if (compressed && decoded && compression.format == COMPRESSION_ZSTD) {
+        members = countZstdFrames(compressed, compressed_length, decoded, length + 1, &decoded_length);
+    }
+#endif
+    const size_t blocks = (length + COMPRESSION_BLOCK_SIZE - 1) / COMPRESSION_BLOCK_SIZE;
+    CHECK(members == blocks || (length == 0 && members <= 1));
+    CHECK(decoded_length == length && (length == 0 || memcmp(decoded, data, length) == 0));
+    free(decoded);
+
+    // Decompress back, with and without an output file
+    const int output_fd = open(output_path, O_WRONLY | O_CREAT | O_TRUNC, 0600);
+    CHECK(output_fd != -1);
+    crc = 0;
+    size = -1;
+    CHECK(decompressFile(compressed_fd, output_fd, compression.format, &crc, &size) == SUCCESS);
+    CHECK(crc == updateCrc32c(0, data, length));
+    CHECK(size == (off_t) length);
+    close(output_fd);
+    size_t output_length;
+    char *output = readTestFile(output_path, &output_length);
+    CHECK(output && output_length == length && (length == 0 || memcmp(output, data, length) == 0));
+    free(output);
+    CHECK(decompressFile(compressed_fd, -1, compression.format, &crc, &size) == SUCCESS);
+    CHECK(crc == updateCrc32c(0, data, length) && size == (off_t) length);
+
+    // A truncated file is invalid
+    if (length > 0 && compressed) {
+        CHECK(ftruncate(compressed_fd, compressed_length - 1) == 0);
+        CHECK(decompressFile(compressed_fd, -1, compression.format, NULL, NULL) == ERROR_INVALID_SOURCE);
+    }
+    free(compressed);
+    close(compressed_fd);
+}
+
+/**
+ * @brief Decodes concatenated gzip members with zlib, counting them.
+ *
+ * @return The number of members, or 0 if the data is not a complete gzip stream.
+ */
+static size_t countGzipMembers(const uint8_t *compressed, const size_t length, uint8_t *output,
+                               const size_t capacity, size_t *output_length) {
+    z_stream stream = {0};
+    if (inflateInit2(&stream, 16 + MAX_WBITS) != Z_OK) {
+        return 0;
+    }
+    stream.next_in = (Bytef *) compressed;
+    stream.avail_in = length;
+    stream.next_out = output;
+    stream.avail_out = capacity;
+    size_t members = 0;
+    while (stream.avail_in > 0) {
+        const int status = inflate(&stream, Z_FINISH);
+        if (status != Z_STREAM_END) {
+            members = 0;
+            break;
+        }
+        ++members;
+        inflateReset(&stream);
+    }
+    *output_length = capacity - stream.avail_out;
+    inflateEnd(&stream);
+    return members;
+}
+
+#ifdef REDIT_HAVE_ZSTD
+/**
+ * @brief Decodes concatenated Zstandard frames with libzstd, counting them.
+ *
+ * @return The number of frames, or 0 if the data is not a sequence of complete frames.
+ */
+static size_t countZstdFrames(const uint8_t *compressed, size_t length, uint8_t *output, const size_t capacity,
+                              size_t *output_length) {
+    size_t frames = 0;
+    *output_length = 0;
+    while (length > 0) {
+        const size_t frame_length = ZSTD_findFrameCompressedSize(compressed, length);
+        if (ZSTD_isError(frame_length)) {
+            return 0;
+        }
+        const size_t decoded = ZSTD_decompress(output + *output_length, capacity - *output_length, compressed,
+                                               frame_length);
+        if (ZSTD_isError(decoded)) {
+            return 0;
+        }
+        *output_length += decoded;
+        compressed += frame_length;
+        length -= frame_length;
+        ++frames;
+    }
+    return frames;
+}
+#endif
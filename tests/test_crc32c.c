@@ -0,0 +1,91 @@
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "test_utils.h"
+#include "../src/checksum_handler.c" // For the static software implementation
+
+/**
+ * @file test_crc32c.c
+ * @brief Tests the CRC32C checksums used to verify copies.
+ *
+ * Known check values are compared with `updateCrc32c`, which uses the CPU's CRC
+ * instructions where available, and with the slicing-by-8 software implementation.
+ * Both are then compared with a bit-at-a-time reference on random data, across every
+ * alignment and split point, so that chained calls give the one-shot checksum.
+ */
+
+#define CRC_DATA_SIZE 4096 // Random data checksummed
+#define CRC_MAX_ALIGNMENT 16 // Start offsets checked, to cover unaligned buffers
+
+// Function prototypes
+static uint32_t crc32cReference(uint32_t crc, const uint8_t *data, size_t length);
+static uint32_t crc32cTables(uint32_t crc, const void *data, size_t length);
+
+int main() {
+    fillCrc32cTables();
+
+    // Check values of the CRC-32C (iSCSI) catalogue and RFC 3720
+    uint8_t block[32];
+    CHECK(updateCrc32c(0, "123456789", 9) == 0xE3069283);
+    CHECK(crc32cTables(0, "123456789", 9) == 0xE3069283);
+    CHECK(updateCrc32c(0, "", 0) == 0);
+    memset(block, 0, sizeof(block));
+    CHECK(updateCrc32c(0, block, sizeof(block)) == 0x8A9136AA);
+    CHECK(crc32cTables(0, block, sizeof(block)) == 0x8A9136AA);
+    memset(block, 0xFF, sizeof(block));
+    CHECK(updateCrc32c(0, block, sizeof(block)) == 0x62A8AB43);
+    CHECK(crc32cTables(0, block, sizeof(block)) == 0x62A8AB43);
+    for (int i = 0; i < 32; ++i) {
+        block[i] = (uint8_t) i;
+    }
+    CHECK(updateCrc32c(0, block, sizeof(block)) == 0x46DD794E);
+    CHECK(crc32cTables(0, block, sizeof(block)) == 0x46DD794E);
+
+    uint8_t data[CRC_DATA_SIZE + CRC_MAX_ALIGNMENT];
+    srand(42);
+    for (size_t i = 0; i < sizeof(data); ++i) {
+        data[i] = (uint8_t) rand();
+    }
+
+    // Every alignment and length against the reference
+    for (size_t alignment = 0; alignment < CRC_MAX_ALIGNMENT; ++alignment) {
+        for (size_t length = 0; length <= 64; ++length) {
+            const uint32_t expected = ~crc32cReference(~0U, data + alignment, length);
+            CHECK(updateCrc32c(0, data + alignment, length) == expected);
+            CHECK(crc32cTables(0, data + alignment, length) == expected);
+        }
+    }
+
+    // Chained calls split at every offset give the one-shot checksum
+    const uint32_t whole = ~crc32cReference(~0U, data, CRC_DATA_SIZE);
+    CHECK(updateCrc32c(0, data, CRC_DATA_SIZE) == whole);
+    CHECK(crc32cTables(0, data, CRC_DATA_SIZE) == whole);
+    for (size_t split = 0; split <= CRC_DATA_SIZE; ++split) {
+        CHECK(updateCrc32c(updateCrc32c(0, data, split), data + split, CRC_DATA_SIZE - split) == whole);
+        CHECK(crc32cTables(crc32cTables(0, data, split), data + split, CRC_DATA_SIZE - split) == whole);
+    }
+
+    return testResult("test_crc32c");
+}
+
+/**
+ * @brief Computes CRC32C one bit at a time, on the inverted checksum like the other implementations.
+ */
+static uint32_t crc32cReference(uint32_t crc, const uint8_t *data, size_t length) {
+    for (; length > 0; ++data, --length) {
+        crc ^= *data;
+        for (int bit = 0; bit < 8; ++bit) {
+            crc = crc & 1 ? (crc >> 1) ^ CRC32C_POLYNOMIAL : crc >> 1;
+        }
+    }
+    return crc;
+}
+
+/**
+ * @brief Adds bytes to a CRC32C checksum with the software implementation, as `updateCrc32c` does.
+ */
+static uint32_t crc32cTables(const uint32_t crc, const void *data, const size_t length) {
+    return ~crc32cSoftware(~crc, data, length);
+}
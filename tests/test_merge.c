@@ -0,0 +1,196 @@
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <linux/limits.h>
+
+#include "test_utils.h"
+#include "../src/merge_handler.c" // For the static diff helpers
+
+/**
+ * @file test_merge.c
+ * @brief Tests the Myers line diff and the diff3-style three-way merge.
+ *
+ * The diff is checked against a dynamic-programming longest common subsequence on
+ * random inputs: the matches must be increasing, pair equal lines, and be as many as
+ * the LCS, since Myers' algorithm finds a shortest edit script. The merge is checked
+ * end to end through `mergeFiles` on temporary files.
+ */
+
+#define DIFF_ROUNDS 2000 // Random diff inputs checked against the LCS
+#define DIFF_MAX_LINES 40 // Largest random input, in lines
+#define DIFF_ALPHABET 4 // Distinct lines in random inputs, small so that lines repeat
+
+// Function prototypes
+static void testDiffAgainstLcs();
+static void testMerge(const char *dir);
+static void fillLines(line_file_t *file, line_t *lines, const char *const *texts, size_t count);
+static size_t lcsLength(const line_file_t *a, const line_file_t *b);
+static void checkMerge(const char *dir, const char *base, const char *copy, const char *current,
+                       const char *expected, size_t expected_conflicts);
+
+int main() {
+    char dir[PATH_MAX];
+    makeTempDir(dir);
+
+    testDiffAgainstLcs();
+    testMerge(dir);
+
+    removeTempDir(dir);
+    return testResult("test_merge");
+}
+
+/**
+ * @brief Diffs random line sequences and compares the matches with the LCS length.
+ */
+static void testDiffAgainstLcs() {
+    static const char *const ALPHABET[DIFF_ALPHABET] = {"alpha\n", "beta\n", "gamma\n", "delta"};
+    const char *a_texts[DIFF_MAX_LINES], *b_texts[DIFF_MAX_LINES];
+    line_t a_lines[DIFF_MAX_LINES], b_lines[DIFF_MAX_LINES];
+    ssize_t matches[DIFF_MAX_LINES];
+
+    srand(42);
+    for (int round = 0; round < DIFF_ROUNDS; ++round) {
+        const size_t a_count = rand() % (DIFF_MAX_LINES + 1);
+        const size_t b_count = rand() % (DIFF_MAX_LINES + 1);
+        for (size_t i = 0; i < a_count; ++i) {
+            a_texts[i] = ALPHABET[rand() % DIFF_ALPHABET];
+        }
+        // Derive half of the new sequences from the old one, as real edits mostly keep lines
+        for (size_t i = 0; i < b_count; ++i) {
+            b_texts[i] = round % 2 && i < a_count && rand() % 4 ? a_texts[i] : ALPHABET[rand() % DIFF_ALPHABET];
+        }
+
+        line_file_t a, b;
+        fillLines(&a, a_lines, a_texts, a_count);
+        fillLines(&b, b_lines, b_texts, b_count);
+        CHECK(diffLines(&a, &b, matches) == SUCCESS);
+
+        size_t n_matches = 0;
+        ssize_t previous = -1;
+        for (size_t i = 0; i < a_count; ++i) {
+            if (matches[i] == -1) {
+                continue;
+            }
+            CHECK(matches[i] > previous && matches[i] < (ssize_t) b_count);
+            CHECK(linesEqual(&a.lines[i], &b.lines[matches[i]]));
+            previous = matches[i];
+            ++n_matches;
+        }
+        CHECK(n_matches == lcsLength(&a, &b));
+    }
+}
+
+/**
+ * @brief Builds a line table over constant strings.
+ */
+static void fillLines(line_file_t *file, line_t *lines, const char *const *texts, const size_t count) {
+    for (size_t i = 0; i < count; ++i) {
+        lines[i].data = texts[i];
+        lines[i].length = strlen(texts[i]);
+        lines[i].hash = hashLine(texts[i], lines[i].length);
+    }
+    *file = (line_file_t){.buffer = NULL, .lines = lines, .count = count};
+}
+
+/**
+ * @brief Computes the length of the longest common subsequence of two line tables.
+ */
+static size_t lcsLength(const line_file_t *a, const line_file_t *b) {
+    size_t table[DIFF_MAX_LINES + 1][DIFF_MAX_LINES + 1] = {0};
+    for (size_t i = 1; i <= a->count; ++i) {
+        for (size_t j = 1; j <= b->count; ++j) {
+            if (linesEqual(&a->lines[i - 1], &b->lines[j - 1])) {
+                table[i][j] = table[i - 1][j - 1] + 1;
+            } else {
+                table[i][j] = table[i - 1][j] > table[i][j - 1] ? table[i - 1][j] : table[i][j - 1];
+            }
+        }
+    }
+    return table[a->count][b->count];
+}
+
+/**
+ * @brief Merges small files covering one-sided, disjoint, identical and conflicting changes.
+ */
+static void testMerge(const char *dir) {
+    const char *base = "one\ntwo\nthree\nfour\nfive\n";
+
+    // Changes on one side only are taken as they are
+    checkMerge(dir, base, "one\nTWO\nthree\nfour\nfive\n", base, "one\nTWO\nthree\nfour\nfive\n", 0);
+    checkMerge(dir, base, base, "one\ntwo\nthree\nFOUR\nfive\n", "one\ntwo\nthree\nFOUR\nfive\n", 0);
+
+    // Disjoint changes on both sides are combined
+    checkMerge(dir, base, "one\nTWO\nthree\nfour\nfive\n", "one\ntwo\nthree\nFOUR\nfive\n",
+               "one\nTWO\nthree\nFOUR\nfive\n", 0);
+
+    // Identical changes on both sides are taken once
+    checkMerge(dir, base, "one\ntwo\n2.5\nthree\nfour\nfive\n", "one\ntwo\n2.5\nthree\nfour\nfive\n",
+               "one\ntwo\n2.5\nthree\nfour\nfive\n", 0);
+
+    // Inserts and deletes at both ends of the file
+    checkMerge(dir, base, "zero\none\ntwo\nthree\nfour\nfive\n", "one\ntwo\nthree\nfour\n",
+               "zero\none\ntwo\nthree\nfour\n", 0);
+    checkMerge(dir, base, "two\nthree\nfour\nfive\n", "one\ntwo\nthree\nfour\nfive\nsix\n",
+               "two\nthree\nfour\nfive\nsix\n", 0);
+
+    // Lines added to an empty file on one side are taken
+    checkMerge(dir, "", "added\n", "", "added\n", 0);
+
+    // A last line without a newline is kept as it is
+    checkMerge(dir, "one\ntwo", "ONE\ntwo", "one\ntwo", "ONE\ntwo", 0);
+
+    // Overlapping different changes produce one conflict with all three versions
+    char copy_path[PATH_MAX], current_path[PATH_MAX], expected[4 * PATH_MAX];
+    testPath(copy_path, dir, "copy");
+    testPath(current_path, dir, "current");
+    CHECK(snprintf(expected, sizeof(expected),
+             "one\n<<<<<<< %s\nTWO\n||||||| baseline\ntwo\n=======\nDeux\n>>>>>>> %s\nthree\nfour\nfive\n",
+             copy_path, current_path) < (int) sizeof(expected));
+    checkMerge(dir, base, "one\nTWO\nthree\nfour\nfive\n", "one\nDeux\nthree\nfour\nfive\n", expected, 1);
+
+    // Two separate conflicts are counted separately
+    CHECK(snprintf(expected, sizeof(expected),
+             "<<<<<<< %s\nONE\n||||||| baseline\none\n=======\nUno\n>>>>>>> %s\ntwo\nthree\nfour\n"
+             "<<<<<<< %s\nFIVE\n||||||| baseline\nfive\n=======\nCinq\n>>>>>>> %s\n",
+             copy_path, current_path, copy_path, current_path) < (int) sizeof(expected));
+    checkMerge(dir, base, "ONE\ntwo\nthree\nfour\nFIVE\n", "Uno\ntwo\nthree\nfour\nCinq\n", expected, 2);
+
+    // The output may replace one of the inputs
+    char base_path[PATH_MAX];
+    size_t conflicts;
+    writeTestFile(base_path, dir, "base", base, strlen(base));
+    writeTestFile(copy_path, dir, "copy", "one\nTWO\nthree\nfour\nfive\n", 24);
+    writeTestFile(current_path, dir, "current", "one\ntwo\nthree\nfour\nFIVE\n", 24);
+    CHECK(mergeFiles(base_path, copy_path, current_path, copy_path, &conflicts) == SUCCESS);
+    char *merged = readTestFile(copy_path, NULL);
+    CHECK(conflicts == 0);
+    CHECK(merged && strcmp(merged, "one\nTWO\nthree\nfour\nFIVE\n") == 0);
+    free(merged);
+
+    // A missing input is reported
+    CHECK(mergeFiles("/nonexistent/base", copy_path, current_path, copy_path, &conflicts) == ERROR_FILE_NOT_FOUND);
+}
+
+/**
+ * @brief Merges three versions of a file and compares the output and conflict count.
+ */
+static void checkMerge(const char *dir, const char *base, const char *copy, const char *current,
+                       const char *expected, const size_t expected_conflicts) {
+    char base_path[PATH_MAX], copy_path[PATH_MAX], current_path[PATH_MAX], output_path[PATH_MAX];
+    writeTestFile(base_path, dir, "base", base, strlen(base));
+    writeTestFile(copy_path, dir, "copy", copy, strlen(copy));
+    writeTestFile(current_path, dir, "current", current, strlen(current));
+    testPath(output_path, dir, "output");
+
+    size_t conflicts = SIZE_MAX;
+    CHECK(mergeFiles(base_path, copy_path, current_path, output_path, &conflicts) == SUCCESS);
+    CHECK(conflicts == expected_conflicts);
+
+    char *output = readTestFile(output_path, NULL);
+    CHECK(output && strcmp(output, expected) == 0);
+    if (output && strcmp(output, expected) != 0) {
+        fprintf(stderr, "expected:\n%s\ngot:\n%s\n", expected, output);
+    }
+    free(output);
+}
@@ -0,0 +1,189 @@
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/stat.h>
+
+#include "test_utils.h"
+#include "../src/session_handler.c" // For the static hash table operations
+
+/**
+ * @file test_sessions.c
+ * @brief Tests the open-addressing hash table of the session index.
+ *
+ * An index is built in memory and filled with copies whose inodes are chosen to collide
+ * on a few home slots at both ends of the table, so their probe runs wrap around, and with
+ * copies spread over the whole table. Random inserts and backward-shift deletes are then
+ * checked against a plain list of the live copies: each one must be found from its home
+ * slot, removed ones must be gone, the count must match the used slots, and every probe
+ * run must be unbroken, as lookups stop at the first empty slot.
+ */
+
+#define TEST_ROUNDS 20000 // Random inserts and deletes
+#define TEST_CHECK_INTERVAL 256 // Rounds between two full checks of the index
+#define TEST_FIRST_REMOVED 4 // Copies removed from the colliding run before the random rounds
+#define TEST_HOT_SLOTS 4 // Home slots at each end of the table most copies collide on
+
+/**
+ * @brief A copy recorded in the index under test.
+ */
+typedef struct {
+    uint64_t device; ///< Device of the copy.
+    uint64_t inode; ///< Inode of the copy.
+} test_copy_t;
+
+// Function prototypes
+static uint64_t nextInode(uint64_t device, bool hot);
+static void insertCopy(const session_index_t *index, test_copy_t copy);
+static long findCopy(const session_index_t *index, test_copy_t copy);
+static void checkIndex(const session_index_t *index, const test_copy_t *live, size_t n_live,
+                       const test_copy_t *removed, size_t n_removed);
+
+static uint64_t last_inode = 0; // Last inode handed out by nextInode
+
+int main() {
+    session_index_t index = {
+        .fd = -1,
+        .header = calloc(1, sizeof(session_header_t)),
+        .entries = calloc(SESSION_CAPACITY, sizeof(session_entry_t))
+    };
+    test_copy_t *live = malloc(SESSION_MAX_LOAD * sizeof(test_copy_t));
+    test_copy_t *removed = calloc(TEST_ROUNDS + TEST_FIRST_REMOVED, sizeof(test_copy_t));
+    if (!index.header || !index.entries || !live || !removed) {
+        perror("malloc");
+        return EXIT_FAILURE;
+    }
+    size_t n_live = 0, n_removed = 0;
+
+    // One long run of copies colliding on the slots at both ends, wrapping around, then deletes from it
+    for (int i = 0; i < 2 * TEST_HOT_SLOTS * 4; ++i) {
+        live[n_live] = (test_copy_t){.device = 1, .inode = nextInode(1, true)};
+        insertCopy(&index, live[n_live++]);
+    }
+    checkIndex(&index, live, n_live, removed, n_removed);
+    for (size_t victim = n_live / 2; n_removed < TEST_FIRST_REMOVED; victim = n_live - 1) {
+        const long slot = findCopy(&index, live[victim]);
+        CHECK(slot != -1);
+        if (slot != -1) {
+            clearSlot(&index, (size_t) slot);
+        }
+        removed[n_removed++] = live[victim];
+        live[victim] = live[--n_live];
+        checkIndex(&index, live, n_live, removed, n_removed);
+    }
+
+    // Random inserts and deletes, half of the copies on the hot slots, up to the maximum load
+    srand(42);
+    for (int round = 0; round < TEST_ROUNDS; ++round) {
+        const bool insert = n_live == 0 || (n_live < SESSION_MAX_LOAD && rand() % 3 != 0);
+        if (insert) {
+            const uint64_t device = 1 + rand() % 3;
+            live[n_live] = (test_copy_t){.device = device, .inode = nextInode(device, rand() % 2 == 0)};
+            insertCopy(&index, live[n_live++]);
+        } else {
+            const size_t victim = (size_t) rand() % n_live;
+            const long slot = findCopy(&index, live[victim]);
+            CHECK(slot != -1);
+            if (slot != -1) {
+                clearSlot(&index, (size_t) slot);
+            }
+            removed[n_removed++] = live[victim];
+            live[victim] = live[--n_live];
+        }
+        if (round % TEST_CHECK_INTERVAL == 0) {
+            checkIndex(&index, live, n_live, removed, n_removed);
+        }
+    }
+    checkIndex(&index, live, n_live, removed, n_removed);
+
+    // A full index refuses new entries
+    while (n_live < SESSION_MAX_LOAD) {
+        live[n_live] = (test_copy_t){.device = 1, .inode = nextInode(1, false)};
+        insertCopy(&index, live[n_live++]);
+    }
+    const session_entry_t extra = {.device = 1, .inode = nextInode(1, false)};
+    CHECK(insertEntry(&index, &extra) == ERROR_BUFFER_TOO_SMALL);
+    checkIndex(&index, live, n_live, removed, n_removed);
+
+    // Emptying the index leaves every slot clear
+    while (n_live > 0) {
+        const long slot = findCopy(&index, live[--n_live]);
+        CHECK(slot != -1);
+        if (slot != -1) {
+            clearSlot(&index, (size_t) slot);
+        }
+    }
+    CHECK(index.header->count == 0);
+    for (size_t i = 0; i < SESSION_CAPACITY; ++i) {
+        CHECK(index.entries[i].inode == 0);
+    }
+
+    free(index.header);
+    free(index.entries);
+    free(live);
+    free(removed);
+    return testResult("test_sessions");
+}
+
+/**
+ * @brief Hands out a new inode on a device, optionally one whose home slot is at either end of the table.
+ */
+static uint64_t nextInode(const uint64_t device, const bool hot) {
+    for (;;) {
+        const size_t home = homeSlot(device, ++last_inode);
+        if (!hot || home < TEST_HOT_SLOTS || home >= SESSION_CAPACITY - TEST_HOT_SLOTS) {
+            return last_inode;
+        }
+    }
+}
+
+/**
+ * @brief Records a copy in the index, with a path derived from its device and inode.
+ */
+static void insertCopy(const session_index_t *index, const test_copy_t copy) {
+    session_entry_t entry = {.device = copy.device, .inode = copy.inode};
+    snprintf(entry.copy_path, sizeof(entry.copy_path), "/copies/%llu/%llu", (unsigned long long) copy.device,
+             (unsigned long long) copy.inode);
+    snprintf(entry.privileged_path, sizeof(entry.privileged_path), "/etc/file%llu", (unsigned long long) copy.inode);
+    CHECK(insertEntry(index, &entry) == SUCCESS);
+}
+
+/**
+ * @brief Looks a copy up by inode, as `findSession` does.
+ */
+static long findCopy(const session_index_t *index, const test_copy_t copy) {
+    char copy_path[SESSION_PATH_SIZE];
+    snprintf(copy_path, sizeof(copy_path), "/copies/%llu/%llu", (unsigned long long) copy.device,
+             (unsigned long long) copy.inode);
+    struct stat copy_stat = {.st_dev = (dev_t) copy.device, .st_ino = (ino_t) copy.inode};
+    return findSlot(index, copy_path, &copy_stat);
+}
+
+/**
+ * @brief Checks the index against the live and removed copies, and that no probe run is broken.
+ */
+static void checkIndex(const session_index_t *index, const test_copy_t *live, const size_t n_live,
+                       const test_copy_t *removed, const size_t n_removed) {
+    for (size_t i = 0; i < n_live; ++i) {
+        const long slot = findCopy(index, live[i]);
+        CHECK(slot != -1 && index->entries[slot].inode == live[i].inode);
+    }
+    for (size_t i = 0; i < n_removed; ++i) {
+        CHECK(findCopy(index, removed[i]) == -1);
+    }
+
+    size_t used = 0;
+    for (size_t i = 0; i < SESSION_CAPACITY; ++i) {
+        const session_entry_t *entry = &index->entries[i];
+        if (entry->inode == 0) {
+            continue;
+        }
+        ++used;
+        // Every slot from the home slot of an entry to its own is used, or lookups would stop short
+        for (size_t j = homeSlot(entry->device, entry->inode); j != i; j = (j + 1) & (SESSION_CAPACITY - 1)) {
+            CHECK(index->entries[j].inode != 0);
+        }
+    }
+    CHECK(used == n_live);
+    CHECK(index->header->count == n_live);
+}
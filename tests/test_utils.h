@@ -0,0 +1,162 @@
+#ifndef TEST_UTILS_H
+#define TEST_UTILS_H
+
+#include <dirent.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <linux/limits.h>
+
+/**
+ * @file test_utils.h
+ * @brief Assertions and temporary file helpers shared by the tests.
+ *
+ * Each test is a small executable registered with CTest. A failed `CHECK` prints the
+ * expression and its location and marks the run as failed, and `testResult` turns the
+ * outcome into the exit status CTest reads.
+ *
+ * Functions:
+ * - makeTempDir: Creates a temporary directory for the test files.
+ * - removeTempDir: Removes the temporary directory and the files in it.
+ * - testPath: Builds the path of a file in the temporary directory.
+ * - writeTestFile: Writes a buffer to a file in the temporary directory.
+ * - readTestFile: Reads a whole file into a newly allocated, NUL-terminated buffer.
+ * - testResult: Returns the exit status of the test run.
+ */
+
+static int test_failures = 0; // Failed checks so far
+
+/**
+ * @brief Checks a condition, recording a failure without stopping the test.
+ */
+#define CHECK(condition)                                                                 \
+    do {                                                                                 \
+        if (!(condition)) {                                                              \
+            fprintf(stderr, "%s:%d: check failed: %s\n", __FILE__, __LINE__, #condition); \
+            ++test_failures;                                                             \
+        }                                                                                \
+    } while (0)
+
+/**
+ * @brief Creates a temporary directory for the test files.
+ *
+ * @param dir Buffer receiving the path of the directory.
+ * @return The path, or exits if the directory could not be created.
+ */
+static inline const char *makeTempDir(char dir[PATH_MAX]) {
+    const char *tmp = getenv("TMPDIR");
+    if (snprintf(dir, PATH_MAX, "%s/redit_test_XXXXXX", tmp && *tmp ? tmp : "/tmp") >= PATH_MAX || !mkdtemp(dir)) {
+        perror("mkdtemp");
+        exit(EXIT_FAILURE);
+    }
+    return dir;
+}
+
+/**
+ * @brief Removes the temporary directory and the files in it.
+ */
+static inline void removeTempDir(const char *dir) {
+    DIR *stream = opendir(dir);
+    if (stream) {
+        const struct dirent *entry;
+        while ((entry = readdir(stream))) {
+            if (strcmp(entry->d_name, ".") != 0 && strcmp(entry->d_name, "..") != 0) {
+                char path[PATH_MAX];
+                if (snprintf(path, sizeof(path), "%s/%s", dir, entry->d_name) < (int) sizeof(path)) {
+                    unlink(path);
+                }
+            }
+        }
+        closedir(stream);
+    }
+    rmdir(dir);
+}
+
+/**
+ * @brief Builds the path of a file in the temporary directory.
+ *
+ * @param path Buffer receiving the path of the file.
+ * @param dir The temporary directory.
+ * @param name Name of the file inside the directory.
+ * @return The path, or exits if it does not fit in `PATH_MAX`.
+ */
+static inline const char *testPath(char path[PATH_MAX], const char *dir, const char *name) {
+    if (snprintf(path, PATH_MAX, "%s/%s", dir, name) >= PATH_MAX) {
+        fprintf(stderr, "%s/%s: path too long\n", dir, name);
+        exit(EXIT_FAILURE);
+    }
+    return path;
+}
+
+/**
+ * @brief Writes a buffer to a file in the temporary directory.
+ *
+ * @param path Buffer receiving the path of the file.
+ * @param dir The temporary directory.
+ * @param name Name of the file inside the directory.
+ * @param data Contents of the file.
+ * @param length Length of the contents in bytes.
+ * @return The path, or exits if the file could not be written.
+ */
+static inline const char *writeTestFile(char path[PATH_MAX], const char *dir, const char *name, const void *data,
+                                        const size_t length) {
+    testPath(path, dir, name);
+    FILE *file = fopen(path, "wb");
+    if (!file || fwrite(data, 1, length, file) != length || fclose(file) != 0) {
+        perror(path);
+        exit(EXIT_FAILURE);
+    }
+    return path;
+}
+
+/**
+ * @brief Reads a whole file into a newly allocated, NUL-terminated buffer.
+ *
+ * @param path Path to the file.
+ * @param length Pointer receiving the length of the file, or NULL.
+ * @return The contents, to be freed by the caller, or NULL if the file could not be read.
+ */
+static inline char *readTestFile(const char *path, size_t *length) {
+    FILE *file = fopen(path, "rb");
+    if (!file) {
+        return NULL;
+    }
+    size_t size = 0;
+    size_t capacity = 4096;
+    char *data = malloc(capacity + 1);
+    size_t n_read;
+    while (data && (n_read = fread(data + size, 1, capacity - size, file)) > 0) {
+        size += n_read;
+        if (size == capacity) {
+            capacity *= 2;
+            char *grown = realloc(data, capacity + 1);
+            if (!grown) {
+                free(data);
+            }
+            data = grown;
+        }
+    }
+    fclose(file);
+    if (data) {
+        data[size] = '\0';
+        if (length) {
+            *length = size;
+        }
+    }
+    return data;
+}
+
+/**
+ * @brief Returns the exit status of the test run, after printing a summary.
+ */
+static inline int testResult(const char *name) {
+    if (test_failures) {
+        fprintf(stderr, "%s: %d check(s) failed\n", name, test_failures);
+        return EXIT_FAILURE;
+    }
+    printf("%s: all checks passed\n", name);
+    return EXIT_SUCCESS;
+}
+
+#endif // TEST_UTILS_H